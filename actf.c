@@ -65,16 +65,61 @@ static void print_usage(void)
 		"              For the [-]sec[.nano] format, sec is the number of seconds from origin.\n"
 		"              The date is considered localtime. If you want UTC, set environment to TZ=UTC.\n"
 		"  -e <tstamp> Trim events occurring after tstamp. See available formats under -b.\n"
-		"  -q          Quiet, do not print events\n" "  -h          Print help\n" "");
+		"  -a <evc>    Only decode events of the event record class evc, which is\n"
+		"              given as an id, a name or a namespace/name. Can be given\n"
+		"              multiple times to decode events of several classes.\n"
+		"  -x <evc>    Skip events of the event record class evc, see -a for the format.\n"
+		"              Can be given multiple times but not together with -a.\n"
+		"  -i          Write packet index files next to the data stream files. Existing\n"
+		"              packet index files are always used to speed up seeking (-b).\n"
+		"  -j <n>      Decode the packets of each data stream file in parallel using n\n"
+		"              threads. If n is 0, the number of online processors is used.\n"
+		"  -P          Decode each data stream file on a thread of its own, ahead of\n"
+		"              the merging of the events.\n"
+		"  -o <order>  The order of the events of different data stream files:\n"
+		"                strict     ordered by timestamp (default)\n"
+		"                stream     batches of each data stream file in turn, the\n"
+		"                           events of a data stream file are in order\n"
+		"                window:ns  in windows of ns nanoseconds, events are out of\n"
+		"                           order by less than ns\n"
+		"              The relaxed orders skip merging the events and can not be used\n"
+		"              together with -e.\n"
+		"  -m <n>      Only mmap and decode the data stream files while their events\n"
+		"              are needed, keeping at most n of them mmapped when possible.\n"
+		"              If n is 0, a default is used. Suits traces with a lot of data\n"
+		"              stream files. Not used together with -j or -P.\n"
+		"  -r <n>      Read the data stream files in chunks of n bytes instead of\n"
+		"              mmapping them. If n is 0, a default is used. Not used together\n"
+		"              with -j, -P or -m.\n"
+		"  -D          With -r, bypass the page cache when reading.\n"
+		"  -A <n>      Advise the kernel to read ahead n bytes of each mmapped data\n"
+		"              stream file and to drop what is further behind, keeping the\n"
+		"              memory use of reading large traces constant. If n is 0, a\n"
+		"              default is used. Not used together with -j or -r.\n"
+		"  -q          Quiet, do not print events. Only the event record headers and\n"
+		"              common contexts are decoded.\n" "  -h          Print help\n" "");
 }
 
 struct flags {
 	bool quiet;
+	bool write_pkt_idx;
+	size_t dstream_threads;
+	bool dstream_producers;
+	enum actf_muxer_order muxer_order;
+	int64_t muxer_window_ns;
+	bool lazy_dstreams;
+	size_t max_mmaps;
+	bool read_dstreams;
+	size_t read_size;
+	bool direct_io;
+	size_t advise_window;
 	char **ctf_paths;
 	size_t ctf_paths_len;
 	int printer_flags;
 	struct actf_filter_time_range filter_range;
 	bool has_filter_range;
+	struct actf_event_cls_sel *evc_sels;
+	struct actf_event_cls_filter evc_filter;
 };
 
 /* strtoboundi64 parses s as a bounded base10 int64 and puts it in
@@ -90,6 +135,24 @@ static int strtoboundi64(const char *s, int64_t lower, int64_t upper, int64_t *v
 	return ACTF_OK;
 }
 
+/* parse_order parses s as an event order, strict, stream or
+ * window:ns. */
+static int parse_order(const char *s, enum actf_muxer_order *order, int64_t *window_ns)
+{
+	const char *window = "window:";
+	if (strcmp(s, "strict") == 0) {
+		*order = ACTF_MUXER_ORDER_STRICT;
+	} else if (strcmp(s, "stream") == 0) {
+		*order = ACTF_MUXER_ORDER_STREAM;
+	} else if (strncmp(s, window, strlen(window)) == 0 &&
+		   strtoboundi64(s + strlen(window), 1, INT64_MAX, window_ns) == 0) {
+		*order = ACTF_MUXER_ORDER_WINDOW;
+	} else {
+		return ACTF_ERROR;
+	}
+	return ACTF_OK;
+}
+
 static bool is_leap_year(int year)
 {
 	return (year % 4 == 0) && ((year % 100 != 0) || (year % 400 == 0));
@@ -272,6 +335,44 @@ static int parse_tstamp_ns(const char *s, bool parse_as_utc, int64_t *ns, bool *
 	return rc;
 }
 
+/* parse_evc_sel parses an event record class selector given as an
+ * id, a name or a namespace/name. The name is taken after the last
+ * slash since a namespace can be a URI. s is modified and referred to
+ * by sel. */
+static void parse_evc_sel(char *s, struct actf_event_cls_sel *sel)
+{
+	*sel = (struct actf_event_cls_sel) { 0 };
+	if (*s && strspn(s, "0123456789") == strlen(s)) {
+		errno = 0;
+		sel->id = strtoull(s, NULL, 10);
+		if (errno == 0) {
+			return;
+		}
+	}
+	char *slash = strrchr(s, '/');
+	if (slash) {
+		*slash = '\0';
+		sel->namespace = s;
+		sel->name = slash + 1;
+	} else {
+		sel->name = s;
+	}
+}
+
+/* add_evc_sel adds an event record class selector to the filter of
+ * the given mode. */
+static void add_evc_sel(struct flags *f, enum actf_event_cls_filter_mode mode, char *s)
+{
+	if (f->evc_filter.mode != ACTF_EVENT_CLS_FILTER_NONE && f->evc_filter.mode != mode) {
+		fprintf(stderr, "-a and -x can not be combined\n");
+		print_usage();
+		exit(-1);
+	}
+	f->evc_filter.mode = mode;
+	f->evc_filter.sels = f->evc_sels;
+	parse_evc_sel(s, &f->evc_sels[f->evc_filter.sels_len++]);
+}
+
 /* parse_flags populates f or fails horribly. */
 static void parse_flags(int argc, char *argv[], struct flags *f)
 {
@@ -296,10 +397,20 @@ static void parse_flags(int argc, char *argv[], struct flags *f)
 	};
 	char *filter_begin = NULL;
 	char *filter_end = NULL;
+	// There can not be more selectors than arguments.
+	f->evc_sels = calloc(argc, sizeof(*f->evc_sels));
+	if (!f->evc_sels) {
+		fprintf(stderr, "calloc: %s\n", strerror(errno));
+		exit(-1);
+	}
 	int opt;
 	char *subopts;
 	char *value;
-	while ((opt = getopt(argc, argv, "p:ldcgtsb:e:qh")) != -1) {
+	int64_t n_threads;
+	int64_t max_mmaps;
+	int64_t read_size;
+	int64_t advise_window;
+	while ((opt = getopt(argc, argv, "p:ldcgtsb:e:a:x:ij:Po:m:r:DA:qh")) != -1) {
 		switch (opt) {
 		case 'p':
 			subopts = optarg;
@@ -358,6 +469,67 @@ static void parse_flags(int argc, char *argv[], struct flags *f)
 		case 'e':
 			filter_end = optarg;
 			break;
+		case 'a':
+			add_evc_sel(f, ACTF_EVENT_CLS_FILTER_ALLOW, optarg);
+			break;
+		case 'x':
+			add_evc_sel(f, ACTF_EVENT_CLS_FILTER_DENY, optarg);
+			break;
+		case 'i':
+			f->write_pkt_idx = true;
+			break;
+		case 'j':
+			if (strtoboundi64(optarg, 0, 1024, &n_threads) < 0) {
+				fprintf(stderr, "invalid number of threads: %s\n", optarg);
+				print_usage();
+				exit(-1);
+			}
+			if (n_threads == 0) {
+				long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+				n_threads = n_cpus > 0 ? n_cpus : 1;
+			}
+			f->dstream_threads = n_threads;
+			break;
+		case 'P':
+			f->dstream_producers = true;
+			break;
+		case 'm':
+			if (strtoboundi64(optarg, 0, INT64_MAX, &max_mmaps) < 0) {
+				fprintf(stderr, "invalid number of mmaps: %s\n", optarg);
+				print_usage();
+				exit(-1);
+			}
+			f->lazy_dstreams = true;
+			f->max_mmaps = max_mmaps;
+			break;
+		case 'r':
+			if (strtoboundi64(optarg, 0, INT64_MAX, &read_size) < 0) {
+				fprintf(stderr, "invalid read size: %s\n", optarg);
+				print_usage();
+				exit(-1);
+			}
+			f->read_dstreams = true;
+			f->read_size = read_size;
+			break;
+		case 'D':
+			f->direct_io = true;
+			break;
+		case 'A':
+			if (strtoboundi64(optarg, 0, INT64_MAX, &advise_window) < 0) {
+				fprintf(stderr, "invalid advise window: %s\n", optarg);
+				print_usage();
+				exit(-1);
+			}
+			f->advise_window = advise_window ? advise_window :
+			    ACTF_FREADER_DEFAULT_ADVISE_WINDOW;
+			break;
+		case 'o':
+			if (parse_order(optarg, &f->muxer_order, &f->muxer_window_ns) < 0) {
+				fprintf(stderr, "invalid order: %s\n", optarg);
+				print_usage();
+				exit(-1);
+			}
+			break;
 		case 'q':
 			f->quiet = true;
 			break;
@@ -382,6 +554,11 @@ static void parse_flags(int argc, char *argv[], struct flags *f)
 		f->printer_flags |= ACTF_PRINT_ALL;
 	}
 
+	if (filter_end && f->muxer_order != ACTF_MUXER_ORDER_STRICT) {
+		fprintf(stderr, "-e requires the strict order\n");
+		exit(-1);
+	}
+
 	f->filter_range = ACTF_FILTER_TIME_RANGE_ALL;
 	f->has_filter_range = (filter_begin || filter_end);
 	const char *errfmt = "invalid timestamp (%s), the formats "
@@ -452,17 +629,44 @@ int main(int argc, char *argv[])
 	struct flags flags = { 0 };
 	parse_flags(argc, argv, &flags);
 
-	struct actf_freader_cfg cfg = { 0 };
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct actf_freader_cfg cfg = {
+		.pkt_idx_files = true,
+		.evc_filter = flags.evc_filter,
+		// Quiet runs only count the events
+		.decoder_mode = flags.quiet ? ACTF_DECODER_MODE_HEADER : ACTF_DECODER_MODE_FULL,
+		.dstream_threads = flags.dstream_threads,
+		.dstream_producers = flags.dstream_producers,
+		.muxer_order = flags.muxer_order,
+		.muxer_window_ns = flags.muxer_window_ns,
+		.lazy_dstreams = flags.lazy_dstreams,
+		.max_mmaps = flags.max_mmaps,
+		.dstream_io = flags.read_dstreams ? ACTF_FREADER_IO_PREAD : ACTF_FREADER_IO_MMAP,
+		.read_size = flags.read_size,
+		.direct_io = flags.direct_io,
+		.advise_window = flags.advise_window,
+		.open_threads = n_cpus > 0 ? n_cpus : 1,
+	};
 	actf_freader *rd = actf_freader_init(cfg);
 	if (!rd) {
 		fprintf(stderr, "actf_freader_init: %s\n", strerror(errno));
+		free(flags.evc_sels);
 		return ACTF_OOM;
 	}
-	if (actf_freader_open_folders(rd, flags.ctf_paths, flags.ctf_paths_len) < 0) {
+	int rc = actf_freader_open_folders(rd, flags.ctf_paths, flags.ctf_paths_len);
+	// The event record class selectors are only used when opening.
+	free(flags.evc_sels);
+	if (rc < 0) {
 		fprintf(stderr, "actf_freader_open_folder: %s\n", actf_freader_last_error(rd));
 		actf_freader_free(rd);
 		return ACTF_ERROR;
 	}
+	if (flags.write_pkt_idx && actf_freader_write_pkt_idx_files(rd) < 0) {
+		fprintf(stderr, "actf_freader_write_pkt_idx_files: %s\n",
+			actf_freader_last_error(rd));
+		actf_freader_free(rd);
+		return ACTF_ERROR;
+	}
 	struct actf_event_generator gen = actf_freader_to_generator(rd);
 
 	actf_filter *flt = NULL;
@@ -476,7 +680,7 @@ int main(int argc, char *argv[])
 		gen = actf_filter_to_generator(flt);
 	}
 
-	int rc = read_events(gen, flags.quiet, flags.printer_flags);
+	rc = read_events(gen, flags.quiet, flags.printer_flags);
 
 	actf_filter_free(flt);
 	actf_freader_free(rd);
@@ -46,8 +46,10 @@
 #include "mappings.h"
 #include "metadata.h"
 #include "muxer.h"
+#include "pdecoder.h"
 #include "rng.h"
 #include "pkt.h"
 #include "print.h"
+#include "producer.h"
 
 #endif /* ACTF_H */
@@ -302,6 +302,20 @@ uint8_t *breader_read_bytes(struct breader *br, size_t cnt)
 	return ptr;
 }
 
+uint64_t breader_read_uint_le(struct breader *br, size_t n_bytes)
+{
+	assert(breader_byte_aligned(br));
+	assert(n_bytes <= 8 && breader_bytes_remaining(br) >= n_bytes);
+	uint8_t *ptr = br->read_ptr - (br->lookahead_bit_cnt >> 3);
+	uint64_t res = 0;
+	memcpy(&res, ptr, n_bytes);
+	br->read_ptr = ptr + n_bytes;
+	br->lookahead = 0;
+	br->lookahead_bit_cnt = 0;
+	br->tot_bit_cnt += n_bytes * 8;
+	return HTOLE64(res);
+}
+
 void breader_seek(struct breader *br, size_t off, enum breader_seek_op whence)
 {
 	switch (whence) {
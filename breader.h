@@ -107,6 +107,13 @@ uint64_t breader_read_bits(struct breader *br, size_t cnt);
  */
 uint8_t *breader_read_bytes(struct breader *br, size_t cnt);
 
+/* Reads a little-endian unsigned integer of n_bytes bytes, at most 8,
+ * with a single load that bypasses the lookahead, which is emptied.
+ * Requires that the read pointer is byte-aligned and that n_bytes are
+ * available.
+ */
+uint64_t breader_read_uint_le(struct breader *br, size_t n_bytes);
+
 enum breader_seek_op {
 	BREADER_SEEK_SET,
 	BREADER_SEEK_CUR,
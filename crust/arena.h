@@ -155,6 +155,44 @@ static inline void arena_clear(struct arena *a)
 	a->tail = NULL;
 }
 
+/* arena_mark is a position in an arena that it can be rewound to. */
+struct arena_mark {
+	struct region *tail;
+	size_t len;
+};
+
+static inline struct arena_mark arena_get_mark(const struct arena *a)
+{
+	return (struct arena_mark) {
+		.tail = a->tail,
+		.len = a->tail ? a->tail->hdr.len : 0,
+	};
+}
+
+/* arena_rewind releases everything allocated after the mark m was
+ * taken. Regions which become unused are moved to the free list. */
+static inline void arena_rewind(struct arena *a, struct arena_mark m)
+{
+	if (!m.tail) {
+		arena_clear(a);
+		return;
+	}
+	struct region *par = NULL;
+	struct region *cur = m.tail->hdr.next;
+	while (cur) {
+		cur->hdr.len = 0;
+		par = cur;
+		cur = cur->hdr.next;
+	}
+	if (par) {
+		par->hdr.next = a->free;
+		a->free = m.tail->hdr.next;
+		m.tail->hdr.next = NULL;
+	}
+	m.tail->hdr.len = m.len;
+	a->tail = m.tail;
+}
+
 static inline void region_list_free(struct region *list)
 {
 	struct region *cur = list;
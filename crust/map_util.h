@@ -59,6 +59,26 @@ static inline size_t hash_fnv(const char *s)
 	return hash;
 }
 
+/* fnv-1a for len bytes at p */
+static inline size_t hash_fnv_n(const void *p, size_t len)
+{
+	size_t prime, offset_basis;
+	if (sizeof(prime) == 4) {
+		prime = UINT32_C(16777619);
+		offset_basis = UINT32_C(2166136261);
+	} else { // assume 64-bit
+		prime = UINT64_C(1099511628211);
+		offset_basis = UINT64_C(14695981039346656037);
+	}
+	const unsigned char *s = p;
+	size_t hash = offset_basis;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= s[i];
+		hash *= prime;
+	}
+	return hash;
+}
+
 static inline int uint64cmp(uint64_t v1, uint64_t v2)
 {
 	return v2 - v1;
@@ -620,6 +620,35 @@ static void test_arena_basic(void)
 	arena_free(&a);
 }
 
+static void test_arena_rewind(void)
+{
+	struct arena a = ARENA_EMPTY;
+	a.default_cap = 64;
+
+	/* Rewinding to a mark of an empty arena clears it */
+	struct arena_mark m = arena_get_mark(&a);
+	CU_ASSERT_PTR_NOT_NULL(arena_alloc(&a, 8));
+	arena_rewind(&a, m);
+	CU_ASSERT_PTR_NULL(a.head);
+	CU_ASSERT_PTR_NULL(a.tail);
+
+	uint8_t *keep = arena_alloc_align(&a, 8, 1);
+	CU_ASSERT_PTR_NOT_NULL(keep);
+	m = arena_get_mark(&a);
+	uint8_t *p = arena_alloc_align(&a, 8, 1);
+	CU_ASSERT_PTR_EQUAL(p, keep + 8);
+	/* Spill over into more regions */
+	CU_ASSERT_PTR_NOT_NULL(arena_alloc_align(&a, 128, 1));
+	CU_ASSERT_PTR_NOT_NULL(arena_alloc_align(&a, 64, 1));
+	arena_rewind(&a, m);
+	CU_ASSERT_PTR_EQUAL(a.head, a.tail);
+	CU_ASSERT_PTR_NOT_NULL(a.free);
+	/* The memory after the mark is reused */
+	CU_ASSERT_PTR_EQUAL(arena_alloc_align(&a, 8, 1), p);
+
+	arena_free(&a);
+}
+
 int main(void)
 {
 	CU_pSuite pSuite = NULL;
@@ -645,7 +674,8 @@ int main(void)
 	    || (CU_ADD_TEST(pSuite, test_u64tosize) == NULL)
 	    || (CU_ADD_TEST(pSuite, test_strtoidx) == NULL)
 	    || (CU_ADD_TEST(pSuite, test_arena) == NULL)
-	    || (CU_ADD_TEST(pSuite, test_arena_basic) == NULL)) {
+	    || (CU_ADD_TEST(pSuite, test_arena_basic) == NULL)
+	    || (CU_ADD_TEST(pSuite, test_arena_rewind) == NULL)) {
 		CU_cleanup_registry();
 		return CU_get_error();
 	}
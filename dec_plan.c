@@ -0,0 +1,438 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crust/common.h"
+#include "dec_plan.h"
+#include "types.h"
+
+#define TYPE struct dec_op
+#define TYPED_NAME(x) dec_op_##x
+#include "crust/vec.h"
+
+
+static struct dec_op_bit_arr dec_op_bit_arr_init(const struct fxd_len_bit_arr_fld_cls *cls)
+{
+	bool reverse;
+	if (cls->bo == ACTF_LIL_ENDIAN) {
+		reverse = cls->bito == ACTF_LAST_TO_FIRST;
+	} else {
+		reverse = cls->bito == ACTF_FIRST_TO_LAST;
+	}
+	bool bytes_le = cls->bo == ACTF_LIL_ENDIAN && !reverse &&
+	    (cls->len == 8 || cls->len == 16 || cls->len == 32 || cls->len == 64);
+	return (struct dec_op_bit_arr) {
+		.len = cls->len,
+		.bo = cls->bo,
+		.reverse = reverse,
+		.bytes_le = bytes_le,
+	};
+}
+
+/* dec_op_init sets up the op decoding the value of cls, without
+ * regards to the values it contains. */
+static int dec_op_init(const struct actf_fld_cls *cls, bool handle_roles,
+		       struct dec_op *op, struct error *e)
+{
+	*op = (struct dec_op) {
+		.cls = cls,
+		.roles = handle_roles ? actf_fld_cls_roles(cls) : ACTF_ROLE_NIL,
+	};
+	switch (cls->type) {
+	case ACTF_FLD_CLS_FXD_LEN_BIT_ARR:
+		op->type = DEC_OP_FXD_LEN_BIT_ARR;
+		op->u.bit_arr = dec_op_bit_arr_init(&cls->cls.fxd_len_bit_arr);
+		break;
+	case ACTF_FLD_CLS_FXD_LEN_BIT_MAP:
+		op->type = DEC_OP_FXD_LEN_BIT_MAP;
+		op->u.bit_arr = dec_op_bit_arr_init(&cls->cls.fxd_len_bit_map.bit_arr);
+		break;
+	case ACTF_FLD_CLS_FXD_LEN_UINT:
+		op->type = DEC_OP_FXD_LEN_UINT;
+		op->u.bit_arr = dec_op_bit_arr_init(&cls->cls.fxd_len_int.bit_arr);
+		break;
+	case ACTF_FLD_CLS_FXD_LEN_SINT:
+		op->type = DEC_OP_FXD_LEN_SINT;
+		op->u.bit_arr = dec_op_bit_arr_init(&cls->cls.fxd_len_int.bit_arr);
+		break;
+	case ACTF_FLD_CLS_FXD_LEN_BOOL:
+		op->type = DEC_OP_FXD_LEN_BOOL;
+		op->u.bit_arr = dec_op_bit_arr_init(&cls->cls.fxd_len_bool.bit_arr);
+		break;
+	case ACTF_FLD_CLS_FXD_LEN_FLOAT:
+		op->type = DEC_OP_FXD_LEN_FLOAT;
+		op->u.bit_arr = dec_op_bit_arr_init(&cls->cls.fxd_len_float.bit_arr);
+		break;
+	case ACTF_FLD_CLS_VAR_LEN_UINT:
+		op->type = DEC_OP_VAR_LEN_UINT;
+		break;
+	case ACTF_FLD_CLS_VAR_LEN_SINT:
+		op->type = DEC_OP_VAR_LEN_SINT;
+		break;
+	case ACTF_FLD_CLS_NULL_TERM_STR:
+		op->type = DEC_OP_NULL_TERM_STR;
+		break;
+	case ACTF_FLD_CLS_STATIC_LEN_STR:
+		op->type = DEC_OP_STATIC_LEN_STR;
+		op->u.len = cls->cls.static_len_str.len;
+		break;
+	case ACTF_FLD_CLS_DYN_LEN_STR:
+		op->type = DEC_OP_DYN_LEN_STR;
+		break;
+	case ACTF_FLD_CLS_STATIC_LEN_BLOB:
+		op->type = DEC_OP_STATIC_LEN_BLOB;
+		op->u.len = cls->cls.static_len_blob.len;
+		break;
+	case ACTF_FLD_CLS_DYN_LEN_BLOB:
+		op->type = DEC_OP_DYN_LEN_BLOB;
+		break;
+	case ACTF_FLD_CLS_STRUCT:
+		op->type = DEC_OP_STRUCT;
+		op->u.n_members = cls->cls.struct_.n_members;
+		break;
+	case ACTF_FLD_CLS_STATIC_LEN_ARR:
+		op->type = DEC_OP_STATIC_LEN_ARR;
+		op->u.len = cls->cls.static_len_arr.len;
+		break;
+	case ACTF_FLD_CLS_DYN_LEN_ARR:
+		op->type = DEC_OP_DYN_LEN_ARR;
+		break;
+	case ACTF_FLD_CLS_OPTIONAL:
+		op->type = DEC_OP_OPTIONAL;
+		break;
+	case ACTF_FLD_CLS_VARIANT:
+		op->type = DEC_OP_VARIANT;
+		break;
+	case ACTF_FLD_CLS_NIL:
+	case ACTF_N_FLD_CLSES:
+	default:
+		eprintf(e, "unable to compile a decode plan for a %s",
+			actf_fld_cls_type_name(cls->type));
+		return ACTF_INTERNAL;
+	}
+	op->align = cls->align_req;
+	return ACTF_OK;
+}
+
+/* dec_plan_scope is a structure field class enclosing the field class
+ * being compiled. */
+struct dec_plan_scope {
+	const struct actf_fld_cls *cls;
+	const struct dec_plan_scope *parent;
+};
+
+struct dec_plan_ctx {
+	struct dec_op_vec ops;
+	const struct dec_plan_origins *origins;
+	size_t max_depth;
+	bool locs_resolved;
+	struct error *e;
+};
+
+/* unwrap_fld_cls returns the field class of the value that the field
+ * location procedure continues with after reaching a value of cls. It
+ * continues with the element being decoded of an array and an enabled
+ * optional has the value of its field class. */
+static const struct actf_fld_cls *unwrap_fld_cls(const struct actf_fld_cls *cls)
+{
+	for (;;) {
+		switch (cls->type) {
+		case ACTF_FLD_CLS_STATIC_LEN_ARR:
+			cls = cls->cls.static_len_arr.base.ele_fld_cls;
+			break;
+		case ACTF_FLD_CLS_DYN_LEN_ARR:
+			cls = cls->cls.dyn_len_arr.base.ele_fld_cls;
+			break;
+		case ACTF_FLD_CLS_OPTIONAL:
+			cls = cls->cls.optional.fld_cls;
+			break;
+		default:
+			return cls;
+		}
+	}
+}
+
+static bool struct_member_idx(const struct actf_fld_cls *cls, const char *name, size_t *idx)
+{
+	const struct struct_fld_cls *struct_ = &cls->cls.struct_;
+	for (size_t i = 0; i < struct_->n_members && struct_->member_clses[i].name; i++) {
+		if (strcmp(name, struct_->member_clses[i].name) == 0) {
+			*idx = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* dec_fld_loc_resolve resolves loc of a field class enclosed by scope
+ * into dloc. Paths which can not be resolved are left for the decoder
+ * to locate by names, which reports any errors. */
+static int dec_fld_loc_resolve(const struct actf_fld_loc *loc, const struct dec_plan_scope *scope,
+			       struct dec_plan_ctx *ctx, struct dec_fld_loc *dloc)
+{
+	*dloc = (struct dec_fld_loc) {.loc = loc };
+	if (!loc->path_len) {
+		return ACTF_OK;
+	}
+
+	/* The structure field classes from the origin down to the
+	 * structure reached so far. */
+	size_t chain_len = 0;
+	const struct actf_fld_cls *root = NULL;
+	if (loc->origin == ACTF_FLD_LOC_ORIGIN_NONE) {
+		for (const struct dec_plan_scope *s = scope; s; s = s->parent) {
+			chain_len++;
+		}
+	} else if (loc->origin < ACTF_FLD_LOC_N_ORIGINS && ctx->origins) {
+		root = ctx->origins->clses[loc->origin];
+		chain_len = root && root->type == ACTF_FLD_CLS_STRUCT;
+	}
+	if (!chain_len) {
+		return ACTF_OK;
+	}
+	const struct actf_fld_cls **chain = malloc((chain_len + loc->path_len) * sizeof(*chain));
+	size_t *idxs = malloc(loc->path_len * sizeof(*idxs));
+	if (!chain || !idxs) {
+		eprintf(ctx->e, "malloc: %s", strerror(errno));
+		free(chain);
+		free(idxs);
+		return ACTF_OOM;
+	}
+	if (root) {
+		chain[0] = root;
+	} else {
+		size_t i = chain_len;
+		for (const struct dec_plan_scope *s = scope; s; s = s->parent) {
+			chain[--i] = s->cls;
+		}
+	}
+
+	for (size_t i = 0; i < loc->path_len; i++) {
+		const char *name = loc->path[i];
+		if (!name) {
+			if (chain_len == 1) {
+				goto unresolved;
+			}
+			chain_len--;
+			idxs[i] = DEC_FLD_LOC_PARENT;
+			continue;
+		}
+		const struct actf_fld_cls *cur = chain[chain_len - 1];
+		if (!struct_member_idx(cur, name, &idxs[i])) {
+			goto unresolved;
+		}
+		const struct actf_fld_cls *member =
+		    unwrap_fld_cls(&cur->cls.struct_.member_clses[idxs[i]].cls);
+		if (i == loc->path_len - 1) {
+			dloc->target = member;
+			break;
+		}
+		if (member->type != ACTF_FLD_CLS_STRUCT) {
+			goto unresolved;
+		}
+		chain[chain_len++] = member;
+	}
+	free(chain);
+	dloc->idxs = idxs;
+	return ACTF_OK;
+
+      unresolved:
+	free(chain);
+	free(idxs);
+	return ACTF_OK;
+}
+
+static bool dec_op_has_fld_loc(const struct dec_op *op)
+{
+	switch (op->type) {
+	case DEC_OP_DYN_LEN_STR:
+	case DEC_OP_DYN_LEN_BLOB:
+	case DEC_OP_DYN_LEN_ARR:
+	case DEC_OP_OPTIONAL:
+	case DEC_OP_VARIANT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* dec_op_fld_loc returns the field location of op or NULL if it has
+ * none. */
+static struct dec_fld_loc *dec_op_fld_loc(struct dec_op *op)
+{
+	return dec_op_has_fld_loc(op) ? &op->u.loc : NULL;
+}
+
+static const struct actf_fld_loc *fld_cls_fld_loc(const struct actf_fld_cls *cls)
+{
+	switch (cls->type) {
+	case ACTF_FLD_CLS_DYN_LEN_STR:
+		return &cls->cls.dyn_len_str.len_fld_loc;
+	case ACTF_FLD_CLS_DYN_LEN_BLOB:
+		return &cls->cls.dyn_len_blob.len_fld_loc;
+	case ACTF_FLD_CLS_DYN_LEN_ARR:
+		return &cls->cls.dyn_len_arr.len_fld_loc;
+	case ACTF_FLD_CLS_OPTIONAL:
+		return &cls->cls.optional.sel_fld_loc;
+	case ACTF_FLD_CLS_VARIANT:
+		return &cls->cls.variant.sel_fld_loc;
+	default:
+		return NULL;
+	}
+}
+
+static int dec_plan_compile_rec(const struct actf_fld_cls *cls, bool handle_roles, size_t depth,
+				const struct dec_plan_scope *scope, struct dec_plan_ctx *ctx)
+{
+	int rc;
+	struct dec_op op;
+	if ((rc = dec_op_init(cls, handle_roles, &op, ctx->e)) < 0) {
+		return rc;
+	}
+	struct dec_fld_loc *dloc = dec_op_fld_loc(&op);
+	if (dloc && (rc = dec_fld_loc_resolve(fld_cls_fld_loc(cls), scope, ctx, dloc)) < 0) {
+		return rc;
+	}
+	if (dloc && !dloc->idxs) {
+		ctx->locs_resolved = false;
+	}
+	size_t idx = ctx->ops.len;
+	if ((rc = dec_op_vec_push(&ctx->ops, op)) < 0) {
+		eprintf(ctx->e, "dec_op_vec_push: %s", strerror(-rc));
+		if (dloc) {
+			free(dloc->idxs);
+		}
+		return ACTF_OOM;
+	}
+
+	ctx->max_depth = MAX(ctx->max_depth, depth);
+
+	/* The contained values are decoded one level deeper */
+	struct dec_plan_scope member_scope = {.cls = cls, .parent = scope };
+	switch (cls->type) {
+	case ACTF_FLD_CLS_STRUCT:
+		for (size_t i = 0; i < cls->cls.struct_.n_members; i++) {
+			if ((rc = dec_plan_compile_rec(&cls->cls.struct_.member_clses[i].cls, true,
+						       depth + 1, &member_scope, ctx)) < 0) {
+				return rc;
+			}
+		}
+		break;
+	case ACTF_FLD_CLS_STATIC_LEN_ARR:
+		rc = dec_plan_compile_rec(cls->cls.static_len_arr.base.ele_fld_cls, false,
+					  depth + 1, scope, ctx);
+		break;
+	case ACTF_FLD_CLS_DYN_LEN_ARR:
+		rc = dec_plan_compile_rec(cls->cls.dyn_len_arr.base.ele_fld_cls, false,
+					  depth + 1, scope, ctx);
+		break;
+	case ACTF_FLD_CLS_OPTIONAL:
+		rc = dec_plan_compile_rec(cls->cls.optional.fld_cls, true, depth + 1, scope, ctx);
+		break;
+	case ACTF_FLD_CLS_VARIANT:
+		for (size_t i = 0; i < cls->cls.variant.n_opts; i++) {
+			if ((rc = dec_plan_compile_rec(&cls->cls.variant.opts[i].fc, true,
+						       depth + 1, scope, ctx)) < 0) {
+				return rc;
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	if (rc < 0) {
+		return rc;
+	}
+	ctx->ops.data[idx].end = ctx->ops.len;
+	return ACTF_OK;
+}
+
+static void dec_ops_free(struct dec_op *ops, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		struct dec_fld_loc *dloc = dec_op_fld_loc(&ops[i]);
+		if (dloc) {
+			free(dloc->idxs);
+		}
+	}
+	free(ops);
+}
+
+int dec_plan_compile(const struct actf_fld_cls *cls, const struct dec_plan_origins *origins,
+		     struct dec_plan *plan, struct error *e)
+{
+	int rc;
+	*plan = (struct dec_plan) {.has_static_len = true,.locs_resolved = true };
+	if (cls->type == ACTF_FLD_CLS_NIL) {
+		return ACTF_OK;
+	}
+	struct dec_plan_ctx ctx = {
+		.origins = origins,
+		.locs_resolved = true,
+		.e = e,
+	};
+	/* Roles of the root field class itself are never handled */
+	if ((rc = dec_plan_compile_rec(cls, false, 0, NULL, &ctx)) < 0) {
+		dec_ops_free(ctx.ops.data, ctx.ops.len);
+		return rc;
+	}
+	plan->ops = ctx.ops.data;
+	plan->len = ctx.ops.len;
+	plan->max_depth = ctx.max_depth;
+	plan->has_static_len = cls->has_static_len;
+	plan->static_len = cls->static_len;
+	plan->locs_resolved = ctx.locs_resolved;
+	return ACTF_OK;
+}
+
+void dec_plan_mark_loc_targets(struct dec_plan *plan, const struct dec_plan *src)
+{
+	for (size_t i = 0; i < src->len; i++) {
+		const struct dec_op *op = &src->ops[i];
+		if (!dec_op_has_fld_loc(op) || !op->u.loc.target) {
+			continue;
+		}
+		for (size_t j = 0; j < plan->len; j++) {
+			if (plan->ops[j].cls == op->u.loc.target) {
+				plan->ops[j].loc_target = true;
+			}
+		}
+	}
+	/* The ops are in pre-order, so the ops contained in an op are
+	 * marked before it. */
+	for (size_t i = plan->len; i-- > 0;) {
+		struct dec_op *op = &plan->ops[i];
+		for (size_t j = i + 1; j < op->end && !op->loc_target; j = plan->ops[j].end) {
+			op->loc_target = plan->ops[j].loc_target;
+		}
+	}
+}
+
+void dec_plan_free(struct dec_plan *plan)
+{
+	if (!plan) {
+		return;
+	}
+	dec_ops_free(plan->ops, plan->len);
+	*plan = (struct dec_plan) { 0 };
+}
@@ -0,0 +1,163 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEC_PLAN_H
+#define DEC_PLAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "error.h"
+#include "fld_cls_int.h"
+#include "fld_loc_int.h"
+
+/* A decode plan is a field class flattened into an array of ops in
+ * pre-order. Every op decodes one value and the ops of the values it
+ * contains directly follow it, so the ops of a value are
+ * [i, ops[i].end). The plan is compiled once when the metadata is
+ * loaded and is then immutable, it can be shared between all decoders
+ * of the metadata.
+ *
+ * A plan can also be scanned, which moves past the values that no
+ * field location can locate without decoding them, see
+ * dec_plan_mark_loc_targets().
+ *
+ * - struct: the member ops follow, one value after the other.
+ * - static/dynamic-length array: the element ops follow and are
+ *   decoded once per element.
+ * - optional: the ops of the optional field class follow and are
+ *   skipped when it is disabled.
+ * - variant: the ops of each option follow, one option after the
+ *   other. Only the selected option is decoded.
+ */
+enum dec_op_type {
+	DEC_OP_FXD_LEN_BIT_ARR,
+	DEC_OP_FXD_LEN_BIT_MAP,
+	DEC_OP_FXD_LEN_UINT,
+	DEC_OP_FXD_LEN_SINT,
+	DEC_OP_FXD_LEN_BOOL,
+	DEC_OP_FXD_LEN_FLOAT,
+	DEC_OP_VAR_LEN_UINT,
+	DEC_OP_VAR_LEN_SINT,
+	DEC_OP_NULL_TERM_STR,
+	DEC_OP_STATIC_LEN_STR,
+	DEC_OP_DYN_LEN_STR,
+	DEC_OP_STATIC_LEN_BLOB,
+	DEC_OP_DYN_LEN_BLOB,
+	DEC_OP_STRUCT,
+	DEC_OP_STATIC_LEN_ARR,
+	DEC_OP_DYN_LEN_ARR,
+	DEC_OP_OPTIONAL,
+	DEC_OP_VARIANT,
+};
+
+/* The constant parameters of a fixed-length bit array. */
+struct dec_op_bit_arr {
+	uint64_t len;
+	enum actf_byte_order bo;
+	// true if the bits must be reversed after being read
+	bool reverse;
+	// true if the value is an 8, 16, 32 or 64-bit little-endian
+	// integer which is not reversed. It can then be read with a
+	// single load whenever it starts at a byte boundary.
+	bool bytes_le;
+};
+
+/* The index of a resolved field location path element which moves to
+ * the parent structure. */
+#define DEC_FLD_LOC_PARENT SIZE_MAX
+
+/* dec_fld_loc is a field location with its path resolved to member
+ * indexes, i.e. idxs[i] is the index of the member named loc->path[i]
+ * in the structure reached so far. idxs is NULL if the path can not
+ * be resolved when compiling, which is the case when it passes
+ * through a variant. loc must then be located by member names.
+ *
+ * Relative paths depend on the structures enclosing the field class
+ * where it is used, which is why they are resolved per plan and not
+ * stored with the field class that an alias can copy elsewhere. */
+struct dec_fld_loc {
+	const struct actf_fld_loc *loc;
+	size_t *idxs;
+	/* The field class of the located value if idxs is set and the
+	 * path ends at a member, else NULL. */
+	const struct actf_fld_cls *target;
+};
+
+struct dec_op {
+	enum dec_op_type type;
+	/* Roles to handle after the value has been decoded. Only set if
+	 * the field class is in a context where roles apply, which is
+	 * not the case for array elements. */
+	enum actf_role roles;
+	const struct actf_fld_cls *cls;
+	size_t align;
+	/* Index of the first op after the ops of this value. */
+	size_t end;
+	/* true if a field location can locate this value or a value
+	 * that it contains, it must then be decoded when scanning. */
+	bool loc_target;
+	union {
+		struct dec_op_bit_arr bit_arr;	// fixed-length bit arrays
+		uint64_t len;	// static-length strings, blobs and arrays
+		size_t n_members;	// structures
+		/* length of dynamic-length strings, blobs and arrays,
+		 * selector of optionals and variants */
+		struct dec_fld_loc loc;
+	} u;
+};
+
+struct dec_plan {
+	struct dec_op *ops;
+	size_t len;
+	/* The greatest amount of nested structures, arrays, optionals
+	 * and variants that is required to decode the plan. */
+	size_t max_depth;
+	/* The static length of the compiled field class. The empty plan
+	 * of a NIL field class has a static length of zero. */
+	bool has_static_len;
+	uint64_t static_len;
+	/* true if all field locations of the plan are resolved, see
+	 * dec_fld_loc. The values that they locate are then known. */
+	bool locs_resolved;
+};
+
+/* dec_plan_origins holds the root field classes of the field location
+ * origins which are known when compiling. Field locations with an
+ * unknown (NULL) origin are not resolved. */
+struct dec_plan_origins {
+	const struct actf_fld_cls *clses[ACTF_FLD_LOC_N_ORIGINS];
+};
+
+/* dec_plan_compile compiles the field class cls into plan. A NIL
+ * field class yields an empty plan. The plan must outlive neither cls
+ * nor any of the field classes that it contains. */
+int dec_plan_compile(const struct actf_fld_cls *cls, const struct dec_plan_origins *origins,
+		     struct dec_plan *plan, struct error *e);
+
+/* dec_plan_mark_loc_targets marks the ops of plan which the resolved
+ * field locations of src can locate, together with the ops containing
+ * them. src may be plan itself. */
+void dec_plan_mark_loc_targets(struct dec_plan *plan, const struct dec_plan *src);
+
+void dec_plan_free(struct dec_plan *plan);
+
+#endif /* DEC_PLAN_H */
@@ -18,24 +18,33 @@
  * <https://www.gnu.org/licenses/>.
  */
 
+// madvise()
+#define _DEFAULT_SOURCE
+
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "breader.h"
 #include "event_int.h"
 #include "decoder.h"
+#include "decoder_int.h"
 #include "crust/common.h"
 #include "crust/arena.h"
+#include "dec_plan.h"
 #include "event_generator.h"
 #include "fld.h"
 #include "fld_cls_int.h"
 #include "metadata_int.h"
 #include "pkt_int.h"
+#include "pkt_idx.h"
 #include "error.h"
 #include "pkt_state.h"
 
@@ -49,13 +58,110 @@ enum dec_ctx {
 	DEC_CTX_EVENT_PAYLOAD,
 };
 
-struct dec_state {
-	struct arena pkt_arena;
+/* dec_buf holds the events of a decode call. */
+struct dec_buf {
+	struct actf_event **evs;
 	struct arena ev_arena;
+};
+
+/* dec_pkt holds the decoded packet header and packet context of a
+ * packet. */
+struct dec_pkt {
+	struct arena arena;
+	/* The packet state once the packet header and packet context are
+	 * decoded */
 	struct pkt_state pkt_s;
 	struct actf_pkt pkt;
+};
+
+struct dec_state {
+	struct arena ev_arena;
+	struct pkt_state pkt_s;
+	/* The packet being decoded, one of pkts. The others hold the
+	 * previous packets as long as events of them are in use. */
+	struct dec_pkt *pkt;
+	struct dec_pkt *pkts;
+	size_t n_pkts;
 	struct actf_event *ev;
 	enum dec_ctx ctx;
+	/* The op of the structure or static-length array being decoded
+	 * which is known to fit in the packet and the bit stream as a
+	 * whole. The fixed-length values it contains skip their bounds
+	 * checks. NULL if no such value is being decoded. */
+	const struct dec_op *in_bounds;
+};
+
+/* dec_frame keeps track of a structure, array, optional or variant
+ * value whose contained values are being decoded. */
+struct dec_frame {
+	const struct dec_op *op;
+	struct actf_fld *val;
+	size_t i;		// current member/element
+	size_t n;		// amount of members/elements
+	size_t body;		// first op of an array element
+};
+
+/* A buffer of fed data which is no longer decoded from but might
+ * still be referred to by the events in use. */
+struct retired_buf {
+	uint8_t *data;
+	size_t cap;
+	// the decode call during which it was retired
+	size_t decode_no;
+};
+
+/* A buffer of fed data which is no longer referred to, kept to be
+ * reused as a staging buffer. */
+struct spare_buf {
+	uint8_t *data;
+	size_t cap;
+};
+
+/* The max number of spare buffers of a fed decoder. The decoder
+ * swaps between the staging buffer and the one being decoded from,
+ * more are only in use while retired. */
+#define FEED_MAX_SPARES 2
+
+/* feed holds the data of a decoder fed by actf_decoder_feed(). The
+ * decoder reads the complete packets that were fed, the rest is kept
+ * in the staging buffer until it is complete. */
+struct feed {
+	// the fed data which is not yet decoded from, starting at a
+	// packet.
+	uint8_t *staging;
+	size_t staging_len;
+	size_t staging_cap;
+	// the length of the complete packets at the start of staging,
+	// as far as they are known.
+	size_t complete_len;
+	// set by actf_decoder_feed_end()
+	bool ended;
+	// the buffer of complete packets being decoded from
+	uint8_t *data;
+	size_t data_cap;
+	struct retired_buf *retired;
+	size_t retired_len;
+	size_t retired_cap;
+	// the buffers to reuse as staging buffers
+	struct spare_buf spares[FEED_MAX_SPARES];
+	size_t n_spares;
+	// the number of decode calls
+	size_t decode_no;
+	// the number of bytes dropped before the staging buffer, see
+	// actf_decoder_feed_pkt_idx()
+	size_t idx_off;
+	// finds the complete packets by decoding their packet header
+	// and packet context, NULL until needed.
+	struct actf_decoder *probe;
+};
+
+/* iovs holds the segments of a decoder initialized by
+ * actf_decoder_init_iov(), which are decoded from in turn. */
+struct iovs {
+	struct iovec *iov;
+	size_t iovcnt;
+	// the next segment to decode from
+	size_t iov_i;
 };
 
 enum decoding_state {
@@ -81,14 +187,42 @@ struct actf_decoder {
 	struct actf_event **evs;
 	size_t evs_cap;
 	struct dec_state dec_s;
+	// packet index built lazily by the first seek.
+	bool has_idx;
+	struct pkt_idx idx;
+	struct pkt_idx_entry_vec idx_entries;
+	// frames of dec_plan_run, grown to the deepest plan run.
+	struct dec_frame *frames;
+	size_t frames_cap;
+	// skip_evcs[evc->idx] is true if the events of evc are filtered
+	// out. NULL if no event record class is filtered out.
+	bool *skip_evcs;
+	enum actf_decoder_mode mode;
+	// the events of the last n_bufs decode calls are valid. If
+	// n_bufs > 1, bufs holds the event arrays and event arenas
+	// which are used in turn, bufs[buf_i] is the one in use
+	// (evs and dec_s.ev_arena).
+	size_t n_bufs;
+	struct dec_buf *bufs;
+	size_t buf_i;
+	// true if events of the previous decode call belong to the
+	// packet being decoded.
+	bool prev_evs_in_pkt;
+	// NULL unless the decoder is fed, see actf_decoder_init_fed()
+	struct feed *feed;
+	// NULL unless the decoder has segments, see
+	// actf_decoder_init_iov()
+	struct iovs *iovs;
+	// see actf_decoder_cfg.advise_window, zero if not advising.
+	// The data up to advised_off has been read ahead and the pages
+	// before dropped_off have been dropped.
+	size_t advise_window;
+	size_t advised_off;
+	size_t dropped_off;
 	struct error err;
 };
 
 
-static int fld_cls_decode(struct actf_decoder *dec, const struct actf_fld_cls *cls,
-			  struct actf_fld *val);
-
-
 static struct actf_fld *fld_loc_locate(const struct actf_fld_loc loc, struct actf_decoder *dec,
 				       struct actf_fld *cur);
 
@@ -105,6 +239,23 @@ static struct actf_fld *get_struct_member(struct actf_fld *val, const char *name
 	return NULL;
 }
 
+/* dyn_len_arr_len sets len to the length of a dynamic-length array
+ * from its located length field len_val. */
+static int dyn_len_arr_len(const struct actf_fld *len_val, struct error *e, size_t *len)
+{
+	if (!len_val) {
+		eprependf(e, "no dynamic-length-array length");
+		return ACTF_MISSING_FLD_LOC;
+	}
+	if (len_val->type != ACTF_FLD_TYPE_UINT) {
+		eprintf(e,
+			"dynamic-length-array field has a length indicator that is not an unsigned integer");
+		return ACTF_WRONG_FLD_TYPE;
+	}
+	*len = len_val->d.uint.val;
+	return ACTF_OK;
+}
+
 static int get_arr_cls_len(struct actf_fld *val, struct actf_decoder *dec, size_t *len)
 {
 	struct error *e = &dec->err;
@@ -112,39 +263,27 @@ static int get_arr_cls_len(struct actf_fld *val, struct actf_decoder *dec, size_
 	case ACTF_FLD_CLS_STATIC_LEN_ARR:
 		*len = val->cls->cls.static_len_arr.len;
 		return ACTF_OK;
-	case ACTF_FLD_CLS_DYN_LEN_ARR: {
-		struct actf_fld *len_val =
-			fld_loc_locate(val->cls->cls.dyn_len_arr.len_fld_loc,
-				       dec, val);
-		if (!len_val) {
-			eprependf(e, "no dynamic-length-array length");
-			return ACTF_MISSING_FLD_LOC;
-		}
-		if (len_val->type != ACTF_FLD_TYPE_UINT) {
-			eprintf(e,
-				"dynamic-length-array field has a length indicator that is not an unsigned integer");
-			return ACTF_WRONG_FLD_TYPE;
-		}
-		*len = len_val->d.uint.val;
-		return ACTF_OK;
-	}
+	case ACTF_FLD_CLS_DYN_LEN_ARR:
+		return dyn_len_arr_len(fld_loc_locate(val->cls->cls.dyn_len_arr.len_fld_loc,
+						      dec, val), e, len);
 	default:
 		eprintf(e, "trying to retrieve length of a non-array field class");
 		return ACTF_INTERNAL;
 	}
 }
 
-/* Not finding a field is considered an error. */
-static struct actf_fld *fld_loc_locate(const struct actf_fld_loc loc, struct actf_decoder *dec,
+/* fld_loc_origin returns the value where the field location procedure
+ * of a field location with origin starts. */
+static struct actf_fld *fld_loc_origin(enum actf_fld_loc_origin origin, struct actf_decoder *dec,
 				       struct actf_fld *cur)
 {
-	struct actf_pkt *pkt = &dec->dec_s.pkt;
+	struct actf_pkt *pkt = &dec->dec_s.pkt->pkt;
 	struct actf_event *ev = dec->dec_s.ev;
 	struct error *e = &dec->err;
 
 	// 6.3.2 Field location procedure
 	struct actf_fld *fld;
-	switch (loc.origin) {
+	switch (origin) {
 	case ACTF_FLD_LOC_ORIGIN_NONE:
 		fld = cur->parent;
 		break;
@@ -172,11 +311,83 @@ static struct actf_fld *fld_loc_locate(const struct actf_fld_loc loc, struct act
 	}
 	if (!fld || fld->type != ACTF_FLD_TYPE_STRUCT) {
 		eprintf(e, "unable to locate field with origin: %s",
-			actf_fld_loc_origin_name(loc.origin) ? actf_fld_loc_origin_name(loc.
-											origin) :
+			actf_fld_loc_origin_name(origin) ? actf_fld_loc_origin_name(origin) :
 			"relative");
 		return NULL;
 	}
+	return fld;
+}
+
+/* fld_loc_parent moves fld to its parent as a field location path
+ * element without a name. */
+static int fld_loc_parent(struct actf_fld **fld, struct error *e)
+{
+	if (!(*fld)->parent) {
+		eprintf(e,
+			"field location points to a field's containing struct, but the field has no encompassing struct");
+		return ACTF_MISSING_FLD_LOC;
+	}
+	*fld = (*fld)->parent;
+	return ACTF_OK;
+}
+
+/* fld_loc_visit handles the value fld reached by the field location
+ * procedure. It returns 1 if fld is the located field, 0 if the
+ * procedure should continue with the, possibly updated, fld and a
+ * negative error code otherwise. */
+static int fld_loc_visit(struct actf_fld **fld, bool last, struct actf_decoder *dec)
+{
+	struct error *e = &dec->err;
+	if ((*fld)->type == ACTF_FLD_TYPE_NIL) {
+		eprintf(e, "field location points to a field which is not yet decoded");
+		return ACTF_MISSING_FLD_LOC;
+	}
+	switch ((*fld)->type) {
+	case ACTF_FLD_TYPE_BOOL:
+	case ACTF_FLD_TYPE_SINT:
+	case ACTF_FLD_TYPE_UINT:
+		if (!last) {
+			eprintf(e, "field location points to an integer-based field-value"
+				" but there are remaining elements in the field location path");
+			return ACTF_MISSING_FLD_LOC;
+		}
+		return 1;
+	case ACTF_FLD_TYPE_STRUCT:
+		return 0;
+	case ACTF_FLD_TYPE_ARR: {
+		/* While V is an array:
+		   - If V isn’t currently being decoded, then report an error and abort the data stream decoding process.
+		   - Set V to the element of V currently being decoded.
+		*/
+		do {
+			size_t len;
+			if (get_arr_cls_len(*fld, dec, &len) < 0) {
+				return ACTF_MISSING_FLD_LOC;
+			}
+			if ((*fld)->d.arr.n_vals == len) {
+				eprintf(e,
+					"trying to lookup a field location in an already decoded array");
+				return ACTF_MISSING_FLD_LOC;
+			}
+			*fld = &(*fld)->d.arr.vals[(*fld)->d.arr.n_vals];
+		} while ((*fld)->type == ACTF_FLD_TYPE_ARR);
+		return 0;
+	}
+	default:
+		eprintf(e, "field location points to a non-supported field-class");
+		return ACTF_MISSING_FLD_LOC;
+	}
+}
+
+/* Not finding a field is considered an error. */
+static struct actf_fld *fld_loc_locate(const struct actf_fld_loc loc, struct actf_decoder *dec,
+				       struct actf_fld *cur)
+{
+	struct error *e = &dec->err;
+	struct actf_fld *fld = fld_loc_origin(loc.origin, dec, cur);
+	if (!fld) {
+		return NULL;
+	}
 	for (size_t i = 0; i < loc.path_len; i++) {
 		const char *next_path = loc.path[i];
 		if (next_path) {
@@ -186,54 +397,50 @@ static struct actf_fld *fld_loc_locate(const struct actf_fld_loc loc, struct act
 					next_path);
 				return NULL;
 			}
-			if (fld->type == ACTF_FLD_TYPE_NIL) {
-				eprintf(e,
-					"field location points to a field which is not yet decoded");
-				return NULL;
-			}
-		} else {
-			if (!fld->parent) {
-				eprintf(e,
-					"field location points to a field's containing struct, but the field has no encompassing struct");
-				return NULL;
-			}
-			fld = fld->parent;
+		} else if (fld_loc_parent(&fld, e) < 0) {
+			return NULL;
+		}
+		int rc = fld_loc_visit(&fld, i == (loc.path_len - 1), dec);
+		if (rc < 0) {
+			return NULL;
+		} else if (rc) {
+			return fld;
 		}
+	}
+	eprintf(e, "unable to find field location");
+	return NULL;
+}
 
-		switch (fld->type) {
-		case ACTF_FLD_TYPE_BOOL:
-		case ACTF_FLD_TYPE_SINT:
-		case ACTF_FLD_TYPE_UINT:
-			if (i != (loc.path_len - 1)) {
-				eprintf(e, "field location points to an integer-based field-value"
-					" but there are remaining elements in the field location path");
+/* dec_fld_loc_locate is fld_loc_locate of a field location resolved
+ * when compiling the decode plan, the members along the path are then
+ * directly indexed. */
+static struct actf_fld *dec_fld_loc_locate(const struct dec_fld_loc *dloc,
+					   struct actf_decoder *dec, struct actf_fld *cur)
+{
+	if (!dloc->idxs) {
+		return fld_loc_locate(*dloc->loc, dec, cur);
+	}
+	struct error *e = &dec->err;
+	struct actf_fld *fld = fld_loc_origin(dloc->loc->origin, dec, cur);
+	if (!fld) {
+		return NULL;
+	}
+	size_t path_len = dloc->loc->path_len;
+	for (size_t i = 0; i < path_len; i++) {
+		if (dloc->idxs[i] != DEC_FLD_LOC_PARENT) {
+			if (unlikely(fld->type != ACTF_FLD_TYPE_STRUCT)) {
+				eprintf(e, "field location points to a non-supported field-class");
 				return NULL;
 			}
-			return fld;
-		case ACTF_FLD_TYPE_STRUCT:
-			break;
-		case ACTF_FLD_TYPE_ARR: {
-			/* While V is an array:
-			   - If V isn’t currently being decoded, then report an error and abort the data stream decoding process.
-			   - Set V to the element of V currently being decoded.
-			*/
-			do {
-				size_t len;
-				if (get_arr_cls_len(fld, dec, &len) < 0) {
-					return NULL;
-				}
-				if (fld->d.arr.n_vals == len) {
-					eprintf(e,
-						"trying to lookup a field location in an already decoded array");
-					return NULL;
-				}
-				fld = &fld->d.arr.vals[fld->d.arr.n_vals];
-			} while (fld->type == ACTF_FLD_TYPE_ARR);
-			break;
+			fld = &fld->d.struct_.vals[dloc->idxs[i]];
+		} else if (fld_loc_parent(&fld, e) < 0) {
+			return NULL;
 		}
-		default:
-			eprintf(e, "field location points to a non-supported field-class");
+		int rc = fld_loc_visit(&fld, i == (path_len - 1), dec);
+		if (rc < 0) {
 			return NULL;
+		} else if (rc) {
+			return fld;
 		}
 	}
 	eprintf(e, "unable to find field location");
@@ -312,16 +519,6 @@ static uint64_t reverse_bits(uint64_t v, size_t len)
 	return r;
 }
 
-static inline bool needs_reverse_bits_le(const struct fxd_len_bit_arr_fld_cls *cls)
-{
-	return cls->bito == ACTF_LAST_TO_FIRST;
-}
-
-static inline bool needs_reverse_bits_be(const struct fxd_len_bit_arr_fld_cls *cls)
-{
-	return cls->bito == ACTF_FIRST_TO_LAST;
-}
-
 static inline uint64_t read_upper_bits_le(struct breader *br, uint64_t result,
 					  size_t remain_bits, size_t first_bits)
 {
@@ -335,34 +532,41 @@ static inline uint64_t read_upper_bits_be(struct breader *br, uint64_t result,
 	return (result << remain_bits) | breader_peek_be(br, remain_bits);
 }
 
-#define fxd_len_bit_arr_decodem(dec, cls, val, BO)			\
+/* CHECKED is false if the bounds have already been checked by an
+ * enclosing value, see dec_state.in_bounds. */
+#define fxd_len_bit_arr_decodem(dec, op, val, BO, CHECKED)		\
     do {								\
-	assert(cls->len <= 64);						\
-	int rc;								\
+	const struct dec_op_bit_arr *ba = &op->u.bit_arr;		\
+	assert(ba->len <= 64);						\
 	struct pkt_state *pkt_s = &dec->dec_s.pkt_s;			\
 	struct breader *br = &dec->br;					\
 	struct error *e = &dec->err;					\
 									\
-	breader_set_bo(br, cls->bo);					\
-	if (unlikely((rc = do_align_##BO(br, cls->align, pkt_s, e)) < 0)) { \
-	    return rc;							\
-	}								\
-	if (unlikely(pkt_bits_remaining(pkt_s, br) < cls->len)) {	\
-	    eprintf(e, "not enough bits to read in packet");		\
-	    return ACTF_NOT_ENOUGH_BITS;				\
+	breader_set_bo(br, ba->bo);					\
+	if (CHECKED) {							\
+	    int rc;							\
+	    if (unlikely((rc = do_align_##BO(br, op->align, pkt_s, e)) < 0)) { \
+		return rc;						\
+	    }								\
+	    if (unlikely(pkt_bits_remaining(pkt_s, br) < ba->len)) {	\
+		eprintf(e, "not enough bits to read in packet");	\
+		return ACTF_NOT_ENOUGH_BITS;				\
+	    }								\
+	} else {							\
+	    breader_align_##BO(br, op->align);				\
 	}								\
 	if (unlikely((pkt_s->opt_flags & PKT_LAST_BO) &&		\
-		     pkt_s->last_bo != cls->bo &&			\
+		     pkt_s->last_bo != ba->bo &&			\
 		     ! breader_byte_aligned(br))) {			\
 	    eprintf(e, "changing byte-order in the middle of a byte");	\
 	    return ACTF_MID_BYTE_ENDIAN_SWAP;				\
 	}								\
 	/* refill is run unconditionally here, it could be more efficient \
-	 * to decode lots of small ints by only refilling if cls->len <	\
+	 * to decode lots of small ints by only refilling if ba->len <	\
 	 * br->lookahead_bit_cnt.					\
 	 */								\
 	size_t avail_bits = breader_refill_##BO(br);			\
-	if (unlikely(! avail_bits)) {					\
+	if (CHECKED && unlikely(! avail_bits)) {			\
 	    eprintf(e, "not enough bits to read in bit stream");	\
 	    return ACTF_NOT_ENOUGH_BITS;				\
 	}								\
@@ -371,21 +575,21 @@ static inline uint64_t read_upper_bits_be(struct breader *br, uint64_t result,
 	 * bits here just means that we will consume the bits before	\
 	 * realizing they won't be enough.				\
 	 */								\
-	/* if (cls->len < MAX_READ_BITS && avail_bits < cls->len) { */	\
+	/* if (ba->len < MAX_READ_BITS && avail_bits < ba->len) { */	\
 	/* 	eprintf(e, "Not enough bits to read"); */		\
 	/* 	return ACTF_NOT_ENOUGH_BITS; */				\
 	/* } */								\
 									\
 	/* Read up to MAX_READ_BITS */					\
-	size_t first_bits = MIN(avail_bits, cls->len);			\
+	size_t first_bits = MIN(avail_bits, ba->len);			\
 	uint64_t result = breader_peek_##BO(br, first_bits);		\
 	breader_consume_##BO(br, first_bits);				\
 									\
-	size_t remain_bits = cls->len - first_bits;			\
+	size_t remain_bits = ba->len - first_bits;			\
 	if (remain_bits) {						\
-	    /* Read the last cls->len - MAX_READ_BITS bits */		\
+	    /* Read the last ba->len - MAX_READ_BITS bits */		\
 	    avail_bits = breader_refill_##BO(br);			\
-	    if (unlikely(avail_bits < remain_bits)) {			\
+	    if (CHECKED && unlikely(avail_bits < remain_bits)) {	\
 		eprintf(e, "not enough bits to read in bit stream");	\
 		return ACTF_NOT_ENOUGH_BITS;				\
 	    }								\
@@ -393,36 +597,83 @@ static inline uint64_t read_upper_bits_be(struct breader *br, uint64_t result,
 	    breader_consume_##BO(br, remain_bits);			\
 	}								\
 	/* Reverse the bits if necessary. */				\
-	if (needs_reverse_bits_##BO(cls)) {				\
-	    *val = reverse_bits(result, cls->len);			\
+	if (ba->reverse) {						\
+	    *val = reverse_bits(result, ba->len);			\
 	} else {							\
 	    *val = result;						\
 	}								\
 									\
-	pkt_s->last_bo = cls->bo;					\
+	pkt_s->last_bo = ba->bo;					\
 	pkt_s->opt_flags |= PKT_LAST_BO;				\
 	return ACTF_OK;							\
     } while (0)								\
 
-static int fxd_len_bit_arr_decode(struct actf_decoder *dec,
-				  const struct fxd_len_bit_arr_fld_cls *cls, uint64_t *val)
+/* fxd_len_bytes_le_decode decodes a fixed-length bit array which is
+ * op->u.bit_arr.bytes_le and starts at a byte boundary once aligned,
+ * with a single load. */
+static int fxd_len_bytes_le_decode(struct actf_decoder *dec, const struct dec_op *op,
+				   uint64_t *val)
+{
+	struct pkt_state *pkt_s = &dec->dec_s.pkt_s;
+	struct breader *br = &dec->br;
+	struct error *e = &dec->err;
+	size_t n_bytes = op->u.bit_arr.len / 8;
+
+	if (dec->dec_s.in_bounds) {
+		breader_align(br, op->align);
+	} else {
+		int rc;
+		if (unlikely((rc = do_align(br, op->align, pkt_s, e)) < 0)) {
+			return rc;
+		}
+		if (unlikely(pkt_bits_remaining(pkt_s, br) < op->u.bit_arr.len)) {
+			eprintf(e, "not enough bits to read in packet");
+			return ACTF_NOT_ENOUGH_BITS;
+		}
+		if (unlikely(breader_bytes_remaining(br) < n_bytes)) {
+			eprintf(e, "not enough bits to read in bit stream");
+			return ACTF_NOT_ENOUGH_BITS;
+		}
+	}
+	/* Aligned to a byte, so no byte order change can happen in the
+	 * middle of one */
+	*val = breader_read_uint_le(br, n_bytes);
+	pkt_s->last_bo = ACTF_LIL_ENDIAN;
+	pkt_s->opt_flags |= PKT_LAST_BO;
+	return ACTF_OK;
+}
+
+static int fxd_len_bit_arr_decode(struct actf_decoder *dec, const struct dec_op *op,
+				  uint64_t *val)
 {
-	if (cls->bo == ACTF_LIL_ENDIAN) {
-		fxd_len_bit_arr_decodem(dec, cls, val, le);
+	/* Aligning a byte-aligned position keeps it byte aligned */
+	if (op->u.bit_arr.bytes_le && (op->align % 8 == 0 || breader_byte_aligned(&dec->br))) {
+		return fxd_len_bytes_le_decode(dec, op, val);
+	}
+	if (dec->dec_s.in_bounds) {
+		if (op->u.bit_arr.bo == ACTF_LIL_ENDIAN) {
+			fxd_len_bit_arr_decodem(dec, op, val, le, false);
+		} else {
+			fxd_len_bit_arr_decodem(dec, op, val, be, false);
+		}
 	} else {
-		fxd_len_bit_arr_decodem(dec, cls, val, be);
+		if (op->u.bit_arr.bo == ACTF_LIL_ENDIAN) {
+			fxd_len_bit_arr_decodem(dec, op, val, le, true);
+		} else {
+			fxd_len_bit_arr_decodem(dec, op, val, be, true);
+		}
 	}
 }
 
 static int fld_cls_fxd_len_bit_arr_decode(struct actf_decoder *dec,
-					  const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+					  const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_FXD_LEN_BIT_ARR);
 	int rc;
-	const struct fxd_len_bit_arr_fld_cls *cls = &gen_cls->cls.fxd_len_bit_arr;
 
 	uint64_t bit_arr;
-	if ((rc = fxd_len_bit_arr_decode(dec, cls, &bit_arr)) < 0) {
+	if ((rc = fxd_len_bit_arr_decode(dec, op, &bit_arr)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
@@ -432,14 +683,14 @@ static int fld_cls_fxd_len_bit_arr_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_fxd_len_bit_map_decode(struct actf_decoder *dec,
-					  const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+					  const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_FXD_LEN_BIT_MAP);
 	int rc;
-	const struct fxd_len_bit_map_fld_cls *cls = &gen_cls->cls.fxd_len_bit_map;
 
 	uint64_t bit_arr;
-	if ((rc = fxd_len_bit_arr_decode(dec, &cls->bit_arr, &bit_arr)) < 0) {
+	if ((rc = fxd_len_bit_arr_decode(dec, op, &bit_arr)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
@@ -459,32 +710,32 @@ static uint64_t sext(uint64_t val, uint64_t n_bits)
 }
 
 static int fld_cls_fxd_len_sint_decode(struct actf_decoder *dec,
-				       const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				       const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_FXD_LEN_SINT);
 	int rc;
-	const struct fxd_len_int_fld_cls *cls = &gen_cls->cls.fxd_len_int;
 
 	uint64_t bit_arr;
-	if ((rc = fxd_len_bit_arr_decode(dec, &cls->bit_arr, &bit_arr)) < 0) {
+	if ((rc = fxd_len_bit_arr_decode(dec, op, &bit_arr)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
 
 	val->type = ACTF_FLD_TYPE_SINT;
-	val->d.int_.val = sext(bit_arr, cls->bit_arr.len);
+	val->d.int_.val = sext(bit_arr, op->u.bit_arr.len);
 	return ACTF_OK;
 }
 
 static int fld_cls_fxd_len_uint_decode(struct actf_decoder *dec,
-				       const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				       const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_FXD_LEN_UINT);
 	int rc;
-	const struct fxd_len_int_fld_cls *cls = &gen_cls->cls.fxd_len_int;
 
 	uint64_t bit_arr;
-	if ((rc = fxd_len_bit_arr_decode(dec, &cls->bit_arr, &bit_arr)) < 0) {
+	if ((rc = fxd_len_bit_arr_decode(dec, op, &bit_arr)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
@@ -495,14 +746,14 @@ static int fld_cls_fxd_len_uint_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_fxd_len_bool_decode(struct actf_decoder *dec,
-				       const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				       const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_FXD_LEN_BOOL);
 	int rc;
-	const struct fxd_len_bool_fld_cls *cls = &gen_cls->cls.fxd_len_bool;
 
 	uint64_t bit_arr;
-	if ((rc = fxd_len_bit_arr_decode(dec, &cls->bit_arr, &bit_arr)) < 0) {
+	if ((rc = fxd_len_bit_arr_decode(dec, op, &bit_arr)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
@@ -513,20 +764,20 @@ static int fld_cls_fxd_len_bool_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_fxd_len_float_decode(struct actf_decoder *dec,
-					const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+					const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_FXD_LEN_FLOAT);
 	int rc;
-	const struct fxd_len_float_fld_cls *cls = &gen_cls->cls.fxd_len_float;
 
 	uint64_t bit_arr;
-	if ((rc = fxd_len_bit_arr_decode(dec, &cls->bit_arr, &bit_arr)) < 0) {
+	if ((rc = fxd_len_bit_arr_decode(dec, op, &bit_arr)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
 
 	val->type = ACTF_FLD_TYPE_REAL;
-	switch (cls->bit_arr.len) {
+	switch (op->u.bit_arr.len) {
 	case 32: {
 		union {
 			uint32_t u;
@@ -544,14 +795,13 @@ static int fld_cls_fxd_len_float_decode(struct actf_decoder *dec,
 		break;
 	}
 	default:
-		eprintf(&dec->err, "unsupported float of length %" PRIu64, cls->bit_arr.len);
+		eprintf(&dec->err, "unsupported float of length %" PRIu64, op->u.bit_arr.len);
 		return ACTF_UNSUPPORTED_LENGTH;
 	}
 	return ACTF_OK;
 }
 
-static int fld_cls_var_len_int_decode(struct actf_decoder *dec,
-				      const struct actf_fld_cls *gen_cls,
+static int fld_cls_var_len_int_decode(struct actf_decoder *dec, const struct dec_op *op,
 				      uint64_t *val, uint64_t *n_bits)
 {
 	int rc;
@@ -560,7 +810,7 @@ static int fld_cls_var_len_int_decode(struct actf_decoder *dec,
 	struct error *e = &dec->err;
 
 	breader_set_bo(br, ACTF_LIL_ENDIAN);	// not req if I read bytes.
-	if ((rc = do_align(br, actf_fld_cls_get_align_req(gen_cls), pkt_s, e)) < 0) {
+	if ((rc = do_align(br, op->align, pkt_s, e)) < 0) {
 		return rc;
 	}
 	if (pkt_bits_remaining(pkt_s, br) < 8) {
@@ -599,12 +849,13 @@ static int fld_cls_var_len_int_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_var_len_uint_decode(struct actf_decoder *dec,
-				       const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				       const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_VAR_LEN_UINT);
 	int rc;
 	uint64_t uval, n_bits;
-	if ((rc = fld_cls_var_len_int_decode(dec, gen_cls, &uval, &n_bits)) < 0) {
+	if ((rc = fld_cls_var_len_int_decode(dec, op, &uval, &n_bits)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
@@ -616,12 +867,13 @@ static int fld_cls_var_len_uint_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_var_len_sint_decode(struct actf_decoder *dec,
-				       const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				       const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_VAR_LEN_SINT);
 	int rc;
 	uint64_t uval, n_bits;
-	if ((rc = fld_cls_var_len_int_decode(dec, gen_cls, &uval, &n_bits)) < 0) {
+	if ((rc = fld_cls_var_len_int_decode(dec, op, &uval, &n_bits)) < 0) {
 		eprependf(&dec->err, actf_fld_cls_type_name(gen_cls->type));
 		return rc;
 	}
@@ -660,8 +912,9 @@ static uint8_t *find_null_term(uint8_t *ptr, size_t n_bytes, enum actf_encoding
 }
 
 static int fld_cls_null_term_str_decode(struct actf_decoder *dec,
-					const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+					const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_NULL_TERM_STR);
 	int rc;
 	const struct null_term_str_fld_cls *cls = &gen_cls->cls.null_term_str;
@@ -669,7 +922,7 @@ static int fld_cls_null_term_str_decode(struct actf_decoder *dec,
 	struct breader *br = &dec->br;
 	struct error *e = &dec->err;
 
-	if ((rc = do_align(br, actf_fld_cls_get_align_req(gen_cls), pkt_s, e)) < 0) {
+	if ((rc = do_align(br, op->align, pkt_s, e)) < 0) {
 		return rc;
 	}
 	if (pkt_bits_remaining(pkt_s, br) < actf_encoding_to_codepoint_size(cls->base.enc) * 8) {
@@ -713,8 +966,9 @@ static bool is_valid_str_sz(size_t str_sz, enum actf_encoding enc)
 // fld_cls_dyn_len_str_decode together into the same function if I use
 // fld_cls helpers to get encoding and len from them.
 static int fld_cls_static_len_str_decode(struct actf_decoder *dec,
-					 const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+					 const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_STATIC_LEN_STR);
 	int rc;
 	const struct static_len_str_fld_cls *cls = &gen_cls->cls.static_len_str;
@@ -722,7 +976,7 @@ static int fld_cls_static_len_str_decode(struct actf_decoder *dec,
 	struct breader *br = &dec->br;
 	struct error *e = &dec->err;
 
-	if ((rc = do_align(br, actf_fld_cls_get_align_req(gen_cls), pkt_s, e)) < 0) {
+	if ((rc = do_align(br, op->align, pkt_s, e)) < 0) {
 		return rc;
 	}
 	if (pkt_bits_remaining(pkt_s, br) < cls->len * 8) {
@@ -760,8 +1014,9 @@ static int fld_cls_static_len_str_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_dyn_len_str_decode(struct actf_decoder *dec,
-				      const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				      const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_DYN_LEN_STR);
 	int rc;
 	const struct dyn_len_str_fld_cls *cls = &gen_cls->cls.dyn_len_str;
@@ -770,7 +1025,7 @@ static int fld_cls_dyn_len_str_decode(struct actf_decoder *dec,
 	struct error *e = &dec->err;
 
 	/* The value of the field that indicates the length */
-	struct actf_fld *len_val = fld_loc_locate(cls->len_fld_loc, dec, val);
+	struct actf_fld *len_val = dec_fld_loc_locate(&op->u.loc, dec, val);
 	if (!len_val) {
 		eprependf(e, "no dynamic-length-string length");
 		return ACTF_MISSING_FLD_LOC;
@@ -782,7 +1037,7 @@ static int fld_cls_dyn_len_str_decode(struct actf_decoder *dec,
 	}
 	size_t len = len_val->d.uint.val;
 
-	if ((rc = do_align(br, actf_fld_cls_get_align_req(gen_cls), pkt_s, e)) < 0) {
+	if ((rc = do_align(br, op->align, pkt_s, e)) < 0) {
 		return rc;
 	}
 	if (pkt_bits_remaining(pkt_s, br) < len * 8) {
@@ -819,8 +1074,9 @@ static int fld_cls_dyn_len_str_decode(struct actf_decoder *dec,
 }
 
 static int fld_cls_static_len_blob_decode(struct actf_decoder *dec,
-					  const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+					  const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_STATIC_LEN_BLOB);
 	int rc;
 	const struct static_len_blob_fld_cls *cls = &gen_cls->cls.static_len_blob;
@@ -828,7 +1084,7 @@ static int fld_cls_static_len_blob_decode(struct actf_decoder *dec,
 	struct breader *br = &dec->br;
 	struct error *e = &dec->err;
 
-	if ((rc = do_align(br, actf_fld_cls_get_align_req(gen_cls), pkt_s, e)) < 0) {
+	if ((rc = do_align(br, op->align, pkt_s, e)) < 0) {
 		return rc;
 	}
 	if (pkt_bits_remaining(pkt_s, br) < cls->len * 8) {
@@ -850,17 +1106,17 @@ static int fld_cls_static_len_blob_decode(struct actf_decoder *dec,
 
 /* Very similar to dyn_len_str, could maybe commonalize. */
 static int fld_cls_dyn_len_blob_decode(struct actf_decoder *dec,
-				       const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+				       const struct dec_op *op, struct actf_fld *val)
 {
+	const struct actf_fld_cls *gen_cls = op->cls;
 	assert(gen_cls->type == ACTF_FLD_CLS_DYN_LEN_BLOB);
 	int rc;
-	const struct dyn_len_blob_fld_cls *cls = &gen_cls->cls.dyn_len_blob;
 	struct pkt_state *pkt_s = &dec->dec_s.pkt_s;
 	struct breader *br = &dec->br;
 	struct error *e = &dec->err;
 
 	/* The value of the field that indicates the length */
-	struct actf_fld *len_val = fld_loc_locate(cls->len_fld_loc, dec, val);
+	struct actf_fld *len_val = dec_fld_loc_locate(&op->u.loc, dec, val);
 	if (!len_val) {
 		eprependf(e, "no dynamic-length-blob length");
 		return ACTF_MISSING_FLD_LOC;
@@ -872,7 +1128,7 @@ static int fld_cls_dyn_len_blob_decode(struct actf_decoder *dec,
 	}
 	size_t len = len_val->d.uint.val;
 
-	if ((rc = do_align(br, actf_fld_cls_get_align_req(gen_cls), pkt_s, e)) < 0) {
+	if ((rc = do_align(br, op->align, pkt_s, e)) < 0) {
 		return rc;
 	}
 	if (pkt_bits_remaining(pkt_s, br) < len * 8) {
@@ -997,112 +1253,86 @@ static int handle_fld_roles(struct actf_decoder *dec, enum actf_role roles,
 	return ACTF_OK;
 }
 
-static int fld_cls_optional_decode(struct actf_decoder *dec,
-				   const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+/* optional_is_enabled sets enabled to whether the optional field of
+ * op is enabled or not. */
+static int optional_is_enabled(struct actf_decoder *dec, const struct dec_op *op,
+			       struct actf_fld *val, bool *enabled)
 {
-	assert(gen_cls->type == ACTF_FLD_CLS_OPTIONAL);
-	int rc;
-	const struct optional_fld_cls *cls = &gen_cls->cls.optional;
+	assert(op->type == DEC_OP_OPTIONAL);
+	const struct optional_fld_cls *cls = &op->cls->cls.optional;
 	struct error *e = &dec->err;
 
 	/* The value of the field that indicates if the optional field is
 	 * enabled or not.
 	 */
-	struct actf_fld *sel_val = fld_loc_locate(cls->sel_fld_loc, dec, val);
+	struct actf_fld *sel_val = dec_fld_loc_locate(&op->u.loc, dec, val);
 	if (!sel_val) {
 		eprependf(e, "no optional selector field");
 		return ACTF_MISSING_FLD_LOC;
 	}
 
-	struct actf_fld_cls *opt_fld_cls = NULL;
 	if (sel_val->type == ACTF_FLD_TYPE_BOOL) {
-		if (sel_val->d.bool_.val) {
-			opt_fld_cls = cls->fld_cls;
-		}
+		*enabled = sel_val->d.bool_.val;
 	} else if (!actf_rng_set_len(&cls->sel_fld_rng_set)) {
 		eprintf(e,
 			"selector field of optional field is not a boolean, but there are no selector-field-ranges specified");
 		return ACTF_NO_SELECTOR_FLD;
 	} else if (sel_val->type == ACTF_FLD_TYPE_SINT) {
-		if (actf_rng_set_intersect_sint(&cls->sel_fld_rng_set, sel_val->d.int_.val)) {
-			opt_fld_cls = cls->fld_cls;
-		}
+		*enabled = actf_rng_set_intersect_sint(&cls->sel_fld_rng_set, sel_val->d.int_.val);
 	} else if (sel_val->type == ACTF_FLD_TYPE_UINT) {
-		if (actf_rng_set_intersect_uint(&cls->sel_fld_rng_set, sel_val->d.uint.val)) {
-			opt_fld_cls = cls->fld_cls;
-		}
+		*enabled = actf_rng_set_intersect_uint(&cls->sel_fld_rng_set, sel_val->d.uint.val);
 	} else {
 		eprintf(e, "selector field of optional is not an integer field");
 		return ACTF_WRONG_FLD_TYPE;
 	}
-
-	/* The optional field-class is disabled */
-	if (!opt_fld_cls) {
-		val->type = ACTF_FLD_TYPE_NIL;
-		return ACTF_OK;
-	}
-	/* The optional field-class is enabled */
-	if ((rc = fld_cls_decode(dec, opt_fld_cls, val)) < 0) {
-		eprependf(e, "optional field-class");
-		return rc;
-	}
-	enum actf_role roles = actf_fld_cls_roles(opt_fld_cls);
-	if (roles && (rc = handle_fld_roles(dec, roles, opt_fld_cls, val)) < 0) {
-		return rc;
-	}
 	return ACTF_OK;
 }
 
-static int fld_cls_variant_decode(struct actf_decoder *dec,
-				  const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+/* variant_select sets opt_pc to the index of the first op of the
+ * selected option of the variant at index pc of plan. */
+static int variant_select(struct actf_decoder *dec, const struct dec_plan *plan, size_t pc,
+			  struct actf_fld *val, size_t *opt_pc)
 {
-	assert(gen_cls->type == ACTF_FLD_CLS_VARIANT);
-	int rc;
-	const struct variant_fld_cls *cls = &gen_cls->cls.variant;
+	const struct dec_op *op = &plan->ops[pc];
+	assert(op->type == DEC_OP_VARIANT);
+	const struct variant_fld_cls *cls = &op->cls->cls.variant;
 	struct error *e = &dec->err;
 
 	/* The value of the field that indicates what variant option to
 	 * select.
 	 */
-	struct actf_fld *sel_val = fld_loc_locate(cls->sel_fld_loc, dec, val);
+	struct actf_fld *sel_val = dec_fld_loc_locate(&op->u.loc, dec, val);
 	if (!sel_val) {
 		eprependf(e, "no variant selector field");
 		return ACTF_MISSING_FLD_LOC;
 	}
+	if (sel_val->type != ACTF_FLD_TYPE_SINT && sel_val->type != ACTF_FLD_TYPE_UINT) {
+		eprintf(e, "selector field of variant is not an integer field");
+		return ACTF_WRONG_FLD_TYPE;
+	}
 
-	struct actf_fld_cls *opt_fld_cls = NULL;
-	if (sel_val->type == ACTF_FLD_TYPE_SINT) {
-		for (size_t i = 0; i < cls->n_opts; i++) {
-			struct variant_fld_cls_opt *opt = &cls->opts[i];
-			if (actf_rng_set_intersect_sint(&opt->sel_fld_rng_set, sel_val->d.int_.val)) {
-				opt_fld_cls = &opt->fc;
-			}
+	/* The options are laid out one after the other following the
+	 * variant op. */
+	bool found = false;
+	size_t opt_start = pc + 1;
+	for (size_t i = 0; i < cls->n_opts; i++) {
+		const struct variant_fld_cls_opt *opt = &cls->opts[i];
+		bool match;
+		if (sel_val->type == ACTF_FLD_TYPE_SINT) {
+			match = actf_rng_set_intersect_sint(&opt->sel_fld_rng_set, sel_val->d.int_.val);
+		} else {
+			match = actf_rng_set_intersect_uint(&opt->sel_fld_rng_set, sel_val->d.uint.val);
 		}
-	} else if (sel_val->type == ACTF_FLD_TYPE_UINT) {
-		for (size_t i = 0; i < cls->n_opts; i++) {
-			struct variant_fld_cls_opt *opt = &cls->opts[i];
-			if (actf_rng_set_intersect_uint(&opt->sel_fld_rng_set, sel_val->d.uint.val)) {
-				opt_fld_cls = &opt->fc;
-			}
+		if (match) {
+			*opt_pc = opt_start;
+			found = true;
 		}
-	} else {
-		eprintf(e, "selector field of variant is not an integer field");
-		return ACTF_WRONG_FLD_TYPE;
+		opt_start = plan->ops[opt_start].end;
 	}
-	if (!opt_fld_cls) {
+	if (!found) {
 		eprintf(e, "selector field of variant does not match any option");
 		return ACTF_NO_SELECTOR_FLD;
 	}
-
-	/* Decode the selected variant option field-class */
-	if ((rc = fld_cls_decode(dec, opt_fld_cls, val)) < 0) {
-		eprependf(e, "variant field-class");
-		return rc;
-	}
-	enum actf_role roles = actf_fld_cls_roles(opt_fld_cls);
-	if (roles && (rc = handle_fld_roles(dec, roles, opt_fld_cls, val)) < 0) {
-		return rc;
-	}
 	return ACTF_OK;
 }
 
@@ -1111,7 +1341,7 @@ static struct arena *dec_ctx_arena(struct dec_state *dec_s)
 	switch (dec_s->ctx) {
 	case DEC_CTX_PKT_HEADER:
 	case DEC_CTX_PKT_CTX:
-		return &dec_s->pkt_arena;
+		return &dec_s->pkt->arena;
 	case DEC_CTX_EVENT_HEADER:
 	case DEC_CTX_EVENT_COMMON_CTX:
 	case DEC_CTX_EVENT_SPECIFIC_CTX:
@@ -1123,208 +1353,443 @@ static struct arena *dec_ctx_arena(struct dec_state *dec_s)
 	}
 }
 
-static int fld_cls_struct_decode(struct actf_decoder *dec,
-				 const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+/* Allocates n zeroed values from the arena of the current context. */
+static struct actf_fld *dec_alloc_vals(struct actf_decoder *dec, size_t n)
 {
-	assert(gen_cls->type == ACTF_FLD_CLS_STRUCT);
-	int rc;
-	const struct struct_fld_cls cls = gen_cls->cls.struct_;
-	struct error *e = &dec->err;
+	struct arena *arena = dec_ctx_arena(&dec->dec_s);
+	struct actf_fld *vals = arena_allocn(arena, struct actf_fld, n);
+	if (!vals) {
+		eprintf(&dec->err, "arena_allocn: %s", strerror(errno));
+		return NULL;
+	}
+	memset(vals, 0, n * sizeof(*vals));
+	return vals;
+}
 
-	if ((rc =
-	     do_align(&dec->br, actf_fld_cls_get_align_req(gen_cls), &dec->dec_s.pkt_s, e)) < 0) {
+static int fld_cls_struct_begin(struct actf_decoder *dec, const struct dec_op *op,
+				struct actf_fld *val)
+{
+	int rc;
+	if ((rc = do_align(&dec->br, op->align, &dec->dec_s.pkt_s, &dec->err)) < 0) {
 		return rc;
 	}
-
-	struct arena *arena = dec_ctx_arena(&dec->dec_s);
-	struct actf_fld *vals = arena_allocn(arena, struct actf_fld, cls.n_members);
+	struct actf_fld *vals = dec_alloc_vals(dec, op->u.n_members);
 	if (!vals) {
-		eprintf(e, "arena_allocn: %s", strerror(errno));
 		return ACTF_OOM;
 	}
-	memset(vals, 0, cls.n_members * sizeof(*vals));
-
 	/* Must initialize the struct before decoding its members since
 	 * they can have field locations pointing to earlier members held
 	 * by this struct.
 	 */
 	val->type = ACTF_FLD_TYPE_STRUCT;
 	val->d.struct_.vals = vals;
-
-	size_t i;
-	for (i = 0; i < cls.n_members; i++) {
-		const struct struct_fld_member_cls *member = &cls.member_clses[i];
-		/* Set the current struct as the parent of the to-be decoded
-		 * value.
-		 */
-		vals[i].parent = val;
-		if ((rc = fld_cls_decode(dec, &member->cls, &vals[i])) < 0) {
-			eprependf(e, "structure member %s", member->name);
-			return rc;
-		}
-		enum actf_role roles = actf_fld_cls_roles(&member->cls);
-		if (roles && (rc = handle_fld_roles(dec, roles, &member->cls, &vals[i])) < 0) {
-			i++;
-			return rc;
-		}
-	}
 	return ACTF_OK;
 }
 
-static int fld_cls_arr_decode(struct actf_decoder *dec, size_t align,
-			      const struct arr_fld_cls *arr_fld_cls,
-			      size_t arr_len, struct actf_fld *val)
+static int fld_cls_arr_begin(struct actf_decoder *dec, const struct dec_op *op,
+			     struct actf_fld *val, size_t *len)
 {
 	int rc;
 	struct error *e = &dec->err;
-	if ((rc = do_align(&dec->br, align, &dec->dec_s.pkt_s, e)) < 0) {
+	if (op->type == DEC_OP_STATIC_LEN_ARR) {
+		*len = op->u.len;
+	} else if ((rc = dyn_len_arr_len(dec_fld_loc_locate(&op->u.loc, dec, val), e, len)) < 0) {
+		eprependf(e, "dynamic-length-array");
 		return rc;
 	}
-
-	struct arena *arena = dec_ctx_arena(&dec->dec_s);
-	struct actf_fld *vals = arena_allocn(arena, struct actf_fld, arr_len);
+	if ((rc = do_align(&dec->br, op->align, &dec->dec_s.pkt_s, e)) < 0) {
+		return rc;
+	}
+	struct actf_fld *vals = dec_alloc_vals(dec, *len);
 	if (!vals) {
-		eprintf(e, "arena_allocn: %s", strerror(errno));
 		return ACTF_OOM;
 	}
-	memset(vals, 0, arr_len * sizeof(*vals));
-
 	val->type = ACTF_FLD_TYPE_ARR;
 	val->d.arr.vals = vals;
+	return ACTF_OK;
+}
 
-	size_t i;
-	for (i = 0; i < arr_len; i++) {
-		vals[i].parent = val->parent;
-		if ((rc = fld_cls_decode(dec, arr_fld_cls->ele_fld_cls, &vals[i])) < 0) {
-			return rc;
-		}
-		val->d.arr.n_vals++;
+/* dec_bounds_enter checks, once for the whole value, if the aligned
+ * structure or static-length array of op fits in the packet and the
+ * bit stream. If it does, the values it contains are decoded without
+ * bounds checks until it is decoded. If it does not, they are
+ * decoded with checks so that the error points out the first value
+ * that does not fit. */
+static void dec_bounds_enter(struct actf_decoder *dec, const struct dec_op *op)
+{
+	struct dec_state *dec_s = &dec->dec_s;
+	if (dec_s->in_bounds || !op->cls->has_static_len) {
+		return;
+	}
+	if (pkt_bits_remaining(&dec_s->pkt_s, &dec->br) >= op->cls->static_len &&
+	    breader_bits_remaining(&dec->br) >= op->cls->static_len) {
+		dec_s->in_bounds = op;
+	}
+}
+
+static int dec_frames_reserve(struct actf_decoder *dec, size_t n)
+{
+	if (n <= dec->frames_cap) {
+		return ACTF_OK;
+	}
+	struct dec_frame *frames = realloc(dec->frames, n * sizeof(*frames));
+	if (!frames) {
+		eprintf(&dec->err, "realloc: %s", strerror(errno));
+		return ACTF_OOM;
 	}
+	dec->frames = frames;
+	dec->frames_cap = n;
 	return ACTF_OK;
 }
 
-static int fld_cls_static_len_arr_decode(struct actf_decoder *dec,
-					 const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+/* dec_frame_eprependf describes where in the value of f that an error
+ * occurred. */
+static void dec_frame_eprependf(const struct dec_frame *f, struct error *e)
+{
+	switch (f->op->type) {
+	case DEC_OP_STRUCT:
+		eprependf(e, "structure member %s",
+			  f->op->cls->cls.struct_.member_clses[f->i].name);
+		break;
+	case DEC_OP_STATIC_LEN_ARR:
+		eprependf(e, "static-length-array members");
+		break;
+	case DEC_OP_DYN_LEN_ARR:
+		eprependf(e, "dynamic-length-array members");
+		break;
+	case DEC_OP_OPTIONAL:
+		eprependf(e, "optional field-class");
+		break;
+	case DEC_OP_VARIANT:
+		eprependf(e, "variant field-class");
+		break;
+	default:
+		break;
+	}
+}
+
+/* dec_skip_bits moves past len bits aligned to align. */
+static int dec_skip_bits(struct actf_decoder *dec, size_t align, uint64_t len)
 {
-	assert(gen_cls->type == ACTF_FLD_CLS_STATIC_LEN_ARR);
-	const struct static_len_arr_fld_cls *cls = &gen_cls->cls.static_len_arr;
 	int rc;
+	struct breader *br = &dec->br;
+	struct pkt_state *pkt_s = &dec->dec_s.pkt_s;
 	struct error *e = &dec->err;
-	size_t align = actf_fld_cls_get_align_req(gen_cls);
-	size_t len;
-	if ((rc = get_arr_cls_len(val, dec, &len)) < 0) {
-		eprependf(e, "static-length-array");
+
+	if ((rc = do_align(br, align, pkt_s, e)) < 0) {
 		return rc;
 	}
-	if ((rc = fld_cls_arr_decode(dec, align, &cls->base, cls->len, val)) < 0) {
-		eprependf(e, "static-length-array members");
-		return rc;
+	if (pkt_bits_remaining(pkt_s, br) < len) {
+		eprintf(e, "not enough bits to read in packet");
+		return ACTF_NOT_ENOUGH_BITS;
+	}
+	if (breader_bits_remaining(br) < len) {
+		eprintf(e, "not enough bits to read in bit stream");
+		return ACTF_NOT_ENOUGH_BITS;
 	}
+	breader_consume_checked(br, len);
 	return ACTF_OK;
 }
 
-static int fld_cls_dyn_len_arr_decode(struct actf_decoder *dec,
-				      const struct actf_fld_cls *gen_cls, struct actf_fld *val)
+/* dec_op_scan moves past the value of op without decoding it, which
+ * is done for a value with a static length and a dynamic-length array
+ * of elements with a static length. It returns 1 if it moved past the
+ * value, 0 if the value has to be decoded to get past it and a
+ * negative error code otherwise. */
+static int dec_op_scan(struct actf_decoder *dec, const struct dec_op *op, struct actf_fld *val)
 {
-	assert(gen_cls->type == ACTF_FLD_CLS_DYN_LEN_ARR);
-	const struct dyn_len_arr_fld_cls *cls = &gen_cls->cls.dyn_len_arr;
 	int rc;
 	struct error *e = &dec->err;
-	size_t align = actf_fld_cls_get_align_req(gen_cls);
-	size_t len;
-	if ((rc = get_arr_cls_len(val, dec, &len)) < 0) {
-		eprependf(e, "dynamic-length-array");
-		return rc;
+	uint64_t len = op->cls->static_len;
+	if (op->type == DEC_OP_DYN_LEN_ARR) {
+		const struct actf_fld_cls *ele = op->cls->cls.dyn_len_arr.base.ele_fld_cls;
+		if (!ele->has_static_len) {
+			return 0;
+		}
+		size_t n;
+		if ((rc = dyn_len_arr_len(dec_fld_loc_locate(&op->u.loc, dec, val), e, &n)) < 0) {
+			eprependf(e, "dynamic-length-array");
+			return rc;
+		}
+		/* The elements are as far apart as in a static-length
+		 * array, see fld_cls_static_len() */
+		uint64_t stride = ele->static_len;
+		if (ele->align_req > 1 && stride % ele->align_req) {
+			stride += ele->align_req - stride % ele->align_req;
+		}
+		if (n && stride && n - 1 > (UINT64_MAX - ele->static_len) / stride) {
+			eprintf(e, "not enough bits to read in packet");
+			return ACTF_NOT_ENOUGH_BITS;
+		}
+		len = n ? ele->static_len + (n - 1) * stride : 0;
+	} else if (!op->cls->has_static_len) {
+		return 0;
 	}
-	if ((rc = fld_cls_arr_decode(dec, align, &cls->base, len, val)) < 0) {
-		eprependf(e, "dynamic-length-array members");
+	if ((rc = dec_skip_bits(dec, op->align, len)) < 0) {
 		return rc;
 	}
-	return ACTF_OK;
+	val->type = ACTF_FLD_TYPE_NIL;
+	return 1;
 }
 
-/* This could be in fld_cls.h but then that header becomes dependent
- * on pkt_state and breader, which seems lame especially since
- * decoding will modify pkt_state and breader.
+/* dec_plan_run decodes val by running plan. Instead of recursing into
+ * the values held by a structure, array, optional or variant, a frame
+ * is pushed which keeps track of what is left to decode of it.
+ *
+ * The roles of a value are handled as soon as it has been decoded
+ * since later values can depend on them.
  *
- * It would be nice since all switch-cases are confined to fld_cls.c,
- * but I don't think it's worth for now to create a dependency-mess.
- * Not sure how encoding will work either.
+ * If scan is set, only the values that the field locations of the
+ * plan and the plans it is marked with can locate are decoded, see
+ * dec_plan_mark_loc_targets(), together with the values that are
+ * decoded to get past them. The rest are moved past and left NIL,
+ * without handling their roles. Such values only have roles which
+ * matter in the packet and event record headers, which are never
+ * scanned.
  */
-static int fld_cls_decode(struct actf_decoder *dec, const struct actf_fld_cls *cls,
-			  struct actf_fld *val)
+static int dec_plan_run(struct actf_decoder *dec, const struct dec_plan *plan,
+			struct actf_fld *val, bool scan)
 {
-	val->cls = cls;
-	switch (cls->type) {
-	case ACTF_FLD_CLS_NIL:
-		return ACTF_INTERNAL;
-	case ACTF_FLD_CLS_FXD_LEN_BIT_ARR:
-		return fld_cls_fxd_len_bit_arr_decode(dec, cls, val);
-	case ACTF_FLD_CLS_FXD_LEN_BIT_MAP:
-		return fld_cls_fxd_len_bit_map_decode(dec, cls, val);
-	case ACTF_FLD_CLS_FXD_LEN_UINT:
-		return fld_cls_fxd_len_uint_decode(dec, cls, val);
-	case ACTF_FLD_CLS_FXD_LEN_SINT:
-		return fld_cls_fxd_len_sint_decode(dec, cls, val);
-	case ACTF_FLD_CLS_FXD_LEN_BOOL:
-		return fld_cls_fxd_len_bool_decode(dec, cls, val);
-	case ACTF_FLD_CLS_FXD_LEN_FLOAT:
-		return fld_cls_fxd_len_float_decode(dec, cls, val);
-	case ACTF_FLD_CLS_VAR_LEN_UINT:
-		return fld_cls_var_len_uint_decode(dec, cls, val);
-	case ACTF_FLD_CLS_VAR_LEN_SINT:
-		return fld_cls_var_len_sint_decode(dec, cls, val);
-	case ACTF_FLD_CLS_NULL_TERM_STR:
-		return fld_cls_null_term_str_decode(dec, cls, val);
-	case ACTF_FLD_CLS_STATIC_LEN_STR:
-		return fld_cls_static_len_str_decode(dec, cls, val);
-	case ACTF_FLD_CLS_DYN_LEN_STR:
-		return fld_cls_dyn_len_str_decode(dec, cls, val);
-	case ACTF_FLD_CLS_STATIC_LEN_BLOB:
-		return fld_cls_static_len_blob_decode(dec, cls, val);
-	case ACTF_FLD_CLS_DYN_LEN_BLOB:
-		return fld_cls_dyn_len_blob_decode(dec, cls, val);
-	case ACTF_FLD_CLS_STRUCT:
-		return fld_cls_struct_decode(dec, cls, val);
-	case ACTF_FLD_CLS_STATIC_LEN_ARR:
-		return fld_cls_static_len_arr_decode(dec, cls, val);
-	case ACTF_FLD_CLS_DYN_LEN_ARR:
-		return fld_cls_dyn_len_arr_decode(dec, cls, val);
-	case ACTF_FLD_CLS_OPTIONAL:
-		return fld_cls_optional_decode(dec, cls, val);
-	case ACTF_FLD_CLS_VARIANT:
-		return fld_cls_variant_decode(dec, cls, val);
-	case ACTF_N_FLD_CLSES:
-		return ACTF_INTERNAL;
+	int rc;
+	struct error *e = &dec->err;
+	if ((rc = dec_frames_reserve(dec, plan->max_depth)) < 0) {
+		return rc;
 	}
-	return ACTF_INTERNAL;
-}
-
-static void dec_state_init(struct dec_state *dec_s, uint64_t pkt_bit_off)
-{
-	arena_clear(&dec_s->pkt_arena);
+	struct dec_frame *frames = dec->frames;
+	size_t depth = 0;
+	size_t pc = 0;
+	dec->dec_s.in_bounds = NULL;
+
+	for (;;) {
+		const struct dec_op *op = &plan->ops[pc];
+		val->cls = op->cls;
+		if (scan && !op->loc_target) {
+			if ((rc = dec_op_scan(dec, op, val)) < 0) {
+				goto err;
+			} else if (rc) {
+				pc = op->end;
+				goto next;
+			}
+		}
+		switch (op->type) {
+		case DEC_OP_FXD_LEN_BIT_ARR:
+			rc = fld_cls_fxd_len_bit_arr_decode(dec, op, val);
+			break;
+		case DEC_OP_FXD_LEN_BIT_MAP:
+			rc = fld_cls_fxd_len_bit_map_decode(dec, op, val);
+			break;
+		case DEC_OP_FXD_LEN_UINT:
+			rc = fld_cls_fxd_len_uint_decode(dec, op, val);
+			break;
+		case DEC_OP_FXD_LEN_SINT:
+			rc = fld_cls_fxd_len_sint_decode(dec, op, val);
+			break;
+		case DEC_OP_FXD_LEN_BOOL:
+			rc = fld_cls_fxd_len_bool_decode(dec, op, val);
+			break;
+		case DEC_OP_FXD_LEN_FLOAT:
+			rc = fld_cls_fxd_len_float_decode(dec, op, val);
+			break;
+		case DEC_OP_VAR_LEN_UINT:
+			rc = fld_cls_var_len_uint_decode(dec, op, val);
+			break;
+		case DEC_OP_VAR_LEN_SINT:
+			rc = fld_cls_var_len_sint_decode(dec, op, val);
+			break;
+		case DEC_OP_NULL_TERM_STR:
+			rc = fld_cls_null_term_str_decode(dec, op, val);
+			break;
+		case DEC_OP_STATIC_LEN_STR:
+			rc = fld_cls_static_len_str_decode(dec, op, val);
+			break;
+		case DEC_OP_DYN_LEN_STR:
+			rc = fld_cls_dyn_len_str_decode(dec, op, val);
+			break;
+		case DEC_OP_STATIC_LEN_BLOB:
+			rc = fld_cls_static_len_blob_decode(dec, op, val);
+			break;
+		case DEC_OP_DYN_LEN_BLOB:
+			rc = fld_cls_dyn_len_blob_decode(dec, op, val);
+			break;
+		case DEC_OP_STRUCT:
+			if ((rc = fld_cls_struct_begin(dec, op, val)) < 0 || !op->u.n_members) {
+				break;
+			}
+			dec_bounds_enter(dec, op);
+			frames[depth++] = (struct dec_frame) {
+				.op = op,
+				.val = val,
+				.n = op->u.n_members,
+			};
+			val = &frames[depth - 1].val->d.struct_.vals[0];
+			val->parent = frames[depth - 1].val;
+			pc++;
+			continue;
+		case DEC_OP_STATIC_LEN_ARR:
+		case DEC_OP_DYN_LEN_ARR: {
+			size_t len;
+			if ((rc = fld_cls_arr_begin(dec, op, val, &len)) < 0 || !len) {
+				break;
+			}
+			dec_bounds_enter(dec, op);
+			frames[depth++] = (struct dec_frame) {
+				.op = op,
+				.val = val,
+				.n = len,
+				.body = pc + 1,
+			};
+			val = &frames[depth - 1].val->d.arr.vals[0];
+			val->parent = frames[depth - 1].val->parent;
+			pc++;
+			continue;
+		}
+		case DEC_OP_OPTIONAL: {
+			bool enabled;
+			if ((rc = optional_is_enabled(dec, op, val, &enabled)) < 0) {
+				break;
+			}
+			if (!enabled) {
+				val->type = ACTF_FLD_TYPE_NIL;
+				break;
+			}
+			frames[depth++] = (struct dec_frame) {
+				.op = op,
+				.val = val,
+			};
+			pc++;
+			continue;
+		}
+		case DEC_OP_VARIANT:
+			if ((rc = variant_select(dec, plan, pc, val, &pc)) < 0) {
+				break;
+			}
+			frames[depth++] = (struct dec_frame) {
+				.op = op,
+				.val = val,
+			};
+			continue;
+		}
+		if (unlikely(rc < 0)) {
+			goto err;
+		}
+
+		/* val is decoded */
+		pc = op->end;
+		if (op->roles && (rc = handle_fld_roles(dec, op->roles, op->cls, val)) < 0) {
+			/* Role errors are not described by the value holding
+			 * the field with the role. */
+			depth--;
+			goto err;
+		}
+	      next:
+		while (depth) {
+			struct dec_frame *f = &frames[depth - 1];
+			if (f->op->type == DEC_OP_STRUCT) {
+				if (++f->i < f->n) {
+					val = &f->val->d.struct_.vals[f->i];
+					val->parent = f->val;
+					break;
+				}
+			} else if (f->op->type == DEC_OP_STATIC_LEN_ARR ||
+				   f->op->type == DEC_OP_DYN_LEN_ARR) {
+				f->val->d.arr.n_vals++;
+				if (++f->i < f->n) {
+					val = &f->val->d.arr.vals[f->i];
+					val->parent = f->val->parent;
+					pc = f->body;
+					break;
+				}
+			}
+			/* The value of the frame is decoded as well */
+			if (f->op == dec->dec_s.in_bounds) {
+				dec->dec_s.in_bounds = NULL;
+			}
+			val = f->val;
+			pc = f->op->end;
+			depth--;
+		}
+		if (!depth) {
+			return ACTF_OK;
+		}
+	}
+
+      err:
+	while (depth) {
+		dec_frame_eprependf(&frames[--depth], e);
+	}
+	return rc;
+}
+
+static void dec_state_init(struct dec_state *dec_s, uint64_t pkt_bit_off)
+{
+	arena_clear(&dec_s->pkt->arena);
 	arena_clear(&dec_s->ev_arena);
 	pkt_state_init(&dec_s->pkt_s);
 	dec_s->pkt_s.bit_off = pkt_bit_off;
-	actf_pkt_init(&dec_s->pkt, &dec_s->pkt_s);
+	actf_pkt_init(&dec_s->pkt->pkt, &dec_s->pkt->pkt_s);
 	dec_s->ev = NULL;
 }
 
-static int actf_decoder_ev_decode(struct actf_decoder *dec, struct actf_event *ev)
+/* dec_plan_skip moves past a value of plan without decoding it. The
+ * plan must have a static length. */
+static int dec_plan_skip(struct actf_decoder *dec, const struct dec_plan *plan)
+{
+	assert(plan->has_static_len);
+	if (!plan->len) {
+		return ACTF_OK;
+	}
+	return dec_skip_bits(dec, plan->ops[0].align, plan->static_len);
+}
+
+/* ev_scope is a part of an event record following its header. */
+struct ev_scope {
+	const struct dec_plan *plan;
+	enum dec_ctx ctx;
+	enum actf_event_prop prop;
+	const char *name;
+};
+
+#define EV_N_SCOPES 3
+
+/* ev_scopes_init sets up the scopes following the header of an event
+ * record of the event record class evc, in decoding order: the
+ * event-record-common-context-field-class of the data stream class,
+ * specific-context-field-class and payload-field-class of evc. */
+static void ev_scopes_init(const struct dec_state *dec_s, const struct actf_event_cls *evc,
+			   struct ev_scope scopes[EV_N_SCOPES])
+{
+	scopes[0] = (struct ev_scope) {
+		&dec_s->pkt_s.dsc.cls->event_common_ctx_plan, DEC_CTX_EVENT_COMMON_CTX,
+		ACTF_EVENT_PROP_COMMON_CTX, "event-record-common-context-field-class"};
+	scopes[1] = (struct ev_scope) {
+		&evc->spec_ctx_plan, DEC_CTX_EVENT_SPECIFIC_CTX,
+		ACTF_EVENT_PROP_SPECIFIC_CTX, "specific-context-field-class"};
+	scopes[2] = (struct ev_scope) {
+		&evc->payload_plan, DEC_CTX_EVENT_PAYLOAD,
+		ACTF_EVENT_PROP_PAYLOAD, "payload-field-class"};
+}
+
+/* actf_decoder_ev_decode decodes an event record into ev. If the
+ * event record class is filtered out, only the header is decoded, the
+ * rest is skipped over and skipped is set to true. In header mode,
+ * the specific context and payload are skipped over and left NIL. In
+ * lazy mode, they are skipped over and decoded on first access. */
+static int actf_decoder_ev_decode(struct actf_decoder *dec, struct actf_event *ev, bool *skipped)
 {
 	int rc;
 	struct dec_state *dec_s = &dec->dec_s;
 	struct error *e = &dec->err;
 
-	actf_event_init(ev, &dec_s->pkt);
+	actf_event_init(ev, &dec_s->pkt->pkt);
 	struct event_state *ev_s = &ev->ev_s;
 	dec_s->ev = ev;
+	struct arena_mark ev_mark = arena_get_mark(&dec_s->ev_arena);
 
 	/* Decode event-record-header-field-class */
 	if (dec_s->pkt_s.dsc.cls->event_hdr.type != ACTF_FLD_CLS_NIL) {
 		dec_s->ctx = DEC_CTX_EVENT_HEADER;
-		if ((rc = fld_cls_decode(dec, &dec_s->pkt_s.dsc.cls->event_hdr,
-					 &ev->props[ACTF_EVENT_PROP_HEADER])) < 0) {
+		if ((rc = dec_plan_run(dec, &dec_s->pkt_s.dsc.cls->event_hdr_plan,
+					 &ev->props[ACTF_EVENT_PROP_HEADER], false)) < 0) {
 			eprependf(e, "event-record-header-field-class");
 			return rc;
 		}
@@ -1338,36 +1803,188 @@ static int actf_decoder_ev_decode(struct actf_decoder *dec, struct actf_event *e
 			ev_s->id, dec_s->pkt_s.dsc.id);
 		return ACTF_NO_SUCH_ID;
 	}
-	/* Decode event-record-common-context-field-class of dsc */
-	if (dec_s->pkt_s.dsc.cls->event_common_ctx.type != ACTF_FLD_CLS_NIL) {
-		dec_s->ctx = DEC_CTX_EVENT_COMMON_CTX;
-		if ((rc = fld_cls_decode(dec, &dec_s->pkt_s.dsc.cls->event_common_ctx,
-					 &ev->props[ACTF_EVENT_PROP_COMMON_CTX])) < 0) {
-			eprependf(e, "event-record-common-context-field-class");
-			return rc;
+
+	struct ev_scope scopes[EV_N_SCOPES];
+	ev_scopes_init(dec_s, ev_s->cls, scopes);
+	/* The scopes [0, n_keep) are kept in the event */
+	size_t n_keep = ARRLEN(scopes);
+	*skipped = dec->skip_evcs && dec->skip_evcs[ev_s->cls->idx];
+	if (*skipped) {
+		n_keep = 0;
+	} else if (dec->mode != ACTF_DECODER_MODE_FULL) {
+		n_keep = 1;
+	}
+	/* A scope can only be skipped without being scanned if no scope
+	 * after it is scanned, since a field location of a later scope
+	 * can point into it. */
+	size_t n_decode = ARRLEN(scopes);
+	bool scan = true;
+	while (n_decode > n_keep && scopes[n_decode - 1].plan->has_static_len) {
+		n_decode--;
+	}
+	/* Scanning only decodes the lengths and selectors, which are
+	 * known if the field locations are resolved */
+	for (size_t i = n_keep; i < n_decode; i++) {
+		scan = scan && scopes[i].plan->locs_resolved;
+	}
+	/* Scopes which would have to be fully decoded to get past them
+	 * are decoded right away in lazy mode */
+	bool lazy = !*skipped && dec->mode == ACTF_DECODER_MODE_LAZY;
+	if (lazy && !scan && n_decode > n_keep) {
+		n_keep = n_decode = ARRLEN(scopes);
+	}
+	struct arena_mark drop_mark = ev_mark;
+	for (size_t i = 0; i < ARRLEN(scopes); i++) {
+		const struct ev_scope *scope = &scopes[i];
+		if (i == n_keep) {
+			drop_mark = arena_get_mark(&dec_s->ev_arena);
+			if (lazy) {
+				ev_s->lazy_bit_off = dec->br.tot_bit_cnt;
+			}
 		}
-	}
-	/* Decode specific-context-field-class of erc */
-	if (ev_s->cls->spec_ctx.type != ACTF_FLD_CLS_NIL) {
-		dec_s->ctx = DEC_CTX_EVENT_SPECIFIC_CTX;
-		if ((rc = fld_cls_decode(dec, &ev_s->cls->spec_ctx,
-					 &ev->props[ACTF_EVENT_PROP_SPECIFIC_CTX])) < 0) {
-			eprependf(e, "specific-context-field-class");
+		if (!scope->plan->len) {
+			continue;
+		}
+		dec_s->ctx = scope->ctx;
+		if (i < n_keep) {
+			rc = dec_plan_run(dec, scope->plan, &ev->props[scope->prop], false);
+		} else {
+			if (i < n_decode) {
+				rc = dec_plan_run(dec, scope->plan, &ev->props[scope->prop], scan);
+			} else {
+				rc = dec_plan_skip(dec, scope->plan);
+			}
+			ev->lazy_dec = lazy ? dec : NULL;
+		}
+		if (rc < 0) {
+			eprependf(e, "%s", scope->name);
 			return rc;
 		}
 	}
-	/* Decode payload-field-class of erc */
-	if (ev_s->cls->payload.type != ACTF_FLD_CLS_NIL) {
-		dec_s->ctx = DEC_CTX_EVENT_PAYLOAD;
-		if ((rc = fld_cls_decode(dec, &ev_s->cls->payload,
-					 &ev->props[ACTF_EVENT_PROP_PAYLOAD])) < 0) {
-			eprependf(e, "payload-field-class");
-			return rc;
+	if (*skipped) {
+		/* Nothing refers to the fields of a skipped event */
+		arena_rewind(&dec_s->ev_arena, ev_mark);
+	} else if (n_keep < n_decode) {
+		/* Drop the scopes which were only scanned to get past them */
+		arena_rewind(&dec_s->ev_arena, drop_mark);
+		for (size_t i = n_keep; i < n_decode; i++) {
+			struct actf_fld *val = &ev->props[scopes[i].prop];
+			val->type = ACTF_FLD_TYPE_NIL;
+			val->cls = NULL;
 		}
 	}
 	return ACTF_OK;
 }
 
+int actf_decoder_ev_lazy_decode(struct actf_decoder *dec, struct actf_event *ev)
+{
+	int rc = ACTF_OK;
+	struct dec_state *dec_s = &dec->dec_s;
+	struct error *e = &dec->err;
+	assert(ev->lazy_dec == dec);
+	ev->lazy_dec = NULL;
+
+	/* The event belongs to the packet being decoded, only the
+	 * position and what it affects needs to be restored. */
+	struct breader br = dec->br;
+	struct pkt_state pkt_s = dec_s->pkt_s;
+	struct actf_event *cur_ev = dec_s->ev;
+	enum dec_ctx ctx = dec_s->ctx;
+
+	breader_seek(&dec->br, ev->ev_s.lazy_bit_off / 8, BREADER_SEEK_SET);
+	breader_consume_checked(&dec->br, ev->ev_s.lazy_bit_off % 8);
+	/* The byte order of the value before the skipped scopes is not
+	 * kept */
+	dec_s->pkt_s.opt_flags &= ~PKT_LAST_BO;
+	dec_s->ev = ev;
+
+	struct ev_scope scopes[EV_N_SCOPES];
+	ev_scopes_init(dec_s, ev->ev_s.cls, scopes);
+	for (size_t i = 1; i < ARRLEN(scopes); i++) {
+		const struct ev_scope *scope = &scopes[i];
+		if (!scope->plan->len) {
+			continue;
+		}
+		dec_s->ctx = scope->ctx;
+		if ((rc = dec_plan_run(dec, scope->plan, &ev->props[scope->prop], false)) < 0) {
+			eprependf(e, "%s", scope->name);
+			for (i = 1; i < ARRLEN(scopes); i++) {
+				ev->props[scopes[i].prop].type = ACTF_FLD_TYPE_NIL;
+				ev->props[scopes[i].prop].cls = NULL;
+			}
+			break;
+		}
+	}
+
+	dec->br = br;
+	dec_s->pkt_s = pkt_s;
+	dec_s->ev = cur_ev;
+	dec_s->ctx = ctx;
+	return rc;
+}
+
+/* pkt_retire leaves the packet being decoded as it is if the events of
+ * the previous decode call belong to it, the next packet is then
+ * decoded into the next packet buffer. Events of different packets
+ * are never returned by the same decode call, so the packet buffer
+ * taken holds a packet whose events are older than those of the last
+ * n_bufs decode calls. */
+static void pkt_retire(struct actf_decoder *dec)
+{
+	if (!dec->prev_evs_in_pkt) {
+		return;
+	}
+	struct dec_state *dec_s = &dec->dec_s;
+	dec_s->pkt = dec_s->pkts + (dec_s->pkt - dec_s->pkts + 1) % dec_s->n_pkts;
+	dec->prev_evs_in_pkt = false;
+}
+
+/* advise_drop advises the kernel to reclaim the len bytes of pages at
+ * addr before others. Unlike MADV_DONTNEED, neither zero-fills
+ * anonymous memory. */
+static void advise_drop(void __maybe_unused *addr, size_t __maybe_unused len)
+{
+#ifdef MADV_COLD
+	if (madvise(addr, len, MADV_COLD) == 0 || errno != EINVAL) {
+		return;
+	}
+#endif
+#ifdef MADV_PAGEOUT
+	madvise(addr, len, MADV_PAGEOUT);
+#endif
+}
+
+/* advise_pkt advises the kernel about the data around the packet at
+ * the byte offset pkt_off, see actf_decoder_cfg.advise_window. The
+ * window ahead is read ahead once half of the previous one has been
+ * decoded and the pages further behind than the window are dropped in
+ * batches of at least a window. The hints are best effort, any
+ * failure is ignored. */
+static void advise_pkt(struct actf_decoder *dec, size_t pkt_off)
+{
+	size_t window = dec->advise_window;
+	const struct breader *br = &dec->br;
+	size_t len = br->end_ptr - br->start_ptr;
+	uintptr_t base = (uintptr_t) br->start_ptr;
+	uintptr_t page_sz = (uintptr_t) sysconf(_SC_PAGESIZE);
+	if (dec->advised_off < len && pkt_off + window / 2 >= dec->advised_off) {
+		uintptr_t lo = (base + MAX(pkt_off, dec->advised_off)) / page_sz * page_sz;
+		size_t end = len - pkt_off > window ? pkt_off + window : len;
+		if (base + end > lo) {
+			madvise((void *) lo, base + end - lo, MADV_WILLNEED);
+		}
+		dec->advised_off = end;
+	}
+	if (pkt_off >= window && pkt_off - window >= dec->dropped_off + window) {
+		uintptr_t lo = (base + dec->dropped_off + page_sz - 1) / page_sz * page_sz;
+		uintptr_t hi = (base + pkt_off - window) / page_sz * page_sz;
+		if (hi > lo) {
+			advise_drop((void *) lo, hi - lo);
+		}
+		dec->dropped_off = pkt_off - window;
+	}
+}
+
 /* actf_decoder_pkt_hdrctx_decode resets the decoding state and
  * decodes a packet-header and packet-context at the current bit
  * offset. */
@@ -1379,18 +1996,22 @@ static int actf_decoder_pkt_hdrctx_decode(struct actf_decoder *dec)
 	struct dec_state *dec_s = &dec->dec_s;
 	struct error *e = &dec->err;
 
+	pkt_retire(dec);
 	dec_state_init(dec_s, br->tot_bit_cnt);
+	if (dec->advise_window) {
+		advise_pkt(dec, (size_t) (br->tot_bit_cnt / 8));
+	}
 
 	/* Decode packet-header-field-class */
 	if (metadata->trace_cls.pkt_hdr.type != ACTF_FLD_CLS_NIL) {
 		/* To follow the spec, the role behavior should be done after
 		 * each field has been decoded and not after the whole header
 		 * has been decoded. Thus roles are handled inline during the
-		 * fld_cls_decode in `handle_fld_roles`.
+		 * dec_plan_run in `handle_fld_roles`.
 		 */
 		dec_s->ctx = DEC_CTX_PKT_HEADER;
-		if ((rc = fld_cls_decode(dec, &metadata->trace_cls.pkt_hdr,
-					 &dec_s->pkt.props[ACTF_PKT_PROP_HEADER])) < 0) {
+		if ((rc = dec_plan_run(dec, &metadata->trace_cls.pkt_hdr_plan,
+					 &dec_s->pkt->pkt.props[ACTF_PKT_PROP_HEADER], false)) < 0) {
 			eprependf(e, "packet-header-field-class");
 			return rc;
 		}
@@ -1408,8 +2029,8 @@ static int actf_decoder_pkt_hdrctx_decode(struct actf_decoder *dec)
 	if (dec_s->pkt_s.dsc.cls->pkt_ctx.type != ACTF_FLD_CLS_NIL) {
 		/* See role comment by packet-header decoding */
 		dec_s->ctx = DEC_CTX_PKT_CTX;
-		if ((rc = fld_cls_decode(dec, &dec_s->pkt_s.dsc.cls->pkt_ctx,
-					 &dec_s->pkt.props[ACTF_PKT_PROP_CTX])) < 0) {
+		if ((rc = dec_plan_run(dec, &dec_s->pkt_s.dsc.cls->pkt_ctx_plan,
+					 &dec_s->pkt->pkt.props[ACTF_PKT_PROP_CTX], false)) < 0) {
 			eprependf(e, "packet-context-field-class");
 			return rc;
 		}
@@ -1435,6 +2056,7 @@ static int actf_decoder_pkt_hdrctx_decode(struct actf_decoder *dec)
 			return ACTF_INVALID_CONTENT_LEN;
 		}
 	}
+	dec_s->pkt->pkt_s = dec_s->pkt_s;
 
 	return ACTF_OK;
 }
@@ -1459,10 +2081,13 @@ static int actf_decoder_pkt_decode(struct actf_decoder *dec, size_t *evs_len)
 			dec->state |= DECODING_STATE_RESUME_PKT;
 			return ACTF_OK;
 		}
-		if ((rc = actf_decoder_ev_decode(dec, dec->evs[*evs_len])) < 0) {
+		bool skipped;
+		if ((rc = actf_decoder_ev_decode(dec, dec->evs[*evs_len], &skipped)) < 0) {
 			return rc;
 		}
-		*evs_len += 1;
+		if (!skipped) {
+			*evs_len += 1;
+		}
 	}
 
 	if (dec_s->pkt_s.tot_len != UINT64_MAX && dec_s->pkt_s.content_len != UINT64_MAX) {
@@ -1475,14 +2100,86 @@ static int actf_decoder_pkt_decode(struct actf_decoder *dec, size_t *evs_len)
 	return ACTF_OK;
 }
 
-struct actf_decoder *actf_decoder_init(void *data, size_t data_len, size_t evs_cap,
-				       const struct actf_metadata *metadata)
+static bool event_cls_sel_match(const struct actf_event_cls_sel *sel,
+				const struct actf_event_cls *evc)
+{
+	if (!sel->name) {
+		return sel->id == evc->id;
+	}
+	if (!evc->name || strcmp(sel->name, evc->name) != 0) {
+		return false;
+	}
+	return !sel->namespace || (evc->namespace && strcmp(sel->namespace, evc->namespace) == 0);
+}
+
+/* skip_evcs_init applies filter to every event record class of
+ * metadata. The returned array tells, by event record class index,
+ * whether the events of a class are filtered out. NULL is returned
+ * with errno set on failure. */
+static bool *skip_evcs_init(const struct actf_metadata *metadata,
+			    const struct actf_event_cls_filter *filter)
+{
+	bool *skip_evcs = calloc(MAX(metadata->n_evcs, 1), sizeof(*skip_evcs));
+	if (!skip_evcs) {
+		return NULL;
+	}
+	bool deny = filter->mode == ACTF_EVENT_CLS_FILTER_DENY;
+	uint64_t id;
+	struct actf_dstream_cls *dsc;
+	struct u64todsc_it dsc_it = { 0 };
+	while (u64todsc_foreach(&metadata->idtodsc, &id, &dsc, &dsc_it) == 0) {
+		struct actf_event_cls *evc;
+		struct u64toevc_it evc_it = { 0 };
+		while (u64toevc_foreach(&dsc->idtoevc, &id, &evc, &evc_it) == 0) {
+			bool selected = false;
+			for (size_t i = 0; i < filter->sels_len && !selected; i++) {
+				selected = event_cls_sel_match(&filter->sels[i], evc);
+			}
+			skip_evcs[evc->idx] = selected == deny;
+		}
+	}
+	return skip_evcs;
+}
+
+/* dec_bufs_init allocates n_bufs event buffers, evs being the event
+ * array of the first one. */
+static struct dec_buf *dec_bufs_init(size_t n_bufs, struct actf_event **evs, size_t evs_cap)
+{
+	struct dec_buf *bufs = calloc(n_bufs, sizeof(*bufs));
+	if (!bufs) {
+		return NULL;
+	}
+	for (size_t i = 0; i < n_bufs; i++) {
+		if (i == 0) {
+			bufs[i].evs = evs;
+		} else if (!(bufs[i].evs = actf_event_arr_alloc(evs_cap))) {
+			goto err;
+		}
+		// An event arena holds evs_cap event
+		// header/context/payload at a time.
+		bufs[i].ev_arena = (struct arena) {.default_cap =
+			    16 * sizeof(struct actf_fld) * evs_cap };
+	}
+	return bufs;
+
+      err:
+	for (size_t i = 1; i < n_bufs; i++) {
+		actf_event_arr_free(bufs[i].evs);
+	}
+	free(bufs);
+	return NULL;
+}
+
+struct actf_decoder *actf_decoder_init_cfg(void *data, size_t data_len,
+					   const struct actf_metadata *metadata,
+					   struct actf_decoder_cfg cfg)
 {
 	struct actf_decoder *dec = malloc(sizeof(*dec));
 	if (!dec) {
 		return NULL;
 	}
 	dec->err = ERROR_EMPTY;
+	size_t evs_cap = cfg.evs_cap;
 	if (evs_cap == 0) {
 		evs_cap = ACTF_DEFAULT_EVS_CAP;
 	}
@@ -1492,20 +2189,399 @@ struct actf_decoder *actf_decoder_init(void *data, size_t data_len, size_t evs_c
 		free(dec);
 		return NULL;
 	}
+	bool *skip_evcs = NULL;
+	if (cfg.evc_filter.mode != ACTF_EVENT_CLS_FILTER_NONE &&
+	    !(skip_evcs = skip_evcs_init(metadata, &cfg.evc_filter))) {
+		actf_event_arr_free(evs);
+		error_free(&dec->err);
+		free(dec);
+		return NULL;
+	}
+	/* A lazily decoded event needs the decoding state of its packet,
+	 * which only exists as long as no other packet is decoded. */
+	size_t n_bufs = cfg.mode == ACTF_DECODER_MODE_LAZY ? 1 : MAX(cfg.n_bufs, 1);
+	struct dec_buf *bufs = NULL;
+	struct dec_pkt *pkts = calloc(n_bufs, sizeof(*pkts));
+	if (!pkts || !(bufs = dec_bufs_init(n_bufs, evs, evs_cap))) {
+		free(pkts);
+		free(skip_evcs);
+		actf_event_arr_free(evs);
+		error_free(&dec->err);
+		free(dec);
+		return NULL;
+	}
 
 	dec->state = DECODING_STATE_OK;
 	dec->metadata = metadata;
 	breader_init(data, data_len, ACTF_LIL_ENDIAN, &dec->br);
 	dec->evs = evs;
 	dec->evs_cap = evs_cap;
-	// The packet arena holds a single packet header/context at a time.
-	dec->dec_s.pkt_arena = (struct arena) {.default_cap = 16 * sizeof(struct actf_fld) };
-	// The event arena holds evs_cap event header/context/payload at a time.
-	dec->dec_s.ev_arena = (struct arena) {.default_cap =
-		    16 * sizeof(struct actf_fld) * evs_cap };
+	dec->has_idx = false;
+	dec->idx = (struct pkt_idx) { 0 };
+	dec->idx_entries = (struct pkt_idx_entry_vec) { 0 };
+	dec->frames = NULL;
+	dec->frames_cap = 0;
+	dec->skip_evcs = skip_evcs;
+	dec->mode = cfg.mode;
+	dec->n_bufs = n_bufs;
+	dec->bufs = bufs;
+	dec->buf_i = 0;
+	dec->prev_evs_in_pkt = false;
+	dec->feed = NULL;
+	dec->iovs = NULL;
+	dec->advise_window = cfg.advise_window;
+	dec->advised_off = 0;
+	dec->dropped_off = 0;
+	if (cfg.advise_window && data_len) {
+		uintptr_t page_sz = (uintptr_t) sysconf(_SC_PAGESIZE);
+		uintptr_t lo = (uintptr_t) data / page_sz * page_sz;
+		madvise((void *) lo, (uintptr_t) data + data_len - lo, MADV_SEQUENTIAL);
+	}
+	// A packet arena holds a single packet header/context at a time.
+	for (size_t i = 0; i < n_bufs; i++) {
+		pkts[i].arena = (struct arena) {.default_cap = 16 * sizeof(struct actf_fld) };
+	}
+	dec->dec_s.pkts = pkts;
+	dec->dec_s.n_pkts = n_bufs;
+	dec->dec_s.pkt = &pkts[0];
+	dec->dec_s.ev_arena = bufs[0].ev_arena;
+	return dec;
+}
+
+struct actf_decoder *actf_decoder_init(void *data, size_t data_len, size_t evs_cap,
+				       const struct actf_metadata *metadata)
+{
+	struct actf_decoder_cfg cfg = {.evs_cap = evs_cap };
+	return actf_decoder_init_cfg(data, data_len, metadata, cfg);
+}
+
+void actf_decoder_reset(struct actf_decoder *dec, void *data, size_t data_len)
+{
+	dec->state = DECODING_STATE_OK;
+	breader_init(data, data_len, ACTF_LIL_ENDIAN, &dec->br);
+	dec->has_idx = false;
+	dec->idx = (struct pkt_idx) { 0 };
+	dec->idx_entries.len = 0;
+	dec->prev_evs_in_pkt = false;
+	dec->advised_off = 0;
+	dec->dropped_off = 0;
+	dec_state_init(&dec->dec_s, 0);
+}
+
+actf_decoder *actf_decoder_init_fed(const actf_metadata *metadata, struct actf_decoder_cfg cfg)
+{
+	struct feed *feed = calloc(1, sizeof(*feed));
+	if (!feed) {
+		return NULL;
+	}
+	// The fed data is not mmapped
+	cfg.advise_window = 0;
+	struct actf_decoder *dec = actf_decoder_init_cfg(NULL, 0, metadata, cfg);
+	if (!dec) {
+		free(feed);
+		return NULL;
+	}
+	dec->feed = feed;
+	return dec;
+}
+
+actf_decoder *actf_decoder_init_iov(const struct iovec *iov, size_t iovcnt,
+				    const actf_metadata *metadata, struct actf_decoder_cfg cfg)
+{
+	struct iovs *iovs = malloc(sizeof(*iovs));
+	if (!iovs) {
+		return NULL;
+	}
+	*iovs = (struct iovs) {.iovcnt = iovcnt };
+	if (iovcnt && !(iovs->iov = malloc(iovcnt * sizeof(*iov)))) {
+		free(iovs);
+		return NULL;
+	}
+	if (iovcnt) {
+		memcpy(iovs->iov, iov, iovcnt * sizeof(*iov));
+	}
+	cfg.advise_window = 0;
+	struct actf_decoder *dec = actf_decoder_init_cfg(NULL, 0, metadata, cfg);
+	if (!dec) {
+		free(iovs->iov);
+		free(iovs);
+		return NULL;
+	}
+	dec->iovs = iovs;
 	return dec;
 }
 
+/* iovs_next makes the decoder read the next non-empty segment. 1 is
+ * returned if there is one, 0 if all of them are decoded. */
+static int iovs_next(struct actf_decoder *dec)
+{
+	struct iovs *iovs = dec->iovs;
+	while (iovs->iov_i < iovs->iovcnt) {
+		struct iovec *iov = &iovs->iov[iovs->iov_i++];
+		if (iov->iov_len) {
+			breader_init(iov->iov_base, iov->iov_len, ACTF_LIL_ENDIAN, &dec->br);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void iovs_free(struct iovs *iovs)
+{
+	if (!iovs) {
+		return;
+	}
+	free(iovs->iov);
+	free(iovs);
+}
+
+/* feed_spare_get takes the largest spare buffer of feed as the
+ * staging buffer, which is empty, if there is any. */
+static void feed_spare_get(struct feed *feed)
+{
+	if (!feed->n_spares) {
+		return;
+	}
+	size_t max_i = 0;
+	for (size_t i = 1; i < feed->n_spares; i++) {
+		if (feed->spares[i].cap > feed->spares[max_i].cap) {
+			max_i = i;
+		}
+	}
+	free(feed->staging);
+	feed->staging = feed->spares[max_i].data;
+	feed->staging_cap = feed->spares[max_i].cap;
+	feed->spares[max_i] = feed->spares[--feed->n_spares];
+}
+
+/* feed_spare_put keeps the buffer data of capacity cap to be reused,
+ * the smallest buffer is freed if there are too many. */
+static void feed_spare_put(struct feed *feed, uint8_t *data, size_t cap)
+{
+	if (feed->n_spares < FEED_MAX_SPARES) {
+		feed->spares[feed->n_spares++] = (struct spare_buf) {.data = data,.cap = cap };
+		return;
+	}
+	size_t min_i = 0;
+	for (size_t i = 1; i < feed->n_spares; i++) {
+		if (feed->spares[i].cap < feed->spares[min_i].cap) {
+			min_i = i;
+		}
+	}
+	if (feed->spares[min_i].cap < cap) {
+		free(feed->spares[min_i].data);
+		feed->spares[min_i] = (struct spare_buf) {.data = data,.cap = cap };
+	} else {
+		free(data);
+	}
+}
+
+int actf_decoder_feed(actf_decoder *dec, const void *data, size_t len)
+{
+	struct feed *feed = dec->feed;
+	if (!feed) {
+		eprintf(&dec->err, "the decoder is not fed");
+		return ACTF_ERROR;
+	}
+	if (feed->ended) {
+		eprintf(&dec->err, "the fed data stream has ended");
+		return ACTF_ERROR;
+	}
+	if (!feed->staging) {
+		feed_spare_get(feed);
+	}
+	if (len > feed->staging_cap - feed->staging_len) {
+		size_t cap = MAX(feed->staging_cap * 2, feed->staging_len + len);
+		uint8_t *staging = realloc(feed->staging, cap);
+		if (!staging) {
+			eprintf(&dec->err, "realloc: %s", strerror(errno));
+			return ACTF_OOM;
+		}
+		feed->staging = staging;
+		feed->staging_cap = cap;
+	}
+	if (len) {
+		memcpy(feed->staging + feed->staging_len, data, len);
+		feed->staging_len += len;
+	}
+	return ACTF_OK;
+}
+
+int actf_decoder_feed_end(actf_decoder *dec)
+{
+	if (!dec->feed) {
+		eprintf(&dec->err, "the decoder is not fed");
+		return ACTF_ERROR;
+	}
+	dec->feed->ended = true;
+	return ACTF_OK;
+}
+
+/* feed_free_retired releases the retired buffers which none of the
+ * events in use refer to to be reused. A buffer retired during decode
+ * call k is referred to by the events of at most the n_bufs - 1 calls
+ * before k. */
+static void feed_free_retired(struct actf_decoder *dec)
+{
+	struct feed *feed = dec->feed;
+	size_t n_kept = 0;
+	for (size_t i = 0; i < feed->retired_len; i++) {
+		struct retired_buf *rb = &feed->retired[i];
+		if (feed->decode_no >= rb->decode_no + dec->n_bufs - 1) {
+			feed_spare_put(feed, rb->data, rb->cap);
+		} else {
+			feed->retired[n_kept++] = *rb;
+		}
+	}
+	feed->retired_len = n_kept;
+}
+
+/* feed_probe returns the probe of the fed decoder dec reset to its
+ * staging buffer, or NULL with an error if it can not be created. */
+static struct actf_decoder *feed_probe(struct actf_decoder *dec)
+{
+	struct feed *feed = dec->feed;
+	if (!feed->probe) {
+		feed->probe = actf_decoder_init(NULL, 0, 1, dec->metadata);
+		if (!feed->probe) {
+			eprintf(&dec->err, "actf_decoder_init: %s", strerror(errno));
+			return NULL;
+		}
+	}
+	actf_decoder_reset(feed->probe, feed->staging, feed->staging_len);
+	return feed->probe;
+}
+
+/* feed_probe_complete extends the complete packets at the start of
+ * the staging buffer with the ones which have been fed since. A
+ * packet is complete once its total length is in the buffer. Once the
+ * data stream has ended or a packet header or packet context is
+ * invalid, all of the fed data is made complete, the decoder then
+ * takes care of any error. */
+static int feed_probe_complete(struct actf_decoder *dec)
+{
+	struct feed *feed = dec->feed;
+	struct actf_decoder *probe = feed_probe(dec);
+	if (!probe) {
+		return ACTF_OOM;
+	}
+	struct breader *br = &probe->br;
+	struct pkt_state *pkt_s = &probe->dec_s.pkt_s;
+	uint64_t data_bits = (uint64_t) feed->staging_len * 8;
+	bool invalid = false;
+	breader_seek(br, feed->complete_len, BREADER_SEEK_SET);
+	while (breader_has_bits_remaining(br)) {
+		uint64_t pkt_off = br->tot_bit_cnt;
+		int rc = actf_decoder_pkt_hdrctx_decode(probe);
+		if (rc < 0) {
+			invalid = rc != ACTF_NOT_ENOUGH_BITS;
+			break;
+		}
+		// A packet without a total length lasts until the end
+		if (pkt_s->tot_len == UINT64_MAX) {
+			break;
+		}
+		uint64_t next_off = sataddu64(pkt_s->bit_off, pkt_s->tot_len);
+		if (next_off % 8 || next_off <= pkt_off) {
+			invalid = true;
+			break;
+		}
+		if (next_off > data_bits) {
+			break;
+		}
+		feed->complete_len = next_off / 8;
+		breader_seek(br, feed->complete_len, BREADER_SEEK_SET);
+	}
+	if (feed->ended || invalid) {
+		feed->complete_len = feed->staging_len;
+	}
+	return ACTF_OK;
+}
+
+/* feed_next makes the decoder read the complete packets of the
+ * staging buffer, the rest of it is moved to a new staging buffer,
+ * which is a spare buffer if there is one. The current data is
+ * retired. 1 is returned if there is anything to read, 0 if more data
+ * needs to be fed or the data stream has ended. */
+static int feed_next(struct actf_decoder *dec)
+{
+	int rc;
+	struct feed *feed = dec->feed;
+	if ((rc = feed_probe_complete(dec)) < 0) {
+		return rc;
+	}
+	if (feed->complete_len == 0) {
+		return 0;
+	}
+	if (feed->data && feed->retired_len == feed->retired_cap) {
+		size_t cap = MAX(feed->retired_cap * 2, 2);
+		struct retired_buf *retired = realloc(feed->retired, cap * sizeof(*retired));
+		if (!retired) {
+			eprintf(&dec->err, "realloc: %s", strerror(errno));
+			return ACTF_OOM;
+		}
+		feed->retired = retired;
+		feed->retired_cap = cap;
+	}
+	size_t tail_len = feed->staging_len - feed->complete_len;
+	uint8_t *staging = NULL;
+	size_t staging_cap = 0;
+	if (tail_len) {
+		struct spare_buf spare = { 0 };
+		for (size_t i = 0; i < feed->n_spares; i++) {
+			if (feed->spares[i].cap >= tail_len) {
+				spare = feed->spares[i];
+				feed->spares[i] = feed->spares[--feed->n_spares];
+				break;
+			}
+		}
+		staging = spare.data;
+		staging_cap = spare.cap;
+		if (!staging) {
+			staging_cap = MAX(tail_len, feed->staging_cap / 2);
+			if (!(staging = malloc(staging_cap))) {
+				eprintf(&dec->err, "malloc: %s", strerror(errno));
+				return ACTF_OOM;
+			}
+		}
+		memcpy(staging, feed->staging + feed->complete_len, tail_len);
+	}
+	if (feed->data) {
+		feed->retired[feed->retired_len++] = (struct retired_buf) {
+			.data = feed->data,
+			.cap = feed->data_cap,
+			.decode_no = feed->decode_no,
+		};
+	}
+	feed->data = feed->staging;
+	feed->data_cap = feed->staging_cap;
+	breader_init(feed->data, feed->complete_len, ACTF_LIL_ENDIAN, &dec->br);
+	feed->staging = staging;
+	feed->staging_cap = staging_cap;
+	feed->staging_len = tail_len;
+	feed->complete_len = 0;
+	feed_free_retired(dec);
+	return 1;
+}
+
+static void feed_free(struct feed *feed)
+{
+	if (!feed) {
+		return;
+	}
+	for (size_t i = 0; i < feed->retired_len; i++) {
+		free(feed->retired[i].data);
+	}
+	for (size_t i = 0; i < feed->n_spares; i++) {
+		free(feed->spares[i].data);
+	}
+	free(feed->retired);
+	free(feed->data);
+	free(feed->staging);
+	actf_decoder_free(feed->probe);
+	free(feed);
+}
+
 int actf_decoder_decode(actf_decoder *dec, struct actf_event ***evs, size_t *evs_len)
 {
 	int rc;
@@ -1519,20 +2595,62 @@ int actf_decoder_decode(actf_decoder *dec, struct actf_event ***evs, size_t *evs
 		*evs = NULL;
 		return dec->err_rc;
 	}
+	if (dec->n_bufs > 1) {
+		/* The previous events are kept in the other buffers */
+		dec->bufs[dec->buf_i] = (struct dec_buf) {
+			.evs = dec->evs,
+			.ev_arena = dec->dec_s.ev_arena,
+		};
+		dec->buf_i = (dec->buf_i + 1) % dec->n_bufs;
+		dec->evs = dec->bufs[dec->buf_i].evs;
+		dec->dec_s.ev_arena = dec->bufs[dec->buf_i].ev_arena;
+	}
 	*evs_len = 0;
 	*evs = dec->evs;
-	if (breader_has_bits_remaining(&dec->br)) {
+	if (dec->feed) {
+		dec->feed->decode_no++;
+		feed_free_retired(dec);
+	}
+	// A packet can be decoded without yielding any events if all of
+	// them are filtered out, decoding then goes on with the next.
+	while (*evs_len == 0) {
+		if (!breader_has_bits_remaining(&dec->br)) {
+			if (dec->feed) {
+				rc = feed_next(dec);
+			} else if (dec->iovs) {
+				rc = iovs_next(dec);
+			} else {
+				rc = 0;
+			}
+			if (rc == 0) {
+				break;
+			} else if (rc < 0) {
+				dec->state |= DECODING_STATE_ERROR;
+				dec->err_rc = rc;
+				return rc;
+			}
+		}
 		// Run actf_decoder_pkt_decode until:
 		// 1. A packet is fully decoded
 		// 2. The output buffer is full
 		// 3. An error has occurred.
+		uint64_t bit_cnt = dec->br.tot_bit_cnt;
 		if ((rc = actf_decoder_pkt_decode(dec, evs_len)) < 0) {
 			dec->state |= DECODING_STATE_ERROR;
 			dec->err_rc = rc;
 			if (*evs_len == 0) {
 				return rc;
 			}
+			break;
 		}
+		if (dec->br.tot_bit_cnt == bit_cnt) {
+			// An empty packet which does not move the decoding
+			// forward.
+			break;
+		}
+	}
+	if (*evs_len) {
+		dec->prev_evs_in_pkt = dec->n_bufs > 1;
 	}
 	return ACTF_OK;
 }
@@ -1543,14 +2661,224 @@ static int decoder_decode(void *self, struct actf_event ***evs, size_t *evs_len)
 	return actf_decoder_decode(dec, evs, evs_len);
 }
 
+/* pkt_idx_entry_from_pkt_state fills an index entry with the packet
+ * described by pkt_s. prev_max_end_ns is the max_end_ns of the
+ * preceding entry. */
+static void pkt_idx_entry_from_pkt_state(const struct pkt_state *pkt_s, int64_t prev_max_end_ns,
+					 struct pkt_idx_entry *entry)
+{
+	const actf_clk_cls *clkc = actf_dstream_cls_clk_cls(pkt_s->dsc.cls);
+	int64_t end_ns = INT64_MAX;
+	if (clkc && (pkt_s->opt_flags & PKT_END_DEF_CLK_VAL)) {
+		end_ns = actf_clk_cls_cc_to_ns_from_origin(clkc, pkt_s->end_def_clk_val);
+	}
+	*entry = (struct pkt_idx_entry) {
+		.bit_off = pkt_s->bit_off,
+		.tot_len = pkt_s->tot_len,
+		.content_len = pkt_s->content_len,
+		.begin_def_clk_val = pkt_s->begin_def_clk_val,
+		.end_def_clk_val = pkt_s->opt_flags & PKT_END_DEF_CLK_VAL ? pkt_s->end_def_clk_val : 0,
+		.seq_num = pkt_s->opt_flags & PKT_SEQ_NUM ? pkt_s->seq_num : 0,
+		.disc_er_snap = pkt_s->opt_flags & PKT_DISC_ER_SNAP ? pkt_s->disc_er_snap : 0,
+		.dsc_id = pkt_s->dsc.id,
+		.max_end_ns = MAX(prev_max_end_ns, end_ns),
+		.opt_flags = pkt_s->opt_flags &
+		    (PKT_DISC_ER_SNAP | PKT_END_DEF_CLK_VAL | PKT_SEQ_NUM),
+	};
+}
+
+/* actf_decoder_build_pkt_idx indexes the packets of the data stream
+ * by decoding only their packet header and packet context. Indexing
+ * stops at the first packet which can not be fully skipped over, any
+ * such packet is left to be handled by a regular decoding. The
+ * decoding state is left reset. No advice is given while indexing,
+ * only the packet headers and packet contexts are read. */
+static int actf_decoder_build_pkt_idx(struct actf_decoder *dec)
+{
+	int rc = ACTF_OK;
+	size_t advise_window = dec->advise_window;
+	dec->advise_window = 0;
+	struct breader *br = &dec->br;
+	struct pkt_state *pkt_s = &dec->dec_s.pkt_s;
+	struct pkt_idx_entry_vec *entries = &dec->idx_entries;
+	uint64_t data_bits = (uint64_t) (br->end_ptr - br->start_ptr) * 8;
+
+	entries->len = 0;
+	breader_seek(br, 0, BREADER_SEEK_SET);
+	while (breader_has_bits_remaining(br)) {
+		uint64_t pkt_off = br->tot_bit_cnt;
+		if (actf_decoder_pkt_hdrctx_decode(dec) < 0) {
+			break;
+		}
+		uint64_t next_off = sataddu64(pkt_s->bit_off, pkt_s->tot_len);
+		if (pkt_s->tot_len == UINT64_MAX || next_off > data_bits ||
+		    next_off % 8 || next_off <= pkt_off) {
+			break;
+		}
+		struct pkt_idx_entry entry;
+		int64_t prev_max_end_ns = entries->len ?
+		    entries->data[entries->len - 1].max_end_ns : INT64_MIN;
+		pkt_idx_entry_from_pkt_state(pkt_s, prev_max_end_ns, &entry);
+		if ((rc = pkt_idx_entry_vec_push(entries, entry)) < 0) {
+			eprintf(&dec->err, "pkt_idx_entry_vec_push: %s", strerror(-rc));
+			rc = ACTF_OOM;
+			break;
+		}
+		breader_seek(br, (size_t) (next_off / 8), BREADER_SEEK_SET);
+	}
+	dec->idx = (struct pkt_idx) {
+		.entries = entries->data,
+		.len = entries->len,
+		.end_bit_off = entries->len ?
+		    entries->data[entries->len - 1].bit_off + entries->data[entries->len - 1].tot_len : 0,
+	};
+	dec->has_idx = rc == ACTF_OK;
+	dec_state_init(&dec->dec_s, 0);
+	dec->advise_window = advise_window;
+	return rc;
+}
+
+int actf_decoder_pkt_idx(struct actf_decoder *dec, struct pkt_idx *idx)
+{
+	if (!dec->has_idx) {
+		/* Index using a separate decoder to not disturb the decoding
+		 * position of this one. */
+		struct breader *br = &dec->br;
+		struct actf_decoder *idx_dec = actf_decoder_init(br->start_ptr,
+								 br->end_ptr - br->start_ptr, 1,
+								 dec->metadata);
+		if (!idx_dec) {
+			eprintf(&dec->err, "actf_decoder_init: %s", strerror(errno));
+			return ACTF_OOM;
+		}
+		int rc = actf_decoder_build_pkt_idx(idx_dec);
+		if (rc < 0) {
+			eprintf(&dec->err, "%s", actf_decoder_last_error(idx_dec));
+			actf_decoder_free(idx_dec);
+			return rc;
+		}
+		pkt_idx_entry_vec_free(&dec->idx_entries);
+		dec->idx_entries = idx_dec->idx_entries;
+		dec->idx = idx_dec->idx;
+		dec->has_idx = true;
+		idx_dec->idx_entries = (struct pkt_idx_entry_vec) { 0 };
+		actf_decoder_free(idx_dec);
+	}
+	*idx = dec->idx;
+	return ACTF_OK;
+}
+
+int actf_decoder_feed_pkt_idx(struct actf_decoder *dec)
+{
+	struct feed *feed = dec->feed;
+	if (!feed) {
+		eprintf(&dec->err, "the decoder is not fed");
+		return ACTF_ERROR;
+	}
+	if (dec->has_idx) {
+		feed->idx_off += feed->staging_len;
+		feed->staging_len = 0;
+		return 1;
+	}
+	struct actf_decoder *probe = feed_probe(dec);
+	if (!probe) {
+		return ACTF_OOM;
+	}
+	struct breader *br = &probe->br;
+	struct pkt_state *pkt_s = &probe->dec_s.pkt_s;
+	struct pkt_idx_entry_vec *entries = &dec->idx_entries;
+	uint64_t data_bits = (uint64_t) feed->staging_len * 8;
+	size_t indexed_len = 0;
+	/* Indexing stops as in actf_decoder_build_pkt_idx(), or once the
+	 * packets run out after the end of the data stream */
+	bool done = false;
+	while (true) {
+		if (!breader_has_bits_remaining(br)) {
+			done = feed->ended;
+			break;
+		}
+		uint64_t pkt_off = br->tot_bit_cnt;
+		int rc = actf_decoder_pkt_hdrctx_decode(probe);
+		if (rc < 0) {
+			done = rc != ACTF_NOT_ENOUGH_BITS || feed->ended;
+			break;
+		}
+		uint64_t next_off = sataddu64(pkt_s->bit_off, pkt_s->tot_len);
+		if (pkt_s->tot_len == UINT64_MAX || next_off % 8 || next_off <= pkt_off) {
+			done = true;
+			break;
+		}
+		if (next_off > data_bits) {
+			done = feed->ended;
+			break;
+		}
+		struct pkt_idx_entry entry;
+		int64_t prev_max_end_ns = entries->len ?
+		    entries->data[entries->len - 1].max_end_ns : INT64_MIN;
+		pkt_idx_entry_from_pkt_state(pkt_s, prev_max_end_ns, &entry);
+		entry.bit_off += (uint64_t) feed->idx_off * 8;
+		if ((rc = pkt_idx_entry_vec_push(entries, entry)) < 0) {
+			eprintf(&dec->err, "pkt_idx_entry_vec_push: %s", strerror(-rc));
+			return ACTF_OOM;
+		}
+		indexed_len = (size_t) (next_off / 8);
+		breader_seek(br, indexed_len, BREADER_SEEK_SET);
+	}
+	/* Only the packet being fed is kept */
+	size_t drop = done ? feed->staging_len : indexed_len;
+	if (drop) {
+		memmove(feed->staging, feed->staging + drop, feed->staging_len - drop);
+		feed->staging_len -= drop;
+		feed->idx_off += drop;
+	}
+	if (!done) {
+		return 0;
+	}
+	dec->idx = (struct pkt_idx) {
+		.entries = entries->data,
+		.len = entries->len,
+		.end_bit_off = entries->len ?
+		    entries->data[entries->len - 1].bit_off + entries->data[entries->len - 1].tot_len : 0,
+	};
+	dec->has_idx = true;
+	return 1;
+}
+
+void actf_decoder_set_pkt_idx(struct actf_decoder *dec, struct pkt_idx idx)
+{
+	pkt_idx_entry_vec_free(&dec->idx_entries);
+	dec->idx_entries = (struct pkt_idx_entry_vec) { 0 };
+	dec->idx = idx;
+	dec->has_idx = true;
+}
+
 int actf_decoder_seek_ns_from_origin(actf_decoder *dec, int64_t tstamp)
 {
 	/* seek means we want to setup the decoder so that the next call
 	 * to decode will return an event with a tstamp greater or equal
 	 * to the sought tstamp. */
+	if (dec->feed) {
+		eprintf(&dec->err, "a fed decoder can not seek");
+		return ACTF_ERROR;
+	} else if (dec->iovs) {
+		eprintf(&dec->err, "a decoder of segments can not seek");
+		return ACTF_ERROR;
+	}
 	dec->state = DECODING_STATE_OK;
-	/* TODO: make this seek smart based on index (if avail) */
-	breader_seek(&dec->br, 0, BREADER_SEEK_SET);
+	dec->prev_evs_in_pkt = false;
+	if (!dec->has_idx) {
+		/* Failing to build the index only means that the seek has to
+		 * scan the packets itself. */
+		actf_decoder_build_pkt_idx(dec);
+	}
+	/* Start at the first indexed packet that might hold the sought
+	 * event, or after the indexed ones if none of them do. */
+	size_t pkt_i = pkt_idx_find(&dec->idx, tstamp);
+	uint64_t start_off = pkt_i < dec->idx.len ?
+	    dec->idx.entries[pkt_i].bit_off : dec->idx.end_bit_off;
+	breader_seek(&dec->br, (size_t) (start_off / 8), BREADER_SEEK_SET);
+	dec->advised_off = 0;
+	dec->dropped_off = (size_t) (start_off / 8);
 
 	/* search packet by packet for the correct seek location. If the
 	 * packet ends before tstamp, skip it! */
@@ -1604,6 +2932,34 @@ static int decoder_seek_ns_from_origin(void *self, int64_t tstamp)
 	return actf_decoder_seek_ns_from_origin(dec, tstamp);
 }
 
+int actf_decoder_time_range(actf_decoder *dec, int64_t *begin, int64_t *end)
+{
+	// The packets of a fed decoder are not known in advance, nor
+	// are the ones of a decoder of segments indexed.
+	if (dec->feed || dec->iovs) {
+		return ACTF_NOT_FOUND;
+	}
+	struct pkt_idx idx;
+	int rc = actf_decoder_pkt_idx(dec, &idx);
+	if (rc < 0) {
+		return rc;
+	}
+	if ((rc = pkt_idx_time_range(&idx, dec->metadata, begin, end)) < 0) {
+		return rc;
+	}
+	/* The packets after the indexed ones could end at any time */
+	if (idx.end_bit_off < (uint64_t) (dec->br.end_ptr - dec->br.start_ptr) * 8) {
+		*end = INT64_MAX;
+	}
+	return ACTF_OK;
+}
+
+static int decoder_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	actf_decoder *dec = self;
+	return actf_decoder_time_range(dec, begin, end);
+}
+
 const char *actf_decoder_last_error(actf_decoder *dec)
 {
 	if (!dec || dec->err.buf[0] == '\0') {
@@ -1623,9 +2979,25 @@ void actf_decoder_free(struct actf_decoder *dec)
 	if (!dec) {
 		return;
 	}
+	// bufs[buf_i] is outdated by evs and dec_s.ev_arena
+	for (size_t i = 0; i < dec->n_bufs; i++) {
+		if (i != dec->buf_i) {
+			actf_event_arr_free(dec->bufs[i].evs);
+			arena_free(&dec->bufs[i].ev_arena);
+		}
+	}
+	free(dec->bufs);
 	actf_event_arr_free(dec->evs);
-	arena_free(&dec->dec_s.pkt_arena);
+	pkt_idx_entry_vec_free(&dec->idx_entries);
+	free(dec->frames);
+	free(dec->skip_evcs);
+	for (size_t i = 0; i < dec->dec_s.n_pkts; i++) {
+		arena_free(&dec->dec_s.pkts[i].arena);
+	}
+	free(dec->dec_s.pkts);
 	arena_free(&dec->dec_s.ev_arena);
+	feed_free(dec->feed);
+	iovs_free(dec->iovs);
 	error_free(&dec->err);
 	free(dec);
 }
@@ -1637,5 +3009,7 @@ struct actf_event_generator actf_decoder_to_generator(actf_decoder *dec)
 		.seek_ns_from_origin = decoder_seek_ns_from_origin,
 		.last_error = decoder_last_error,
 		.self = dec,
+		.n_bufs = dec->n_bufs,
+		.time_range = decoder_time_range,
 	};
 }
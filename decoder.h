@@ -28,6 +28,8 @@
 #ifndef ACTF_DECODER_H
 #define ACTF_DECODER_H
 
+#include <sys/uio.h>
+
 #include "metadata.h"
 #include "event_generator.h"
 #include "event.h"
@@ -35,6 +37,95 @@
 /** A CTF2 decoder, implements an actf_event_generator */
 typedef struct actf_decoder actf_decoder;
 
+/** Selects event record classes by namespace and name or by id */
+struct actf_event_cls_sel {
+	/** The name of the event record classes to select. If NULL, the
+	 * event record classes are selected by id instead. */
+	const char *name;
+	/** The namespace of the event record classes to select by name.
+	 * If NULL, any namespace matches. */
+	const char *namespace;
+	/** The id of the event record classes to select if name is
+	 * NULL. The id matches in every data stream class. */
+	uint64_t id;
+};
+
+/** What an event record class filter does with the selected event
+ * record classes */
+enum actf_event_cls_filter_mode {
+	/** Decode all events, nothing is selected */
+	ACTF_EVENT_CLS_FILTER_NONE,
+	/** Decode only the events of the selected event record classes */
+	ACTF_EVENT_CLS_FILTER_ALLOW,
+	/** Decode all events except those of the selected event record
+	 * classes */
+	ACTF_EVENT_CLS_FILTER_DENY,
+};
+
+/** An event record class filter. Only the header of a filtered out
+ * event is decoded, the rest of it is skipped over and the event is
+ * never returned. Parts of the event with a static length are skipped
+ * without being decoded, the others are scanned for the lengths and
+ * selectors needed to get past them. */
+struct actf_event_cls_filter {
+	/** The filter mode */
+	enum actf_event_cls_filter_mode mode;
+	/** The selected event record classes */
+	const struct actf_event_cls_sel *sels;
+	/** The number of elements in sels */
+	size_t sels_len;
+};
+
+/** What a decoder decodes of the event records */
+enum actf_decoder_mode {
+	/** Decode the whole event records */
+	ACTF_DECODER_MODE_FULL,
+	/** Decode only the header and common context of the event
+	 * records. The specific context and payload are skipped over and
+	 * left as NIL fields. Useful when only the event record classes,
+	 * timestamps and packets of the events are of interest. */
+	ACTF_DECODER_MODE_HEADER,
+	/** Decode the specific context and payload of an event record
+	 * on first access through actf_event_prop(), actf_event_fld() or
+	 * actf_event_prop_fld(). Until then, they are skipped over
+	 * without being decoded, or only scanned for the lengths and
+	 * selectors needed to get past them. Event records where a field
+	 * location can not be resolved from the metadata alone, such as
+	 * one through a variant, are decoded in full. Useful when
+	 * most events are discarded on their timestamps or event record
+	 * classes. */
+	ACTF_DECODER_MODE_LAZY,
+};
+
+/** The configuration of a decoder. It can be initialized to zero to
+ * get the default values. */
+struct actf_decoder_cfg {
+	/** The max event array capacity. If zero, ACTF_DEFAULT_EVS_CAP
+	 * will be used. */
+	size_t evs_cap;
+	/** The event record class filter. It is applied when the decoder
+	 * is initialized and does not need to outlive the call. */
+	struct actf_event_cls_filter evc_filter;
+	/** What to decode of the event records. The default is
+	 * ACTF_DECODER_MODE_FULL. */
+	enum actf_decoder_mode mode;
+	/** The number of event buffers, see
+	 * actf_event_generator.n_bufs. The decoder takes n_bufs times
+	 * the memory for its events. If zero, one is used. The lazy
+	 * mode always uses one. */
+	size_t n_bufs;
+	/** The number of bytes to advise the kernel about around the
+	 * packet being decoded with madvise(). The data up to
+	 * advise_window bytes ahead of it is read ahead and the pages
+	 * further behind it than advise_window are marked to be reclaimed
+	 * first (MADV_COLD or MADV_PAGEOUT), which keeps a single pass
+	 * over a large data stream from crowding out other memory. The
+	 * data is left intact, but the hints are only useful for an
+	 * mmapping of a file. Fed decoders and decoders of segments do
+	 * not advise. If zero, no advice is given. */
+	size_t advise_window;
+};
+
 /**
  * Initialize a decoder
  * @param data the ctf2 data to process
@@ -48,12 +139,103 @@ typedef struct actf_decoder actf_decoder;
 actf_decoder *actf_decoder_init(void *data, size_t data_len, size_t evs_cap,
 				const actf_metadata *metadata);
 
+/**
+ * Initialize a decoder with a configuration
+ * @param data the ctf2 data to process
+ * @param data_len the length of the data
+ * @param metadata the metadata describing the data
+ * @param cfg the configuration
+ * @return a decoder or NULL with errno set. A returned decoder should
+ * be freed with actf_decoder_free().
+ */
+actf_decoder *actf_decoder_init_cfg(void *data, size_t data_len, const actf_metadata *metadata,
+				    struct actf_decoder_cfg cfg);
+
+/**
+ * Initialize a decoder which is fed its data
+ *
+ * Instead of getting the whole data stream up front, a fed decoder
+ * gets it in chunks of any size by actf_decoder_feed(), for example
+ * as it is read from a pipe or a socket. Only the complete packets
+ * are decoded, a packet is complete once its total length has been
+ * fed. The fed data which is not yet decoded is kept by the decoder,
+ * the rest is dropped once the events referring to it are no longer
+ * valid.
+ *
+ * actf_decoder_decode() returns no events once the complete packets
+ * are decoded, until more data is fed. After actf_decoder_feed_end(),
+ * the rest of the data is decoded and no events means that the data
+ * stream has ended. A fed decoder can not seek and has no time range.
+ *
+ * @param metadata the metadata describing the data
+ * @param cfg the configuration
+ * @return a decoder or NULL with errno set. A returned decoder should
+ * be freed with actf_decoder_free().
+ */
+actf_decoder *actf_decoder_init_fed(const actf_metadata *metadata, struct actf_decoder_cfg cfg);
+
+/**
+ * Initialize a decoder of a data stream in segments
+ *
+ * The segments are decoded in order as one data stream without being
+ * copied, for example the sub-buffers of a ring buffer. Each segment
+ * holds one or more whole packets, a packet can not be split between
+ * two segments. A decoder of segments can not seek and has no time
+ * range.
+ *
+ * @param iov the segments, the array is copied but the data of the
+ * segments must outlive the decoder.
+ * @param iovcnt the number of segments
+ * @param metadata the metadata describing the data
+ * @param cfg the configuration
+ * @return a decoder or NULL with errno set. A returned decoder should
+ * be freed with actf_decoder_free().
+ */
+actf_decoder *actf_decoder_init_iov(const struct iovec *iov, size_t iovcnt,
+				    const actf_metadata *metadata, struct actf_decoder_cfg cfg);
+
+/**
+ * Feed data to a decoder
+ *
+ * The data is the continuation of the data stream fed so far and it
+ * is copied, it does not need to outlive the call. A packet may be
+ * split over several calls.
+ *
+ * @param dec the decoder, initialized by actf_decoder_init_fed()
+ * @param data the data
+ * @param len the length of data
+ * @return ACTF_OK on success or an error code. On error, see
+ * actf_decoder_last_error().
+ */
+int actf_decoder_feed(actf_decoder *dec, const void *data, size_t len);
+
+/**
+ * End the data stream of a fed decoder
+ *
+ * No more data can be fed after it. The data not making up a complete
+ * packet is then decoded as well, as the last packet of the data
+ * stream.
+ *
+ * @param dec the decoder, initialized by actf_decoder_init_fed()
+ * @return ACTF_OK on success or an error code. On error, see
+ * actf_decoder_last_error().
+ */
+int actf_decoder_feed_end(actf_decoder *dec);
+
 /** @see actf_event_generate */
 int actf_decoder_decode(actf_decoder *dec, actf_event ***evs, size_t *evs_len);
 
 /** @see actf_seek_ns_from_origin */
 int actf_decoder_seek_ns_from_origin(actf_decoder *dec, int64_t tstamp);
 
+/**
+ * @see actf_time_range
+ *
+ * The range is taken from the packet index of the decoder, which is
+ * built first if the decoder has none.
+ */
+int actf_decoder_time_range(actf_decoder *dec, int64_t *begin, int64_t *end);
+
 /** @see actf_last_error */
 const char *actf_decoder_last_error(actf_decoder *dec);
 
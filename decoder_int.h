@@ -0,0 +1,55 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACTF_DECODER_INT_H
+#define ACTF_DECODER_INT_H
+
+#include "decoder.h"
+#include "pkt_idx.h"
+
+
+/* Gets the packet index of a decoder, the index is built first if the
+ * decoder has none. Building the index does not affect the decoding
+ * position. */
+int actf_decoder_pkt_idx(actf_decoder *dec, struct pkt_idx *idx);
+
+/* Indexes the packets fed to a fed decoder instead of decoding them,
+ * the data of the indexed packets is dropped as they are complete.
+ * Indexing stops as when building the index of a decoder, or at the
+ * end of the fed data stream. 1 is returned once the index is
+ * complete, it is then available from actf_decoder_pkt_idx(), and
+ * any data fed after that is dropped. 0 is returned if more data
+ * needs to be fed. A decoder indexed this way can not decode. */
+int actf_decoder_feed_pkt_idx(actf_decoder *dec);
+
+/* Makes the decoder use idx as its packet index instead of building
+ * one. The entries must be kept alive as long as the decoder. */
+void actf_decoder_set_pkt_idx(actf_decoder *dec, struct pkt_idx idx);
+
+/* Makes the decoder decode data from the beginning, as if it was
+ * initialized with it. Any packet index is dropped. */
+void actf_decoder_reset(actf_decoder *dec, void *data, size_t data_len);
+
+/* Decodes the specific context and payload of ev, which dec skipped
+ * over in lazy mode. ev must belong to the events that dec returned
+ * last. On error, both are left NIL. */
+int actf_decoder_ev_lazy_decode(actf_decoder *dec, struct actf_event *ev);
+
+#endif /* ACTF_DECODER_INT_H */
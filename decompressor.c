@@ -0,0 +1,246 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "crust/common.h"
+#include "decompressor.h"
+#include "types.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+struct decompressor {
+	enum compression c;
+	/* Set at the end of a gzip member or zstd frame */
+	bool ended;
+#ifdef HAVE_ZLIB
+	z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zds;
+#endif
+};
+
+/* The ID bytes and the deflate compression method of a gzip member */
+static const uint8_t GZIP_MAGIC[] = { 0x1f, 0x8b, 0x08 };
+/* The reserved bits of the FLG byte of a gzip member, always zero */
+#define GZIP_FLG_RESERVED 0xe0
+static const uint8_t ZSTD_MAGIC[] = { 0x28, 0xb5, 0x2f, 0xfd };
+/* The magic of a CTF packet in either byte order */
+static const uint8_t PKT_MAGIC_LE[] = { 0xc1, 0x1f, 0xfc, 0xc1 };
+static const uint8_t PKT_MAGIC_BE[] = { 0xc1, 0xfc, 0x1f, 0xc1 };
+
+enum compression compression_of(const void *magic, size_t len)
+{
+	const uint8_t *m = magic;
+	if (len >= sizeof(PKT_MAGIC_LE) && (memcmp(m, PKT_MAGIC_LE, sizeof(PKT_MAGIC_LE)) == 0 ||
+					    memcmp(m, PKT_MAGIC_BE, sizeof(PKT_MAGIC_BE)) == 0)) {
+		return COMPRESSION_NONE;
+	}
+	if (len >= sizeof(ZSTD_MAGIC) && memcmp(m, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0) {
+		return COMPRESSION_ZSTD;
+	}
+	if (len > sizeof(GZIP_MAGIC) && memcmp(m, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0 &&
+	    !(m[sizeof(GZIP_MAGIC)] & GZIP_FLG_RESERVED)) {
+		return COMPRESSION_GZIP;
+	}
+	return COMPRESSION_NONE;
+}
+
+const char *compression_name(enum compression c)
+{
+	switch (c) {
+	case COMPRESSION_NONE:
+		return "none";
+	case COMPRESSION_GZIP:
+		return "gzip";
+	case COMPRESSION_ZSTD:
+		return "zstd";
+	}
+	return "unknown";
+}
+
+struct decompressor *decompressor_init(enum compression c, struct error *e)
+{
+	struct decompressor *d = calloc(1, sizeof(*d));
+	if (!d) {
+		eprintf(e, "calloc: %s", strerror(errno));
+		return NULL;
+	}
+	d->c = c;
+	switch (c) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_GZIP: {
+		/* 16 selects the gzip wrapper */
+		int rc = inflateInit2(&d->zs, 15 + 16);
+		if (rc != Z_OK) {
+			eprintf(e, "inflateInit2: %s", d->zs.msg ? d->zs.msg : zError(rc));
+			free(d);
+			return NULL;
+		}
+		return d;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		d->zds = ZSTD_createDStream();
+		if (!d->zds) {
+			eprintf(e, "ZSTD_createDStream failed");
+			free(d);
+			return NULL;
+		}
+		return d;
+#endif
+	default:
+		eprintf(e, "%s decompression is not supported by this build", compression_name(c));
+		free(d);
+		return NULL;
+	}
+}
+
+#ifdef HAVE_ZLIB
+static int gzip_run(struct decompressor *d, const void *in, size_t in_len, size_t *in_used,
+		    void *out, size_t out_cap, size_t *out_len, struct error *e)
+{
+	*in_used = 0;
+	*out_len = 0;
+	if (d->ended) {
+		if (!in_len) {
+			return ACTF_OK;
+		}
+		/* The next member of the file */
+		inflateReset(&d->zs);
+		d->ended = false;
+	}
+	d->zs.next_in = (Bytef *) in;
+	d->zs.avail_in = MIN(in_len, UINT_MAX);
+	d->zs.next_out = out;
+	d->zs.avail_out = MIN(out_cap, UINT_MAX);
+	int rc = inflate(&d->zs, Z_NO_FLUSH);
+	switch (rc) {
+	case Z_STREAM_END:
+		d->ended = true;
+		break;
+	case Z_OK:
+	case Z_BUF_ERROR:	// No progress possible, not an error
+		break;
+	case Z_MEM_ERROR:
+		eprintf(e, "inflate: %s", zError(rc));
+		return ACTF_OOM;
+	default:
+		eprintf(e, "inflate: %s", d->zs.msg ? d->zs.msg : zError(rc));
+		return ACTF_ERROR;
+	}
+	*in_used = MIN(in_len, UINT_MAX) - d->zs.avail_in;
+	*out_len = MIN(out_cap, UINT_MAX) - d->zs.avail_out;
+	return ACTF_OK;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int zstd_run(struct decompressor *d, const void *in, size_t in_len, size_t *in_used,
+		    void *out, size_t out_cap, size_t *out_len, struct error *e)
+{
+	ZSTD_inBuffer ib = { .src = in, .size = in_len };
+	ZSTD_outBuffer ob = { .dst = out, .size = out_cap };
+	size_t rc = ZSTD_decompressStream(d->zds, &ob, &ib);
+	if (ZSTD_isError(rc)) {
+		eprintf(e, "ZSTD_decompressStream: %s", ZSTD_getErrorName(rc));
+		return ACTF_ERROR;
+	}
+	/* Zero once a frame is decompressed and flushed, a call without
+	 * input after that does not start a new frame. */
+	if (rc == 0) {
+		d->ended = true;
+	} else if (ib.pos) {
+		d->ended = false;
+	}
+	*in_used = ib.pos;
+	*out_len = ob.pos;
+	return ACTF_OK;
+}
+#endif
+
+int decompressor_run(struct decompressor *d, const void __maybe_unused *in, size_t in_len,
+		     size_t *in_used, void __maybe_unused *out, size_t out_cap, size_t *out_len,
+		     struct error *e)
+{
+	int rc;
+	switch (d->c) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_GZIP:
+		rc = gzip_run(d, in, in_len, in_used, out, out_cap, out_len, e);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		rc = zstd_run(d, in, in_len, in_used, out, out_cap, out_len, e);
+		break;
+#endif
+	default:
+		eprintf(e, "%s decompression is not supported by this build",
+			compression_name(d->c));
+		return ACTF_INTERNAL;
+	}
+	/* Keeps the callers from spinning on input that is never
+	 * consumed */
+	if (rc == ACTF_OK && in_len && out_cap && !*in_used && !*out_len) {
+		eprintf(e, "%s decompression made no progress", compression_name(d->c));
+		return ACTF_ERROR;
+	}
+	return rc;
+}
+
+bool decompressor_ended(const struct decompressor *d)
+{
+	return d->ended;
+}
+
+void decompressor_free(struct decompressor *d)
+{
+	if (!d) {
+		return;
+	}
+	switch (d->c) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_GZIP:
+		inflateEnd(&d->zs);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		ZSTD_freeDStream(d->zds);
+		break;
+#endif
+	default:
+		break;
+	}
+	free(d);
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "error.h"
+
+/* The number of bytes needed to tell the compression of a file */
+#define COMPRESSION_MAGIC_LEN 4
+
+enum compression {
+	COMPRESSION_NONE,
+	COMPRESSION_GZIP,
+	COMPRESSION_ZSTD,
+};
+
+/* A streaming decompressor of a gzip or zstd compressed file. Files
+ * of several concatenated gzip members or zstd frames are decompressed
+ * as one. */
+struct decompressor;
+
+/* compression_of returns the compression of the file starting with
+ * the len bytes of magic, COMPRESSION_NONE if it is not compressed. A
+ * file starting with the magic of a CTF packet is never compressed and
+ * gzip requires the deflate method and the reserved flags to be
+ * unset, which keeps a packet without a magic from being taken for a
+ * compressed file. */
+enum compression compression_of(const void *magic, size_t len);
+
+const char *compression_name(enum compression c);
+
+/* decompressor_init returns a decompressor of c or NULL with an error
+ * in e, also if this build does not support c. */
+struct decompressor *decompressor_init(enum compression c, struct error *e);
+
+/* decompressor_run decompresses from the in_len bytes of in into the
+ * out_cap bytes of out. The number of bytes consumed from in and
+ * written to out are returned in in_used and out_len. If out is
+ * filled there might be more output pending, which is written by the
+ * next call, even one without any input. */
+int decompressor_run(struct decompressor *d, const void *in, size_t in_len, size_t *in_used,
+		     void *out, size_t out_cap, size_t *out_len, struct error *e);
+
+/* decompressor_ended returns true if all input so far has been
+ * decompressed up to the end of a gzip member or zstd frame, false if
+ * the data is truncated. */
+bool decompressor_ended(const struct decompressor *d);
+
+void decompressor_free(struct decompressor *d);
+
+#endif /* DECOMPRESSOR_H */
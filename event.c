@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "decoder_int.h"
 #include "metadata_int.h"
 #include "event_int.h"
 #include "fld_cls_int.h"
@@ -38,6 +39,18 @@ void actf_event_init(struct actf_event *ev, struct actf_pkt *pkt)
 		ev->props[i].parent = NULL;
 	}
 	ev->pkt = pkt;
+	ev->lazy_dec = NULL;
+}
+
+/* event_lazy_decode decodes the specific context and payload of ev if
+ * its decoder is lazy and they have not been accessed yet. */
+static void event_lazy_decode(const struct actf_event *ev, enum actf_event_prop prop)
+{
+	if (ev->lazy_dec &&
+	    (prop == ACTF_EVENT_PROP_SPECIFIC_CTX || prop == ACTF_EVENT_PROP_PAYLOAD)) {
+		// The event is only logically const, the fields are a part of it.
+		actf_decoder_ev_lazy_decode(ev->lazy_dec, (struct actf_event *) ev);
+	}
 }
 
 const struct actf_fld *actf_event_fld(const struct actf_event *ev, const char *key)
@@ -59,6 +72,7 @@ const struct actf_fld *actf_event_prop_fld(const struct actf_event *ev, const ch
 	case ACTF_EVENT_PROP_COMMON_CTX:
 	case ACTF_EVENT_PROP_SPECIFIC_CTX:
 	case ACTF_EVENT_PROP_PAYLOAD:
+		event_lazy_decode(ev, prop);
 		return actf_fld_struct_fld(&ev->props[prop], key);
 	case ACTF_EVENT_N_PROPS:
 		return NULL;
@@ -73,6 +87,7 @@ const struct actf_fld *actf_event_prop(const struct actf_event *ev, enum actf_ev
 	case ACTF_EVENT_PROP_COMMON_CTX:
 	case ACTF_EVENT_PROP_SPECIFIC_CTX:
 	case ACTF_EVENT_PROP_PAYLOAD:
+		event_lazy_decode(ev, prop);
 		return &ev->props[prop];
 	case ACTF_EVENT_N_PROPS:
 		return NULL;
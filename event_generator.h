@@ -29,6 +29,7 @@
 #ifndef ACTF_EVENT_GENERATOR_H
 #define ACTF_EVENT_GENERATOR_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include "event.h"
 
@@ -42,7 +43,9 @@
  * returned.
  *
  * The generator owns the events and any returned events (or their
- * fields) are invalid after the next actf_event_generate() call.
+ * fields) are invalid after the next actf_event_generate() call,
+ * unless the generator keeps more buffers valid, see
+ * actf_event_generator.n_bufs.
  *
  * @param self the generator's self parameter
  * @param evs a pointer to be populated with an event array
@@ -77,6 +80,25 @@ typedef int (*actf_seek_ns_from_origin)(void *self, int64_t tstamp);
  */
 typedef const char *(*actf_last_error)(void *self);
 
+/**
+ * Get the time range of the events of a generator.
+ *
+ * Every event of the generator, from its beginning, has a timestamp
+ * within [begin, end]. The range only bounds the events, there might
+ * not be any events at its ends. It lets a consumer tell whether a
+ * generator has any events around a timestamp without generating
+ * them, for example to skip seeking it.
+ *
+ * @param self the generator's self parameter
+ * @param begin a pointer to be populated with the nanosecond from
+ * origin timestamp no event is before
+ * @param end a pointer to be populated with the nanosecond from
+ * origin timestamp no event is after
+ * @return ACTF_OK on success, ACTF_NOT_FOUND if the range is not known
+ * or an error code. On error, see actf_last_error().
+ */
+typedef int (*actf_time_range)(void *self, int64_t *begin, int64_t *end);
+
 /** The default capacity of an event array
  *
  * Napkin math for 32 data stream files:
@@ -99,6 +121,15 @@ struct actf_event_generator {
 	actf_last_error last_error;
 	/** Opaque data, should be passed to the generator methods. */
 	void *self;
+	/** The number of consecutive actf_event_generate() calls whose
+	 * events are valid at the same time. With two, the events of a
+	 * call stay valid until the call after the next one, which lets
+	 * a consumer generate more events while still using the
+	 * previous ones. Zero is treated as one. */
+	size_t n_bufs;
+	/** See actf_time_range(), NULL if the generator does not know
+	 * its time range. */
+	actf_time_range time_range;
 };
 
 /**
@@ -33,6 +33,9 @@ struct actf_event {
 	struct event_state ev_s;
 	struct actf_pkt *pkt;
 	struct actf_fld props[ACTF_EVENT_N_PROPS];
+	/* The decoder which decodes the specific context and payload on
+	 * first access, NULL if they are decoded. */
+	struct actf_decoder *lazy_dec;
 };
 
 /* Initializes an event. */
@@ -30,6 +30,8 @@ struct event_state {
 	uint64_t id;
 	struct actf_event_cls *cls;
 	uint64_t def_clk_val;
+	/* Bit offset of the specific context when it is decoded lazily */
+	uint64_t lazy_bit_off;
 };
 
 static inline void event_state_init(struct event_state *ev)
@@ -37,6 +39,7 @@ static inline void event_state_init(struct event_state *ev)
 	ev->id = 0;
 	ev->cls = NULL;
 	ev->def_clk_val = 0;
+	ev->lazy_bit_off = 0;
 }
 
 #endif /* EVENT_STATE_H */
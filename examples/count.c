@@ -54,8 +54,9 @@ int main(int argc, char *argv[])
 	}
 
 	/* Initialize a CTF-FS reader and open the provided folders with
-	 * it. */
-	struct actf_freader_cfg cfg = { 0 };
+	 * it. Only the event record classes are needed to count the
+	 * events, so only the event record headers are decoded. */
+	struct actf_freader_cfg cfg = {.decoder_mode = ACTF_DECODER_MODE_HEADER };
 	actf_freader *rd = actf_freader_init(cfg);
 	if (!rd) {
 		perror("actf_freader_init");
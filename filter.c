@@ -210,5 +210,6 @@ struct actf_event_generator actf_filter_to_generator(actf_filter *f)
 		.seek_ns_from_origin = filter_seek_ns_from_origin,
 		.last_error = filter_last_error,
 		.self = f,
+		.n_bufs = f->gen.n_bufs,
 	};
 }
@@ -304,6 +304,21 @@ uint64_t actf_fld_cls_min_alignment(const struct actf_fld_cls *fc)
 	}
 }
 
+size_t actf_fld_cls_align_req(const struct actf_fld_cls *fc)
+{
+	return fc->align_req;
+}
+
+bool actf_fld_cls_has_static_len(const struct actf_fld_cls *fc)
+{
+	return fc->has_static_len;
+}
+
+uint64_t actf_fld_cls_static_len(const struct actf_fld_cls *fc)
+{
+	return fc->static_len;
+}
+
 size_t actf_fld_cls_members_len(const struct actf_fld_cls *fc)
 {
 	if (fc->type == ACTF_FLD_CLS_STRUCT) {
@@ -656,6 +671,90 @@ size_t actf_fld_cls_get_align_req(const struct actf_fld_cls *fc)
 	return 1;
 }
 
+/* align_up aligns v to align, saturating at UINT64_MAX. */
+static uint64_t align_up(uint64_t v, uint64_t align)
+{
+	if (v > UINT64_MAX - (align - 1)) {
+		return UINT64_MAX;
+	}
+	return (v + align - 1) & ~(align - 1);
+}
+
+/* fld_cls_static_len computes the static length of fc from the
+ * layouts of the field classes it contains. The alignment requirement
+ * of a structure or an array is at least that of what it contains,
+ * which makes all padding inside an instance static as long as the
+ * instance itself starts aligned. */
+static bool fld_cls_static_len(const struct actf_fld_cls *fc, uint64_t *len)
+{
+	switch (fc->type) {
+	case ACTF_FLD_CLS_FXD_LEN_BIT_ARR:
+	case ACTF_FLD_CLS_FXD_LEN_BIT_MAP:
+	case ACTF_FLD_CLS_FXD_LEN_UINT:
+	case ACTF_FLD_CLS_FXD_LEN_SINT:
+	case ACTF_FLD_CLS_FXD_LEN_BOOL:
+	case ACTF_FLD_CLS_FXD_LEN_FLOAT:
+		*len = actf_fld_cls_len(fc);
+		return true;
+	case ACTF_FLD_CLS_STATIC_LEN_STR:
+	case ACTF_FLD_CLS_STATIC_LEN_BLOB:{
+		uint64_t n_bytes = fc->type == ACTF_FLD_CLS_STATIC_LEN_STR ?
+		    fc->cls.static_len_str.len : fc->cls.static_len_blob.len;
+		if (n_bytes > UINT64_MAX / 8) {
+			return false;
+		}
+		*len = n_bytes * 8;
+		return true;
+	}
+	case ACTF_FLD_CLS_STRUCT:{
+		uint64_t off = 0;
+		for (size_t i = 0; i < fc->cls.struct_.n_members; i++) {
+			const struct actf_fld_cls *member = &fc->cls.struct_.member_clses[i].cls;
+			if (!member->has_static_len) {
+				return false;
+			}
+			off = sataddu64(align_up(off, member->align_req), member->static_len);
+			if (off == UINT64_MAX) {
+				return false;
+			}
+		}
+		*len = off;
+		return true;
+	}
+	case ACTF_FLD_CLS_STATIC_LEN_ARR:{
+		const struct actf_fld_cls *ele = fc->cls.static_len_arr.base.ele_fld_cls;
+		uint64_t n = fc->cls.static_len_arr.len;
+		if (n == 0) {
+			*len = 0;
+			return true;
+		}
+		if (!ele->has_static_len) {
+			return false;
+		}
+		uint64_t stride = align_up(ele->static_len, ele->align_req);
+		if (stride == UINT64_MAX ||
+		    (stride && n - 1 > (UINT64_MAX - 1 - ele->static_len) / stride)) {
+			return false;
+		}
+		*len = ele->static_len + (n - 1) * stride;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+/* fld_cls_layout_init computes the layout of a parsed fc. */
+static void fld_cls_layout_init(struct actf_fld_cls *fc)
+{
+	fc->align_req = actf_fld_cls_get_align_req(fc);
+	fc->static_len = 0;
+	fc->has_static_len = fld_cls_static_len(fc, &fc->static_len);
+	if (!fc->has_static_len) {
+		fc->static_len = 0;
+	}
+}
+
 static int actf_fld_cls_resolve_alias(struct json_object *fc_jobj,
 				      const struct actf_metadata *metadata,
 				      struct actf_fld_cls *fc, struct error *e)
@@ -761,7 +860,9 @@ int actf_fld_cls_parse(struct json_object *fc_jobj, const struct actf_metadata *
 		}
 		if (rc < 0) {
 			eprependf(e, type_name);
+			return rc;
 		}
+		fld_cls_layout_init(fc);
 		return rc;
 	} else if (json_object_is_type(fc_jobj, json_type_string)) {
 		return actf_fld_cls_resolve_alias(fc_jobj, metadata, fc, e);
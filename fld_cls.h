@@ -25,6 +25,9 @@
 #ifndef ACTF_FLD_CLS_H
 #define ACTF_FLD_CLS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "flags.h"
 #include "fld_loc.h"
 #include "mappings.h"
@@ -277,6 +280,55 @@ const actf_fld_loc *actf_fld_cls_len_fld_loc(const actf_fld_cls *fc);
  */
 uint64_t actf_fld_cls_min_alignment(const actf_fld_cls *fc);
 
+/**
+ * Get the effective alignment requirement of the field class, the
+ * alignment of the first bit of any instance of it.
+ *
+ * This is precomputed when the metadata is parsed.
+ *
+ * @param fc the field class
+ * @return the alignment requirement
+ */
+size_t actf_fld_cls_align_req(const actf_fld_cls *fc);
+
+/**
+ * Check if all instances of the field class have the same length.
+ *
+ * Applicable to:
+ * - ACTF_FLD_CLS_FXD_LEN_BIT_ARR
+ * - ACTF_FLD_CLS_FXD_LEN_BIT_MAP
+ * - ACTF_FLD_CLS_FXD_LEN_UINT
+ * - ACTF_FLD_CLS_FXD_LEN_SINT
+ * - ACTF_FLD_CLS_FXD_LEN_BOOL
+ * - ACTF_FLD_CLS_FXD_LEN_FLOAT
+ * - ACTF_FLD_CLS_STATIC_LEN_STR
+ * - ACTF_FLD_CLS_STATIC_LEN_BLOB
+ * - ACTF_FLD_CLS_STRUCT if all of its member classes have a static
+ *   length
+ * - ACTF_FLD_CLS_STATIC_LEN_ARR if its element class has a static
+ *   length or if it has no elements
+ *
+ * Any other field class returns false.
+ *
+ * @param fc the field class
+ * @return true if the field class has a static length
+ */
+bool actf_fld_cls_has_static_len(const actf_fld_cls *fc);
+
+/**
+ * Get the static length of the field class in bits.
+ *
+ * The length includes the padding between the values an instance
+ * contains, given that the instance starts aligned to
+ * actf_fld_cls_align_req(). It is precomputed when the metadata is
+ * parsed.
+ *
+ * @param fc the field class
+ * @return the static length or 0 if
+ * actf_fld_cls_has_static_len() is false
+ */
+uint64_t actf_fld_cls_static_len(const actf_fld_cls *fc);
+
 /**
  * Get the number of members of the struct field class.
  *
@@ -197,6 +197,13 @@ struct actf_fld_cls {
 		struct optional_fld_cls optional;
 		struct variant_fld_cls variant;
 	} cls;
+	/* The layout of an instance, computed when the field class is
+	 * parsed. static_len is the length in bits of every instance if
+	 * has_static_len, including any padding between the values it
+	 * contains but not the padding before it. */
+	size_t align_req;
+	bool has_static_len;
+	uint64_t static_len;
 	char *alias; // NULL if actf_fld is not an alias. Only non-aliases
 	// owns the cls structure and should free it.
 	struct ctfjson *attributes;
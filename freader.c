@@ -18,24 +18,162 @@
  * <https://www.gnu.org/licenses/>.
  */
 
+// O_DIRECT
+#define _GNU_SOURCE
+
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include "crust/common.h"
+#include "crust/map_util.h"
 #include "decoder.h"
+#include "decoder_int.h"
+#include "decompressor.h"
 #include "metadata.h"
 #include "muxer.h"
 #include "freader.h"
 #include "error.h"
+#include "pdecoder.h"
+#include "pdecoder_int.h"
+#include "pkt_idx.h"
+#include "producer.h"
 
 struct mmap_s {
 	void *pa;
 	size_t len;
+	char *name;
+	struct timespec mtime;
+	struct pkt_idx_file idx_file;
+};
+
+/* A lazy data stream file is only mmapped and decoded while its
+ * events are needed, see actf_freader_cfg.lazy_dstreams. It is active
+ * while being decoded. An inactive one stays mmapped in the LRU until
+ * it is evicted. */
+struct lazy_ds {
+	char *name;
+	size_t len;
+	struct timespec mtime;
+	int dirfd;
+	const actf_metadata *metadata;
+	const struct actf_freader_cfg *cfg;
+	struct ds_lru *lru;
+	struct pkt_idx_entry_vec idx_entries;
+	struct pkt_idx idx;
+	/* Set if idx is taken from the packet index file */
+	bool idx_from_file;
+	bool has_range;
+	int64_t begin;
+	int64_t end;
+	/* pa and dec are NULL while not mmapped */
+	void *pa;
+	actf_decoder *dec;
+	bool active;
+	/* Set once dec runs out of events, until the next seek */
+	bool exhausted;
+	/* The epoch of the LRU when it was last released */
+	size_t released_epoch;
+	struct lazy_ds *prev;
+	struct lazy_ds *next;
+	struct error err;
+};
+
+/* ds_lru holds the inactive mmapped lazy data stream files, the least
+ * recently used one first. */
+struct ds_lru {
+	struct lazy_ds *head;
+	struct lazy_ds *tail;
+	/* The number of mmapped lazy data stream files, active or not */
+	size_t n_mapped;
+	size_t max_mapped;
+	/* Incremented by each read and seek of the freader. The events of
+	 * a data stream file released in an earlier epoch are no longer
+	 * in use. */
+	size_t epoch;
+};
+
+/* The buffer that the read data stream files are read into before
+ * their data is fed to their decoders. It is allocated by the first
+ * read. */
+struct read_buf {
+	void *buf;
+	size_t size;
+	/* The size bytes that compressed files are decompressed into,
+	 * allocated by the first read of one. */
+	void *out;
+};
+
+/* A read data stream file is read with pread() and fed to its
+ * decoder, see ACTF_FREADER_IO_PREAD. It is only open while being
+ * read. A compressed file is decompressed while being read. */
+struct read_ds {
+	char *name;
+	/* The size when opened, any data after it is not read */
+	size_t len;
+	struct timespec mtime;
+	int dirfd;
+	/* -1 while not open */
+	int fd;
+	const actf_metadata *metadata;
+	const struct actf_freader_cfg *cfg;
+	struct read_buf *rb;
+	/* The packet index file, pa is NULL if there is none */
+	struct pkt_idx_file idx_file;
+	/* NULL until the first read or seek */
+	actf_decoder *dec;
+	enum compression compression;
+	/* NULL if not compressed */
+	struct decompressor *dcmp;
+	/* The offset of the next read */
+	size_t off;
+	/* The number of bytes of the next read before the data to feed,
+	 * the reads are aligned. Of a compressed file, the number of
+	 * decompressed bytes before the data to feed. */
+	size_t skip;
+	/* The number of decompressed bytes so far of a compressed file */
+	size_t dcmp_off;
+	/* Set once the end of the file has been fed */
+	bool ended;
+	/* Set after a seek until an event at or after seek_ns is
+	 * decoded, the events before it are dropped. */
+	bool seeking;
+	int64_t seek_ns;
+	struct error err;
+};
+
+/* The metadata of a metadata file, see metadata_cache */
+struct metadata_entry {
+	size_t hash;
+	char *buf;
+	size_t len;
+	/* Set once buf has been parsed into m, which is NULL if it
+	 * failed with err. */
+	bool parsed;
+	actf_metadata *m;
+	struct error err;
+};
+
+/* A metadata cache holds the metadata of the reader by the contents of
+ * their metadata files. The directories with identical metadata files
+ * share a single metadata and its decode plans, which is parsed
+ * once. It is used by the threads opening the directories. */
+struct metadata_cache {
+	pthread_mutex_t mtx;
+	/* Broadcasted when an entry has been parsed */
+	pthread_cond_t parsed_cond;
+	struct metadata_entry *entries;
+	size_t len;
+	size_t cap;
 };
 
 struct muxer_s {
@@ -46,10 +184,26 @@ struct muxer_s {
 
 struct ctf_dir {
 	char *path;
+	/* Owned by the metadata cache of the reader */
 	actf_metadata *metadata;
 	struct mmap_s *mmaps;
 	size_t mmaps_len;
 	actf_decoder **decs;
+	/* Parallel decoders of the data stream files, NULL if they are
+	 * decoded by decs. decs then only provide the packet indexes. */
+	actf_pdecoder **pdecs;
+	/* Producers of decs, NULL if decs are generated from
+	 * directly. */
+	actf_producer **prods;
+	/* The lazy data stream files, NULL unless lazy_dstreams is set.
+	 * There are then no mmaps nor decs. */
+	struct lazy_ds *lazy_dss;
+	/* The read data stream files, NULL unless dstream_io is
+	 * ACTF_FREADER_IO_PREAD. There are then no mmaps nor decs. */
+	struct read_ds *read_dss;
+	/* The directory of lazy_dss or read_dss, -1 if none */
+	int dirfd;
+	/* The number of data stream files */
 	size_t decs_len;
 };
 
@@ -59,130 +213,1280 @@ struct actf_freader {
 	size_t dirs_len;
 	struct muxer_s mux;
 	struct actf_event_generator active_gen;
+	struct ds_lru lru;
+	struct metadata_cache mdc;
+	struct read_buf rb;
 	struct error err;
 };
 
 
-/* openat_metadata tries to read a metadata file relative to the
- * directory fd. */
-static actf_metadata *openat_metadata(int fd, const char *metadata_filename, struct error *e)
+/* read_metadata_file reads the metadata file relative to the
+ * directory fd into a buffer, returned in buf and len. */
+static int read_metadata_file(int fd, const char *metadata_filename, char **buf, size_t *len,
+			      struct error *e)
+{
+	int mfd = openat(fd, metadata_filename, O_RDONLY);
+	if (mfd < 0) {
+		eprintf(e, "%s openat: %s", metadata_filename, strerror(errno));
+		return ACTF_ERROR;
+	}
+	struct stat sb;
+	if (fstat(mfd, &sb) < 0) {
+		eprintf(e, "fstat: %s", strerror(errno));
+		close(mfd);
+		return ACTF_ERROR;
+	}
+	char *b = malloc(MAX(sb.st_size, 1));
+	if (!b) {
+		eprintf(e, "malloc: %s", strerror(errno));
+		close(mfd);
+		return ACTF_OOM;
+	}
+	size_t n_read = 0;
+	while (n_read < (size_t) sb.st_size) {
+		ssize_t n = read(mfd, b + n_read, sb.st_size - n_read);
+		if (n < 0) {
+			eprintf(e, "read: %s", strerror(errno));
+			free(b);
+			close(mfd);
+			return ACTF_ERROR;
+		}
+		if (n == 0) {
+			break;
+		}
+		n_read += n;
+	}
+	close(mfd);
+	*buf = b;
+	*len = n_read;
+	return ACTF_OK;
+}
+
+static actf_metadata *parse_metadata(const char *buf, size_t len, struct error *e)
+{
+	actf_metadata *m = actf_metadata_init();
+	if (!m) {
+		eprintf(e, "actf_metadata_init: %s", strerror(errno));
+		return NULL;
+	}
+	if (actf_metadata_nparse(m, buf, len) < 0) {
+		eprintf(e, "%s", actf_metadata_last_error(m));
+		actf_metadata_free(m);
+		return NULL;
+	}
+	return m;
+}
+
+static int metadata_cache_init(struct metadata_cache *mc)
+{
+	int rc;
+	*mc = (struct metadata_cache) { 0 };
+	if ((rc = pthread_mutex_init(&mc->mtx, NULL)) != 0) {
+		errno = rc;
+		return ACTF_ERROR;
+	}
+	if ((rc = pthread_cond_init(&mc->parsed_cond, NULL)) != 0) {
+		pthread_mutex_destroy(&mc->mtx);
+		errno = rc;
+		return ACTF_ERROR;
+	}
+	return ACTF_OK;
+}
+
+/* metadata_cache_find returns the index of the entry with the metadata
+ * file contents buf, mc->len if there is none. */
+static size_t metadata_cache_find(struct metadata_cache *mc, size_t hash, const char *buf,
+				  size_t len)
+{
+	size_t i;
+	for (i = 0; i < mc->len; i++) {
+		struct metadata_entry *me = &mc->entries[i];
+		if (me->hash == hash && me->len == len && memcmp(me->buf, buf, len) == 0) {
+			break;
+		}
+	}
+	return i;
+}
+
+/* metadata_cache_get returns the metadata of the metadata file relative
+ * to the directory fd. It is only parsed if no identical metadata file
+ * has been, otherwise the metadata is shared. A metadata file which is
+ * being parsed by another thread is waited for. */
+static actf_metadata *metadata_cache_get(struct metadata_cache *mc, int fd,
+					 const char *metadata_filename, struct error *e)
+{
+	char *buf;
+	size_t len;
+	if (read_metadata_file(fd, metadata_filename, &buf, &len, e) < 0) {
+		return NULL;
+	}
+	size_t hash = hash_fnv_n(buf, len);
+
+	pthread_mutex_lock(&mc->mtx);
+	size_t i = metadata_cache_find(mc, hash, buf, len);
+	if (i < mc->len) {
+		free(buf);
+		while (!mc->entries[i].parsed) {
+			pthread_cond_wait(&mc->parsed_cond, &mc->mtx);
+		}
+		actf_metadata *m = mc->entries[i].m;
+		if (!m) {
+			eprintf(e, "%s", mc->entries[i].err.buf);
+		}
+		pthread_mutex_unlock(&mc->mtx);
+		return m;
+	}
+	if (mc->len == mc->cap) {
+		size_t cap = mc->cap ? mc->cap * 2 : 4;
+		struct metadata_entry *entries = realloc(mc->entries, cap * sizeof(*entries));
+		if (!entries) {
+			pthread_mutex_unlock(&mc->mtx);
+			free(buf);
+			eprintf(e, "realloc: %s", strerror(errno));
+			return NULL;
+		}
+		mc->entries = entries;
+		mc->cap = cap;
+	}
+	mc->entries[mc->len++] = (struct metadata_entry) {
+		.hash = hash,
+		.buf = buf,
+		.len = len,
+		.err = ERROR_EMPTY,
+	};
+	pthread_mutex_unlock(&mc->mtx);
+
+	actf_metadata *m = parse_metadata(buf, len, e);
+
+	pthread_mutex_lock(&mc->mtx);
+	struct metadata_entry *me = &mc->entries[i];
+	me->m = m;
+	me->parsed = true;
+	if (!m) {
+		eprintf(&me->err, "%s", e->buf);
+	}
+	pthread_cond_broadcast(&mc->parsed_cond);
+	pthread_mutex_unlock(&mc->mtx);
+	return m;
+}
+
+static void metadata_cache_free(struct metadata_cache *mc)
+{
+	for (size_t i = 0; i < mc->len; i++) {
+		struct metadata_entry *me = &mc->entries[i];
+		actf_metadata_free(me->m);
+		error_free(&me->err);
+		free(me->buf);
+	}
+	free(mc->entries);
+	pthread_cond_destroy(&mc->parsed_cond);
+	pthread_mutex_destroy(&mc->mtx);
+}
+
+static void mmap_s_free(struct mmap_s *ms)
+{
+	pkt_idx_file_unmap(&ms->idx_file);
+	munmap(ms->pa, ms->len);
+	free(ms->name);
+}
+
+static struct pkt_idx_file_id pkt_idx_file_id_of(size_t ds_size, struct timespec ds_mtime,
+						  const actf_metadata *m, enum compression c)
+{
+	const struct actf_uuid *uuid = actf_preamble_uuid(actf_metadata_preamble(m));
+	return (struct pkt_idx_file_id) {
+		.ds_size = ds_size,
+		.ds_mtime = ds_mtime,
+		.metadata_uuid = uuid ? uuid->d : NULL,
+		.metadata_hash = m->text_hash,
+		.compressed = c != COMPRESSION_NONE,
+	};
+}
+
+static struct pkt_idx_file_id mmap_s_pkt_idx_file_id(const struct mmap_s *ms,
+						     const actf_metadata *m)
+{
+	return pkt_idx_file_id_of(ms->len, ms->mtime, m, COMPRESSION_NONE);
+}
+
+/* map_pkt_idx_files maps any valid packet index file of the data
+ * stream files, to be handed over to their decoders. An index file is
+ * only an optimization, so one that can not be used is skipped. */
+static void map_pkt_idx_files(int fd, struct mmap_s *mmaps, size_t mmaps_len,
+			      actf_metadata *m)
+{
+	for (size_t i = 0; i < mmaps_len; i++) {
+		struct pkt_idx_file_id id = mmap_s_pkt_idx_file_id(&mmaps[i], m);
+		pkt_idx_file_map(fd, mmaps[i].name, &id, &mmaps[i].idx_file, NULL);
+	}
+}
+
+/* count_dir_entries returns the number of entries in dir and rewinds
+ * it. */
+static size_t count_dir_entries(DIR *dir)
+{
+	size_t n_entries = 0;
+	while (readdir(dir) != NULL) {
+		n_entries++;
+	}
+	rewinddir(dir);
+	return n_entries;
+}
+
+/* open_next_dstream opens the next data stream file of dir, which is
+ * any non-empty regular file not named `metadata_filename` nor
+ * starting with a dot. Its directory entry, file descriptor and
+ * status are returned in dp, fd and sb. ACTF_NOT_FOUND is returned if
+ * there are no more data stream files. */
+static int open_next_dstream(DIR *dir, const char *metadata_filename, struct dirent **dp,
+			     int *fd, struct stat *sb, struct error *e)
+{
+	int dir_fd = dirfd(dir);
+	if (dir_fd < 0) {
+		eprintf(e, "dirfd: %s", strerror(errno));
+		return ACTF_ERROR;
+	}
+	while ((*dp = readdir(dir)) != NULL) {
+		if (strcmp((*dp)->d_name, metadata_filename) == 0 || (*dp)->d_name[0] == '.') {
+			continue;
+		}
+		*fd = openat(dir_fd, (*dp)->d_name, O_RDONLY);
+		if (*fd < 0) {
+			eprintf(e, "openat: %s", strerror(errno));
+			return ACTF_ERROR;
+		}
+		if (fstat(*fd, sb) < 0) {
+			close(*fd);
+			eprintf(e, "fstat: %s", strerror(errno));
+			return ACTF_ERROR;
+		}
+		if (!S_ISREG(sb->st_mode) || sb->st_size == 0) {
+			close(*fd);
+			continue;
+		}
+		return ACTF_OK;
+	}
+	return ACTF_NOT_FOUND;
+}
+
+/* mmap_datastreams mmaps all regular files in dir. Any file matching
+ * `metadata_filename` will not be mmapped. */
+static int mmap_datastreams(DIR *dir, const char *metadata_filename,
+			    struct mmap_s **mmaps_out, size_t *mmaps_len_out, struct error *e)
+{
+	int rc;
+	size_t mmaps_len = 0;
+	struct mmap_s *mmaps = malloc(count_dir_entries(dir) * sizeof(*mmaps));	// Allow the waste
+	if (!mmaps) {
+		eprintf(e, "malloc: %s", strerror(errno));
+		return ACTF_OOM;
+	}
+
+	struct dirent *dp;
+	int dstream_fd;
+	struct stat sb;
+	while ((rc = open_next_dstream(dir, metadata_filename, &dp, &dstream_fd, &sb, e)) == ACTF_OK) {
+		void *pa = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, dstream_fd, 0);
+		if (pa == MAP_FAILED) {
+			close(dstream_fd);
+			eprintf(e, "mmap: %s", strerror(errno));
+			rc = ACTF_ERROR;
+			goto err;
+		}
+		close(dstream_fd);
+		char *name = strdup(dp->d_name);
+		if (!name) {
+			munmap(pa, sb.st_size);
+			eprintf(e, "strdup: %s", strerror(errno));
+			rc = ACTF_OOM;
+			goto err;
+		}
+		mmaps[mmaps_len++] = (struct mmap_s) {
+			.pa = pa,
+			.len = sb.st_size,
+			.name = name,
+			.mtime = sb.st_mtim,
+		};
+	}
+	if (rc != ACTF_NOT_FOUND) {
+		goto err;
+	}
+
+	*mmaps_out = mmaps;
+	*mmaps_len_out = mmaps_len;
+	return ACTF_OK;
+
+err:
+	for (size_t i = 0; i < mmaps_len; i++) {
+		mmap_s_free(&mmaps[i]);
+	}
+	free(mmaps);
+	return rc;
+}
+
+/* use_producers returns true if the decoders are put behind
+ * producers. A lazy decoder only has a single buffer, it can not be
+ * decoded ahead. */
+static bool use_producers(const struct actf_freader_cfg *cfg)
+{
+	return cfg->dstream_producers && !cfg->dstream_threads &&
+	    cfg->decoder_mode != ACTF_DECODER_MODE_LAZY && cfg->dstream_io == ACTF_FREADER_IO_MMAP;
+}
+
+/* use_lazy_dstreams returns true if the data stream files are lazy
+ * data stream files. */
+static bool use_lazy_dstreams(const struct actf_freader_cfg *cfg)
+{
+	return cfg->lazy_dstreams && !cfg->dstream_threads && !cfg->dstream_producers &&
+	    cfg->dstream_io == ACTF_FREADER_IO_MMAP;
+}
+
+/* dstream_dec_cfg returns the configuration of the decoder of a data
+ * stream file. */
+static struct actf_decoder_cfg dstream_dec_cfg(const struct actf_freader_cfg *cfg)
+{
+	/* Two buffers lets the muxer generate more events of a decoder
+	 * while its previous ones are still in the muxer's output. A
+	 * producer decodes ahead into the others. A lazy decoder only
+	 * has one. */
+	size_t n_bufs = use_producers(cfg) ? ACTF_FREADER_PRODUCER_BUFS : 2;
+	return (struct actf_decoder_cfg) {
+		.evs_cap = cfg->dstream_evs_cap,
+		.evc_filter = cfg->evc_filter,
+		.mode = cfg->decoder_mode,
+		.n_bufs = cfg->decoder_mode == ACTF_DECODER_MODE_LAZY ? 1 : n_bufs,
+		.advise_window = cfg->dstream_threads ? 0 : cfg->advise_window,
+	};
+}
+
+/* init_decoder sets up the decoder of the data stream file ms,
+ * handing it the packet index file of ms if there is one. */
+static actf_decoder *init_decoder(struct mmap_s *ms, actf_metadata *m,
+				  const struct actf_freader_cfg *cfg, struct error *e)
+{
+	actf_decoder *d = actf_decoder_init_cfg(ms->pa, ms->len, m, dstream_dec_cfg(cfg));
+	if (!d) {
+		eprintf(e, "actf_decoder_init_cfg: %s", strerror(errno));
+		return NULL;
+	}
+	if (ms->idx_file.pa) {
+		actf_decoder_set_pkt_idx(d, ms->idx_file.idx);
+	}
+	return d;
+}
+
+static void ds_lru_remove(struct ds_lru *lru, struct lazy_ds *ds)
+{
+	if (ds->prev) {
+		ds->prev->next = ds->next;
+	} else {
+		lru->head = ds->next;
+	}
+	if (ds->next) {
+		ds->next->prev = ds->prev;
+	} else {
+		lru->tail = ds->prev;
+	}
+	ds->prev = NULL;
+	ds->next = NULL;
+}
+
+static void ds_lru_push(struct ds_lru *lru, struct lazy_ds *ds)
+{
+	ds->prev = lru->tail;
+	ds->next = NULL;
+	if (lru->tail) {
+		lru->tail->next = ds;
+	} else {
+		lru->head = ds;
+	}
+	lru->tail = ds;
+}
+
+static void lazy_ds_unmap(struct lazy_ds *ds)
+{
+	if (!ds->pa) {
+		return;
+	}
+	actf_decoder_free(ds->dec);
+	munmap(ds->pa, ds->len);
+	ds->dec = NULL;
+	ds->pa = NULL;
+	ds->lru->n_mapped--;
+}
+
+/* ds_lru_trim unmaps the least recently used data stream files, whose
+ * events are no longer in use, until there is room for n more mmapped
+ * ones. */
+static void ds_lru_trim(struct ds_lru *lru, size_t n)
+{
+	while (lru->head && lru->n_mapped + n > lru->max_mapped &&
+	       lru->head->released_epoch < lru->epoch) {
+		struct lazy_ds *ds = lru->head;
+		ds_lru_remove(lru, ds);
+		lazy_ds_unmap(ds);
+	}
+}
+
+/* lazy_ds_map mmaps the data stream file and sets up its decoder. */
+static int lazy_ds_map(struct lazy_ds *ds)
+{
+	ds_lru_trim(ds->lru, 1);
+	int fd = openat(ds->dirfd, ds->name, O_RDONLY);
+	if (fd < 0) {
+		eprintf(&ds->err, "%s openat: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0) {
+		close(fd);
+		eprintf(&ds->err, "%s fstat: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	if ((size_t) sb.st_size != ds->len) {
+		close(fd);
+		eprintf(&ds->err, "%s has changed size since it was opened", ds->name);
+		return ACTF_ERROR;
+	}
+	void *pa = mmap(NULL, ds->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pa == MAP_FAILED) {
+		eprintf(&ds->err, "%s mmap: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	actf_decoder *dec = actf_decoder_init_cfg(pa, ds->len, ds->metadata, dstream_dec_cfg(ds->cfg));
+	if (!dec) {
+		munmap(pa, ds->len);
+		eprintf(&ds->err, "actf_decoder_init_cfg: %s", strerror(errno));
+		return ACTF_ERROR;
+	}
+	actf_decoder_set_pkt_idx(dec, ds->idx);
+	ds->pa = pa;
+	ds->dec = dec;
+	ds->lru->n_mapped++;
+	return ACTF_OK;
+}
+
+static int lazy_ds_activate(struct lazy_ds *ds)
+{
+	if (ds->active) {
+		return ACTF_OK;
+	}
+	if (ds->pa) {
+		ds_lru_remove(ds->lru, ds);
+	} else {
+		int rc = lazy_ds_map(ds);
+		if (rc < 0) {
+			return rc;
+		}
+	}
+	ds->active = true;
+	return ACTF_OK;
+}
+
+/* lazy_ds_release puts an active data stream file in the LRU. It is
+ * not unmapped before the next epoch since its events might still be
+ * in use. */
+static void lazy_ds_release(struct lazy_ds *ds)
+{
+	if (!ds->active) {
+		return;
+	}
+	ds->active = false;
+	ds->released_epoch = ds->lru->epoch;
+	ds_lru_push(ds->lru, ds);
+}
+
+static int lazy_ds_generate(void *self, actf_event ***evs, size_t *evs_len)
+{
+	struct lazy_ds *ds = self;
+	*evs = NULL;
+	*evs_len = 0;
+	if (ds->exhausted) {
+		return ACTF_OK;
+	}
+	int rc = lazy_ds_activate(ds);
+	if (rc < 0) {
+		return rc;
+	}
+	if ((rc = actf_decoder_decode(ds->dec, evs, evs_len)) < 0) {
+		eprintf(&ds->err, "%s", actf_decoder_last_error(ds->dec));
+		return rc;
+	}
+	if (*evs_len == 0) {
+		ds->exhausted = true;
+		lazy_ds_release(ds);
+	}
+	return ACTF_OK;
+}
+
+static int lazy_ds_seek_ns_from_origin(void *self, int64_t tstamp)
+{
+	struct lazy_ds *ds = self;
+	ds->exhausted = false;
+	int rc = lazy_ds_activate(ds);
+	if (rc < 0) {
+		return rc;
+	}
+	if ((rc = actf_decoder_seek_ns_from_origin(ds->dec, tstamp)) < 0) {
+		eprintf(&ds->err, "%s", actf_decoder_last_error(ds->dec));
+		return rc;
+	}
+	return ACTF_OK;
+}
+
+static int lazy_ds_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	struct lazy_ds *ds = self;
+	if (!ds->has_range) {
+		return ACTF_NOT_FOUND;
+	}
+	*begin = ds->begin;
+	*end = ds->end;
+	return ACTF_OK;
+}
+
+static const char *lazy_ds_last_error(void *self)
+{
+	struct lazy_ds *ds = self;
+	if (ds->err.buf[0] == '\0') {
+		return NULL;
+	}
+	return ds->err.buf;
+}
+
+static struct actf_event_generator lazy_ds_to_generator(struct lazy_ds *ds)
+{
+	return (struct actf_event_generator) {
+		.generate = lazy_ds_generate,
+		.seek_ns_from_origin = lazy_ds_seek_ns_from_origin,
+		.last_error = lazy_ds_last_error,
+		.self = ds,
+		.n_bufs = dstream_dec_cfg(ds->cfg).n_bufs,
+		.time_range = lazy_ds_time_range,
+	};
+}
+
+/* lazy_ds_set_idx makes a copy of idx the packet index of ds and
+ * gets the time range of ds from it. */
+static int lazy_ds_set_idx(struct lazy_ds *ds, struct pkt_idx idx)
+{
+	ds->idx_entries = pkt_idx_entry_vec_init(idx.len);
+	if (idx.len && !ds->idx_entries.data) {
+		return ACTF_OOM;
+	}
+	if (idx.len) {
+		memcpy(ds->idx_entries.data, idx.entries, idx.len * sizeof(*idx.entries));
+	}
+	ds->idx_entries.len = idx.len;
+	ds->idx = (struct pkt_idx) {
+		.entries = ds->idx_entries.data,
+		.len = idx.len,
+		.end_bit_off = idx.end_bit_off,
+	};
+	ds->has_range = pkt_idx_time_range(&ds->idx, ds->metadata, &ds->begin, &ds->end) == ACTF_OK;
+	/* The packets after the indexed ones could end at any time */
+	if (ds->idx.end_bit_off < (uint64_t) ds->len * 8) {
+		ds->end = INT64_MAX;
+	}
+	return ACTF_OK;
+}
+
+/* lazy_ds_init_idx sets the packet index of ds. It is taken from the
+ * packet index file if there is a valid one, otherwise the data stream
+ * file is mmapped while being indexed. */
+static int lazy_ds_init_idx(struct lazy_ds *ds, struct error *e)
+{
+	int rc;
+	if (ds->cfg->pkt_idx_files) {
+		struct pkt_idx_file_id id = pkt_idx_file_id_of(ds->len, ds->mtime, ds->metadata,
+								COMPRESSION_NONE);
+		struct pkt_idx_file f;
+		if (pkt_idx_file_map(ds->dirfd, ds->name, &id, &f, NULL) == ACTF_OK) {
+			rc = lazy_ds_set_idx(ds, f.idx);
+			pkt_idx_file_unmap(&f);
+			if (rc < 0) {
+				eprintf(e, "%s: %s", ds->name, strerror(ENOMEM));
+				return rc;
+			}
+			ds->idx_from_file = true;
+			return ACTF_OK;
+		}
+	}
+	int fd = openat(ds->dirfd, ds->name, O_RDONLY);
+	if (fd < 0) {
+		eprintf(e, "%s openat: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	void *pa = mmap(NULL, ds->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pa == MAP_FAILED) {
+		eprintf(e, "%s mmap: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	actf_decoder *dec = actf_decoder_init(pa, ds->len, 1, ds->metadata);
+	if (!dec) {
+		munmap(pa, ds->len);
+		eprintf(e, "actf_decoder_init: %s", strerror(errno));
+		return ACTF_ERROR;
+	}
+	struct pkt_idx idx;
+	if ((rc = actf_decoder_pkt_idx(dec, &idx)) < 0) {
+		eprintf(e, "%s: %s", ds->name, actf_decoder_last_error(dec));
+	} else if ((rc = lazy_ds_set_idx(ds, idx)) < 0) {
+		eprintf(e, "%s: %s", ds->name, strerror(ENOMEM));
+	}
+	actf_decoder_free(dec);
+	munmap(pa, ds->len);
+	return rc;
+}
+
+static void lazy_ds_free(struct lazy_ds *ds)
+{
+	lazy_ds_unmap(ds);
+	pkt_idx_entry_vec_free(&ds->idx_entries);
+	error_free(&ds->err);
+	free(ds->name);
+}
+
+/* open_lazy_dstreams sets up a lazy data stream file for each data
+ * stream file in dir, dirfd being another file descriptor of dir. Their
+ * packet indexes are left to lazy_ds_init_idx(). */
+static int open_lazy_dstreams(DIR *dir, int dirfd, const actf_metadata *m,
+			      const struct actf_freader_cfg *cfg, struct ds_lru *lru,
+			      struct lazy_ds **dss_out, size_t *dss_len_out, struct error *e)
+{
+	int rc;
+	size_t dss_len = 0;
+	struct lazy_ds *dss = malloc(count_dir_entries(dir) * sizeof(*dss));	// Allow the waste
+	if (!dss) {
+		eprintf(e, "malloc: %s", strerror(errno));
+		return ACTF_OOM;
+	}
+
+	struct dirent *dp;
+	int dstream_fd;
+	struct stat sb;
+	while ((rc = open_next_dstream(dir, cfg->metadata_filename, &dp, &dstream_fd, &sb, e)) ==
+	       ACTF_OK) {
+		struct lazy_ds *ds = &dss[dss_len];
+		*ds = (struct lazy_ds) {
+			.name = strdup(dp->d_name),
+			.len = sb.st_size,
+			.mtime = sb.st_mtim,
+			.dirfd = dirfd,
+			.metadata = m,
+			.cfg = cfg,
+			.lru = lru,
+			.err = ERROR_EMPTY,
+		};
+		close(dstream_fd);
+		if (!ds->name) {
+			eprintf(e, "strdup: %s", strerror(errno));
+			rc = ACTF_OOM;
+			goto err;
+		}
+		dss_len++;
+	}
+	if (rc != ACTF_NOT_FOUND) {
+		goto err;
+	}
+
+	*dss_out = dss;
+	*dss_len_out = dss_len;
+	return ACTF_OK;
+
+      err:
+	for (size_t i = 0; i < dss_len; i++) {
+		lazy_ds_free(&dss[i]);
+	}
+	free(dss);
+	return rc;
+}
+
+static int read_buf_alloc(struct read_buf *rb, const struct actf_freader_cfg *cfg,
+			  struct error *e)
+{
+	size_t size = cfg->read_size ? cfg->read_size : ACTF_FREADER_DEFAULT_READ_SIZE;
+	size = (size + ACTF_FREADER_READ_ALIGN - 1) / ACTF_FREADER_READ_ALIGN *
+	    ACTF_FREADER_READ_ALIGN;
+	int rc = posix_memalign(&rb->buf, ACTF_FREADER_READ_ALIGN, size);
+	if (rc != 0) {
+		rb->buf = NULL;
+		eprintf(e, "posix_memalign: %s", strerror(rc));
+		return ACTF_OOM;
+	}
+	rb->size = size;
+	return ACTF_OK;
+}
+
+static int read_ds_open(struct read_ds *ds)
+{
+	int fd = -1;
+#ifdef O_DIRECT
+	/* Fails with EINVAL if the file system does not support it */
+	if (ds->cfg->direct_io) {
+		fd = openat(ds->dirfd, ds->name, O_RDONLY | O_DIRECT);
+	}
+#endif
+	if (fd < 0) {
+		if ((fd = openat(ds->dirfd, ds->name, O_RDONLY)) < 0) {
+			eprintf(&ds->err, "%s openat: %s", ds->name, strerror(errno));
+			return ACTF_ERROR;
+		}
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	ds->fd = fd;
+	return ACTF_OK;
+}
+
+static void read_ds_close(struct read_ds *ds)
+{
+	if (ds->fd >= 0) {
+		close(ds->fd);
+		ds->fd = -1;
+	}
+}
+
+/* read_ds_restart sets up a new decoder of ds which is fed the data
+ * from the offset start, which is at a packet. A compressed file is
+ * decompressed from its beginning, the data before start is
+ * dropped. */
+static int read_ds_restart(struct read_ds *ds, size_t start)
+{
+	if (ds->fd < 0 && read_ds_open(ds) < 0) {
+		return ACTF_ERROR;
+	}
+	actf_decoder_free(ds->dec);
+	/* Only the events of the last read are in use, see
+	 * read_ds_to_generator() */
+	struct actf_decoder_cfg dec_cfg = dstream_dec_cfg(ds->cfg);
+	dec_cfg.n_bufs = 1;
+	ds->dec = actf_decoder_init_fed(ds->metadata, dec_cfg);
+	if (!ds->dec) {
+		eprintf(&ds->err, "actf_decoder_init_fed: %s", strerror(errno));
+		return ACTF_ERROR;
+	}
+	if (ds->compression != COMPRESSION_NONE) {
+		decompressor_free(ds->dcmp);
+		if (!(ds->dcmp = decompressor_init(ds->compression, &ds->err))) {
+			eprependf(&ds->err, "%s", ds->name);
+			return ACTF_ERROR;
+		}
+		ds->off = 0;
+		ds->skip = start;
+		ds->dcmp_off = 0;
+	} else {
+		ds->off = start - start % ACTF_FREADER_READ_ALIGN;
+		ds->skip = start - ds->off;
+	}
+	ds->ended = false;
+	ds->seeking = false;
+	return ACTF_OK;
+}
+
+/* read_ds_feed_decompressed decompresses the len bytes read into the
+ * read buffer and feeds them to the decoder, dropping the first skip
+ * bytes. */
+static int read_ds_feed_decompressed(struct read_ds *ds, size_t len)
+{
+	struct read_buf *rb = ds->rb;
+	if (!rb->out && !(rb->out = malloc(rb->size))) {
+		eprintf(&ds->err, "malloc: %s", strerror(errno));
+		return ACTF_OOM;
+	}
+	int rc;
+	size_t in_off = 0;
+	size_t out_len;
+	/* A filled output buffer might have more output pending */
+	do {
+		size_t in_used;
+		rc = decompressor_run(ds->dcmp, (uint8_t *) rb->buf + in_off, len - in_off, &in_used,
+				      rb->out, rb->size, &out_len, &ds->err);
+		if (rc < 0) {
+			eprependf(&ds->err, "%s", ds->name);
+			return rc;
+		}
+		in_off += in_used;
+		ds->dcmp_off += out_len;
+		size_t drop = MIN(out_len, ds->skip);
+		ds->skip -= drop;
+		if (out_len > drop &&
+		    (rc = actf_decoder_feed(ds->dec, (uint8_t *) rb->out + drop, out_len - drop)) < 0) {
+			eprintf(&ds->err, "%s", actf_decoder_last_error(ds->dec));
+			return rc;
+		}
+	} while (in_off < len || out_len == rb->size);
+	return ACTF_OK;
+}
+
+/* read_ds_read reads the next chunk of ds into the read buffer. A
+ * short read is continued until the chunk is full, len is only less
+ * than the chunk at the end of the file. The last chunk is requested
+ * as a whole multiple of ACTF_FREADER_READ_ALIGN, which direct I/O
+ * requires, but any data after the size of the file when opened is
+ * left out. */
+static int read_ds_read(struct read_ds *ds, size_t *len)
+{
+	struct read_buf *rb = ds->rb;
+	size_t want = ds->off < ds->len ? MIN(rb->size, ds->len - ds->off) : 0;
+	size_t req = (want + ACTF_FREADER_READ_ALIGN - 1) / ACTF_FREADER_READ_ALIGN *
+	    ACTF_FREADER_READ_ALIGN;
+	*len = 0;
+	while (*len < want) {
+		ssize_t n = pread(ds->fd, (uint8_t *) rb->buf + *len, req - *len, ds->off + *len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			eprintf(&ds->err, "%s pread: %s", ds->name, strerror(errno));
+			return ACTF_ERROR;
+		}
+		if (n == 0) {
+			break;
+		}
+		*len += n;
+	}
+	*len = MIN(*len, want);
+	return ACTF_OK;
+}
+
+/* read_ds_fill reads the next chunk of ds and feeds it to the decoder,
+ * the end of the data stream is fed once there is nothing more to
+ * read. */
+static int read_ds_fill(struct read_ds *ds)
+{
+	struct read_buf *rb = ds->rb;
+	if (!rb->buf && read_buf_alloc(rb, ds->cfg, &ds->err) < 0) {
+		return ACTF_OOM;
+	}
+	size_t len;
+	int rc = read_ds_read(ds, &len);
+	if (rc < 0) {
+		return rc;
+	}
+	if (ds->dcmp && len) {
+		if ((rc = read_ds_feed_decompressed(ds, len)) < 0) {
+			return rc;
+		}
+		ds->off += len;
+		return ACTF_OK;
+	}
+	if (ds->dcmp && !decompressor_ended(ds->dcmp)) {
+		eprintf(&ds->err, "%s: truncated %s data", ds->name, compression_name(ds->compression));
+		return ACTF_ERROR;
+	}
+	if (!len) {
+		if ((rc = actf_decoder_feed_end(ds->dec)) < 0) {
+			eprintf(&ds->err, "%s", actf_decoder_last_error(ds->dec));
+			return rc;
+		}
+		ds->ended = true;
+		read_ds_close(ds);
+		return ACTF_OK;
+	}
+	/* The data before a sought packet is dropped */
+	size_t drop = MIN(len, ds->skip);
+	if (len > drop &&
+	    (rc = actf_decoder_feed(ds->dec, (uint8_t *) rb->buf + drop, len - drop)) < 0) {
+		eprintf(&ds->err, "%s", actf_decoder_last_error(ds->dec));
+		return rc;
+	}
+	ds->off += len;
+	ds->skip -= drop;
+	return ACTF_OK;
+}
+
+/* read_ds_skip_sought drops the events before the sought timestamp
+ * from evs. */
+static void read_ds_skip_sought(struct read_ds *ds, actf_event ***evs, size_t *evs_len)
+{
+	size_t i = 0;
+	while (i < *evs_len && actf_event_tstamp_ns_from_origin((*evs)[i]) < ds->seek_ns) {
+		i++;
+	}
+	if (i < *evs_len) {
+		ds->seeking = false;
+	}
+	*evs += i;
+	*evs_len -= i;
+}
+
+static int read_ds_generate(void *self, actf_event ***evs, size_t *evs_len)
+{
+	struct read_ds *ds = self;
+	int rc;
+	*evs = NULL;
+	*evs_len = 0;
+	if (!ds->dec && (rc = read_ds_restart(ds, 0)) < 0) {
+		return rc;
+	}
+	/* The decoder has no events until a packet has been fed */
+	while (true) {
+		if ((rc = actf_decoder_decode(ds->dec, evs, evs_len)) < 0) {
+			eprintf(&ds->err, "%s", actf_decoder_last_error(ds->dec));
+			return rc;
+		}
+		if (ds->seeking) {
+			read_ds_skip_sought(ds, evs, evs_len);
+		}
+		if (*evs_len || ds->ended) {
+			return ACTF_OK;
+		}
+		if ((rc = read_ds_fill(ds)) < 0) {
+			return rc;
+		}
+	}
+}
+
+static int read_ds_seek_ns_from_origin(void *self, int64_t tstamp)
+{
+	struct read_ds *ds = self;
+	/* Feed the data from the first indexed packet that might hold the
+	 * sought event, if there is an index. */
+	size_t start = 0;
+	if (ds->idx_file.pa) {
+		const struct pkt_idx *idx = &ds->idx_file.idx;
+		size_t pkt_i = pkt_idx_find(idx, tstamp);
+		start = (pkt_i < idx->len ? idx->entries[pkt_i].bit_off : idx->end_bit_off) / 8;
+	}
+	int rc = read_ds_restart(ds, start);
+	if (rc < 0) {
+		return rc;
+	}
+	ds->seeking = true;
+	ds->seek_ns = tstamp;
+	return ACTF_OK;
+}
+
+static int read_ds_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	struct read_ds *ds = self;
+	if (!ds->idx_file.pa) {
+		return ACTF_NOT_FOUND;
+	}
+	const struct pkt_idx *idx = &ds->idx_file.idx;
+	int rc = pkt_idx_time_range(idx, ds->metadata, begin, end);
+	if (rc < 0) {
+		return rc;
+	}
+	/* The packets after the indexed ones could end at any time */
+	if (idx->end_bit_off < ds->idx_file.data_size * 8) {
+		*end = INT64_MAX;
+	}
+	return ACTF_OK;
+}
+
+static const char *read_ds_last_error(void *self)
+{
+	struct read_ds *ds = self;
+	if (ds->err.buf[0] == '\0') {
+		return NULL;
+	}
+	return ds->err.buf;
+}
+
+/* The events of a read data stream file are invalidated by the next
+ * read, which might have to decode more than once before it has any
+ * events. */
+static struct actf_event_generator read_ds_to_generator(struct read_ds *ds)
+{
+	return (struct actf_event_generator) {
+		.generate = read_ds_generate,
+		.seek_ns_from_origin = read_ds_seek_ns_from_origin,
+		.last_error = read_ds_last_error,
+		.self = ds,
+		.n_bufs = 1,
+		.time_range = read_ds_time_range,
+	};
+}
+
+static void read_ds_free(struct read_ds *ds)
+{
+	actf_decoder_free(ds->dec);
+	decompressor_free(ds->dcmp);
+	read_ds_close(ds);
+	pkt_idx_file_unmap(&ds->idx_file);
+	error_free(&ds->err);
+	free(ds->name);
+}
+
+/* read_ds_stream_pkt_idx_file writes the packet index file of the
+ * compressed ds, which is streamed through a fed decoder of its own.
+ * The whole file is decompressed to get the size of its data. */
+static int read_ds_stream_pkt_idx_file(struct read_ds *ds, struct error *e)
+{
+	struct read_ds ids = {
+		.name = ds->name,
+		.len = ds->len,
+		.mtime = ds->mtime,
+		.dirfd = ds->dirfd,
+		.fd = -1,
+		.metadata = ds->metadata,
+		.cfg = ds->cfg,
+		.rb = ds->rb,
+		.compression = ds->compression,
+		.err = ERROR_EMPTY,
+	};
+	int rc = read_ds_restart(&ids, 0);
+	while (rc == ACTF_OK && !ids.ended) {
+		if ((rc = read_ds_fill(&ids)) < 0) {
+			break;
+		}
+		if ((rc = actf_decoder_feed_pkt_idx(ids.dec)) < 0) {
+			eprintf(&ids.err, "%s: %s", ids.name, actf_decoder_last_error(ids.dec));
+			break;
+		}
+		rc = ACTF_OK;
+	}
+	struct pkt_idx idx;
+	if (rc == ACTF_OK && (rc = actf_decoder_pkt_idx(ids.dec, &idx)) < 0) {
+		eprintf(&ids.err, "%s: %s", ids.name, actf_decoder_last_error(ids.dec));
+	}
+	if (rc < 0) {
+		eprintf(e, "%s", ids.err.buf);
+	} else {
+		struct pkt_idx_file_id id = pkt_idx_file_id_of(ds->len, ds->mtime, ds->metadata,
+								ds->compression);
+		rc = pkt_idx_file_write(ds->dirfd, ds->name, &id, &idx, ids.dcmp_off, e);
+	}
+	actf_decoder_free(ids.dec);
+	decompressor_free(ids.dcmp);
+	read_ds_close(&ids);
+	error_free(&ids.err);
+	return rc;
+}
+
+/* read_ds_write_pkt_idx_file writes the packet index file of ds. The
+ * data stream file is mmapped while being indexed. A compressed one
+ * is instead streamed through a fed decoder of its own, as when it is
+ * read, which indexes its packets without keeping them. */
+static int read_ds_write_pkt_idx_file(struct read_ds *ds, struct error *e)
+{
+	if (ds->compression != COMPRESSION_NONE) {
+		return read_ds_stream_pkt_idx_file(ds, e);
+	}
+	int rc;
+	int fd = openat(ds->dirfd, ds->name, O_RDONLY);
+	if (fd < 0) {
+		eprintf(e, "%s openat: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	void *pa = mmap(NULL, ds->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pa == MAP_FAILED) {
+		eprintf(e, "%s mmap: %s", ds->name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	actf_decoder *dec = actf_decoder_init(pa, ds->len, 1, ds->metadata);
+	if (!dec) {
+		eprintf(e, "actf_decoder_init: %s", strerror(errno));
+		rc = ACTF_ERROR;
+		goto out;
+	}
+	struct pkt_idx idx;
+	if ((rc = actf_decoder_pkt_idx(dec, &idx)) < 0) {
+		eprintf(e, "%s: %s", ds->name, actf_decoder_last_error(dec));
+	} else {
+		struct pkt_idx_file_id id = pkt_idx_file_id_of(ds->len, ds->mtime, ds->metadata,
+								ds->compression);
+		rc = pkt_idx_file_write(ds->dirfd, ds->name, &id, &idx, ds->len, e);
+	}
+	actf_decoder_free(dec);
+
+      out:
+	munmap(pa, ds->len);
+	return rc;
+}
+
+/* dstream_compression returns the compression of the data stream
+ * file fd named name in c. */
+static int dstream_compression(int fd, const char *name, enum compression *c, struct error *e)
 {
-	int mfd = openat(fd, metadata_filename, O_RDONLY);
-	if (mfd < 0) {
-		eprintf(e, "%s openat: %s", metadata_filename, strerror(errno));
-		return NULL;
-	}
-	actf_metadata *m = actf_metadata_init();
-	if (!m) {
-		close(mfd);
-		eprintf(e, "actf_metadata_init: %s", strerror(errno));
-		return NULL;
-	}
-	int rc = actf_metadata_parse_fd(m, mfd);
-	if (rc < 0) {
-		eprintf(e, actf_metadata_last_error(m));
-		actf_metadata_free(m);
-		close(mfd);
-		return NULL;
+	uint8_t magic[COMPRESSION_MAGIC_LEN];
+	ssize_t n = pread(fd, magic, sizeof(magic), 0);
+	if (n < 0) {
+		eprintf(e, "%s pread: %s", name, strerror(errno));
+		return ACTF_ERROR;
 	}
-	close(mfd);
-	return m;
+	*c = compression_of(magic, n);
+	return ACTF_OK;
 }
 
-/* mmap_datastreams mmaps all regular files in dir. Any file matching
- * `metadata_filename` will not be mmapped. */
-static int mmap_datastreams(DIR *dir, const char *metadata_filename,
-			    struct mmap_s **mmaps_out, size_t *mmaps_len_out, struct error *e)
+/* has_compressed_dstreams returns true in compressed if any data
+ * stream file in dir is compressed, and rewinds dir. */
+static int has_compressed_dstreams(DIR *dir, const char *metadata_filename, bool *compressed,
+				   struct error *e)
 {
 	int rc;
 	struct dirent *dp;
-	size_t n_entries = 0;
-	while ((dp = readdir(dir)) != NULL) {
-		n_entries++;	// Allow the waste
+	int dstream_fd;
+	struct stat sb;
+	*compressed = false;
+	while (!*compressed &&
+	       (rc = open_next_dstream(dir, metadata_filename, &dp, &dstream_fd, &sb, e)) == ACTF_OK) {
+		enum compression c;
+		rc = dstream_compression(dstream_fd, dp->d_name, &c, e);
+		close(dstream_fd);
+		if (rc < 0) {
+			return rc;
+		}
+		*compressed = c != COMPRESSION_NONE;
 	}
 	rewinddir(dir);
+	return *compressed || rc == ACTF_NOT_FOUND ? ACTF_OK : rc;
+}
 
-	size_t mmaps_len = 0;
-	struct mmap_s *mmaps = malloc(n_entries * sizeof(*mmaps));
-	if (!mmaps) {
+/* open_read_dstreams sets up a read data stream file for each data
+ * stream file in dir, dirfd being another file descriptor of dir. Any
+ * valid packet index file of theirs is mapped. */
+static int open_read_dstreams(DIR *dir, int dirfd, const actf_metadata *m,
+			      const struct actf_freader_cfg *cfg, struct read_buf *rb,
+			      struct read_ds **dss_out, size_t *dss_len_out, struct error *e)
+{
+	int rc;
+	size_t dss_len = 0;
+	struct read_ds *dss = malloc(count_dir_entries(dir) * sizeof(*dss));	// Allow the waste
+	if (!dss) {
 		eprintf(e, "malloc: %s", strerror(errno));
 		return ACTF_OOM;
 	}
 
-	int fd = dirfd(dir);
-	if (fd < 0) {
-		free(mmaps);
-		eprintf(e, "dirfd: %s", strerror(errno));
-		return ACTF_ERROR;
-	}
+	struct dirent *dp;
+	int dstream_fd;
 	struct stat sb;
-	while ((dp = readdir(dir)) != NULL) {
-		if (strcmp(dp->d_name, metadata_filename) == 0 || dp->d_name[0] == '.') {
-			continue;
-		}
-		int dstream_fd = openat(fd, dp->d_name, O_RDONLY);
-		if (dstream_fd < 0) {
-			eprintf(e, "openat: %s", strerror(errno));
-			rc = ACTF_ERROR;
+	while ((rc = open_next_dstream(dir, cfg->metadata_filename, &dp, &dstream_fd, &sb, e)) ==
+	       ACTF_OK) {
+		struct read_ds *ds = &dss[dss_len];
+		*ds = (struct read_ds) {
+			.name = strdup(dp->d_name),
+			.len = sb.st_size,
+			.mtime = sb.st_mtim,
+			.dirfd = dirfd,
+			.fd = -1,
+			.metadata = m,
+			.cfg = cfg,
+			.rb = rb,
+			.err = ERROR_EMPTY,
+		};
+		rc = dstream_compression(dstream_fd, dp->d_name, &ds->compression, e);
+		close(dstream_fd);
+		if (rc < 0) {
+			free(ds->name);
 			goto err;
 		}
-		if (fstat(dstream_fd, &sb) < 0) {
-			close(dstream_fd);
-			eprintf(e, "fstat: %s", strerror(errno));
-			rc = ACTF_ERROR;
+		if (!ds->name) {
+			eprintf(e, "strdup: %s", strerror(errno));
+			rc = ACTF_OOM;
 			goto err;
 		}
-		if (!S_ISREG(sb.st_mode) || sb.st_size == 0) {
-			close(dstream_fd);
-			continue;
-		}
-		void *pa = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, dstream_fd, 0);
-		if (pa == MAP_FAILED) {
-			close(dstream_fd);
-			eprintf(e, "mmap: %s", strerror(errno));
+		/* Fail early if this build can not decompress it */
+		if (ds->compression != COMPRESSION_NONE &&
+		    !(ds->dcmp = decompressor_init(ds->compression, e))) {
+			eprependf(e, "%s", ds->name);
+			free(ds->name);
 			rc = ACTF_ERROR;
 			goto err;
 		}
-		close(dstream_fd);
-		mmaps[mmaps_len++] = (struct mmap_s) {
-			.pa = pa,
-			.len = sb.st_size,
-		};
+		if (cfg->pkt_idx_files) {
+			struct pkt_idx_file_id id = pkt_idx_file_id_of(ds->len, ds->mtime, m,
+									ds->compression);
+			pkt_idx_file_map(dirfd, ds->name, &id, &ds->idx_file, NULL);
+		}
+		dss_len++;
+	}
+	if (rc != ACTF_NOT_FOUND) {
+		goto err;
 	}
 
-	*mmaps_out = mmaps;
-	*mmaps_len_out = mmaps_len;
+	*dss_out = dss;
+	*dss_len_out = dss_len;
 	return ACTF_OK;
 
-err:
-	for (size_t i = 0; i < mmaps_len; i++) {
-		munmap(mmaps[i].pa, mmaps[i].len);
+      err:
+	for (size_t i = 0; i < dss_len; i++) {
+		read_ds_free(&dss[i]);
 	}
-	free(mmaps);
+	free(dss);
 	return rc;
 }
 
-int init_decoders(struct mmap_s *mmaps, size_t mmaps_len,
-		  actf_metadata *m, size_t evs_cap, actf_decoder **decs, struct error *e)
+/* init_pdecoder sets up the parallel decoder of the data stream file
+ * ms, using the packet index of its decoder dec. */
+static actf_pdecoder *init_pdecoder(struct mmap_s *ms, actf_metadata *m,
+				    const struct actf_freader_cfg *cfg, actf_decoder *dec,
+				    struct error *e)
 {
-	int rc = ACTF_ERROR;
-	size_t i;
-	for (i = 0; i < mmaps_len; i++) {
-		actf_decoder *d = actf_decoder_init(mmaps[i].pa, mmaps[i].len, evs_cap, m);
-		if (!d) {
-			eprintf(e, "actf_decoder_init: %s", strerror(errno));
-			rc = ACTF_ERROR;
-			goto err;
+	struct actf_pdecoder_cfg pdec_cfg = {
+		.n_threads = cfg->dstream_threads,
+		.dec_cfg = {
+			.evs_cap = cfg->dstream_evs_cap,
+			.evc_filter = cfg->evc_filter,
+			.mode = cfg->decoder_mode,
+			.n_bufs = 2,
+		},
+	};
+	struct pkt_idx idx;
+	if (actf_decoder_pkt_idx(dec, &idx) < 0) {
+		eprintf(e, "%s: %s", ms->name, actf_decoder_last_error(dec));
+		return NULL;
+	}
+	actf_pdecoder *pd = actf_pdecoder_init_idx(ms->pa, ms->len, m, pdec_cfg, idx);
+	if (!pd) {
+		eprintf(e, "actf_pdecoder_init_idx: %s", strerror(errno));
+		return NULL;
+	}
+	return pd;
+}
+
+/* init_dstream sets up the generator of the data stream file i of cd,
+ * which is opened by open_ctf_dir(). This is the part of opening a
+ * data stream file that needs to read it. */
+static int init_dstream(struct ctf_dir *cd, size_t i, const struct actf_freader_cfg *cfg,
+			struct error *e)
+{
+	if (cd->read_dss) {
+		return ACTF_OK;
+	}
+	if (cd->lazy_dss) {
+		return lazy_ds_init_idx(&cd->lazy_dss[i], e);
+	}
+	cd->decs[i] = init_decoder(&cd->mmaps[i], cd->metadata, cfg, e);
+	if (!cd->decs[i]) {
+		return ACTF_ERROR;
+	}
+	if (cd->pdecs) {
+		cd->pdecs[i] = init_pdecoder(&cd->mmaps[i], cd->metadata, cfg, cd->decs[i], e);
+		if (!cd->pdecs[i]) {
+			return ACTF_ERROR;
+		}
+	}
+	if (cd->prods) {
+		cd->prods[i] = actf_producer_init(actf_decoder_to_generator(cd->decs[i]), 2);
+		if (!cd->prods[i]) {
+			eprintf(e, "actf_producer_init: %s", strerror(errno));
+			return ACTF_ERROR;
 		}
-		decs[i] = d;
 	}
 	return ACTF_OK;
+}
 
-      err:
-	for (size_t j = 0; j < i; j++) {
-		actf_decoder_free(decs[j]);
+/* ctf_dir_gen returns the event generator of the data stream file i. */
+static struct actf_event_generator ctf_dir_gen(struct ctf_dir *cd, size_t i)
+{
+	if (cd->lazy_dss) {
+		return lazy_ds_to_generator(&cd->lazy_dss[i]);
 	}
-	return rc;
+	if (cd->read_dss) {
+		return read_ds_to_generator(&cd->read_dss[i]);
+	}
+	if (cd->pdecs) {
+		return actf_pdecoder_to_generator(cd->pdecs[i]);
+	}
+	if (cd->prods) {
+		return actf_producer_to_generator(cd->prods[i]);
+	}
+	return actf_decoder_to_generator(cd->decs[i]);
 }
 
 actf_freader *actf_freader_init(struct actf_freader_cfg cfg)
@@ -194,12 +1498,17 @@ actf_freader *actf_freader_init(struct actf_freader_cfg cfg)
 	if (cfg.metadata_filename == NULL) {
 		cfg.metadata_filename = "metadata";
 	}
+	if (metadata_cache_init(&rd->mdc) < 0) {
+		free(rd);
+		return NULL;
+	}
 	rd->cfg = cfg;
+	rd->lru.max_mapped = cfg.max_mmaps ? cfg.max_mmaps : ACTF_FREADER_DEFAULT_MAX_MMAPS;
 	rd->err = ERROR_EMPTY;
 	return rd;
 }
 
-static int init_muxer(struct ctf_dir *dirs, size_t dirs_len, size_t evs_cap,
+static int init_muxer(struct ctf_dir *dirs, size_t dirs_len, const struct actf_freader_cfg *cfg,
 		      struct muxer_s *mux, struct error *e)
 {
 	size_t gens_len = 0;
@@ -213,13 +1522,19 @@ static int init_muxer(struct ctf_dir *dirs, size_t dirs_len, size_t evs_cap,
 	}
 	for (size_t gens_i = 0, i = 0; i < dirs_len; i++) {
 		for (size_t j = 0; j < dirs[i].decs_len; j++) {
-			gens[gens_i++] = actf_decoder_to_generator(dirs[i].decs[j]);
+			gens[gens_i++] = ctf_dir_gen(&dirs[i], j);
 		}
 	}
-	actf_muxer *m = actf_muxer_init(gens, gens_len, evs_cap);
+	struct actf_muxer_cfg mux_cfg = {
+		.evs_cap = cfg->muxer_evs_cap,
+		.order = cfg->muxer_order,
+		.window_ns = cfg->muxer_window_ns,
+		.defer_gens = use_lazy_dstreams(cfg),
+	};
+	actf_muxer *m = actf_muxer_init_cfg(gens, gens_len, mux_cfg);
 	if (!m) {
 		free(gens);
-		eprintf(e, "actf_muxer_init: %s", strerror(errno));
+		eprintf(e, "actf_muxer_init_cfg: %s", strerror(errno));
 		return ACTF_ERROR;
 	}
 	*mux = (struct muxer_s) {
@@ -230,10 +1545,71 @@ static int init_muxer(struct ctf_dir *dirs, size_t dirs_len, size_t evs_cap,
 	return ACTF_OK;
 }
 
+/* open_lazy_ctf_dir opens a ctf directory at path, dir, whose
+ * metadata m is read. A lazy data stream file is set up for each data
+ * stream file. */
+static int open_lazy_ctf_dir(const char *path, DIR *dir, actf_metadata *m,
+			     const struct actf_freader_cfg *cfg, struct ds_lru *lru,
+			     struct ctf_dir *cd, struct error *e)
+{
+	int fd = open(path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		eprintf(e, "%s open: %s", path, strerror(errno));
+		return ACTF_ERROR;
+	}
+	size_t dss_len;
+	struct lazy_ds *dss;
+	int rc = open_lazy_dstreams(dir, fd, m, cfg, lru, &dss, &dss_len, e);
+	if (rc < 0) {
+		close(fd);
+		return rc;
+	}
+	*cd = (struct ctf_dir) {
+		.path = strdup(path),
+		.metadata = m,
+		.lazy_dss = dss,
+		.dirfd = fd,
+		.decs_len = dss_len,
+	};
+	return ACTF_OK;
+}
+
+/* open_read_ctf_dir opens a ctf directory at path, dir, whose
+ * metadata m is read. A read data stream file is set up for each data
+ * stream file. */
+static int open_read_ctf_dir(const char *path, DIR *dir, actf_metadata *m,
+			     const struct actf_freader_cfg *cfg, struct read_buf *rb,
+			     struct ctf_dir *cd, struct error *e)
+{
+	int fd = open(path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		eprintf(e, "%s open: %s", path, strerror(errno));
+		return ACTF_ERROR;
+	}
+	size_t dss_len;
+	struct read_ds *dss;
+	int rc = open_read_dstreams(dir, fd, m, cfg, rb, &dss, &dss_len, e);
+	if (rc < 0) {
+		close(fd);
+		return rc;
+	}
+	*cd = (struct ctf_dir) {
+		.path = strdup(path),
+		.metadata = m,
+		.read_dss = dss,
+		.dirfd = fd,
+		.decs_len = dss_len,
+	};
+	return ACTF_OK;
+}
+
 /* open_ctf_dir opens a ctf directory at path. The metadata file is
- * read, all data stream files are mmapped, and a decoder is setup for
- * each data stream file. */
-static int open_ctf_dir(const char *path, struct actf_freader_cfg *cfg,
+ * read and all data stream files are mmapped, unless lazy or read data
+ * stream files are used. Read data stream files are always used if
+ * any data stream file is compressed. Their generators are left to
+ * init_dstream(). */
+static int open_ctf_dir(const char *path, const struct actf_freader_cfg *cfg,
+			struct ds_lru *lru, struct metadata_cache *mdc, struct read_buf *rb,
 			struct ctf_dir *cd, struct error *e)
 {
 	int rc = ACTF_ERROR;
@@ -249,29 +1625,71 @@ static int open_ctf_dir(const char *path, struct actf_freader_cfg *cfg,
 		goto err;
 	}
 
-	actf_metadata *m = openat_metadata(fd, cfg->metadata_filename, e);
+	actf_metadata *m = metadata_cache_get(mdc, fd, cfg->metadata_filename, e);
 	if (!m) {
 		rc = ACTF_ERROR;
 		goto err;
 	}
 
+	/* Compressed data stream files can only be read */
+	bool compressed = false;
+	if (cfg->dstream_io != ACTF_FREADER_IO_PREAD &&
+	    (rc = has_compressed_dstreams(dir, cfg->metadata_filename, &compressed, e)) < 0) {
+		goto err;
+	}
+
+	if (use_lazy_dstreams(cfg) && !compressed) {
+		if ((rc = open_lazy_ctf_dir(path, dir, m, cfg, lru, cd, e)) < 0) {
+			goto err;
+		}
+		closedir(dir);
+		return ACTF_OK;
+	}
+	if (cfg->dstream_io == ACTF_FREADER_IO_PREAD || compressed) {
+		if ((rc = open_read_ctf_dir(path, dir, m, cfg, rb, cd, e)) < 0) {
+			goto err;
+		}
+		closedir(dir);
+		return ACTF_OK;
+	}
+
 	size_t mmaps_len;
 	struct mmap_s *mmaps;
 	rc = mmap_datastreams(dir, cfg->metadata_filename, &mmaps, &mmaps_len, e);
 	if (rc < 0) {
-		goto err_mmap;
+		goto err;
+	}
+
+	if (cfg->pkt_idx_files) {
+		map_pkt_idx_files(fd, mmaps, mmaps_len, m);
 	}
 
-	actf_decoder **decs = malloc(mmaps_len * sizeof(*decs));
+	/* The generators are NULL until set up by init_dstream() */
+	actf_decoder **decs = calloc(mmaps_len, sizeof(*decs));
 	if (!decs) {
-		eprintf(e, "malloc: %s", strerror(errno));
+		eprintf(e, "calloc: %s", strerror(errno));
 		rc = ACTF_OOM;
 		goto err_decs;
 	}
 
-	rc = init_decoders(mmaps, mmaps_len, m, cfg->dstream_evs_cap, decs, e);
-	if (rc < 0) {
-		goto err_decs_init;
+	actf_pdecoder **pdecs = NULL;
+	if (cfg->dstream_threads) {
+		pdecs = calloc(mmaps_len, sizeof(*pdecs));
+		if (!pdecs) {
+			eprintf(e, "calloc: %s", strerror(errno));
+			rc = ACTF_OOM;
+			goto err_pdecs;
+		}
+	}
+
+	actf_producer **prods = NULL;
+	if (use_producers(cfg)) {
+		prods = calloc(mmaps_len, sizeof(*prods));
+		if (!prods) {
+			eprintf(e, "calloc: %s", strerror(errno));
+			rc = ACTF_OOM;
+			goto err_prods;
+		}
 	}
 
 	*cd = (struct ctf_dir) {
@@ -280,21 +1698,24 @@ static int open_ctf_dir(const char *path, struct actf_freader_cfg *cfg,
 		.mmaps = mmaps,
 		.mmaps_len = mmaps_len,
 		.decs = decs,
+		.pdecs = pdecs,
+		.prods = prods,
+		.dirfd = -1,
 		.decs_len = mmaps_len,
 	};
 
 	closedir(dir);
 	return ACTF_OK;
 
-      err_decs_init:
+      err_prods:
+	free(pdecs);
+      err_pdecs:
 	free(decs);
       err_decs:
 	for (size_t i = 0; i < mmaps_len; i++) {
-		munmap(mmaps[i].pa, mmaps[i].len);
+		mmap_s_free(&mmaps[i]);
 	}
 	free(mmaps);
-      err_mmap:
-	actf_metadata_free(m);
       err:
 	closedir(dir);
 	return rc;
@@ -305,18 +1726,155 @@ static void ctf_dir_free(struct ctf_dir *cd)
 	if (!cd) {
 		return;
 	}
-	for (size_t i = 0; i < cd->decs_len; i++) {
+	for (size_t i = 0; cd->pdecs && i < cd->decs_len; i++) {
+		actf_pdecoder_free(cd->pdecs[i]);
+	}
+	free(cd->pdecs);
+	for (size_t i = 0; cd->prods && i < cd->decs_len; i++) {
+		actf_producer_free(cd->prods[i]);
+	}
+	free(cd->prods);
+	for (size_t i = 0; cd->decs && i < cd->decs_len; i++) {
 		actf_decoder_free(cd->decs[i]);
 	}
 	free(cd->decs);
+	for (size_t i = 0; cd->lazy_dss && i < cd->decs_len; i++) {
+		lazy_ds_free(&cd->lazy_dss[i]);
+	}
+	free(cd->lazy_dss);
+	for (size_t i = 0; cd->read_dss && i < cd->decs_len; i++) {
+		read_ds_free(&cd->read_dss[i]);
+	}
+	free(cd->read_dss);
+	if (cd->dirfd >= 0) {
+		close(cd->dirfd);
+	}
 	for (size_t i = 0; i < cd->mmaps_len; i++) {
-		munmap(cd->mmaps[i].pa, cd->mmaps[i].len);
+		mmap_s_free(&cd->mmaps[i]);
 	}
 	free(cd->mmaps);
-	actf_metadata_free(cd->metadata);
 	free(cd->path);
 }
 
+/* A task pool runs the tasks 0 to n_tasks - 1 of run on a number of
+ * threads. The tasks are started in order and none is started after a
+ * task has failed, so the first failed task is the same as if they were
+ * run in order on a single thread. */
+struct task_pool {
+	pthread_mutex_t mtx;
+	int (*run)(void *arg, size_t i);
+	void *arg;
+	size_t n_tasks;
+	size_t next_i;
+	/* The first failed task, n_tasks if none */
+	size_t failed_i;
+	int failed_rc;
+};
+
+static void *task_pool_work(void *arg)
+{
+	struct task_pool *tp = arg;
+	pthread_mutex_lock(&tp->mtx);
+	while (tp->next_i < tp->failed_i) {
+		size_t i = tp->next_i++;
+		pthread_mutex_unlock(&tp->mtx);
+		int rc = tp->run(tp->arg, i);
+		pthread_mutex_lock(&tp->mtx);
+		if (rc < 0 && i < tp->failed_i) {
+			tp->failed_i = i;
+			tp->failed_rc = rc;
+		}
+	}
+	pthread_mutex_unlock(&tp->mtx);
+	return NULL;
+}
+
+/* run_tasks runs the n_tasks tasks of run on up to n_threads threads,
+ * the calling thread being one of them. If a thread can not be
+ * started, the tasks are run by the others. The return code of the
+ * first failed task is returned and its index is put in failed_i,
+ * which is n_tasks if no task failed. */
+static int run_tasks(size_t n_tasks, size_t n_threads, int (*run)(void *arg, size_t i),
+		     void *arg, size_t *failed_i)
+{
+	struct task_pool tp = {
+		.run = run,
+		.arg = arg,
+		.n_tasks = n_tasks,
+		.failed_i = n_tasks,
+		.failed_rc = ACTF_OK,
+	};
+	n_threads = MIN(n_threads, n_tasks);
+	pthread_t *threads = NULL;
+	if (n_threads > 1 && pthread_mutex_init(&tp.mtx, NULL) == 0) {
+		threads = malloc((n_threads - 1) * sizeof(*threads));
+		if (!threads) {
+			pthread_mutex_destroy(&tp.mtx);
+		}
+	}
+	if (!threads) {
+		for (size_t i = 0; i < n_tasks; i++) {
+			int rc = run(arg, i);
+			if (rc < 0) {
+				*failed_i = i;
+				return rc;
+			}
+		}
+		*failed_i = n_tasks;
+		return ACTF_OK;
+	}
+
+	size_t n_started = 0;
+	while (n_started < n_threads - 1 &&
+	       pthread_create(&threads[n_started], NULL, task_pool_work, &tp) == 0) {
+		n_started++;
+	}
+	task_pool_work(&tp);
+	for (size_t i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&tp.mtx);
+	*failed_i = tp.failed_i;
+	return tp.failed_rc;
+}
+
+struct open_dirs {
+	char **paths;
+	struct ctf_dir *dirs;
+	struct error *errs;
+	const struct actf_freader_cfg *cfg;
+	struct ds_lru *lru;
+	struct metadata_cache *mdc;
+	struct read_buf *rb;
+};
+
+static int open_dirs_run(void *arg, size_t i)
+{
+	struct open_dirs *od = arg;
+	return open_ctf_dir(od->paths[i], od->cfg, od->lru, od->mdc, od->rb, &od->dirs[i],
+			    &od->errs[i]);
+}
+
+/* The task of setting up the data stream file i of cd */
+struct dstream_task {
+	struct ctf_dir *cd;
+	size_t i;
+	struct error err;
+};
+
+struct init_dstreams {
+	struct dstream_task *tasks;
+	const struct actf_freader_cfg *cfg;
+};
+
+static int init_dstreams_run(void *arg, size_t i)
+{
+	struct init_dstreams *ids = arg;
+	struct dstream_task *t = &ids->tasks[i];
+	return init_dstream(t->cd, t->i, ids->cfg, &t->err);
+}
+
 int actf_freader_open_folders(actf_freader *rd, char **paths, size_t len)
 {
 	if (!len) {
@@ -331,15 +1889,70 @@ int actf_freader_open_folders(actf_freader *rd, char **paths, size_t len)
 		eprintf(e, "malloc: %s", strerror(errno));
 		return ACTF_OOM;
 	}
-	/* Initialize all data stream files */
-	size_t total_decs = 0;
 	for (i = 0; i < len; i++) {
-		rc = open_ctf_dir(paths[i], &rd->cfg, dirs + i, e);
-		if (rc < 0) {
-			goto err;
-		}
+		dirs[i] = (struct ctf_dir) {.dirfd = -1 };
+	}
+	struct error *errs = calloc(len, sizeof(*errs));
+	if (!errs) {
+		eprintf(e, "calloc: %s", strerror(errno));
+		rc = ACTF_OOM;
+		goto err_errs;
+	}
+
+	/* Open the directories, parsing their metadata, and then set up
+	 * the data stream files of the directories before the first one
+	 * failing to open. A failure of those is reported before the
+	 * failed directory, as if they were opened one by one. */
+	struct open_dirs od = {
+		.paths = paths,
+		.dirs = dirs,
+		.errs = errs,
+		.cfg = &rd->cfg,
+		.lru = &rd->lru,
+		.mdc = &rd->mdc,
+		.rb = &rd->rb,
+	};
+	size_t n_dirs;
+	int dirs_rc = run_tasks(len, rd->cfg.open_threads, open_dirs_run, &od, &n_dirs);
+
+	size_t total_decs = 0;
+	for (i = 0; i < n_dirs; i++) {
 		total_decs += dirs[i].decs_len;
 	}
+	struct dstream_task *tasks = malloc(MAX(total_decs, 1) * sizeof(*tasks));
+	if (!tasks) {
+		eprintf(e, "malloc: %s", strerror(errno));
+		rc = ACTF_OOM;
+		goto err_tasks;
+	}
+	for (size_t tasks_i = 0, j = 0; j < n_dirs; j++) {
+		for (size_t k = 0; k < dirs[j].decs_len; k++) {
+			tasks[tasks_i++] = (struct dstream_task) {
+				.cd = &dirs[j],
+				.i = k,
+				.err = ERROR_EMPTY,
+			};
+		}
+	}
+	struct init_dstreams ids = {
+		.tasks = tasks,
+		.cfg = &rd->cfg,
+	};
+	size_t failed_task;
+	rc = run_tasks(total_decs, rd->cfg.open_threads, init_dstreams_run, &ids, &failed_task);
+	if (rc < 0) {
+		eprintf(e, "%s", tasks[failed_task].err.buf);
+	} else if (dirs_rc < 0) {
+		eprintf(e, "%s", errs[n_dirs].buf);
+		rc = dirs_rc;
+	}
+	for (i = 0; i < total_decs; i++) {
+		error_free(&tasks[i].err);
+	}
+	free(tasks);
+	if (rc < 0) {
+		goto err_tasks;
+	}
 
 	/* Put all data stream files in a muxer if there are more than one
 	 * data stream file in total, otherwise use the decoder directly
@@ -347,21 +1960,23 @@ int actf_freader_open_folders(actf_freader *rd, char **paths, size_t len)
 	struct muxer_s mux = { 0 };
 	struct actf_event_generator active_gen = { 0 };
 	if (total_decs == 1) {
-		actf_decoder *active_dec = NULL;
 		for (i = 0; i < len; i++) {
 			if (dirs[i].decs_len == 1) {
-				active_dec = dirs[i].decs[0];
+				active_gen = ctf_dir_gen(&dirs[i], 0);
 			}
 		}
-		active_gen = actf_decoder_to_generator(active_dec);
 	} else if (total_decs > 0) {
-		rc = init_muxer(dirs, len, rd->cfg.muxer_evs_cap, &mux, e);
+		rc = init_muxer(dirs, len, &rd->cfg, &mux, e);
 		if (rc < 0) {
-			goto err;
+			goto err_tasks;
 		}
 		active_gen = actf_muxer_to_generator(mux.muxer);
 	}
 
+	for (i = 0; i < len; i++) {
+		error_free(&errs[i]);
+	}
+	free(errs);
 	rd->dirs = dirs;
 	rd->dirs_len = len;
 	rd->mux = mux;
@@ -369,9 +1984,15 @@ int actf_freader_open_folders(actf_freader *rd, char **paths, size_t len)
 
 	return ACTF_OK;
 
-      err:
-	for (size_t j = 0; j < i; j++) {
-		ctf_dir_free(&dirs[j]);
+      err_tasks:
+	for (i = 0; i < len; i++) {
+		error_free(&errs[i]);
+	}
+	free(errs);
+      err_errs:
+	/* Directories that did not open are left as initialized */
+	for (i = 0; i < len; i++) {
+		ctf_dir_free(&dirs[i]);
 	}
 	free(dirs);
 	return rc;
@@ -383,12 +2004,72 @@ int actf_freader_open_folder(actf_freader *rd, char *path)
 	return actf_freader_open_folders(rd, paths, 1);
 }
 
+/* write_pkt_idx_files writes a packet index file for each data stream
+ * file in cd which does not already have a valid one. */
+static int write_pkt_idx_files(struct ctf_dir *cd, struct error *e)
+{
+	int rc = ACTF_OK;
+	int fd = open(cd->path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		eprintf(e, "%s open: %s", cd->path, strerror(errno));
+		return ACTF_ERROR;
+	}
+	for (size_t i = 0; i < cd->mmaps_len; i++) {
+		struct mmap_s *ms = &cd->mmaps[i];
+		if (ms->idx_file.pa) {
+			continue;
+		}
+		struct pkt_idx idx;
+		if ((rc = actf_decoder_pkt_idx(cd->decs[i], &idx)) < 0) {
+			eprintf(e, "%s: %s", ms->name, actf_decoder_last_error(cd->decs[i]));
+			break;
+		}
+		struct pkt_idx_file_id id = mmap_s_pkt_idx_file_id(ms, cd->metadata);
+		if ((rc = pkt_idx_file_write(fd, ms->name, &id, &idx, ms->len, e)) < 0) {
+			break;
+		}
+	}
+	for (size_t i = 0; rc == ACTF_OK && cd->lazy_dss && i < cd->decs_len; i++) {
+		struct lazy_ds *ds = &cd->lazy_dss[i];
+		if (ds->idx_from_file) {
+			continue;
+		}
+		struct pkt_idx_file_id id = pkt_idx_file_id_of(ds->len, ds->mtime, cd->metadata,
+								COMPRESSION_NONE);
+		rc = pkt_idx_file_write(fd, ds->name, &id, &ds->idx, ds->len, e);
+	}
+	for (size_t i = 0; rc == ACTF_OK && cd->read_dss && i < cd->decs_len; i++) {
+		struct read_ds *ds = &cd->read_dss[i];
+		if (ds->idx_file.pa) {
+			continue;
+		}
+		rc = read_ds_write_pkt_idx_file(ds, e);
+	}
+	close(fd);
+	return rc;
+}
+
+int actf_freader_write_pkt_idx_files(actf_freader *rd)
+{
+	int rc;
+	for (size_t i = 0; i < rd->dirs_len; i++) {
+		if ((rc = write_pkt_idx_files(&rd->dirs[i], &rd->err)) < 0) {
+			eprependf(&rd->err, "%s", rd->dirs[i].path);
+			return rc;
+		}
+	}
+	return ACTF_OK;
+}
+
 int actf_freader_read(actf_freader *rd, actf_event ***evs, size_t *evs_len)
 {
 	if (!rd->active_gen.generate) {
 		*evs_len = 0;
 		return ACTF_OK;
 	}
+	// the events of the previous read are no longer in use
+	rd->lru.epoch++;
+	ds_lru_trim(&rd->lru, 0);
 	int rc = rd->active_gen.generate(rd->active_gen.self, evs, evs_len);
 	if (rc < 0) {
 		const char *msg = rd->active_gen.last_error(rd->active_gen.self);
@@ -408,6 +2089,14 @@ int actf_freader_seek_ns_from_origin(actf_freader *rd, int64_t tstamp)
 	if (!rd->active_gen.generate) {
 		return ACTF_OK;
 	}
+	/* The lazy data stream files needed after the seek are seeked,
+	 * and thereby activated, by the muxer. */
+	rd->lru.epoch++;
+	for (size_t i = 0; i < rd->dirs_len; i++) {
+		for (size_t j = 0; rd->dirs[i].lazy_dss && j < rd->dirs[i].decs_len; j++) {
+			lazy_ds_release(&rd->dirs[i].lazy_dss[j]);
+		}
+	}
 	int rc = rd->active_gen.seek_ns_from_origin(rd->active_gen.self, tstamp);
 	if (rc < 0) {
 		const char *msg = rd->active_gen.last_error(rd->active_gen.self);
@@ -448,6 +2137,9 @@ void actf_freader_free(actf_freader *rd)
 		ctf_dir_free(&rd->dirs[i]);
 	}
 	free(rd->dirs);
+	metadata_cache_free(&rd->mdc);
+	free(rd->rb.buf);
+	free(rd->rb.out);
 	error_free(&rd->err);
 	free(rd);
 }
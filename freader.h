@@ -31,11 +31,35 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "decoder.h"
 #include "event.h"
+#include "muxer.h"
 
 /** CTF2 FS Reader */
 typedef struct actf_freader actf_freader;
 
+/** How the data stream files are read */
+enum actf_freader_io {
+	/** The data stream files are mmapped */
+	ACTF_FREADER_IO_MMAP,
+	/** The data stream files are read with pread() in chunks of
+	 * actf_freader_cfg.read_size bytes, which are fed to their
+	 * decoders, see actf_decoder_init_fed(). A data stream file is
+	 * only open while it is read and a truncated file is reported as
+	 * an error. Seeking decodes from the start of the file, or from
+	 * the sought packet if there is a packet index file, see
+	 * actf_freader_cfg.pkt_idx_files.
+	 *
+	 * A gzip or zstd compressed data stream file, told by its magic
+	 * bytes, is decompressed while being read. A directory with any
+	 * compressed data stream file is always read this way. Seeking in
+	 * a compressed file decompresses it from its start, the data
+	 * before the sought packet is dropped without being decoded. The
+	 * decompression is only supported if the library is built with
+	 * zlib and libzstd respectively. */
+	ACTF_FREADER_IO_PREAD,
+};
+
 /** The configuration of a CTF2 FS reader. It can be initialized to
  * zero to get the default values. */
 struct actf_freader_cfg {
@@ -49,8 +73,110 @@ struct actf_freader_cfg {
 	/** The number of events used in the buffer for the muxer. If
 	 * zero, the default value is ACTF_DEFAULT_EVS_CAP. */
 	size_t muxer_evs_cap;
+	/** Whether to use packet index files to seek in the data stream
+	 * files. The packet index file of a data stream file is named
+	 * `.`<data stream file name>`.actfidx` and is created by
+	 * actf_freader_write_pkt_idx_files(). An index file is only used
+	 * if the size and modification time of the data stream file as
+	 * well as the metadata UUID are the same as when it was
+	 * written. */
+	bool pkt_idx_files;
+	/** The event record class filter of the decoders. The selectors
+	 * must stay valid until the last call to
+	 * actf_freader_open_folder() or actf_freader_open_folders(). */
+	struct actf_event_cls_filter evc_filter;
+	/** What the decoders decode of the event records. The default
+	 * is ACTF_DECODER_MODE_FULL. */
+	enum actf_decoder_mode decoder_mode;
+	/** The number of worker threads decoding the packets of each
+	 * data stream file in parallel, see pdecoder.h. If zero, the
+	 * data stream files are decoded by regular decoders. */
+	size_t dstream_threads;
+	/** Whether each data stream file is decoded on a thread of its
+	 * own, ahead of the muxer, see producer.h. The decoders then
+	 * keep ACTF_FREADER_PRODUCER_BUFS event buffers each. It is not
+	 * used together with dstream_threads or the lazy decoder
+	 * mode. */
+	bool dstream_producers;
+	/** The order of the events of the data stream files, see
+	 * actf_muxer_order. The default is ACTF_MUXER_ORDER_STRICT. The
+	 * other orders skip merging the events, which suits consumers
+	 * that do not depend on the order, for example when counting
+	 * events. */
+	enum actf_muxer_order muxer_order;
+	/** The window length of ACTF_MUXER_ORDER_WINDOW in
+	 * nanoseconds. */
+	int64_t muxer_window_ns;
+	/** Whether the data stream files are only mmapped and decoded
+	 * while their events are needed, which suits traces with a lot
+	 * of data stream files. The time range of each data stream file
+	 * is taken from its packet index when it is opened, which is
+	 * cheap with packet index files, see pkt_idx_files. A data
+	 * stream file is then first mmapped once the muxer reaches the
+	 * begin of its time range. In ACTF_MUXER_ORDER_STREAM the data
+	 * stream files take turns, so all of them with events are
+	 * mmapped within the first round and max_mmaps is only kept to
+	 * in the strict and window orders. It is not used together with
+	 * dstream_threads or dstream_producers. */
+	bool lazy_dstreams;
+	/** The max number of mmapped data stream files when
+	 * lazy_dstreams is set. The least recently used data stream
+	 * files which are no longer decoded are unmapped to stay below
+	 * it, the ones being decoded are mmapped regardless. If zero,
+	 * the default value is ACTF_FREADER_DEFAULT_MAX_MMAPS. */
+	size_t max_mmaps;
+	/** The number of threads opening the CTF2 directories in
+	 * actf_freader_open_folders(). The metadata of the directories
+	 * is parsed and their data stream files are set up, which
+	 * includes indexing them for dstream_threads and
+	 * lazy_dstreams, on up to this many threads at once. Any error
+	 * is the same as if they were opened one by one. If zero, they
+	 * are opened on the calling thread. */
+	size_t open_threads;
+	/** How the data stream files are read. The default is
+	 * ACTF_FREADER_IO_MMAP. ACTF_FREADER_IO_PREAD is not used
+	 * together with dstream_threads, dstream_producers or
+	 * lazy_dstreams, which are then ignored. */
+	enum actf_freader_io dstream_io;
+	/** The number of bytes of each read of ACTF_FREADER_IO_PREAD,
+	 * rounded up to a multiple of ACTF_FREADER_READ_ALIGN. The reads
+	 * of all data stream files share a single buffer. If zero, the
+	 * default value is ACTF_FREADER_DEFAULT_READ_SIZE. */
+	size_t read_size;
+	/** Whether the reads of ACTF_FREADER_IO_PREAD bypass the page
+	 * cache with O_DIRECT, which suits a single pass over a trace
+	 * which is not to be read again soon. A data stream file is read
+	 * without it if the file system does not support it. */
+	bool direct_io;
+	/** The window of the madvise() hints for the mmapped data stream
+	 * files, see actf_decoder_cfg.advise_window. The data stream
+	 * files are then also mmapped for sequential access. It is not
+	 * used by the parallel decoders of dstream_threads nor by
+	 * ACTF_FREADER_IO_PREAD. If zero, no advice is given. */
+	size_t advise_window;
 };
 
+/** The number of event buffers of each data stream file decoder when
+ * actf_freader_cfg.dstream_producers is set. Two of them are in use
+ * by the muxer, the producer decodes into the others. */
+#define ACTF_FREADER_PRODUCER_BUFS 8
+
+/** The default max number of mmapped data stream files, see
+ * actf_freader_cfg.max_mmaps. */
+#define ACTF_FREADER_DEFAULT_MAX_MMAPS 256
+
+/** A suitable window of madvise() hints, see
+ * actf_freader_cfg.advise_window. */
+#define ACTF_FREADER_DEFAULT_ADVISE_WINDOW (8 << 20)
+
+/** The default number of bytes of each read, see
+ * actf_freader_cfg.read_size. */
+#define ACTF_FREADER_DEFAULT_READ_SIZE (1 << 20)
+
+/** The alignment of the reads and the read buffer, see
+ * actf_freader_cfg.read_size. */
+#define ACTF_FREADER_READ_ALIGN 4096
+
 /**
  * Initialize a CTF2 FS reader
  * @param cfg the configuration
@@ -75,9 +201,26 @@ int actf_freader_open_folder(actf_freader *rd, char *path);
 
 /** Like actf_freader_open_folder() but allows multiple CTF2
  * directories to be specified. The data streams of all CTF2
- * directories will be hooked up to the same muxer. */
+ * directories will be hooked up to the same muxer. Directories with
+ * byte-identical metadata files share a single metadata, which is
+ * only parsed once. */
 int actf_freader_open_folders(actf_freader *rd, char **paths, size_t len);
 
+/**
+ * Write packet index files for the opened data stream files.
+ *
+ * The packet index of each data stream file, which lacks a valid
+ * index file, is built and written next to the data stream file. The
+ * index files can then be used by readers configured with
+ * actf_freader_cfg.pkt_idx_files to seek without scanning all
+ * packets. Writing the index files does not affect the reading
+ * position of the reader.
+ *
+ * @param rd the reader
+ * @return ACTF_OK on success or an error code. On error, see actf_freader_last_error().
+ */
+int actf_freader_write_pkt_idx_files(actf_freader *rd);
+
 /** @see actf_event_generate */
 int actf_freader_read(actf_freader *rd, actf_event ***evs, size_t *evs_len);
 
@@ -29,6 +29,7 @@
 #include <json-c/json.h>
 
 #include "crust/common.h"
+#include "crust/map_util.h"
 #include "metadata_int.h"
 #include "fld_cls_int.h"
 #include "json_utils.h"
@@ -316,6 +317,7 @@ static int actf_trace_cls_parse(const struct json_object *tc_jobj,
 	tc->name = name ? c_strdup(name) : NULL;
 	tc->uid = uid ? c_strdup(uid) : NULL;
 	tc->pkt_hdr = pkt_hdr;
+	CLEAR(tc->pkt_hdr_plan);
 	tc->environment = environment;
 	tc->attributes = attributes;
 	tc->extensions = extensions;
@@ -332,6 +334,7 @@ static void actf_trace_cls_free(struct actf_trace_cls *tc)
 	free(tc->name);
 	free(tc->uid);
 	actf_fld_cls_free(&tc->pkt_hdr);
+	dec_plan_free(&tc->pkt_hdr_plan);
 	ctfjson_free(tc->environment);
 	ctfjson_free(tc->attributes);
 	ctfjson_free(tc->extensions);
@@ -712,6 +715,8 @@ static int actf_event_cls_parse(const struct json_object *evc_jobj,
 	evc->spec_ctx = spec_ctx;
 	evc->attributes = attributes;
 	evc->extensions = extensions;
+	CLEAR(evc->spec_ctx_plan);
+	CLEAR(evc->payload_plan);
 	*evcp = evc;
 	return ACTF_OK;
 
@@ -736,11 +741,61 @@ void actf_event_cls_free(struct actf_event_cls *evc)
 	free(evc->uid);
 	actf_fld_cls_free(&evc->payload);
 	actf_fld_cls_free(&evc->spec_ctx);
+	dec_plan_free(&evc->payload_plan);
+	dec_plan_free(&evc->spec_ctx_plan);
 	ctfjson_free(evc->attributes);
 	ctfjson_free(evc->extensions);
 	free(evc);
 }
 
+/* dec_plan_origins_init sets the field location origins of the plans
+ * of a data stream class, and of one of its event record classes if
+ * evc is non-NULL. */
+static void dec_plan_origins_init(const struct actf_dstream_cls *dsc,
+				  const struct actf_event_cls *evc,
+				  struct dec_plan_origins *origins)
+{
+	const struct actf_metadata *metadata = dsc->metadata;
+	CLEAR(*origins);
+	if (metadata->trace_cls_is_set) {
+		origins->clses[ACTF_FLD_LOC_ORIGIN_PKT_HEADER] = &metadata->trace_cls.pkt_hdr;
+	}
+	origins->clses[ACTF_FLD_LOC_ORIGIN_PKT_CTX] = &dsc->pkt_ctx;
+	origins->clses[ACTF_FLD_LOC_ORIGIN_EVENT_HEADER] = &dsc->event_hdr;
+	origins->clses[ACTF_FLD_LOC_ORIGIN_EVENT_COMMON_CTX] = &dsc->event_common_ctx;
+	if (evc) {
+		origins->clses[ACTF_FLD_LOC_ORIGIN_EVENT_SPECIFIC_CTX] = &evc->spec_ctx;
+		origins->clses[ACTF_FLD_LOC_ORIGIN_EVENT_PAYLOAD] = &evc->payload;
+	}
+}
+
+static int actf_event_cls_compile_plans(struct actf_event_cls *evc, struct error *e)
+{
+	int rc;
+	struct dec_plan_origins origins;
+	dec_plan_origins_init(evc->dsc, evc, &origins);
+	if ((rc = dec_plan_compile(&evc->spec_ctx, &origins, &evc->spec_ctx_plan, e)) < 0) {
+		eprependf(e, "specific-context-field-class");
+		return rc;
+	}
+	if ((rc = dec_plan_compile(&evc->payload, &origins, &evc->payload_plan, e)) < 0) {
+		eprependf(e, "payload-field-class");
+		return rc;
+	}
+	/* The scopes following the event record header can locate values
+	 * in each other, the common context is marked for all event
+	 * record classes of its data stream class. */
+	struct dec_plan *plans[] = {
+		&evc->dsc->event_common_ctx_plan, &evc->spec_ctx_plan, &evc->payload_plan
+	};
+	for (size_t i = 0; i < ARRLEN(plans); i++) {
+		for (size_t j = 0; j < ARRLEN(plans); j++) {
+			dec_plan_mark_loc_targets(plans[i], plans[j]);
+		}
+	}
+	return ACTF_OK;
+}
+
 static int actf_dstream_cls_parse(const struct json_object *ds_cls_jobj,
 				  const struct actf_metadata *metadata,
 				  struct actf_dstream_cls **dscp, struct error *e)
@@ -837,6 +892,9 @@ static int actf_dstream_cls_parse(const struct json_object *ds_cls_jobj,
 	dsc->extensions = extensions;
 	dsc->idtoevc = idtoevc;
 	dsc->metadata = metadata;
+	CLEAR(dsc->pkt_ctx_plan);
+	CLEAR(dsc->event_hdr_plan);
+	CLEAR(dsc->event_common_ctx_plan);
 	*dscp = dsc;
 	return ACTF_OK;
 
@@ -867,12 +925,36 @@ void actf_dstream_cls_free(struct actf_dstream_cls *dsc)
 	actf_fld_cls_free(&dsc->pkt_ctx);
 	actf_fld_cls_free(&dsc->event_hdr);
 	actf_fld_cls_free(&dsc->event_common_ctx);
+	dec_plan_free(&dsc->pkt_ctx_plan);
+	dec_plan_free(&dsc->event_hdr_plan);
+	dec_plan_free(&dsc->event_common_ctx_plan);
 	ctfjson_free(dsc->attributes);
 	ctfjson_free(dsc->extensions);
 	u64toevc_free(&dsc->idtoevc);
 	free(dsc);
 }
 
+static int actf_dstream_cls_compile_plans(struct actf_dstream_cls *dsc, struct error *e)
+{
+	int rc;
+	struct dec_plan_origins origins;
+	dec_plan_origins_init(dsc, NULL, &origins);
+	if ((rc = dec_plan_compile(&dsc->pkt_ctx, &origins, &dsc->pkt_ctx_plan, e)) < 0) {
+		eprependf(e, "packet-context-field-class");
+		return rc;
+	}
+	if ((rc = dec_plan_compile(&dsc->event_hdr, &origins, &dsc->event_hdr_plan, e)) < 0) {
+		eprependf(e, "event-record-header-field-class");
+		return rc;
+	}
+	if ((rc = dec_plan_compile(&dsc->event_common_ctx, &origins,
+				   &dsc->event_common_ctx_plan, e)) < 0) {
+		eprependf(e, "event-record-common-context-field-class");
+		return rc;
+	}
+	return ACTF_OK;
+}
+
 static int verify_clk_roles(struct actf_dstream_cls *dsc, struct actf_fld_cls *fc,
 			    const char *ctx, struct error *e)
 {
@@ -1048,6 +1130,16 @@ static int frag_parse(struct json_object *frag_jobj, struct actf_metadata *metad
 		}
 		metadata->trace_cls = tc;
 		metadata->trace_cls_is_set = true;
+		/* The plan refers to the field classes of the trace class in
+		 * metadata, not the ones of the local tc. */
+		struct dec_plan_origins origins = {
+			.clses[ACTF_FLD_LOC_ORIGIN_PKT_HEADER] = &metadata->trace_cls.pkt_hdr,
+		};
+		if ((rc = dec_plan_compile(&metadata->trace_cls.pkt_hdr, &origins,
+					   &metadata->trace_cls.pkt_hdr_plan, e)) < 0) {
+			eprependf(e, "packet-header-field-class");
+			return rc;
+		}
 	} else if (strcmp(type, "clock-class") == 0) {
 		struct actf_clk_cls *clkc = NULL;
 		if ((rc = actf_clk_cls_parse(frag_jobj, &clkc, e)) < 0) {
@@ -1111,6 +1203,10 @@ static int frag_parse(struct json_object *frag_jobj, struct actf_metadata *metad
 			actf_dstream_cls_free(dsc);
 			return ACTF_DUPLICATE_ERROR;
 		}
+		if ((rc = actf_dstream_cls_compile_plans(dsc, e)) < 0) {
+			actf_dstream_cls_free(dsc);
+			return rc;
+		}
 		if (dsc->def_clkc_id) {
 			for (size_t i = 0; i < metadata->clk_clses.len; i++) {
 				struct actf_clk_cls **clkcp =
@@ -1172,7 +1268,12 @@ static int frag_parse(struct json_object *frag_jobj, struct actf_metadata *metad
 			actf_event_cls_free(evc);
 			return ACTF_DUPLICATE_ERROR;
 		}
+		if ((rc = actf_event_cls_compile_plans(evc, e)) < 0) {
+			actf_event_cls_free(evc);
+			return rc;
+		}
 
+		evc->idx = metadata->n_evcs;
 		rc = u64toevc_insert(&(*dscp)->idtoevc, evc->id, evc);
 		if (rc < 0) {
 			eprintf(e, "unable to insert event class id %" PRIu64 " into hash map",
@@ -1180,6 +1281,7 @@ static int frag_parse(struct json_object *frag_jobj, struct actf_metadata *metad
 			actf_event_cls_free(evc);
 			return ACTF_ERROR;
 		}
+		metadata->n_evcs++;
 	} else {
 		eprintf(e, "%s is not a valid fragment type", type);
 		return ACTF_JSON_ERROR;
@@ -1415,6 +1517,7 @@ int actf_metadata_nparse(struct actf_metadata *metadata, const char *str, size_t
 {
 	int rc = 0;
 	struct error *e = &metadata->err;
+	metadata->text_hash = hash_fnv_n(str, len);
 	if (is_metadata_stream_packetized(str, len)) {
 		rc = unpack_packetized_metadata_stream(str, len, metadata);
 	} else {
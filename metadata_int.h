@@ -25,6 +25,7 @@
 #include <stdint.h>
 
 #include "ctfjson.h"
+#include "dec_plan.h"
 #include "fld_cls_int.h"
 #include "error.h"
 #include "metadata.h"
@@ -54,6 +55,8 @@ struct actf_trace_cls {
 	struct actf_fld_cls pkt_hdr;
 	struct ctfjson *attributes;
 	struct ctfjson *extensions;
+	/* decode plan of pkt_hdr */
+	struct dec_plan pkt_hdr_plan;
 };
 
 struct actf_clk_origin { // For correlation with other clocks.
@@ -103,6 +106,13 @@ struct actf_event_cls {
 	struct actf_fld_cls payload;
 	struct ctfjson *attributes;
 	struct ctfjson *extensions;
+	/* decode plans of spec_ctx and payload */
+	struct dec_plan spec_ctx_plan;
+	struct dec_plan payload_plan;
+	/* idx is the index of the event record class among the event
+	 * record classes of all data stream classes, in parse order. It
+	 * allows per event record class state to be kept in an array. */
+	size_t idx;
 };
 
 void actf_event_cls_free(struct actf_event_cls *evc);
@@ -136,6 +146,10 @@ struct actf_dstream_cls {
 	struct actf_fld_cls event_common_ctx;
 	struct ctfjson *attributes;
 	struct ctfjson *extensions;
+	/* decode plans of pkt_ctx, event_hdr and event_common_ctx */
+	struct dec_plan pkt_ctx_plan;
+	struct dec_plan event_hdr_plan;
+	struct dec_plan event_common_ctx_plan;
 
 	/* Holds all event record classes of this data stream class. Maps
 	 * event class id to event class. */
@@ -167,6 +181,8 @@ struct actf_metadata {
 	struct actf_trace_cls trace_cls; // MAY contain one
 	struct actf_clk_cls_vec clk_clses; // MAY contain one or more which MUST occur before a ds referring to it
 	u64todsc idtodsc; // MUST contain one or more which MUST follow trace_cls
+	size_t n_evcs; // number of event record classes in all of idtodsc
+	size_t text_hash; // hash_fnv_n() of the text it was parsed from
 	bool preamble_is_set;
 	bool trace_cls_is_set;
 	struct error err;
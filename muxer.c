@@ -19,6 +19,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "crust/common.h"
 #include "event.h"
@@ -40,6 +41,24 @@ enum muxer_state {
 	MUXER_STATE_ERROR,
 };
 
+/* The seek state of a generator, see actf_muxer_seek_ns_from_origin. */
+enum gen_seek {
+	/* Generated from as usual */
+	GEN_SEEK_DONE = 0,
+	/* Its seek is deferred until its events are needed, none of its
+	 * events are before the seek */
+	GEN_SEEK_DEFERRED,
+	/* None of its events are at or after the seek, it is not
+	 * generated from */
+	GEN_SEEK_EXHAUSTED,
+};
+
+struct gen_state {
+	enum gen_seek seek;
+	/* The begin of the time range of a deferred generator */
+	int64_t begin;
+};
+
 struct actf_muxer {
 	struct actf_event_generator *gens;
 	size_t gens_len;
@@ -51,7 +70,15 @@ struct actf_muxer {
 	/* in_evs_lens holds the current index of each buffer in
 	 * in_evs. */
 	size_t *in_evs_cur_is;
-	/* evs holds the output buffer */
+	/* in_evs_refills holds the number of times each generator has
+	 * been generated from during the current mux call. */
+	size_t *in_evs_refills;
+	/* gen_states holds the seek state of each generator. */
+	struct gen_state *gen_states;
+	/* The timestamp of the last seek */
+	int64_t seek_tstamp;
+	/* evs holds the output buffer. It points to the events of the
+	 * generators, which are not copied. */
 	actf_event **evs;
 	/* evs_cap holds the capacity of evs */
 	size_t evs_cap;
@@ -65,10 +92,21 @@ struct actf_muxer {
 	 * push to the pq. If pending_gen_i >= gens_len, no generator is
 	 * pending. */
 	size_t pending_gen_i;
+	enum actf_muxer_order order;
+	/* The generator whose turn it is in the stream and window
+	 * orders */
+	size_t cur_gen_i;
+	/* The events before window_bound are in the current window, if
+	 * in_window. */
+	bool in_window;
+	struct node window_bound;
+	int64_t window_ns;
 };
 
-actf_muxer *actf_muxer_init(struct actf_event_generator *gens, size_t gens_len, size_t evs_cap)
+actf_muxer *actf_muxer_init_cfg(struct actf_event_generator *gens, size_t gens_len,
+				struct actf_muxer_cfg cfg)
 {
+	size_t evs_cap = cfg.evs_cap;
 	struct actf_muxer *m = malloc(sizeof(*m));
 	if (!m) {
 		return NULL;
@@ -85,16 +123,24 @@ actf_muxer *actf_muxer_init(struct actf_event_generator *gens, size_t gens_len,
 	if (!in_evs_cur_is) {
 		goto err_free_in_evs_lens;
 	}
+	size_t *in_evs_refills = calloc(gens_len, sizeof(*in_evs_refills));
+	if (!in_evs_refills) {
+		goto err_free_in_evs_cur_is;
+	}
+	struct gen_state *gen_states = calloc(gens_len, sizeof(*gen_states));
+	if (!gen_states) {
+		goto err_free_in_evs_refills;
+	}
 	if (evs_cap == 0) {
 		evs_cap = ACTF_DEFAULT_EVS_CAP;
 	}
-	actf_event **evs = actf_event_arr_alloc(evs_cap);
+	actf_event **evs = malloc(evs_cap * sizeof(*evs));
 	if (!evs) {
-		goto err_free_in_evs_cur_is;
+		goto err_free_gen_states;
 	}
 	struct prio_queue pq;
 	if (prio_queue_init(&pq, gens_len) < 0) {
-		goto err_free_event_arr;
+		goto err_free_evs;
 	}
 	*m = (struct actf_muxer) {
 		.gens = gens,
@@ -102,17 +148,38 @@ actf_muxer *actf_muxer_init(struct actf_event_generator *gens, size_t gens_len,
 		.in_evs = in_evs,
 		.in_evs_lens = in_evs_lens,
 		.in_evs_cur_is = in_evs_cur_is,
+		.in_evs_refills = in_evs_refills,
+		.gen_states = gen_states,
 		.evs = evs,
 		.evs_cap = evs_cap,
 		.err = ERROR_EMPTY,
 		.pq = pq,
 		.state = MUXER_STATE_FRESH,
 		.pending_gen_i = gens_len,
+		.order = cfg.order,
+		.window_ns = MAX(cfg.window_ns, 1),
+		.seek_tstamp = INT64_MIN,
 	};
+	/* Starting out is like having sought to the beginning, without
+	 * the generators with an unknown range having to be seeked. */
+	for (size_t i = 0; cfg.defer_gens && i < gens_len; i++) {
+		int64_t begin, end;
+		if (gens[i].time_range &&
+		    gens[i].time_range(gens[i].self, &begin, &end) == ACTF_OK) {
+			gen_states[i] = (struct gen_state) {
+				.seek = GEN_SEEK_DEFERRED,
+				.begin = begin,
+			};
+		}
+	}
 	return m;
 
-      err_free_event_arr:
-	actf_event_arr_free(evs);
+      err_free_evs:
+	free(evs);
+      err_free_gen_states:
+	free(gen_states);
+      err_free_in_evs_refills:
+	free(in_evs_refills);
       err_free_in_evs_cur_is:
 	free(in_evs_cur_is);
       err_free_in_evs_lens:
@@ -124,6 +191,12 @@ actf_muxer *actf_muxer_init(struct actf_event_generator *gens, size_t gens_len,
 	return NULL;
 }
 
+actf_muxer *actf_muxer_init(struct actf_event_generator *gens, size_t gens_len, size_t evs_cap)
+{
+	struct actf_muxer_cfg cfg = {.evs_cap = evs_cap };
+	return actf_muxer_init_cfg(gens, gens_len, cfg);
+}
+
 static inline bool has_pending_gen(actf_muxer *m)
 {
 	return m->pending_gen_i < m->gens_len;
@@ -139,13 +212,51 @@ static inline void set_pending_gen(actf_muxer *m, size_t gen_i)
 	m->pending_gen_i = gen_i;
 }
 
-static int push_fresh_evs_to_pq(actf_muxer *m, size_t gen_i)
+/* can_refill returns true if the generator gen_i can be generated from
+ * without invalidating any of its events in the output buffer. */
+static inline bool can_refill(actf_muxer *m, size_t gen_i)
+{
+	return m->in_evs_refills[gen_i] + 1 < m->gens[gen_i].n_bufs;
+}
+
+/* seek_gen seeks the generator gen_i to tstamp. */
+static int seek_gen(actf_muxer *m, size_t gen_i, int64_t tstamp)
+{
+	int rc = m->gens[gen_i].seek_ns_from_origin(m->gens[gen_i].self, tstamp);
+	if (rc < 0) {
+		const char *msg = m->gens[gen_i].last_error(m->gens[gen_i].self);
+		eprintf(&m->err, "seek_ns_from_origin: %s",
+			msg ? msg : "unknown seek_ns_from_origin error");
+		m->state = MUXER_STATE_ERROR;
+		return rc;
+	}
+	m->gen_states[gen_i].seek = GEN_SEEK_DONE;
+	return ACTF_OK;
+}
+
+/* refill generates the next events of the generator gen_i, after
+ * doing any deferred seek of it. In the strict order, the generator is
+ * pushed to the pq if it has any. A generator without events after a
+ * refill has run out of them. */
+static int refill(actf_muxer *m, size_t gen_i)
 {
 	int rc;
 	actf_event ***in_evs = m->in_evs + gen_i;
 	size_t *in_evs_len = m->in_evs_lens + gen_i;
 	size_t *in_evs_i = m->in_evs_cur_is + gen_i;
 	*in_evs_i = 0;
+	switch (m->gen_states[gen_i].seek) {
+	case GEN_SEEK_EXHAUSTED:
+		*in_evs_len = 0;
+		return ACTF_OK;
+	case GEN_SEEK_DEFERRED:
+		if ((rc = seek_gen(m, gen_i, m->seek_tstamp)) < 0) {
+			return rc;
+		}
+		break;
+	default:
+		break;
+	}
 	rc = m->gens[gen_i].generate(m->gens[gen_i].self, in_evs, in_evs_len);
 	if (rc < 0) {
 		const char *msg = m->gens[gen_i].last_error(m->gens[gen_i].self);
@@ -153,7 +264,7 @@ static int push_fresh_evs_to_pq(actf_muxer *m, size_t gen_i)
 		m->state = MUXER_STATE_ERROR;
 		return rc;
 	}
-	if (*in_evs_len) {
+	if (*in_evs_len && m->order == ACTF_MUXER_ORDER_STRICT) {
 		prio_queue_push_unchecked(&m->pq, (struct node) {
 					  .key = actf_event_tstamp_ns_from_origin((*in_evs)[0]),
 					  .value = gen_i
@@ -162,6 +273,206 @@ static int push_fresh_evs_to_pq(actf_muxer *m, size_t gen_i)
 	return ACTF_OK;
 }
 
+static inline bool ev_before(actf_event *ev, size_t gen_i, struct node bound)
+{
+	struct node n = {.key = actf_event_tstamp_ns_from_origin(ev),.value = gen_i };
+	return node_less(n, bound);
+}
+
+/* run_len returns how many of the first len events of the generator
+ * gen_i come before bound, the first known of them are known to come
+ * before it. The timestamps of a generator do not decrease, so the run
+ * is found by galloping ahead and then doing a binary search. */
+static size_t run_len(actf_event **evs, size_t len, size_t gen_i, struct node bound,
+		      size_t known)
+{
+	// evs[0..lo) come before bound, evs[hi] does not unless hi >= len
+	size_t lo = known;
+	size_t hi = known;
+	while (hi < len && ev_before(evs[hi], gen_i, bound)) {
+		lo = hi + 1;
+		hi = hi ? hi * 2 : 1;
+	}
+	hi = MIN(hi, len);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ev_before(evs[mid], gen_i, bound)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* mux_strict takes events in the order of their timestamps until evs
+ * is full or a generator can not be refilled. */
+static void mux_strict(actf_muxer *m, size_t *evs_len)
+{
+	while (*evs_len < m->evs_cap && m->pq.len > 0) {
+		struct node n = prio_queue_peek_unchecked(&m->pq);
+		if (m->gen_states[n.value].seek == GEN_SEEK_DEFERRED) {
+			/* Its events are needed now, the node is replaced by
+			 * its first event. None of its events are in evs. */
+			prio_queue_pop_unchecked(&m->pq);
+			if (refill(m, n.value) < 0) {
+				break;
+			}
+			continue;
+		}
+		actf_event **in_evs = m->in_evs[n.value];
+		size_t *in_evs_len = m->in_evs_lens + n.value;
+		size_t *in_evs_i = m->in_evs_cur_is + n.value;
+		/* Take the run of events coming before the events of
+		 * every other generator in one go. */
+		size_t run = MIN(m->evs_cap - *evs_len, *in_evs_len - *in_evs_i);
+		if (m->pq.len > 1) {
+			run = run_len(in_evs + *in_evs_i, run, n.value,
+				      prio_queue_peek_second_unchecked(&m->pq), 1);
+		}
+		memcpy(m->evs + *evs_len, in_evs + *in_evs_i, run * sizeof(*m->evs));
+		*evs_len += run;
+		*in_evs_i += run;
+		// replace the element with the next one of the generator.
+		if (*in_evs_i < *in_evs_len) {
+			prio_queue_replace_top_unchecked(&m->pq, (struct node) {
+							 .key = actf_event_tstamp_ns_from_origin(in_evs[*in_evs_i]),
+							 .value = n.value
+							 });
+			continue;
+		}
+		prio_queue_pop_unchecked(&m->pq);
+		if (can_refill(m, n.value)) {
+			/* The generator keeps the events already in evs
+			 * valid through another generate call. */
+			m->in_evs_refills[n.value]++;
+			if (refill(m, n.value) < 0) {
+				/* The error is returned on the next call */
+				break;
+			}
+		} else {
+			/* Calling generate for the generator whose buffer we
+			 * just emptied would invalidate any existing events
+			 * belonging to it in evs. Instead we return whatever
+			 * events are collected so far and read from the
+			 * generator next call. */
+			set_pending_gen(m, n.value);
+			break;
+		}
+	}
+}
+
+/* mux_stream returns the remaining events of the generators in turn,
+ * up to evs_cap of them at a time, without copying them. A deferred
+ * generator is first generated from at its first turn. */
+static void mux_stream(actf_muxer *m, actf_event ***evs, size_t *evs_len)
+{
+	for (size_t n = 0; n < m->gens_len; n++) {
+		size_t i = m->cur_gen_i;
+		size_t *in_evs_len = m->in_evs_lens + i;
+		size_t *in_evs_i = m->in_evs_cur_is + i;
+		if (m->gen_states[i].seek == GEN_SEEK_DEFERRED && refill(m, i) < 0) {
+			return;
+		}
+		if (*in_evs_i < *in_evs_len) {
+			*evs = m->in_evs[i] + *in_evs_i;
+			*evs_len = MIN(m->evs_cap, *in_evs_len - *in_evs_i);
+			*in_evs_i += *evs_len;
+			if (*in_evs_i == *in_evs_len) {
+				// refilled once its events are no longer in use
+				set_pending_gen(m, i);
+				m->cur_gen_i = (i + 1) % m->gens_len;
+			}
+			return;
+		}
+		m->cur_gen_i = (i + 1) % m->gens_len;
+	}
+}
+
+/* window_open opens a window at the earliest event of all
+ * generators, a deferred generator counting as having an event at the
+ * begin of its time range. The deferred generators which the window
+ * reaches are generated from. It returns false if they have run out
+ * of events or on an error. */
+static bool window_open(actf_muxer *m)
+{
+	bool has_evs = false;
+	int64_t begin = INT64_MAX;
+	for (size_t i = 0; i < m->gens_len; i++) {
+		if (m->gen_states[i].seek == GEN_SEEK_DEFERRED) {
+			begin = MIN(begin, m->gen_states[i].begin);
+			has_evs = true;
+		} else if (m->in_evs_cur_is[i] < m->in_evs_lens[i]) {
+			actf_event *ev = m->in_evs[i][m->in_evs_cur_is[i]];
+			begin = MIN(begin, actf_event_tstamp_ns_from_origin(ev));
+			has_evs = true;
+		}
+	}
+	if (!has_evs) {
+		return false;
+	}
+	/* A window reaching the end of time includes it */
+	if (begin > INT64_MAX - m->window_ns) {
+		m->window_bound = (struct node) {.key = INT64_MAX,.value = SIZE_MAX };
+	} else {
+		m->window_bound = (struct node) {.key = begin + m->window_ns,.value = 0 };
+	}
+	/* None of their events are in evs */
+	for (size_t i = 0; i < m->gens_len; i++) {
+		struct node n = {.key = m->gen_states[i].begin,.value = i };
+		if (m->gen_states[i].seek == GEN_SEEK_DEFERRED && node_less(n, m->window_bound) &&
+		    refill(m, i) < 0) {
+			return false;
+		}
+	}
+	m->in_window = true;
+	m->cur_gen_i = 0;
+	return true;
+}
+
+/* mux_window takes the events of a window of window_ns of one
+ * generator at a time, the windows being in order, until evs is full
+ * or a generator can not be refilled. */
+static void mux_window(actf_muxer *m, size_t *evs_len)
+{
+	while (*evs_len < m->evs_cap) {
+		if (!m->in_window && !window_open(m)) {
+			break;
+		}
+		size_t i = m->cur_gen_i;
+		actf_event **in_evs = m->in_evs[i];
+		size_t *in_evs_len = m->in_evs_lens + i;
+		size_t *in_evs_i = m->in_evs_cur_is + i;
+		if (*in_evs_i < *in_evs_len) {
+			size_t run = MIN(m->evs_cap - *evs_len, *in_evs_len - *in_evs_i);
+			run = run_len(in_evs + *in_evs_i, run, i, m->window_bound, 0);
+			memcpy(m->evs + *evs_len, in_evs + *in_evs_i, run * sizeof(*m->evs));
+			*evs_len += run;
+			*in_evs_i += run;
+			if (*in_evs_i == *in_evs_len) {
+				if (!can_refill(m, i)) {
+					set_pending_gen(m, i);
+					break;
+				}
+				m->in_evs_refills[i]++;
+				if (refill(m, i) < 0) {
+					break;
+				}
+				// the new events might be in the window as well
+				continue;
+			}
+			if (*evs_len == m->evs_cap) {
+				break;
+			}
+		}
+		// the rest of the events of the generator are in later
+		// windows or it has run out of them.
+		if (++m->cur_gen_i == m->gens_len) {
+			m->in_window = false;
+		}
+	}
+}
+
 int actf_muxer_mux(actf_muxer *m, actf_event ***evs, size_t *evs_len)
 {
 	int rc;
@@ -169,7 +480,20 @@ int actf_muxer_mux(actf_muxer *m, actf_event ***evs, size_t *evs_len)
 	case MUXER_STATE_FRESH:
 		// bootstrap pq with all generators.
 		for (size_t i = 0; i < m->gens_len; i++) {
-			if ((rc = push_fresh_evs_to_pq(m, i)) < 0) {
+			/* A deferred generator waits in the pq at the begin
+			 * of its time range, which none of its events are
+			 * before. In the relaxed orders it waits for its turn
+			 * or window. */
+			if (m->gen_states[i].seek == GEN_SEEK_DEFERRED) {
+				if (m->order == ACTF_MUXER_ORDER_STRICT) {
+					prio_queue_push_unchecked(&m->pq, (struct node) {
+								  .key = m->gen_states[i].begin,
+								  .value = i
+								  });
+				}
+				continue;
+			}
+			if ((rc = refill(m, i)) < 0) {
 				return rc;
 			}
 		}
@@ -177,43 +501,31 @@ int actf_muxer_mux(actf_muxer *m, actf_event ***evs, size_t *evs_len)
 		// fallthrough
 	case MUXER_STATE_ONGOING:
 		if (has_pending_gen(m)) {
-			if ((rc = push_fresh_evs_to_pq(m, m->pending_gen_i)) < 0) {
+			if ((rc = refill(m, m->pending_gen_i)) < 0) {
 				return rc;
 			}
 			set_no_pending_gen(m);
 		}
-		// read up to evs_cap events from the priority queue.
+		// read up to evs_cap events.
+		memset(m->in_evs_refills, 0, m->gens_len * sizeof(*m->in_evs_refills));
 		*evs_len = 0;
 		*evs = m->evs;
-		for (size_t i = 0; i < m->evs_cap && m->pq.len > 0; i++) {
-			struct node n = prio_queue_pop_unchecked(&m->pq);
-			actf_event **in_evs = m->in_evs[n.value];
-			size_t *in_evs_len = m->in_evs_lens + n.value;
-			size_t *in_evs_i = m->in_evs_cur_is + n.value;
-			actf_event_copy(m->evs[(*evs_len)++], in_evs[(*in_evs_i)++]);
-			// push in a new element.
-			if (*in_evs_i < *in_evs_len) {
-				prio_queue_push_unchecked(&m->pq, (struct node) {
-							  .key = actf_event_tstamp_ns_from_origin(in_evs[*in_evs_i]),
-							  .value = n.value
-							  });
-			} else {
-				/* Calling generate for the generator whose buffer we
-				 * just emptied would invalidate any existing events
-				 * belonging to it in evs. Instead we return whatever
-				 * events are collected so far and read from the
-				 * generator next call. If buffers are made to not be
-				 * invalidated after a subsequent generate call, we
-				 * could keep more buffers than generators around to
-				 * make sure we fill evs properly. Two buffers per
-				 * generator would guarantee a minimum filledness of
-				 * the output buffer. This is assuming that the
-				 * actf_muxer consumer only uses one buffer though.. */
-				set_pending_gen(m, n.value);
-				break;
-			}
+		switch (m->order) {
+		case ACTF_MUXER_ORDER_STREAM:
+			mux_stream(m, evs, evs_len);
+			break;
+		case ACTF_MUXER_ORDER_WINDOW:
+			mux_window(m, evs_len);
+			break;
+		default:
+			mux_strict(m, evs_len);
+			break;
 		}
-		if (*evs_len == 0 && m->evs_cap > 0) {
+		/* An error without any events is returned right away */
+		if (m->state == MUXER_STATE_ERROR && *evs_len == 0) {
+			return ACTF_ERROR;
+		}
+		if (*evs_len == 0 && m->evs_cap > 0 && m->state == MUXER_STATE_ONGOING) {
 			m->state = MUXER_STATE_DONE;
 		}
 		return ACTF_OK;
@@ -239,23 +551,38 @@ static void muxer_reset(actf_muxer *m)
 	set_no_pending_gen(m);
 	prio_queue_clear(&m->pq);
 	m->state = MUXER_STATE_FRESH;
+	m->cur_gen_i = 0;
+	m->in_window = false;
 	memset(m->in_evs_lens, 0, m->gens_len * sizeof(*m->in_evs_lens));
 	memset(m->in_evs_cur_is, 0, m->gens_len * sizeof(*m->in_evs_cur_is));
+	memset(m->in_evs_refills, 0, m->gens_len * sizeof(*m->in_evs_refills));
 }
 
 int actf_muxer_seek_ns_from_origin(actf_muxer *m, int64_t tstamp)
 {
+	/* A generator whose time range ends before tstamp is not seeked
+	 * nor generated from, one whose range begins at or after it is
+	 * seeked once its events are needed. The others are seeked right
+	 * away, as are the ones without a known range. */
 	for (size_t i = 0; i < m->gens_len; i++) {
-		int rc = m->gens[i].seek_ns_from_origin(m->gens[i].self, tstamp);
-		if (rc < 0) {
-			const char *msg = m->gens[i].last_error(m->gens[i].self);
-			eprintf(&m->err, "seek_ns_from_origin: %s",
-				msg ? msg : "unknown seek_ns_from_origin error");
-			m->state = MUXER_STATE_ERROR;
+		int64_t begin, end;
+		int rc = ACTF_NOT_FOUND;
+		if (m->gens[i].time_range) {
+			rc = m->gens[i].time_range(m->gens[i].self, &begin, &end);
+		}
+		if (rc == ACTF_OK && end < tstamp) {
+			m->gen_states[i].seek = GEN_SEEK_EXHAUSTED;
+		} else if (rc == ACTF_OK && begin >= tstamp) {
+			m->gen_states[i] = (struct gen_state) {
+				.seek = GEN_SEEK_DEFERRED,
+				.begin = begin,
+			};
+		} else if ((rc = seek_gen(m, i, tstamp)) < 0) {
 			return rc;
 		}
 	}
 	muxer_reset(m);
+	m->seek_tstamp = tstamp;
 	return ACTF_OK;
 }
 
@@ -288,7 +615,9 @@ void actf_muxer_free(actf_muxer *m)
 	free(m->in_evs);
 	free(m->in_evs_lens);
 	free(m->in_evs_cur_is);
-	actf_event_arr_free(m->evs);
+	free(m->in_evs_refills);
+	free(m->gen_states);
+	free(m->evs);
 	error_free(&m->err);
 	prio_queue_free(&m->pq);
 	free(m);
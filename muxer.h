@@ -25,6 +25,7 @@
 #ifndef ACTF_MUXER_H
 #define ACTF_MUXER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "decoder.h"
@@ -33,6 +34,46 @@
 /** A muxer, implements an actf_event_generator */
 typedef struct actf_muxer actf_muxer;
 
+/** The order of the events of a muxer */
+enum actf_muxer_order {
+	/** The events are ordered by their timestamps. Events with
+	 * equal timestamps are ordered by their generator. */
+	ACTF_MUXER_ORDER_STRICT = 0,
+	/** The generators take turns and their events are returned as
+	 * generated, up to the event capacity at a time, without being
+	 * merged or copied. Only the events of each generator are in
+	 * order. */
+	ACTF_MUXER_ORDER_STREAM,
+	/** The events are taken in windows of
+	 * actf_muxer_cfg.window_ns, starting at the earliest event of all
+	 * generators, one generator at a time. Events are out of order
+	 * by less than window_ns. */
+	ACTF_MUXER_ORDER_WINDOW,
+};
+
+/** The configuration of a muxer. It can be initialized to zero to get
+ * the default values. */
+struct actf_muxer_cfg {
+	/** The max event array capacity. If zero, ACTF_DEFAULT_EVS_CAP
+	 * will be used. */
+	size_t evs_cap;
+	/** The order of the events. The default is
+	 * ACTF_MUXER_ORDER_STRICT. */
+	enum actf_muxer_order order;
+	/** The length of the windows of ACTF_MUXER_ORDER_WINDOW in
+	 * nanoseconds. Values below one are treated as one. */
+	int64_t window_ns;
+	/** Whether the generators with a time range, see
+	 * actf_event_generator.time_range, are first generated from once
+	 * their events are needed, as after a seek. In the strict order
+	 * a generator is then not generated from before the merge
+	 * reaches the begin of its time range, in the window order not
+	 * before a window reaches it and in the stream order not before
+	 * its first turn. The time ranges are got
+	 * when the muxer is initialized, which should be cheap. */
+	bool defer_gens;
+};
+
 /**
  * Initialize a muxer
  *
@@ -42,6 +83,18 @@ typedef struct actf_muxer actf_muxer;
  * The generators must be kept available by the caller until it no
  * longer wants to use the muxer.
  *
+ * The events of the muxer are not copies, they are the events of the
+ * generators. A generator is never generated from while that would
+ * invalidate any of its events in the output of the muxer, so the
+ * events stay valid until the next call to actf_muxer_mux() or
+ * actf_muxer_seek_ns_from_origin(), like those of any generator.
+ *
+ * A generator with a single buffer can only be generated from when
+ * none of its events are in the output of the muxer, the muxer then
+ * returns fewer events than it has room for. Generators with two
+ * buffers, see actf_event_generator.n_bufs, are generated from
+ * without returning early.
+ *
  * @param gens the generators to multiplex
  * @param gens_len the number of generators
  * @param evs_cap the max event array capacity. If zero,
@@ -52,10 +105,30 @@ typedef struct actf_muxer actf_muxer;
 actf_muxer *actf_muxer_init(struct actf_event_generator *gens, size_t gens_len,
 			    size_t evs_cap);
 
+/**
+ * Initialize a muxer with a configuration
+ * @param gens the generators to multiplex
+ * @param gens_len the number of generators
+ * @param cfg the configuration
+ * @return a muxer or NULL with errno set. A returned muxer should
+ * be freed with actf_muxer_free().
+ */
+actf_muxer *actf_muxer_init_cfg(struct actf_event_generator *gens, size_t gens_len,
+				struct actf_muxer_cfg cfg);
+
 /** @see actf_event_generate */
 int actf_muxer_mux(actf_muxer *m, actf_event ***evs, size_t *evs_len);
 
-/** @see actf_seek_ns_from_origin */
+/**
+ * @see actf_seek_ns_from_origin
+ *
+ * Generators with a time range, see actf_event_generator.time_range,
+ * are only seeked when needed. A generator whose events all are before
+ * tstamp is not seeked nor generated from until the next seek. A
+ * generator whose events all are at or after tstamp is seeked once
+ * its events are needed, in the strict order when the merge reaches
+ * the begin of its time range.
+ */
 int actf_muxer_seek_ns_from_origin(actf_muxer *m, int64_t tstamp);
 
 /** @see actf_last_error */
@@ -0,0 +1,569 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crust/common.h"
+#include "decoder_int.h"
+#include "error.h"
+#include "event.h"
+#include "pdecoder.h"
+#include "pdecoder_int.h"
+#include "pkt_idx.h"
+#include "types.h"
+
+/* A parallel decoder needs to:
+   - Hand out the indexed packets of a data stream, in order, to a pool
+     of worker threads.
+   - Return the events of each packet in the order of the data stream.
+   - Decode whatever follows the indexed packets sequentially.
+
+   Every packet is decoded by the decoder of a slot in a ring of
+   slots, packet i is decoded in slot i % n_slots. A worker can only
+   take the next packet when its slot is free, i.e. when the events of
+   the packet n_slots before it are no longer in use. This limits how
+   far ahead the workers decode.
+ */
+
+enum slot_state {
+	SLOT_FREE,
+	SLOT_BUSY,
+	SLOT_READY,
+};
+
+/* slot holds the decoded events of a single packet. Only the worker
+ * decoding the packet touches a busy slot and only the consumer
+ * touches a ready slot. */
+struct slot {
+	enum slot_state state;
+	size_t pkt_i;
+	actf_decoder *dec;
+	size_t evs_cap;
+	actf_event **evs;
+	size_t evs_len;
+	/* The error following the events, ACTF_OK if none */
+	int rc;
+	struct error err;
+};
+
+struct actf_pdecoder {
+	uint8_t *data;
+	size_t data_len;
+	const struct actf_metadata *metadata;
+	struct actf_decoder_cfg dec_cfg;
+	struct pkt_idx idx;
+	/* The decoder owning idx, NULL if idx was provided. */
+	actf_decoder *idx_dec;
+	/* Decodes the data following the indexed packets, NULL if there
+	 * is none. */
+	actf_decoder *tail_dec;
+	struct slot *slots;
+	size_t n_slots;
+	pthread_t *threads;
+	size_t n_threads;
+
+	/* The members below are protected by mtx */
+	pthread_mutex_t mtx;
+	/* Signaled when a slot is freed or the workers should stop */
+	pthread_cond_t work_cond;
+	/* Signaled when a slot is ready */
+	pthread_cond_t ready_cond;
+	bool stop;
+	/* The next packet to hand out to a worker */
+	size_t next_pkt_i;
+	/* Packets from end_pkt_i are not handed out */
+	size_t end_pkt_i;
+
+	/* The members below are only used by the consumer */
+	/* The next packet to return the events of */
+	size_t cur_pkt_i;
+	/* The slots of the last returned events, held[0] holds the most
+	 * recent ones. Only the first n_bufs are used and NULL if
+	 * none. */
+	struct slot *held[2];
+	size_t n_bufs;
+	/* Events before seek_tstamp are dropped while seeking */
+	bool seeking;
+	int64_t seek_tstamp;
+	/* stored error code if has_err since all valid events are
+	 * returned before returning an error. */
+	bool has_err;
+	int err_rc;
+	struct error err;
+};
+
+static const char *dec_last_error(actf_decoder *dec)
+{
+	const char *msg = actf_decoder_last_error(dec);
+	return msg ? msg : "unknown decoder error";
+}
+
+/* slot_decode decodes all events of the packet of slot. A decoder only
+ * returns the events of a packet in one go if they fit in its event
+ * array, it is replaced with one of twice the capacity until they
+ * do. */
+static void slot_decode(struct actf_pdecoder *pd, struct slot *slot)
+{
+	const struct pkt_idx_entry *pkt = &pd->idx.entries[slot->pkt_i];
+	uint8_t *data = pd->data + pkt->bit_off / 8;
+	size_t len = pkt->tot_len / 8;
+
+	for (;;) {
+		actf_decoder_reset(slot->dec, data, len);
+		slot->rc = actf_decoder_decode(slot->dec, &slot->evs, &slot->evs_len);
+		if (slot->rc < 0) {
+			slot->evs_len = 0;
+			eprintf(&slot->err, "%s", dec_last_error(slot->dec));
+			return;
+		}
+		if (slot->evs_len < slot->evs_cap) {
+			break;
+		}
+		struct actf_decoder_cfg dec_cfg = pd->dec_cfg;
+		dec_cfg.evs_cap = slot->evs_cap * 2;
+		actf_decoder *dec = actf_decoder_init_cfg(data, len, pd->metadata, dec_cfg);
+		if (!dec) {
+			slot->rc = ACTF_OOM;
+			slot->evs_len = 0;
+			eprintf(&slot->err, "actf_decoder_init_cfg: %s", strerror(errno));
+			return;
+		}
+		actf_decoder_free(slot->dec);
+		slot->dec = dec;
+		slot->evs_cap = dec_cfg.evs_cap;
+	}
+
+	/* An error following the events is returned by the next
+	 * decode, which leaves the events intact since the packet is
+	 * fully decoded. */
+	size_t evs_len;
+	actf_event **evs;
+	if ((slot->rc = actf_decoder_decode(slot->dec, &evs, &evs_len)) < 0) {
+		eprintf(&slot->err, "%s", dec_last_error(slot->dec));
+	}
+}
+
+/* claim_slot hands out the next packet to a worker, if its slot is
+ * free. Must be called with mtx held. */
+static struct slot *claim_slot(struct actf_pdecoder *pd)
+{
+	if (pd->next_pkt_i >= pd->end_pkt_i) {
+		return NULL;
+	}
+	struct slot *slot = &pd->slots[pd->next_pkt_i % pd->n_slots];
+	if (slot->state != SLOT_FREE) {
+		return NULL;
+	}
+	slot->state = SLOT_BUSY;
+	slot->pkt_i = pd->next_pkt_i++;
+	return slot;
+}
+
+static void *worker_run(void *arg)
+{
+	struct actf_pdecoder *pd = arg;
+	pthread_mutex_lock(&pd->mtx);
+	for (;;) {
+		struct slot *slot;
+		while (!pd->stop && !(slot = claim_slot(pd))) {
+			pthread_cond_wait(&pd->work_cond, &pd->mtx);
+		}
+		if (pd->stop) {
+			break;
+		}
+		pthread_mutex_unlock(&pd->mtx);
+		slot_decode(pd, slot);
+		pthread_mutex_lock(&pd->mtx);
+		slot->state = SLOT_READY;
+		pthread_cond_broadcast(&pd->ready_cond);
+	}
+	pthread_mutex_unlock(&pd->mtx);
+	return NULL;
+}
+
+/* workers_pause stops handing out packets and waits for the workers to
+ * finish the packets they are decoding. All slots are free
+ * afterwards. */
+static void workers_pause(struct actf_pdecoder *pd)
+{
+	pthread_mutex_lock(&pd->mtx);
+	pd->end_pkt_i = pd->next_pkt_i;
+	for (size_t i = 0; i < pd->n_slots; i++) {
+		while (pd->slots[i].state == SLOT_BUSY) {
+			pthread_cond_wait(&pd->ready_cond, &pd->mtx);
+		}
+		pd->slots[i].state = SLOT_FREE;
+	}
+	pthread_mutex_unlock(&pd->mtx);
+}
+
+/* workers_resume hands out packets again, starting at pkt_i. */
+static void workers_resume(struct actf_pdecoder *pd, size_t pkt_i)
+{
+	pthread_mutex_lock(&pd->mtx);
+	pd->next_pkt_i = pkt_i;
+	pd->end_pkt_i = pd->idx.len;
+	pthread_cond_broadcast(&pd->work_cond);
+	pthread_mutex_unlock(&pd->mtx);
+}
+
+static void workers_stop(struct actf_pdecoder *pd)
+{
+	pthread_mutex_lock(&pd->mtx);
+	pd->stop = true;
+	pthread_cond_broadcast(&pd->work_cond);
+	pthread_mutex_unlock(&pd->mtx);
+	for (size_t i = 0; i < pd->n_threads; i++) {
+		pthread_join(pd->threads[i], NULL);
+	}
+	pd->n_threads = 0;
+}
+
+static void slot_release(struct actf_pdecoder *pd, struct slot *slot)
+{
+	pthread_mutex_lock(&pd->mtx);
+	slot->state = SLOT_FREE;
+	pthread_cond_broadcast(&pd->work_cond);
+	pthread_mutex_unlock(&pd->mtx);
+}
+
+static struct slot *slot_wait(struct actf_pdecoder *pd, size_t pkt_i)
+{
+	struct slot *slot = &pd->slots[pkt_i % pd->n_slots];
+	pthread_mutex_lock(&pd->mtx);
+	while (slot->state != SLOT_READY) {
+		pthread_cond_wait(&pd->ready_cond, &pd->mtx);
+	}
+	pthread_mutex_unlock(&pd->mtx);
+	return slot;
+}
+
+static size_t default_n_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (size_t) n : 1;
+}
+
+static void slots_free(struct slot *slots, size_t n_slots)
+{
+	if (!slots) {
+		return;
+	}
+	for (size_t i = 0; i < n_slots; i++) {
+		actf_decoder_free(slots[i].dec);
+		error_free(&slots[i].err);
+	}
+	free(slots);
+}
+
+actf_pdecoder *actf_pdecoder_init_idx(void *data, size_t data_len,
+				      const struct actf_metadata *metadata,
+				      struct actf_pdecoder_cfg cfg, struct pkt_idx idx)
+{
+	/* The workers decode the indexed packets without any bounds of
+	 * their own */
+	if (!pkt_idx_valid(&idx) || idx.end_bit_off / 8 > data_len) {
+		errno = EINVAL;
+		return NULL;
+	}
+	struct actf_pdecoder *pd = malloc(sizeof(*pd));
+	if (!pd) {
+		return NULL;
+	}
+	if (cfg.dec_cfg.evs_cap == 0) {
+		cfg.dec_cfg.evs_cap = ACTF_DEFAULT_EVS_CAP;
+	}
+	size_t n_threads = cfg.n_threads ? cfg.n_threads : default_n_threads();
+	size_t n_bufs = cfg.dec_cfg.mode == ACTF_DECODER_MODE_LAZY ?
+	    1 : MIN(MAX(cfg.dec_cfg.n_bufs, 1), 2);
+	*pd = (struct actf_pdecoder) {
+		.data = data,
+		.data_len = data_len,
+		.metadata = metadata,
+		.dec_cfg = cfg.dec_cfg,
+		.idx = idx,
+		/* The slots held by the consumer are not decoded into */
+		.n_slots = n_threads * 2 + n_bufs - 1,
+		.n_bufs = n_bufs,
+		.end_pkt_i = idx.len,
+		.err = ERROR_EMPTY,
+	};
+
+	pd->slots = calloc(pd->n_slots, sizeof(*pd->slots));
+	if (!pd->slots) {
+		goto err_free_pd;
+	}
+	/* A slot is not decoded into while its events are in use, its
+	 * decoder only needs one buffer. */
+	pd->dec_cfg.n_bufs = 1;
+	for (size_t i = 0; i < pd->n_slots; i++) {
+		pd->slots[i].dec = actf_decoder_init_cfg(data, 0, metadata, pd->dec_cfg);
+		if (!pd->slots[i].dec) {
+			goto err_free_slots;
+		}
+		pd->slots[i].evs_cap = cfg.dec_cfg.evs_cap;
+		pd->slots[i].err = ERROR_EMPTY;
+	}
+	uint64_t tail_off = idx.end_bit_off / 8;
+	if (tail_off < data_len) {
+		cfg.dec_cfg.n_bufs = n_bufs;
+		pd->tail_dec = actf_decoder_init_cfg(pd->data + tail_off, data_len - tail_off,
+						     metadata, cfg.dec_cfg);
+		if (!pd->tail_dec) {
+			goto err_free_slots;
+		}
+	}
+	pd->threads = malloc(n_threads * sizeof(*pd->threads));
+	if (!pd->threads) {
+		goto err_free_tail;
+	}
+
+	int rc;
+	if ((rc = pthread_mutex_init(&pd->mtx, NULL)) != 0) {
+		errno = rc;
+		goto err_free_threads;
+	}
+	if ((rc = pthread_cond_init(&pd->work_cond, NULL)) != 0) {
+		errno = rc;
+		goto err_destroy_mtx;
+	}
+	if ((rc = pthread_cond_init(&pd->ready_cond, NULL)) != 0) {
+		errno = rc;
+		goto err_destroy_work_cond;
+	}
+	for (size_t i = 0; i < n_threads; i++) {
+		if ((rc = pthread_create(&pd->threads[i], NULL, worker_run, pd)) != 0) {
+			workers_stop(pd);
+			errno = rc;
+			goto err_destroy_ready_cond;
+		}
+		pd->n_threads++;
+	}
+	return pd;
+
+      err_destroy_ready_cond:
+	pthread_cond_destroy(&pd->ready_cond);
+      err_destroy_work_cond:
+	pthread_cond_destroy(&pd->work_cond);
+      err_destroy_mtx:
+	pthread_mutex_destroy(&pd->mtx);
+      err_free_threads:
+	free(pd->threads);
+      err_free_tail:
+	actf_decoder_free(pd->tail_dec);
+      err_free_slots:
+	slots_free(pd->slots, pd->n_slots);
+      err_free_pd:
+	free(pd);
+	return NULL;
+}
+
+actf_pdecoder *actf_pdecoder_init(void *data, size_t data_len,
+				  const struct actf_metadata *metadata,
+				  struct actf_pdecoder_cfg cfg)
+{
+	actf_decoder *idx_dec = actf_decoder_init_cfg(data, data_len, metadata, cfg.dec_cfg);
+	if (!idx_dec) {
+		return NULL;
+	}
+	struct pkt_idx idx;
+	if (actf_decoder_pkt_idx(idx_dec, &idx) < 0) {
+		actf_decoder_free(idx_dec);
+		errno = ENOMEM;
+		return NULL;
+	}
+	struct actf_pdecoder *pd = actf_pdecoder_init_idx(data, data_len, metadata, cfg, idx);
+	if (!pd) {
+		actf_decoder_free(idx_dec);
+		return NULL;
+	}
+	pd->idx_dec = idx_dec;
+	return pd;
+}
+
+/* tail_decode decodes the data following the indexed packets. */
+static int tail_decode(struct actf_pdecoder *pd, actf_event ***evs, size_t *evs_len)
+{
+	int rc;
+	if (pd->seeking) {
+		pd->seeking = false;
+		if ((rc = actf_decoder_seek_ns_from_origin(pd->tail_dec, pd->seek_tstamp)) < 0) {
+			eprintf(&pd->err, "%s", dec_last_error(pd->tail_dec));
+			return rc;
+		}
+	}
+	if ((rc = actf_decoder_decode(pd->tail_dec, evs, evs_len)) < 0) {
+		eprintf(&pd->err, "%s", dec_last_error(pd->tail_dec));
+	}
+	return rc;
+}
+
+int actf_pdecoder_decode(actf_pdecoder *pd, actf_event ***evs, size_t *evs_len)
+{
+	*evs = NULL;
+	*evs_len = 0;
+	struct slot *oldest = pd->held[pd->n_bufs - 1];
+	if (oldest) {
+		slot_release(pd, oldest);
+	}
+	pd->held[1] = pd->held[0];
+	pd->held[0] = NULL;
+	if (pd->has_err) {
+		return pd->err_rc;
+	}
+
+	while (pd->cur_pkt_i < pd->idx.len) {
+		struct slot *slot = slot_wait(pd, pd->cur_pkt_i);
+		pd->cur_pkt_i++;
+		size_t off = 0;
+		if (pd->seeking) {
+			while (off < slot->evs_len &&
+			       actf_event_tstamp_ns_from_origin(slot->evs[off]) < pd->seek_tstamp) {
+				off++;
+			}
+			pd->seeking = off == slot->evs_len;
+		}
+		if (slot->rc < 0) {
+			pd->has_err = true;
+			pd->err_rc = slot->rc;
+			eprintf(&pd->err, "%s", slot->err.buf);
+		}
+		if (off < slot->evs_len) {
+			pd->held[0] = slot;
+			*evs = slot->evs + off;
+			*evs_len = slot->evs_len - off;
+			return ACTF_OK;
+		}
+		slot_release(pd, slot);
+		if (pd->has_err) {
+			return pd->err_rc;
+		}
+	}
+	if (pd->tail_dec) {
+		return tail_decode(pd, evs, evs_len);
+	}
+	return ACTF_OK;
+}
+
+static int pdecoder_decode(void *self, actf_event ***evs, size_t *evs_len)
+{
+	actf_pdecoder *pd = self;
+	return actf_pdecoder_decode(pd, evs, evs_len);
+}
+
+int actf_pdecoder_seek_ns_from_origin(actf_pdecoder *pd, int64_t tstamp)
+{
+	workers_pause(pd);
+	pd->held[0] = pd->held[1] = NULL;
+	pd->has_err = false;
+	/* Start at the first indexed packet that might hold the sought
+	 * event, the events before it in the packet are dropped when
+	 * decoded. */
+	pd->cur_pkt_i = pkt_idx_find(&pd->idx, tstamp);
+	pd->seeking = true;
+	pd->seek_tstamp = tstamp;
+	if (pd->tail_dec) {
+		uint64_t tail_off = pd->idx.end_bit_off / 8;
+		actf_decoder_reset(pd->tail_dec, pd->data + tail_off, pd->data_len - tail_off);
+	}
+	workers_resume(pd, pd->cur_pkt_i);
+	return ACTF_OK;
+}
+
+static int pdecoder_seek_ns_from_origin(void *self, int64_t tstamp)
+{
+	actf_pdecoder *pd = self;
+	return actf_pdecoder_seek_ns_from_origin(pd, tstamp);
+}
+
+int actf_pdecoder_time_range(actf_pdecoder *pd, int64_t *begin, int64_t *end)
+{
+	if (pd->idx.len == 0) {
+		if (!pd->tail_dec) {
+			return ACTF_NOT_FOUND;
+		}
+		int rc = actf_decoder_time_range(pd->tail_dec, begin, end);
+		if (rc < 0 && rc != ACTF_NOT_FOUND) {
+			eprintf(&pd->err, "%s", dec_last_error(pd->tail_dec));
+		}
+		return rc;
+	}
+	int rc = pkt_idx_time_range(&pd->idx, pd->metadata, begin, end);
+	// the tail is not indexed
+	if (rc == ACTF_OK && pd->tail_dec) {
+		*end = INT64_MAX;
+	}
+	return rc;
+}
+
+static int pdecoder_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	actf_pdecoder *pd = self;
+	return actf_pdecoder_time_range(pd, begin, end);
+}
+
+const char *actf_pdecoder_last_error(actf_pdecoder *pd)
+{
+	if (!pd || !pd->err.buf || pd->err.buf[0] == '\0') {
+		return NULL;
+	}
+	return pd->err.buf;
+}
+
+static const char *pdecoder_last_error(void *self)
+{
+	actf_pdecoder *pd = self;
+	return actf_pdecoder_last_error(pd);
+}
+
+void actf_pdecoder_free(actf_pdecoder *pd)
+{
+	if (!pd) {
+		return;
+	}
+	workers_stop(pd);
+	pthread_cond_destroy(&pd->ready_cond);
+	pthread_cond_destroy(&pd->work_cond);
+	pthread_mutex_destroy(&pd->mtx);
+	free(pd->threads);
+	actf_decoder_free(pd->tail_dec);
+	slots_free(pd->slots, pd->n_slots);
+	actf_decoder_free(pd->idx_dec);
+	error_free(&pd->err);
+	free(pd);
+}
+
+struct actf_event_generator actf_pdecoder_to_generator(actf_pdecoder *pd)
+{
+	return (struct actf_event_generator) {
+		.generate = pdecoder_decode,
+		.seek_ns_from_origin = pdecoder_seek_ns_from_origin,
+		.last_error = pdecoder_last_error,
+		.self = pd,
+		.n_bufs = pd->n_bufs,
+		.time_range = pdecoder_time_range,
+	};
+}
@@ -0,0 +1,103 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * A parallel CTF2 decoder and its methods.
+ *
+ * The packets of a data stream are independent of each other, the
+ * parallel decoder decodes them on a pool of worker threads and
+ * returns the events in the order of the data stream.
+ */
+#ifndef ACTF_PDECODER_H
+#define ACTF_PDECODER_H
+
+#include <stddef.h>
+
+#include "decoder.h"
+#include "event_generator.h"
+#include "metadata.h"
+
+/** A parallel CTF2 decoder, implements an actf_event_generator */
+typedef struct actf_pdecoder actf_pdecoder;
+
+/** The configuration of a parallel decoder. It can be initialized to
+ * zero to get the default values. */
+struct actf_pdecoder_cfg {
+	/** The number of worker threads. If zero, the number of online
+	 * processors is used. */
+	size_t n_threads;
+	/** The configuration of the decoders of the worker threads. The
+	 * events of a packet are always returned together, evs_cap is
+	 * the initial event array capacity which is grown to fit the
+	 * packet with the most events. n_bufs applies to the events
+	 * returned by the parallel decoder, values above two are
+	 * treated as two. */
+	struct actf_decoder_cfg dec_cfg;
+};
+
+/**
+ * Initialize a parallel decoder
+ *
+ * The packets of the data are indexed first. Packets following the
+ * first packet which can not be indexed, for example due to an
+ * unknown total length, are decoded sequentially after the indexed
+ * ones.
+ *
+ * @param data the ctf2 data to process
+ * @param data_len the length of the data
+ * @param metadata the metadata describing the data
+ * @param cfg the configuration
+ * @return a parallel decoder or NULL with errno set. A returned
+ * parallel decoder should be freed with actf_pdecoder_free().
+ */
+actf_pdecoder *actf_pdecoder_init(void *data, size_t data_len, const actf_metadata *metadata,
+				  struct actf_pdecoder_cfg cfg);
+
+/** @see actf_event_generate */
+int actf_pdecoder_decode(actf_pdecoder *pd, actf_event ***evs, size_t *evs_len);
+
+/** @see actf_seek_ns_from_origin */
+int actf_pdecoder_seek_ns_from_origin(actf_pdecoder *pd, int64_t tstamp);
+
+/** @see actf_time_range */
+int actf_pdecoder_time_range(actf_pdecoder *pd, int64_t *begin, int64_t *end);
+
+/** @see actf_last_error */
+const char *actf_pdecoder_last_error(actf_pdecoder *pd);
+
+/**
+ * Free a parallel decoder, its worker threads are stopped and joined
+ * @param pd the parallel decoder
+ */
+void actf_pdecoder_free(actf_pdecoder *pd);
+
+/**
+ * Create an event generator based on a parallel decoder
+ *
+ * The parallel decoder is owned by the caller and must be kept alive
+ * as long as the event generator is in use.
+ *
+ * @param pd the parallel decoder
+ * @return an event generator
+ */
+struct actf_event_generator actf_pdecoder_to_generator(actf_pdecoder *pd);
+
+#endif /* ACTF_PDECODER_H */
@@ -0,0 +1,37 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACTF_PDECODER_INT_H
+#define ACTF_PDECODER_INT_H
+
+#include "pdecoder.h"
+#include "pkt_idx.h"
+
+
+/* Initializes a parallel decoder which uses idx as the packet index
+ * of data instead of building one. The entries must be kept alive as
+ * long as the parallel decoder. NULL is returned with errno set to
+ * EINVAL if idx is not valid or has packets past data_len, see
+ * pkt_idx_valid(). */
+actf_pdecoder *actf_pdecoder_init_idx(void *data, size_t data_len,
+				      const actf_metadata *metadata,
+				      struct actf_pdecoder_cfg cfg, struct pkt_idx idx);
+
+#endif /* ACTF_PDECODER_INT_H */
@@ -0,0 +1,276 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "metadata_int.h"
+#include "pkt_idx.h"
+#include "types.h"
+
+#define PKT_IDX_FILE_MAGIC "ACTFPIDX"
+#define PKT_IDX_FILE_VERSION 3
+#define PKT_IDX_FILE_BOM 0x01020304
+
+/* The header of a packet index file, it is directly followed by
+ * n_entries struct pkt_idx_entry. Everything is stored in the byte
+ * order of the host that wrote the file, a host with another byte
+ * order will not recognize the byte order mark and ignore the file. */
+struct pkt_idx_file_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t bom;
+	/* Non-zero if the data stream file is compressed, the index is
+	 * then of the decompressed data. Formerly reserved as zero. */
+	uint32_t compressed;
+	/* Identity of the indexed data stream file */
+	uint64_t ds_size;
+	int64_t ds_mtime_sec;
+	int64_t ds_mtime_nsec;
+	uint8_t metadata_uuid[ACTF_UUID_N_BYTES];
+	uint64_t metadata_hash;
+	/* The index */
+	uint64_t n_entries;
+	uint64_t end_bit_off;
+	/* The size of the indexed data, the decompressed size of a
+	 * compressed data stream file */
+	uint64_t data_size;
+};
+
+static void pkt_idx_file_hdr_init(const struct pkt_idx_file_id *id,
+				  struct pkt_idx_file_hdr *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, PKT_IDX_FILE_MAGIC, sizeof(hdr->magic));
+	hdr->version = PKT_IDX_FILE_VERSION;
+	hdr->entry_size = sizeof(struct pkt_idx_entry);
+	hdr->bom = PKT_IDX_FILE_BOM;
+	hdr->ds_size = id->ds_size;
+	hdr->compressed = id->compressed;
+	hdr->ds_mtime_sec = id->ds_mtime.tv_sec;
+	hdr->ds_mtime_nsec = id->ds_mtime.tv_nsec;
+	if (id->metadata_uuid) {
+		memcpy(hdr->metadata_uuid, id->metadata_uuid, sizeof(hdr->metadata_uuid));
+	}
+	hdr->metadata_hash = id->metadata_hash;
+}
+
+bool pkt_idx_valid(const struct pkt_idx *idx)
+{
+	for (size_t i = 0; i < idx->len; i++) {
+		const struct pkt_idx_entry *pkt = &idx->entries[i];
+		uint64_t next_off = i + 1 < idx->len ? idx->entries[i + 1].bit_off : idx->end_bit_off;
+		if (pkt->bit_off % 8 != 0 || pkt->bit_off > next_off ||
+		    pkt->tot_len > next_off - pkt->bit_off || pkt->content_len > pkt->tot_len) {
+			return false;
+		}
+		if (i + 1 < idx->len && (next_off == pkt->bit_off ||
+					 idx->entries[i + 1].max_end_ns < pkt->max_end_ns)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int pkt_idx_file_name(const char *ds_name, char *buf, size_t buf_len)
+{
+	int n = snprintf(buf, buf_len, ".%s.actfidx", ds_name);
+	if (n < 0 || (size_t) n >= buf_len) {
+		return ACTF_ERROR;
+	}
+	return ACTF_OK;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while (len) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int pkt_idx_file_write(int dirfd, const char *ds_name, const struct pkt_idx_file_id *id,
+		       const struct pkt_idx *idx, uint64_t data_size, struct error *e)
+{
+	char name[PKT_IDX_FILE_NAME_MAX];
+	char tmp_name[PKT_IDX_FILE_NAME_MAX + 4];
+	if (pkt_idx_file_name(ds_name, name, sizeof(name)) < 0 ||
+	    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", name) < 0) {
+		eprintf(e, "packet index file name for %s is too long", ds_name);
+		return ACTF_ERROR;
+	}
+
+	struct pkt_idx_file_hdr hdr;
+	pkt_idx_file_hdr_init(id, &hdr);
+	hdr.n_entries = idx->len;
+	hdr.end_bit_off = idx->end_bit_off;
+	hdr.data_size = data_size;
+
+	/* Write to a temporary file which is then renamed to not leave a
+	 * partially written index behind. */
+	int fd = openat(dirfd, tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		eprintf(e, "%s openat: %s", tmp_name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	if (write_all(fd, &hdr, sizeof(hdr)) < 0 ||
+	    write_all(fd, idx->entries, idx->len * sizeof(*idx->entries)) < 0) {
+		eprintf(e, "%s write: %s", tmp_name, strerror(errno));
+		goto err;
+	}
+	if (close(fd) < 0) {
+		eprintf(e, "%s close: %s", tmp_name, strerror(errno));
+		unlinkat(dirfd, tmp_name, 0);
+		return ACTF_ERROR;
+	}
+	if (renameat(dirfd, tmp_name, dirfd, name) < 0) {
+		eprintf(e, "%s renameat: %s", name, strerror(errno));
+		unlinkat(dirfd, tmp_name, 0);
+		return ACTF_ERROR;
+	}
+	return ACTF_OK;
+
+      err:
+	close(fd);
+	unlinkat(dirfd, tmp_name, 0);
+	return ACTF_ERROR;
+}
+
+int pkt_idx_file_map(int dirfd, const char *ds_name, const struct pkt_idx_file_id *id,
+		     struct pkt_idx_file *f, struct error *e)
+{
+	char name[PKT_IDX_FILE_NAME_MAX];
+	if (pkt_idx_file_name(ds_name, name, sizeof(name)) < 0) {
+		return ACTF_NOT_FOUND;
+	}
+	int fd = openat(dirfd, name, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT) {
+			return ACTF_NOT_FOUND;
+		}
+		eprintf(e, "%s openat: %s", name, strerror(errno));
+		return ACTF_ERROR;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0) {
+		eprintf(e, "%s fstat: %s", name, strerror(errno));
+		close(fd);
+		return ACTF_ERROR;
+	}
+	if ((size_t) sb.st_size < sizeof(struct pkt_idx_file_hdr)) {
+		close(fd);
+		return ACTF_NOT_FOUND;
+	}
+	void *pa = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pa == MAP_FAILED) {
+		eprintf(e, "%s mmap: %s", name, strerror(errno));
+		return ACTF_ERROR;
+	}
+
+	/* Any mismatch means that the index is stale or written by
+	 * someone else, it is then silently ignored. */
+	const struct pkt_idx_file_hdr *hdr = pa;
+	struct pkt_idx_file_hdr expected;
+	pkt_idx_file_hdr_init(id, &expected);
+	uint64_t n_entries = hdr->n_entries;
+	if (memcmp(hdr->magic, expected.magic, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != expected.version ||
+	    hdr->entry_size != expected.entry_size ||
+	    hdr->bom != expected.bom ||
+	    hdr->ds_size != expected.ds_size ||
+	    hdr->compressed != expected.compressed ||
+	    hdr->ds_mtime_sec != expected.ds_mtime_sec ||
+	    hdr->ds_mtime_nsec != expected.ds_mtime_nsec ||
+	    memcmp(hdr->metadata_uuid, expected.metadata_uuid, sizeof(hdr->metadata_uuid)) != 0 ||
+	    hdr->metadata_hash != expected.metadata_hash ||
+	    n_entries > (sb.st_size - sizeof(*hdr)) / sizeof(struct pkt_idx_entry) ||
+	    sizeof(*hdr) + n_entries * sizeof(struct pkt_idx_entry) != (uint64_t) sb.st_size ||
+	    (!hdr->compressed && hdr->data_size != hdr->ds_size) ||
+	    hdr->end_bit_off / 8 > hdr->data_size) {
+		munmap(pa, sb.st_size);
+		return ACTF_NOT_FOUND;
+	}
+
+	struct pkt_idx idx = {
+		.entries = (const struct pkt_idx_entry *) (hdr + 1),
+		.len = n_entries,
+		.end_bit_off = hdr->end_bit_off,
+	};
+	/* A damaged index must not lead the decoders astray */
+	if (!pkt_idx_valid(&idx)) {
+		munmap(pa, sb.st_size);
+		return ACTF_NOT_FOUND;
+	}
+
+	*f = (struct pkt_idx_file) {
+		.pa = pa,
+		.len = sb.st_size,
+		.idx = idx,
+		.data_size = hdr->data_size,
+	};
+	return ACTF_OK;
+}
+
+void pkt_idx_file_unmap(struct pkt_idx_file *f)
+{
+	if (!f || !f->pa) {
+		return;
+	}
+	munmap(f->pa, f->len);
+	f->pa = NULL;
+	f->len = 0;
+}
+
+int pkt_idx_time_range(const struct pkt_idx *idx, const struct actf_metadata *metadata,
+		       int64_t *begin, int64_t *end)
+{
+	if (idx->len == 0) {
+		return ACTF_NOT_FOUND;
+	}
+	const struct pkt_idx_entry *first = &idx->entries[0];
+	struct actf_dstream_cls **dscp = u64todsc_find(&metadata->idtodsc, first->dsc_id);
+	const actf_clk_cls *clkc = dscp ? actf_dstream_cls_clk_cls(*dscp) : NULL;
+	if (!clkc) {
+		return ACTF_NOT_FOUND;
+	}
+	/* A packet without a begin timestamp has it at zero cycles,
+	 * which no event is before. */
+	*begin = actf_clk_cls_cc_to_ns_from_origin(clkc, first->begin_def_clk_val);
+	*end = idx->entries[idx->len - 1].max_end_ns;
+	return ACTF_OK;
+}
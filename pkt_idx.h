@@ -0,0 +1,146 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PKT_IDX_H
+#define PKT_IDX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "error.h"
+#include "pkt_state.h"
+
+/* Large enough for the index file name of any data stream file name. */
+#define PKT_IDX_FILE_NAME_MAX 272
+
+
+/* pkt_idx_entry describes a single packet of a data stream. Only
+ * fixed-width members are used so that an entry has the same layout
+ * everywhere it is stored. */
+struct pkt_idx_entry {
+	uint64_t bit_off;	// Bit offset to start of packet
+	uint64_t tot_len;
+	uint64_t content_len;
+	uint64_t begin_def_clk_val;
+	uint64_t end_def_clk_val;
+	uint64_t seq_num;
+	uint64_t disc_er_snap;
+	uint64_t dsc_id;
+	/* The greatest end timestamp in ns from origin of this packet
+	 * and all packets before it, INT64_MAX if any of them has an
+	 * unknown end. It never decreases which makes it possible to
+	 * binary search. */
+	int64_t max_end_ns;
+	/* OR'd pkt_state_opt for the optional members. */
+	uint32_t opt_flags;
+	uint32_t reserved;
+};
+
+#define TYPE struct pkt_idx_entry
+#define TYPED_NAME(x) pkt_idx_entry_##x
+#include "crust/vec.h"
+
+/* pkt_idx is a view of consecutive packet index entries. Packets
+ * located at or after end_bit_off are not part of the index. */
+struct pkt_idx {
+	const struct pkt_idx_entry *entries;
+	size_t len;
+	uint64_t end_bit_off;
+};
+
+/* pkt_idx_file_id identifies the data stream file that a packet index
+ * file indexes. metadata_uuid is NULL if the metadata has no UUID.
+ * metadata_hash is a hash of the text of the metadata, which the
+ * timestamps of the index depend on. If compressed is set, the index
+ * is of the decompressed data of the file. */
+struct pkt_idx_file_id {
+	uint64_t ds_size;
+	struct timespec ds_mtime;
+	const uint8_t *metadata_uuid;
+	uint64_t metadata_hash;
+	bool compressed;
+};
+
+/* pkt_idx_file is a mmapped packet index file. data_size is the size
+ * of the indexed data, the decompressed size of a compressed data
+ * stream file. */
+struct pkt_idx_file {
+	void *pa;
+	size_t len;
+	struct pkt_idx idx;
+	uint64_t data_size;
+};
+
+
+/* pkt_idx_valid returns true if the entries of idx are consistent:
+ * the packets are byte-aligned, in order, do not overlap, end at or
+ * before end_bit_off, their content fits in them and max_end_ns never
+ * decreases. */
+bool pkt_idx_valid(const struct pkt_idx *idx);
+
+/* pkt_idx_file_name writes the name of the packet index file
+ * belonging to the data stream file ds_name into buf. The index file
+ * is a dot file so that it is not mistaken for a data stream file. */
+int pkt_idx_file_name(const char *ds_name, char *buf, size_t buf_len);
+
+/* pkt_idx_file_write writes idx as the packet index file of the data
+ * stream file ds_name in the directory dirfd. data_size is the size
+ * of the indexed data, which is ds_size unless the file is
+ * compressed. */
+int pkt_idx_file_write(int dirfd, const char *ds_name, const struct pkt_idx_file_id *id,
+		       const struct pkt_idx *idx, uint64_t data_size, struct error *e);
+
+/* pkt_idx_file_map mmaps the packet index file of the data stream
+ * file ds_name in the directory dirfd. ACTF_NOT_FOUND is returned if
+ * there is no index file or if it does not match id. A mapped file
+ * should be unmapped with pkt_idx_file_unmap. */
+int pkt_idx_file_map(int dirfd, const char *ds_name, const struct pkt_idx_file_id *id,
+		     struct pkt_idx_file *f, struct error *e);
+
+void pkt_idx_file_unmap(struct pkt_idx_file *f);
+
+/* pkt_idx_time_range sets begin to the begin timestamp of the first
+ * packet of idx and end to the greatest end timestamp of its packets,
+ * both in ns from origin. end is INT64_MAX if any packet has an
+ * unknown end. ACTF_NOT_FOUND is returned if idx is empty or its first
+ * packet has no clock. */
+int pkt_idx_time_range(const struct pkt_idx *idx, const struct actf_metadata *metadata,
+		       int64_t *begin, int64_t *end);
+
+/* pkt_idx_find returns the index of the first entry which might hold
+ * an event with a timestamp greater than or equal to tstamp. If no
+ * such entry exists, idx->len is returned. */
+static inline size_t pkt_idx_find(const struct pkt_idx *idx, int64_t tstamp)
+{
+	size_t lo = 0, hi = idx->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (idx->entries[mid].max_end_ns < tstamp) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+#endif /* PKT_IDX_H */
@@ -34,6 +34,17 @@ struct node {
 	size_t value;
 };
 
+/* node_less orders nodes by key. Nodes with equal keys are ordered by
+ * value to make the order independent of the sequence of queue
+ * operations. */
+static inline bool node_less(struct node a, struct node b)
+{
+#ifdef PRIO_QUEUE_CMP_HOOK
+	PRIO_QUEUE_CMP_HOOK();
+#endif
+	return a.key < b.key || (a.key == b.key && a.value < b.value);
+}
+
 /* Priority queue implemented with a binary heap. */
 struct prio_queue {
 	// children at indices 2i+1 and 2i+2
@@ -66,17 +77,18 @@ static inline void prio_queue_clear(struct prio_queue *pq)
 static inline void prio_queue_bottomup_fix_heap(struct prio_queue *pq, size_t i)
 {
 	size_t cur_i = i;
+	struct node n = pq->nodes[i];
 	while (cur_i) {
 		size_t par_i = (cur_i - 1) / 2;
-		if (pq->nodes[par_i].key <= pq->nodes[cur_i].key) {
+		if (!node_less(n, pq->nodes[par_i])) {
 			break;
 		}
-		/* the parent is smaller than cur, swap and go up. */
-		struct node tmp = pq->nodes[cur_i];
+		/* cur is smaller than the parent, move the parent down and
+		 * go up. */
 		pq->nodes[cur_i] = pq->nodes[par_i];
-		pq->nodes[par_i] = tmp;
 		cur_i = par_i;
 	}
+	pq->nodes[cur_i] = n;
 }
 
 /* The user must make sure to not push more elements than they
@@ -92,27 +104,25 @@ static inline void prio_queue_push_unchecked(struct prio_queue *pq, struct node
 static inline void prio_queue_topdown_fix_heap(struct prio_queue *pq, size_t i)
 {
 	size_t cur_i = i;
+	struct node n = pq->nodes[i];
 	while (true) {
-		size_t left_i = 2 * cur_i + 1;
-		size_t right_i = 2 * cur_i + 2;
-		size_t smallest_i = cur_i;
-
-		if (left_i < pq->len && pq->nodes[left_i].key < pq->nodes[smallest_i].key) {
-			smallest_i = left_i;
+		size_t smallest_i = 2 * cur_i + 1;
+		if (smallest_i >= pq->len) {
+			break;
 		}
-		if (right_i < pq->len && pq->nodes[right_i].key < pq->nodes[smallest_i].key) {
+		size_t right_i = smallest_i + 1;
+		if (right_i < pq->len && node_less(pq->nodes[right_i], pq->nodes[smallest_i])) {
 			smallest_i = right_i;
 		}
-		if (smallest_i == cur_i) {
+		if (!node_less(pq->nodes[smallest_i], n)) {
 			break;
 		}
-		// the child is smaller than cur, swap and go down that
-		// branch.
-		struct node tmp = pq->nodes[cur_i];
+		// the smallest child is smaller than cur, move it up and go
+		// down that branch.
 		pq->nodes[cur_i] = pq->nodes[smallest_i];
-		pq->nodes[smallest_i] = tmp;
 		cur_i = smallest_i;
 	}
+	pq->nodes[cur_i] = n;
 }
 
 /* The user must make sure that pq has any elements to pop (pq->len >
@@ -127,6 +137,19 @@ static inline struct node prio_queue_pop_unchecked(struct prio_queue *pq)
 	return min;
 }
 
+/* prio_queue_replace_top_unchecked pops the smallest node and pushes
+ * n in a single pass down the heap, which is cheaper than a pop
+ * followed by a push. The user must make sure that pq has any
+ * elements to replace (pq->len > 0). */
+static inline struct node prio_queue_replace_top_unchecked(struct prio_queue *pq, struct node n)
+{
+	assert(pq->len > 0);
+	struct node min = pq->nodes[0];
+	pq->nodes[0] = n;
+	prio_queue_topdown_fix_heap(pq, 0);
+	return min;
+}
+
 /* The user must make sure that pq has any elements to peek (pq->len >
  * 0). */
 static inline struct node prio_queue_peek_unchecked(struct prio_queue *pq)
@@ -135,6 +158,18 @@ static inline struct node prio_queue_peek_unchecked(struct prio_queue *pq)
 	return pq->nodes[0];
 }
 
+/* prio_queue_peek_second_unchecked returns the second smallest node,
+ * which is the smallest of the children of the top. The user must make
+ * sure that pq has at least two elements (pq->len > 1). */
+static inline struct node prio_queue_peek_second_unchecked(struct prio_queue *pq)
+{
+	assert(pq->len > 1);
+	if (pq->len > 2 && node_less(pq->nodes[2], pq->nodes[1])) {
+		return pq->nodes[2];
+	}
+	return pq->nodes[1];
+}
+
 static inline void prio_queue_free(struct prio_queue *pq)
 {
 	if (!pq) {
@@ -0,0 +1,395 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crust/common.h"
+#include "error.h"
+#include "producer.h"
+#include "types.h"
+
+/* A producer needs to:
+   - Generate the events of a generator on a thread of its own.
+   - Hand the batches of events over to the consumer in order.
+   - Never generate a batch while that would invalidate the events of
+     a batch still in use by the consumer.
+
+   The batches are handed over in a single-producer single-consumer
+   ring of n_slots slots, one per buffer of the generator, batch i is
+   generated into slot i % n_slots. The generator keeps the events of
+   its n_slots last batches valid, so batch i can be generated once
+   batch i - n_slots is released by the consumer.
+
+   The ring indices are atomics and handing over a batch takes no
+   lock. A thread only takes the mutex to sleep when it has to wait
+   for the other one, which then wakes it up. All atomics use
+   sequentially consistent ordering, a thread announces that it
+   sleeps before checking what it waits for one last time, while the
+   other one updates what is waited for before checking if anyone
+   sleeps. One of them always sees the other.
+ */
+
+/* batch holds the result of a generate call. */
+struct batch {
+	actf_event **evs;
+	size_t evs_len;
+	int rc;
+};
+
+struct actf_producer {
+	struct actf_event_generator gen;
+	size_t n_bufs;
+	struct batch *slots;
+	size_t n_slots;
+	pthread_t thread;
+	bool started;
+
+	/* The number of generated batches */
+	atomic_size_t tail;
+	/* The number of batches released by the consumer */
+	atomic_size_t head;
+	/* Set while the producer generates a batch */
+	atomic_bool busy;
+	/* Set while the consumer keeps the producer from generating */
+	atomic_bool paused;
+	/* Set once the last batch is generated, the one without events
+	 * or with an error */
+	atomic_bool ended;
+	atomic_bool stop;
+	atomic_bool producer_sleeps;
+	atomic_bool consumer_sleeps;
+	pthread_mutex_t mtx;
+	/* Signaled when the producer might be able to generate */
+	pthread_cond_t producer_cond;
+	/* Signaled when a batch is generated or the producer is no
+	 * longer busy */
+	pthread_cond_t consumer_cond;
+
+	/* The members below are only used by the consumer */
+	/* The next batch to return */
+	size_t next;
+	/* Set once the last batch is returned, done_rc is then returned
+	 * from then on. */
+	bool done;
+	int done_rc;
+	struct error err;
+};
+
+typedef bool (*producer_pred)(struct actf_producer *pr);
+
+/* can_generate returns true if the producer can generate the next
+ * batch. */
+static bool can_generate(struct actf_producer *pr)
+{
+	return !atomic_load(&pr->paused) && !atomic_load(&pr->ended) &&
+	    atomic_load(&pr->tail) - atomic_load(&pr->head) < pr->n_slots;
+}
+
+static bool producer_woken(struct actf_producer *pr)
+{
+	return atomic_load(&pr->stop) || can_generate(pr);
+}
+
+static bool batch_ready(struct actf_producer *pr)
+{
+	return atomic_load(&pr->tail) > pr->next;
+}
+
+static bool producer_idle(struct actf_producer *pr)
+{
+	return !atomic_load(&pr->busy);
+}
+
+/* sleep_until puts the calling thread to sleep on cond until pred
+ * holds. */
+static void sleep_until(struct actf_producer *pr, producer_pred pred, atomic_bool *sleeps,
+			pthread_cond_t *cond)
+{
+	if (pred(pr)) {
+		return;
+	}
+	pthread_mutex_lock(&pr->mtx);
+	atomic_store(sleeps, true);
+	while (!pred(pr)) {
+		pthread_cond_wait(cond, &pr->mtx);
+	}
+	atomic_store(sleeps, false);
+	pthread_mutex_unlock(&pr->mtx);
+}
+
+/* wake wakes up the thread sleeping on cond, if any. */
+static void wake(struct actf_producer *pr, atomic_bool *sleeps, pthread_cond_t *cond)
+{
+	if (atomic_load(sleeps)) {
+		pthread_mutex_lock(&pr->mtx);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&pr->mtx);
+	}
+}
+
+static void *producer_run(void *arg)
+{
+	struct actf_producer *pr = arg;
+	for (;;) {
+		sleep_until(pr, producer_woken, &pr->producer_sleeps, &pr->producer_cond);
+		if (atomic_load(&pr->stop)) {
+			break;
+		}
+		atomic_store(&pr->busy, true);
+		/* The consumer might have paused the producer since it woke
+		 * up, it then waits for the producer to not be busy. */
+		if (!can_generate(pr)) {
+			atomic_store(&pr->busy, false);
+			wake(pr, &pr->consumer_sleeps, &pr->consumer_cond);
+			continue;
+		}
+		size_t tail = atomic_load(&pr->tail);
+		struct batch *b = &pr->slots[tail % pr->n_slots];
+		b->rc = pr->gen.generate(pr->gen.self, &b->evs, &b->evs_len);
+		if (b->rc < 0 || b->evs_len == 0) {
+			atomic_store(&pr->ended, true);
+		}
+		atomic_store(&pr->tail, tail + 1);
+		atomic_store(&pr->busy, false);
+		wake(pr, &pr->consumer_sleeps, &pr->consumer_cond);
+	}
+	return NULL;
+}
+
+/* producer_pause keeps the producer from generating and waits for it
+ * to finish any batch it is generating. */
+static void producer_pause(struct actf_producer *pr)
+{
+	atomic_store(&pr->paused, true);
+	sleep_until(pr, producer_idle, &pr->consumer_sleeps, &pr->consumer_cond);
+}
+
+static void producer_resume(struct actf_producer *pr)
+{
+	atomic_store(&pr->paused, false);
+	wake(pr, &pr->producer_sleeps, &pr->producer_cond);
+}
+
+actf_producer *actf_producer_init(struct actf_event_generator gen, size_t n_bufs)
+{
+	if (gen.n_bufs < 2) {
+		errno = EINVAL;
+		return NULL;
+	}
+	struct actf_producer *pr = malloc(sizeof(*pr));
+	if (!pr) {
+		return NULL;
+	}
+	*pr = (struct actf_producer) {
+		.gen = gen,
+		.n_bufs = MIN(MAX(n_bufs, 1), gen.n_bufs - 1),
+		.n_slots = gen.n_bufs,
+		.err = ERROR_EMPTY,
+	};
+	atomic_init(&pr->tail, 0);
+	atomic_init(&pr->head, 0);
+	atomic_init(&pr->busy, false);
+	atomic_init(&pr->paused, false);
+	atomic_init(&pr->ended, false);
+	atomic_init(&pr->stop, false);
+	atomic_init(&pr->producer_sleeps, false);
+	atomic_init(&pr->consumer_sleeps, false);
+
+	pr->slots = calloc(pr->n_slots, sizeof(*pr->slots));
+	if (!pr->slots) {
+		goto err_free_pr;
+	}
+	int rc;
+	if ((rc = pthread_mutex_init(&pr->mtx, NULL)) != 0) {
+		errno = rc;
+		goto err_free_slots;
+	}
+	if ((rc = pthread_cond_init(&pr->producer_cond, NULL)) != 0) {
+		errno = rc;
+		goto err_destroy_mtx;
+	}
+	if ((rc = pthread_cond_init(&pr->consumer_cond, NULL)) != 0) {
+		errno = rc;
+		goto err_destroy_producer_cond;
+	}
+	return pr;
+
+      err_destroy_producer_cond:
+	pthread_cond_destroy(&pr->producer_cond);
+      err_destroy_mtx:
+	pthread_mutex_destroy(&pr->mtx);
+      err_free_slots:
+	free(pr->slots);
+      err_free_pr:
+	free(pr);
+	return NULL;
+}
+
+int actf_producer_produce(actf_producer *pr, actf_event ***evs, size_t *evs_len)
+{
+	*evs = NULL;
+	*evs_len = 0;
+	if (pr->done) {
+		return pr->done_rc;
+	}
+	if (!pr->started) {
+		int rc = pthread_create(&pr->thread, NULL, producer_run, pr);
+		if (rc != 0) {
+			eprintf(&pr->err, "pthread_create: %s", strerror(rc));
+			return ACTF_ERROR;
+		}
+		pr->started = true;
+	}
+	/* The batch returned n_bufs calls ago goes out of use */
+	if (pr->next >= pr->n_bufs) {
+		atomic_store(&pr->head, pr->next - pr->n_bufs + 1);
+		wake(pr, &pr->producer_sleeps, &pr->producer_cond);
+	}
+	sleep_until(pr, batch_ready, &pr->consumer_sleeps, &pr->consumer_cond);
+	struct batch *b = &pr->slots[pr->next % pr->n_slots];
+	pr->next++;
+	if (b->rc < 0) {
+		const char *msg = pr->gen.last_error(pr->gen.self);
+		eprintf(&pr->err, "%s", msg ? msg : "unknown event_generate error");
+		pr->done = true;
+		pr->done_rc = b->rc;
+		return b->rc;
+	}
+	if (b->evs_len == 0) {
+		pr->done = true;
+		pr->done_rc = ACTF_OK;
+	}
+	*evs = b->evs;
+	*evs_len = b->evs_len;
+	return ACTF_OK;
+}
+
+static int producer_produce(void *self, actf_event ***evs, size_t *evs_len)
+{
+	actf_producer *pr = self;
+	return actf_producer_produce(pr, evs, evs_len);
+}
+
+int actf_producer_seek_ns_from_origin(actf_producer *pr, int64_t tstamp)
+{
+	if (pr->started) {
+		producer_pause(pr);
+	}
+	int rc = pr->gen.seek_ns_from_origin(pr->gen.self, tstamp);
+	atomic_store(&pr->tail, 0);
+	atomic_store(&pr->head, 0);
+	pr->next = 0;
+	pr->done = false;
+	if (rc < 0) {
+		const char *msg = pr->gen.last_error(pr->gen.self);
+		eprintf(&pr->err, "seek_ns_from_origin: %s",
+			msg ? msg : "unknown seek_ns_from_origin error");
+		pr->done = true;
+		pr->done_rc = rc;
+	}
+	atomic_store(&pr->ended, rc < 0);
+	if (pr->started) {
+		producer_resume(pr);
+	}
+	return rc;
+}
+
+static int producer_seek_ns_from_origin(void *self, int64_t tstamp)
+{
+	actf_producer *pr = self;
+	return actf_producer_seek_ns_from_origin(pr, tstamp);
+}
+
+int actf_producer_time_range(actf_producer *pr, int64_t *begin, int64_t *end)
+{
+	if (!pr->gen.time_range) {
+		return ACTF_NOT_FOUND;
+	}
+	/* The generator is not generated from meanwhile */
+	if (pr->started) {
+		producer_pause(pr);
+	}
+	int rc = pr->gen.time_range(pr->gen.self, begin, end);
+	if (rc < 0 && rc != ACTF_NOT_FOUND) {
+		const char *msg = pr->gen.last_error(pr->gen.self);
+		eprintf(&pr->err, "time_range: %s", msg ? msg : "unknown time_range error");
+	}
+	if (pr->started) {
+		producer_resume(pr);
+	}
+	return rc;
+}
+
+static int producer_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	actf_producer *pr = self;
+	return actf_producer_time_range(pr, begin, end);
+}
+
+const char *actf_producer_last_error(actf_producer *pr)
+{
+	if (!pr || pr->err.buf[0] == '\0') {
+		return NULL;
+	}
+	return pr->err.buf;
+}
+
+static const char *producer_last_error(void *self)
+{
+	actf_producer *pr = self;
+	return actf_producer_last_error(pr);
+}
+
+void actf_producer_free(actf_producer *pr)
+{
+	if (!pr) {
+		return;
+	}
+	if (pr->started) {
+		atomic_store(&pr->stop, true);
+		pthread_mutex_lock(&pr->mtx);
+		pthread_cond_signal(&pr->producer_cond);
+		pthread_mutex_unlock(&pr->mtx);
+		pthread_join(pr->thread, NULL);
+	}
+	pthread_cond_destroy(&pr->consumer_cond);
+	pthread_cond_destroy(&pr->producer_cond);
+	pthread_mutex_destroy(&pr->mtx);
+	free(pr->slots);
+	error_free(&pr->err);
+	free(pr);
+}
+
+struct actf_event_generator actf_producer_to_generator(actf_producer *pr)
+{
+	return (struct actf_event_generator) {
+		.generate = producer_produce,
+		.seek_ns_from_origin = producer_seek_ns_from_origin,
+		.last_error = producer_last_error,
+		.self = pr,
+		.n_bufs = pr->n_bufs,
+		.time_range = producer_time_range,
+	};
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * A producer and its methods.
+ *
+ * A producer generates the events of a generator on a thread of its
+ * own, ahead of its consumer. Putting each data stream decoder behind
+ * a producer lets them decode in parallel while a muxer merges their
+ * events.
+ */
+#ifndef ACTF_PRODUCER_H
+#define ACTF_PRODUCER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "event_generator.h"
+
+/** A producer, implements an actf_event_generator */
+typedef struct actf_producer actf_producer;
+
+/**
+ * Initialize a producer
+ *
+ * The producer generates as many batches of events ahead as the
+ * buffers of the generator allow, see actf_event_generator.n_bufs,
+ * while keeping the n_bufs last batches returned valid. The generator
+ * therefore needs more buffers than the producer, a decoder could for
+ * example be configured with eight buffers, see
+ * actf_decoder_cfg.n_bufs.
+ *
+ * The generator is generated from by the producer's thread, which is
+ * started by the first call to actf_producer_produce(). The generator
+ * must not be used by anyone else from then on and it must be kept
+ * available by the caller until the producer is freed.
+ *
+ * @param gen the generator to produce the events of
+ * @param n_bufs the number of buffers of the producer, see
+ * actf_event_generator.n_bufs. If zero, one is used and it is at most
+ * one less than the number of buffers of gen.
+ * @return a producer or NULL with errno set, EINVAL if gen has less
+ * than two buffers. A returned producer should be freed with
+ * actf_producer_free().
+ */
+actf_producer *actf_producer_init(struct actf_event_generator gen, size_t n_bufs);
+
+/** @see actf_event_generate */
+int actf_producer_produce(actf_producer *pr, actf_event ***evs, size_t *evs_len);
+
+/** @see actf_seek_ns_from_origin */
+int actf_producer_seek_ns_from_origin(actf_producer *pr, int64_t tstamp);
+
+/**
+ * @see actf_time_range
+ *
+ * The time range of the generator, ACTF_NOT_FOUND if it does not
+ * have one.
+ */
+int actf_producer_time_range(actf_producer *pr, int64_t *begin, int64_t *end);
+
+/** @see actf_last_error */
+const char *actf_producer_last_error(actf_producer *pr);
+
+/**
+ * Free a producer
+ * @param pr the producer
+ */
+void actf_producer_free(actf_producer *pr);
+
+/**
+ * Create an event generator based on a producer
+ *
+ * The producer is owned by the caller and must be kept alive as long
+ * as the event generator is in use.
+ *
+ * @param pr the producer
+ * @return an event generator
+ */
+struct actf_event_generator actf_producer_to_generator(actf_producer *pr);
+
+#endif /* ACTF_PRODUCER_H */
@@ -18,13 +18,27 @@
  * <https://www.gnu.org/licenses/>.
  */
 
+// MADV_COLD, syscall()
+#define _DEFAULT_SOURCE
+
 #include <CUnit/CUnit.h>
 #include <CUnit/TestDB.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include "crust/common.h"
 #include "decoder.h"
+#include "decoder_int.h"
+#include "event_int.h"
 #include "event_generator.h"
+#include "print.h"
 #include "test_decoder.h"
 
 
@@ -50,6 +64,30 @@ static void test_decoder_test_teardown(void)
 	return;
 }
 
+/* The number of bytes advised to be read ahead and to be reclaimed,
+ * counted by the madvise() below. */
+static size_t advised_willneed;
+static size_t advised_reclaim;
+
+/* Counts the advice of the decoders, which is then given as usual. */
+int madvise(void *addr, size_t len, int advice)
+{
+	if (advice == MADV_WILLNEED) {
+		advised_willneed += len;
+	}
+#ifdef MADV_COLD
+	if (advice == MADV_COLD) {
+		advised_reclaim += len;
+	}
+#endif
+#ifdef MADV_PAGEOUT
+	if (advice == MADV_PAGEOUT) {
+		advised_reclaim += len;
+	}
+#endif
+	return (int) syscall(SYS_madvise, addr, len, advice);
+}
+
 /* Reads all data from path into databuf and returns the size. */
 static size_t read_file(const char *path)
 {
@@ -216,11 +254,750 @@ static void test_decoder_seek(void)
 	actf_metadata_free(metadata);
 }
 
+static void test_decoder_seek_bounds(void)
+{
+	// 1 packet a 17 ok events, 1 packet a 3 ok, 1 nok event
+	const char *ds_path = "testdata/ctfs/philo_nok/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo_nok/metadata";
+
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+
+	size_t len = read_file(ds_path);
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 20, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	size_t evs_len;
+	struct actf_event **evs;
+
+	// seek past the last packet
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_seek_ns_from_origin(dec, INT64_MAX), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+	CU_ASSERT_EQUAL_FATAL(evs_len, 0);
+
+	// seek before the first packet
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_seek_ns_from_origin(dec, INT64_MIN), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+	CU_ASSERT_EQUAL_FATAL(evs_len, 17);
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+	CU_ASSERT_EQUAL_FATAL(evs_len, 3);
+	CU_ASSERT_NOT_EQUAL_FATAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+
+	actf_decoder_free(dec);
+	actf_metadata_free(metadata);
+}
+
+static void test_decoder_time_range(void)
+{
+	const char *ds_paths[] = {
+		"testdata/ctfs/philo/tid125101760",
+		"testdata/ctfs/philo/tid150284608",
+		"testdata/ctfs/philo_nok/tid125101760",
+	};
+	const char *metadata_paths[] = {
+		"testdata/ctfs/philo/metadata",
+		"testdata/ctfs/philo/metadata",
+		"testdata/ctfs/philo_nok/metadata",
+	};
+	for (size_t i = 0; i < ARRLEN(ds_paths); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_paths[i]), 0);
+		size_t len = read_file(ds_paths[i]);
+		struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+
+		int64_t begin, end;
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_time_range(dec, &begin, &end), 0);
+		CU_ASSERT(begin <= end);
+		// getting the range does not move the decoder
+		size_t n_evs = 0;
+		size_t evs_len;
+		struct actf_event **evs;
+		while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+			for (size_t j = 0; j < evs_len; j++) {
+				int64_t tstamp = actf_event_tstamp_ns_from_origin(evs[j]);
+				CU_ASSERT(tstamp >= begin && tstamp <= end);
+			}
+			n_evs += evs_len;
+		}
+		CU_ASSERT(n_evs > 0);
+
+		actf_decoder_free(dec);
+		actf_metadata_free(metadata);
+	}
+}
+
+/* count_events decodes events until there are none left or an error
+ * occurs. The number of events and the number of those of the event
+ * record class named name are returned in n_evs and n_named. */
+static void count_events(struct actf_decoder *dec, const char *name, size_t *n_evs,
+			 size_t *n_named)
+{
+	size_t evs_len;
+	struct actf_event **evs;
+	*n_evs = 0;
+	*n_named = 0;
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len; i++) {
+			const actf_event_cls *evc = actf_event_event_cls(evs[i]);
+			if (strcmp(actf_event_cls_name(evc), name) == 0) {
+				(*n_named)++;
+			}
+		}
+		*n_evs += evs_len;
+	}
+}
+
+static void test_decoder_evc_filter(void)
+{
+	// 1 packet a 17 ok events, 1 packet a 3 ok, 1 nok event
+	const char *ds_path = "testdata/ctfs/philo_nok/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo_nok/metadata";
+
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	size_t len = read_file(ds_path);
+
+	size_t n_evs, n_instants;
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	count_events(dec, "instant", &n_evs, &n_instants);
+	actf_decoder_free(dec);
+	CU_ASSERT_EQUAL_FATAL(n_evs, 20);
+	CU_ASSERT_FATAL(n_instants > 0 && n_instants < n_evs);
+
+	// only instant events, selected by name
+	struct actf_event_cls_sel by_name = {.name = "instant" };
+	struct actf_decoder_cfg cfg = {
+		.evs_cap = 4,
+		.evc_filter = {
+			.mode = ACTF_EVENT_CLS_FILTER_ALLOW,
+			.sels = &by_name,
+			.sels_len = 1,
+		},
+	};
+	size_t n, n_named;
+	dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	count_events(dec, "instant", &n, &n_named);
+	CU_ASSERT_EQUAL(n, n_instants);
+	CU_ASSERT_EQUAL(n_named, n_instants);
+	actf_decoder_free(dec);
+
+	// all but instant events, selected by id
+	struct actf_event_cls_sel by_id = {.id = 2 };
+	cfg.evc_filter = (struct actf_event_cls_filter) {
+		.mode = ACTF_EVENT_CLS_FILTER_DENY,
+		.sels = &by_id,
+		.sels_len = 1,
+	};
+	dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	count_events(dec, "instant", &n, &n_named);
+	CU_ASSERT_EQUAL(n, n_evs - n_instants);
+	CU_ASSERT_EQUAL(n_named, 0);
+	actf_decoder_free(dec);
+
+	// nothing is selected in another namespace
+	by_name.namespace = "no such namespace";
+	cfg.evc_filter.sels = &by_name;
+	dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	count_events(dec, "instant", &n, &n_named);
+	CU_ASSERT_EQUAL(n, n_evs);
+	CU_ASSERT_EQUAL(n_named, n_instants);
+	actf_decoder_free(dec);
+
+	actf_metadata_free(metadata);
+}
+
+static void test_decoder_header_mode(void)
+{
+	// 2 packets with 27 events in total
+	const char *ds_path = "testdata/ctfs/philo/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo/metadata";
+
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	size_t len = read_file(ds_path);
+
+	uint64_t tstamps[64];
+	const actf_event_cls *evcs[64];
+	size_t n_evs = 0, n_payloads = 0;
+	size_t evs_len;
+	struct actf_event **evs;
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len && n_evs < ARRLEN(tstamps); i++, n_evs++) {
+			tstamps[n_evs] = actf_event_tstamp(evs[i]);
+			evcs[n_evs] = actf_event_event_cls(evs[i]);
+			const actf_fld *payload = actf_event_prop(evs[i], ACTF_EVENT_PROP_PAYLOAD);
+			if (actf_fld_type(payload) != ACTF_FLD_TYPE_NIL) {
+				n_payloads++;
+			}
+		}
+	}
+	actf_decoder_free(dec);
+	CU_ASSERT_FATAL(n_evs > 0 && n_evs < ARRLEN(tstamps));
+	CU_ASSERT_FATAL(n_payloads > 0);
+
+	// the same events, without specific contexts and payloads
+	struct actf_decoder_cfg cfg = {
+		.evs_cap = 4,
+		.mode = ACTF_DECODER_MODE_HEADER,
+	};
+	dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	size_t n = 0;
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len && n < n_evs; i++, n++) {
+			CU_ASSERT_EQUAL(actf_event_tstamp(evs[i]), tstamps[n]);
+			CU_ASSERT_PTR_EQUAL(actf_event_event_cls(evs[i]), evcs[n]);
+			CU_ASSERT_NOT_EQUAL(actf_fld_type(actf_event_prop(evs[i], ACTF_EVENT_PROP_HEADER)),
+					    ACTF_FLD_TYPE_NIL);
+			CU_ASSERT_EQUAL(actf_fld_type(actf_event_prop(evs[i], ACTF_EVENT_PROP_SPECIFIC_CTX)),
+					ACTF_FLD_TYPE_NIL);
+			CU_ASSERT_EQUAL(actf_fld_type(actf_event_prop(evs[i], ACTF_EVENT_PROP_PAYLOAD)),
+					ACTF_FLD_TYPE_NIL);
+		}
+	}
+	CU_ASSERT_EQUAL(n, n_evs);
+	actf_decoder_free(dec);
+
+	actf_metadata_free(metadata);
+}
+
+/* print_events decodes and prints all events of dec into a string
+ * which should be freed. If lazy is set, it is checked that the
+ * events are lazily decoded before they are printed. */
+static char *print_events(struct actf_decoder *dec, bool lazy)
+{
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+	size_t evs_len;
+	struct actf_event **evs;
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len; i++) {
+			CU_ASSERT_EQUAL(evs[i]->lazy_dec != NULL, lazy);
+			CU_ASSERT_EQUAL(actf_fprint_event(p, s, evs[i]), 0);
+			CU_ASSERT_PTR_NULL(evs[i]->lazy_dec);
+			fprintf(s, "\n");
+		}
+	}
+	actf_printer_free(p);
+	fclose(s);
+	return buf;
+}
+
+static void test_decoder_lazy_mode(void)
+{
+	struct {
+		const char *ds_path;
+		const char *metadata_path;
+		bool lazy;
+	} tcs[] = {
+		{"testdata/ctfs/ev_spec_ctxt/ds0", "testdata/ctfs/ev_spec_ctxt/metadata", true},
+		{"testdata/ctfs/fxd_len_bit_arr_bo_mix/ds0",
+		 "testdata/ctfs/fxd_len_bit_arr_bo_mix/metadata", true},
+		// payloads without a static length are scanned to get past them
+		{"testdata/ctfs/philo/tid125101760", "testdata/ctfs/philo/metadata", true},
+		{"testdata/ctfs/dyn_len_arr_fld_loc/ds0", "testdata/ctfs/dyn_len_arr_fld_loc/metadata",
+		 true},
+		{"testdata/ctfs/fld_loc_double_arr/ds0", "testdata/ctfs/fld_loc_double_arr/metadata",
+		 true},
+		{"testdata/ctfs/static_len_arr_fld_loc/ds0",
+		 "testdata/ctfs/static_len_arr_fld_loc/metadata", true},
+		{"testdata/ctfs/dyn_str/ds0", "testdata/ctfs/dyn_str/metadata", true},
+		{"testdata/ctfs/dyn_blob/ds0", "testdata/ctfs/dyn_blob/metadata", true},
+		{"testdata/ctfs/optional/ds0", "testdata/ctfs/optional/metadata", true},
+		{"testdata/ctfs/variant/ds0", "testdata/ctfs/variant/metadata", true},
+		{"testdata/ctfs/variant_spec_ctxt_selector/ds0",
+		 "testdata/ctfs/variant_spec_ctxt_selector/metadata", true},
+		{"testdata/ctfs/null_term_str/ds0", "testdata/ctfs/null_term_str/metadata", true},
+	};
+	for (size_t i = 0; i < ARRLEN(tcs); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].metadata_path), 0);
+		size_t len = read_file(tcs[i].ds_path);
+
+		struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *full = print_events(dec, false);
+		actf_decoder_free(dec);
+
+		struct actf_decoder_cfg cfg = {
+			.evs_cap = 4,
+			.mode = ACTF_DECODER_MODE_LAZY,
+		};
+		dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *lazy = print_events(dec, tcs[i].lazy);
+		actf_decoder_free(dec);
+
+		CU_ASSERT_FATAL(full && lazy && strlen(full) > 0);
+		CU_ASSERT_STRING_EQUAL(full, lazy);
+		free(full);
+		free(lazy);
+		actf_metadata_free(metadata);
+	}
+}
+
+/* print_evs prints evs into a string which should be freed. */
+static char *print_evs(struct actf_event **evs, size_t evs_len)
+{
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+	for (size_t i = 0; i < evs_len; i++) {
+		CU_ASSERT_EQUAL(actf_fprint_event(p, s, evs[i]), 0);
+		fprintf(s, "\n");
+	}
+	actf_printer_free(p);
+	fclose(s);
+	return buf;
+}
+
+#define MAX_BUFS 3
+
+static void test_decoder_multiple_buffers(void)
+{
+	const char *ds_path = "testdata/ctfs/philo/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo/metadata";
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	size_t len = read_file(ds_path);
+
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	char *want = print_events(dec, false);
+	actf_decoder_free(dec);
+
+	struct actf_decoder_cfg cfg = {.evs_cap = 4 };
+	for (cfg.n_bufs = 2; cfg.n_bufs <= MAX_BUFS; cfg.n_bufs++) {
+		dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		CU_ASSERT_EQUAL(actf_decoder_to_generator(dec).n_bufs, cfg.n_bufs);
+		for (int seek = 0; seek < 2; seek++) {
+			if (seek) {
+				CU_ASSERT_EQUAL_FATAL(actf_decoder_seek_ns_from_origin(dec, 0), 0);
+			}
+			char *got = NULL;
+			size_t got_len = 0;
+			FILE *s = open_memstream(&got, &got_len);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+			// the events of the previous n_bufs - 1 decode calls,
+			// prevs[0] being the most recent ones.
+			struct {
+				struct actf_event **evs;
+				size_t evs_len;
+				char *str;
+			} prevs[MAX_BUFS - 1] = { 0 };
+			size_t n_prevs = cfg.n_bufs - 1;
+			size_t evs_len;
+			struct actf_event **evs;
+			// the previous events are intact after the next decode
+			// calls, also when they move on to other packets.
+			while (actf_decoder_decode(dec, &evs, &evs_len) == 0) {
+				for (size_t i = 0; i < n_prevs; i++) {
+					if (prevs[i].str) {
+						char *after = print_evs(prevs[i].evs, prevs[i].evs_len);
+						CU_ASSERT_STRING_EQUAL(after, prevs[i].str);
+						free(after);
+					}
+				}
+				if (prevs[n_prevs - 1].str) {
+					fputs(prevs[n_prevs - 1].str, s);
+					free(prevs[n_prevs - 1].str);
+				}
+				memmove(prevs + 1, prevs, (n_prevs - 1) * sizeof(prevs[0]));
+				prevs[0].str = NULL;
+				if (!evs_len) {
+					break;
+				}
+				prevs[0].evs = evs;
+				prevs[0].evs_len = evs_len;
+				prevs[0].str = print_evs(evs, evs_len);
+			}
+			for (size_t i = n_prevs; i-- > 0;) {
+				if (prevs[i].str) {
+					fputs(prevs[i].str, s);
+					free(prevs[i].str);
+				}
+			}
+			fclose(s);
+			CU_ASSERT_STRING_EQUAL(got, want);
+			free(got);
+		}
+		actf_decoder_free(dec);
+	}
+
+	// the lazy mode decodes using the state of the current packet
+	cfg.mode = ACTF_DECODER_MODE_LAZY;
+	dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	CU_ASSERT_EQUAL(actf_decoder_to_generator(dec).n_bufs, 1);
+	actf_decoder_free(dec);
+
+	free(want);
+	actf_metadata_free(metadata);
+}
+
+/* decode_fed decodes the events dec has so far and prints them to s.
+ * The events of the previous decode call, printed in prev, are checked
+ * to still be intact. */
+static void decode_fed(struct actf_decoder *dec, FILE *s, char **prev)
+{
+	static struct actf_event **prev_evs;
+	static size_t prev_evs_len;
+	size_t evs_len;
+	struct actf_event **evs;
+	do {
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+		if (*prev) {
+			char *after = print_evs(prev_evs, prev_evs_len);
+			CU_ASSERT_STRING_EQUAL(after, *prev);
+			free(after);
+			free(*prev);
+			*prev = NULL;
+		}
+		if (evs_len) {
+			*prev = print_evs(evs, evs_len);
+			prev_evs = evs;
+			prev_evs_len = evs_len;
+			fputs(*prev, s);
+		}
+	} while (evs_len);
+}
+
+static void test_decoder_fed(void)
+{
+	struct {
+		const char *ds_path;
+		const char *metadata_path;
+		// the length of the first packet, zero if it lasts until
+		// the end of the data stream.
+		size_t pkt_len;
+	} tcs[] = {
+		{"testdata/ctfs/philo/tid125101760", "testdata/ctfs/philo/metadata", 512},
+		{"testdata/ctfs/pkt_ctxt/ds0", "testdata/ctfs/pkt_ctxt/metadata", 38},
+		{"testdata/ctfs/pkt_str/ds0", "testdata/ctfs/pkt_str/metadata", 12},
+		{"testdata/ctfs/fxd_len_bit_arr_bo_mix/ds0",
+		 "testdata/ctfs/fxd_len_bit_arr_bo_mix/metadata", 0},
+	};
+	size_t chunk_lens[] = { 1, 3, 100, sizeof(databuf) };
+	for (size_t i = 0; i < ARRLEN(tcs); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].metadata_path), 0);
+		size_t len = read_file(tcs[i].ds_path);
+
+		struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *want = print_events(dec, false);
+		actf_decoder_free(dec);
+
+		struct actf_decoder_cfg cfg = {.evs_cap = 4,.n_bufs = 2 };
+		for (size_t j = 0; j < ARRLEN(chunk_lens); j++) {
+			dec = actf_decoder_init_fed(metadata, cfg);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+			char *got = NULL;
+			size_t got_len = 0;
+			FILE *s = open_memstream(&got, &got_len);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+			char *prev = NULL;
+			for (size_t off = 0; off < len; off += chunk_lens[j]) {
+				size_t n = MIN(chunk_lens[j], len - off);
+				CU_ASSERT_EQUAL_FATAL(actf_decoder_feed(dec, databuf + off, n), 0);
+				decode_fed(dec, s, &prev);
+			}
+			CU_ASSERT_EQUAL_FATAL(actf_decoder_feed_end(dec), 0);
+			decode_fed(dec, s, &prev);
+			CU_ASSERT_EQUAL(actf_decoder_feed(dec, databuf, 1), ACTF_ERROR);
+			CU_ASSERT_EQUAL(actf_decoder_seek_ns_from_origin(dec, 0), ACTF_ERROR);
+			fclose(s);
+			CU_ASSERT_STRING_EQUAL(got, want);
+			free(got);
+			actf_decoder_free(dec);
+		}
+
+		/* A packet is decoded once it is complete, a packet without
+		 * a total length once the data stream ends */
+		dec = actf_decoder_init_fed(metadata, cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		size_t first_len = tcs[i].pkt_len ? tcs[i].pkt_len : len;
+		size_t evs_len;
+		struct actf_event **evs;
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_feed(dec, databuf, first_len - 1), 0);
+		CU_ASSERT_EQUAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+		CU_ASSERT_EQUAL(evs_len, 0);
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_feed(dec, databuf + first_len - 1, 1), 0);
+		CU_ASSERT_EQUAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+		CU_ASSERT_EQUAL(evs_len > 0, tcs[i].pkt_len > 0);
+		// The events stay intact while the next packets are decoded
+		struct actf_event **first_evs = evs;
+		size_t first_evs_len = evs_len;
+		char *first = print_evs(first_evs, first_evs_len);
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_feed(dec, databuf + first_len, len - first_len), 0);
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_feed_end(dec), 0);
+		CU_ASSERT_EQUAL(actf_decoder_decode(dec, &evs, &evs_len), 0);
+		CU_ASSERT(evs_len > 0);
+		char *after = print_evs(first_evs, first_evs_len);
+		CU_ASSERT_STRING_EQUAL(after, first);
+		free(after);
+		free(first);
+		actf_decoder_free(dec);
+
+		free(want);
+		actf_metadata_free(metadata);
+	}
+}
+
+static void test_decoder_fed_pkt_idx(void)
+{
+	struct {
+		const char *ds_path;
+		const char *metadata_path;
+	} tcs[] = {
+		{"testdata/ctfs/philo/tid125101760", "testdata/ctfs/philo/metadata"},
+		{"testdata/ctfs/pkt_ctxt/ds0", "testdata/ctfs/pkt_ctxt/metadata"},
+		{"testdata/ctfs/pkt_str/ds0", "testdata/ctfs/pkt_str/metadata"},
+		{"testdata/ctfs/fxd_len_bit_arr_bo_mix/ds0",
+		 "testdata/ctfs/fxd_len_bit_arr_bo_mix/metadata"},
+	};
+	size_t chunk_lens[] = { 1, 3, 100, sizeof(databuf) };
+	for (size_t i = 0; i < ARRLEN(tcs); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].metadata_path), 0);
+		size_t len = read_file(tcs[i].ds_path);
+
+		/* The last packet is not indexed if the data stream is
+		 * truncated */
+		for (size_t ds_len = len; ds_len + 1 >= len; ds_len--) {
+			struct actf_decoder *dec = actf_decoder_init(databuf, ds_len, 1, metadata);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+			struct pkt_idx want;
+			CU_ASSERT_EQUAL_FATAL(actf_decoder_pkt_idx(dec, &want), 0);
+
+			for (size_t j = 0; j < ARRLEN(chunk_lens); j++) {
+				struct actf_decoder *fed = actf_decoder_init_fed(metadata,
+										 (struct actf_decoder_cfg) { 0 });
+				CU_ASSERT_PTR_NOT_NULL_FATAL(fed);
+				for (size_t off = 0; off < ds_len; off += chunk_lens[j]) {
+					size_t n = MIN(chunk_lens[j], ds_len - off);
+					CU_ASSERT_EQUAL_FATAL(actf_decoder_feed(fed, databuf + off, n), 0);
+					CU_ASSERT(actf_decoder_feed_pkt_idx(fed) >= 0);
+				}
+				CU_ASSERT_EQUAL_FATAL(actf_decoder_feed_end(fed), 0);
+				CU_ASSERT_EQUAL_FATAL(actf_decoder_feed_pkt_idx(fed), 1);
+				struct pkt_idx got;
+				CU_ASSERT_EQUAL_FATAL(actf_decoder_pkt_idx(fed, &got), 0);
+				CU_ASSERT_EQUAL(got.end_bit_off, want.end_bit_off);
+				CU_ASSERT_EQUAL_FATAL(got.len, want.len);
+				CU_ASSERT(got.len == 0 ||
+					  memcmp(got.entries, want.entries,
+						 got.len * sizeof(*got.entries)) == 0);
+				actf_decoder_free(fed);
+			}
+			actf_decoder_free(dec);
+		}
+		actf_metadata_free(metadata);
+	}
+}
+
+static void test_decoder_iov(void)
+{
+	struct {
+		const char *ds_path;
+		const char *metadata_path;
+		// the length of the first packet
+		size_t pkt_len;
+	} tcs[] = {
+		{"testdata/ctfs/philo/tid125101760", "testdata/ctfs/philo/metadata", 512},
+		{"testdata/ctfs/pkt_ctxt/ds0", "testdata/ctfs/pkt_ctxt/metadata", 38},
+		{"testdata/ctfs/pkt_str/ds0", "testdata/ctfs/pkt_str/metadata", 12},
+	};
+	for (size_t i = 0; i < ARRLEN(tcs); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].metadata_path), 0);
+		size_t len = read_file(tcs[i].ds_path);
+
+		struct actf_decoder *dec = actf_decoder_init(databuf, len, 4, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *want = print_events(dec, false);
+		actf_decoder_free(dec);
+
+		/* The second segment is copied to keep the segments apart */
+		size_t first_len = tcs[i].pkt_len;
+		char *seg = malloc(len - first_len);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(seg);
+		memcpy(seg, databuf + first_len, len - first_len);
+		struct iovec iov[] = {
+			{.iov_base = NULL,.iov_len = 0 },
+			{.iov_base = databuf,.iov_len = first_len },
+			{.iov_base = NULL,.iov_len = 0 },
+			{.iov_base = seg,.iov_len = len - first_len },
+		};
+		struct actf_decoder_cfg cfg = {.evs_cap = 4,.n_bufs = 2 };
+		dec = actf_decoder_init_iov(iov, ARRLEN(iov), metadata, cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *got = NULL;
+		size_t got_len = 0;
+		FILE *s = open_memstream(&got, &got_len);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+		char *prev = NULL;
+		decode_fed(dec, s, &prev);
+		free(prev);
+		fclose(s);
+		CU_ASSERT_STRING_EQUAL(got, want);
+		CU_ASSERT_EQUAL(actf_decoder_seek_ns_from_origin(dec, 0), ACTF_ERROR);
+		int64_t begin, end;
+		CU_ASSERT_EQUAL(actf_decoder_time_range(dec, &begin, &end), ACTF_NOT_FOUND);
+		free(got);
+		actf_decoder_free(dec);
+
+		/* A packet split between two segments is cut off */
+		struct iovec split_iov[] = {
+			{.iov_base = databuf,.iov_len = first_len - 1 },
+			{.iov_base = databuf + first_len - 1,.iov_len = len - first_len + 1 },
+		};
+		dec = actf_decoder_init_iov(split_iov, ARRLEN(split_iov), metadata, cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		size_t evs_len;
+		struct actf_event **evs;
+		int rc;
+		while ((rc = actf_decoder_decode(dec, &evs, &evs_len)) == 0 && evs_len) ;
+		CU_ASSERT(rc < 0);
+		actf_decoder_free(dec);
+
+		free(seg);
+		free(want);
+		actf_metadata_free(metadata);
+	}
+}
+
+static void test_decoder_advise(void)
+{
+	/* A decoder advising about its mmapped data decodes the same
+	 * events as one that does not, also after its pages have been
+	 * dropped. The data stream file is repeated to span many pages. */
+	enum { N_COPIES = 64 };
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, "testdata/ctfs/pkt_str/metadata"),
+			      0);
+	size_t len = read_file("testdata/ctfs/pkt_str/ds0");
+	char path[] = "/tmp/actf_test_decoder_XXXXXX";
+	int fd = mkstemp(path);
+	CU_ASSERT_FATAL(fd >= 0);
+	for (size_t i = 0; i < N_COPIES; i++) {
+		CU_ASSERT_FATAL(write(fd, databuf, len) == (ssize_t) len);
+	}
+	void *pa = mmap(NULL, len * N_COPIES, PROT_READ, MAP_PRIVATE, fd, 0);
+	CU_ASSERT_FATAL(pa != MAP_FAILED);
+	close(fd);
+	unlink(path);
+
+	struct actf_decoder *dec = actf_decoder_init(pa, len * N_COPIES, 4, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	char *want = print_events(dec, false);
+	actf_decoder_free(dec);
+
+	size_t windows[] = { 1, 100, 4096 };
+	for (size_t i = 0; i < ARRLEN(windows); i++) {
+		struct actf_decoder_cfg cfg = {.evs_cap = 4,.advise_window = windows[i] };
+		dec = actf_decoder_init_cfg(pa, len * N_COPIES, metadata, cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		for (int round = 0; round < 2; round++) {
+			CU_ASSERT_EQUAL(actf_decoder_seek_ns_from_origin(dec, 0), 0);
+			char *got = print_events(dec, false);
+			CU_ASSERT_STRING_EQUAL(got, want);
+			free(got);
+		}
+		actf_decoder_free(dec);
+	}
+	free(want);
+	munmap(pa, len * N_COPIES);
+	actf_metadata_free(metadata);
+}
+
+static void test_decoder_advise_idx(void)
+{
+	/* Building the packet index to seek gives no advice, only the
+	 * window around the sought packet is read ahead. */
+	enum { N_COPIES = 4096, WINDOW = 64 << 10 };
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, "testdata/ctfs/philo/metadata"), 0);
+	size_t len = read_file("testdata/ctfs/philo/tid125101760");
+	char path[] = "/tmp/actf_test_decoder_XXXXXX";
+	int fd = mkstemp(path);
+	CU_ASSERT_FATAL(fd >= 0);
+	for (size_t i = 0; i < N_COPIES; i++) {
+		CU_ASSERT_FATAL(write(fd, databuf, len) == (ssize_t) len);
+	}
+	size_t data_len = len * N_COPIES;
+	void *pa = mmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	CU_ASSERT_FATAL(pa != MAP_FAILED);
+	close(fd);
+	unlink(path);
+
+	struct actf_decoder_cfg cfg = {.evs_cap = 4,.advise_window = WINDOW };
+	struct actf_decoder *dec = actf_decoder_init_cfg(pa, data_len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	advised_willneed = 0;
+	advised_reclaim = 0;
+	CU_ASSERT_EQUAL(actf_decoder_seek_ns_from_origin(dec, 0), 0);
+	struct pkt_idx idx;
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_pkt_idx(dec, &idx), 0);
+	CU_ASSERT_EQUAL(idx.len, 2 * N_COPIES);
+	CU_ASSERT(advised_willneed <= WINDOW + (size_t) sysconf(_SC_PAGESIZE));
+	CU_ASSERT_EQUAL(advised_reclaim, 0);
+
+	/* Decoding it all reads all of it ahead and reclaims what is
+	 * behind */
+	size_t evs_len;
+	struct actf_event **evs;
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) ;
+	CU_ASSERT(advised_willneed >= data_len - WINDOW);
+#if defined(MADV_COLD) || defined(MADV_PAGEOUT)
+	CU_ASSERT(advised_reclaim >= data_len - 3 * WINDOW);
+#endif
+	actf_decoder_free(dec);
+	munmap(pa, data_len);
+	actf_metadata_free(metadata);
+}
+
 static CU_TestInfo test_decoder_tests[] = {
 	{ "basic", test_decoder_basic },
 	{ "pkt resumption", test_decoder_pkt_resumption },
 	{ "pkt resumption error", test_decoder_pkt_resumption_error },
 	{ "seek", test_decoder_seek },
+	{ "seek bounds", test_decoder_seek_bounds },
+	{ "time range", test_decoder_time_range },
+	{ "event class filter", test_decoder_evc_filter },
+	{ "header mode", test_decoder_header_mode },
+	{ "lazy mode", test_decoder_lazy_mode },
+	{ "multiple buffers", test_decoder_multiple_buffers },
+	{ "fed", test_decoder_fed },
+	{ "fed pkt idx", test_decoder_fed_pkt_idx },
+	{ "iov", test_decoder_iov },
+	{ "advise", test_decoder_advise },
+	{ "advise idx", test_decoder_advise_idx },
 	CU_TEST_INFO_NULL,
 };
 
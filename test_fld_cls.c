@@ -32,6 +32,7 @@ const char *struct_attributes_path = "testdata/test_ctf_fld_cls_struct_attribute
 const char *variant_attributes_path = "testdata/test_ctf_fld_cls_variant_attributes.json";
 const char *null_term_str_extensions_path =
     "testdata/test_ctf_fld_cls_null_term_str_extensions.json";
+const char *static_len_path = "testdata/test_ctf_fld_cls_static_len.json";
 
 static int test_fld_cls_suite_init(void)
 {
@@ -151,11 +152,47 @@ static void test_fld_cls_null_term_str_extensions(void)
 	actf_fld_cls_free(&str_fc);
 }
 
+static void test_fld_cls_static_len(void)
+{
+	struct json_object *jobj = json_object_from_file(static_len_path);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(jobj);
+	struct json_object *static_jobj, *dynamic_jobj;
+	CU_ASSERT_FATAL(json_object_object_get_ex(jobj, "static", &static_jobj));
+	CU_ASSERT_FATAL(json_object_object_get_ex(jobj, "dynamic", &dynamic_jobj));
+
+	/* u8 [0, 8), u32 [32, 64), arr of 3 elements with a 17 bit
+	 * length and a 32 bit stride [64, 145), str [152, 168) */
+	struct actf_fld_cls static_fc;
+	CU_ASSERT_FATAL(actf_fld_cls_parse(static_jobj, NULL, &static_fc, NULL) == 0);
+	CU_ASSERT_EQUAL(actf_fld_cls_align_req(&static_fc), 32);
+	CU_ASSERT_TRUE(actf_fld_cls_has_static_len(&static_fc));
+	CU_ASSERT_EQUAL(actf_fld_cls_static_len(&static_fc), 168);
+	const struct actf_fld_cls *arr_fc = actf_fld_cls_members_fld_cls_idx(&static_fc, 2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(arr_fc);
+	CU_ASSERT_EQUAL(actf_fld_cls_align_req(arr_fc), 16);
+	CU_ASSERT_EQUAL(actf_fld_cls_static_len(arr_fc), 81);
+
+	struct actf_fld_cls dynamic_fc;
+	CU_ASSERT_FATAL(actf_fld_cls_parse(dynamic_jobj, NULL, &dynamic_fc, NULL) == 0);
+	CU_ASSERT_EQUAL(actf_fld_cls_align_req(&dynamic_fc), 8);
+	CU_ASSERT_FALSE(actf_fld_cls_has_static_len(&dynamic_fc));
+	CU_ASSERT_EQUAL(actf_fld_cls_static_len(&dynamic_fc), 0);
+	const struct actf_fld_cls *u8_fc = actf_fld_cls_members_fld_cls_idx(&dynamic_fc, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(u8_fc);
+	CU_ASSERT_TRUE(actf_fld_cls_has_static_len(u8_fc));
+	CU_ASSERT_EQUAL(actf_fld_cls_static_len(u8_fc), 8);
+
+	json_object_put(jobj);
+	actf_fld_cls_free(&static_fc);
+	actf_fld_cls_free(&dynamic_fc);
+}
+
 static CU_TestInfo test_fld_cls_tests[] = {
 	{ "fxd len int with attributes", test_fld_cls_fxd_len_int_attributes },
 	{ "struct with attributes", test_fld_cls_struct_attributes },
 	{ "variant with attributes", test_fld_cls_variant_attributes },
 	{ "null term string with extensions", test_fld_cls_null_term_str_extensions },
+	{ "static length", test_fld_cls_static_len },
 	CU_TEST_INFO_NULL,
 };
 
@@ -20,13 +20,31 @@
 
 #include <CUnit/CUnit.h>
 #include <CUnit/TestDB.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "config.h"
+#include "decompressor.h"
+#include "event.h"
 #include "event_generator.h"
 #include "freader.h"
+#include "metadata.h"
+#include "pkt_idx.h"
 #include "test_freader.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 static int test_freader_suite_init(void)
 {
 	return 0;
@@ -104,17 +122,773 @@ static void test_freader_seek(void)
 {
 	// 101 events total
 	struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20 };
+	for (int mode = 0; mode < 4; mode++) {
+		cfg.dstream_producers = mode == 1;
+		cfg.lazy_dstreams = mode == 2;
+		cfg.max_mmaps = 1;
+		cfg.dstream_io = mode == 3 ? ACTF_FREADER_IO_PREAD : ACTF_FREADER_IO_MMAP;
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) philo_nok_seek_test_trace),
+				      0);
+
+		philo_nok_seek_test(actf_freader_to_generator(rd));
+
+		actf_freader_free(rd);
+	}
+}
+
+/* copy_files copies all regular files of the directory src into the
+ * directory dst. */
+static void copy_files(const char *src, const char *dst)
+{
+	char buf[4096];
+	DIR *dir = opendir(src);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dir);
+	struct dirent *dp;
+	while ((dp = readdir(dir)) != NULL) {
+		struct stat sb;
+		CU_ASSERT_FATAL(fstatat(dirfd(dir), dp->d_name, &sb, 0) == 0);
+		if (!S_ISREG(sb.st_mode)) {
+			continue;
+		}
+		int src_fd = openat(dirfd(dir), dp->d_name, O_RDONLY);
+		CU_ASSERT_FATAL(src_fd >= 0);
+		snprintf(buf, sizeof(buf), "%s/%s", dst, dp->d_name);
+		int dst_fd = open(buf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		CU_ASSERT_FATAL(dst_fd >= 0);
+		ssize_t n;
+		while ((n = read(src_fd, buf, sizeof(buf))) > 0) {
+			CU_ASSERT_FATAL(write(dst_fd, buf, n) == n);
+		}
+		CU_ASSERT_FATAL(n == 0);
+		close(src_fd);
+		close(dst_fd);
+	}
+	closedir(dir);
+}
+
+/* remove_files removes all files in the directory path and then the
+ * directory itself. */
+static void remove_files(const char *path)
+{
+	DIR *dir = opendir(path);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dir);
+	struct dirent *dp;
+	while ((dp = readdir(dir)) != NULL) {
+		if (strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0) {
+			unlinkat(dirfd(dir), dp->d_name, 0);
+		}
+	}
+	closedir(dir);
+	CU_ASSERT_EQUAL(rmdir(path), 0);
+}
+
+static void test_freader_pkt_idx_files(void)
+{
+	char path[] = "/tmp/actf_test_freader_XXXXXX";
+	CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(path));
+	copy_files(philo_nok_seek_test_trace, path);
+
+	struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20,
+		.pkt_idx_files = true
+	};
 	actf_freader *rd = actf_freader_init(cfg);
 	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
-	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) philo_nok_seek_test_trace), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_write_pkt_idx_files(rd), 0);
+	actf_freader_free(rd);
+
+	char idx_path[sizeof(path) + 64];
+	snprintf(idx_path, sizeof(idx_path), "%s/.tid125101760.actfidx", path);
+	CU_ASSERT_EQUAL(access(idx_path, R_OK), 0);
+
+	/* A reader using the written index files behaves as one without */
+	rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	philo_nok_seek_test(actf_freader_to_generator(rd));
+	actf_freader_free(rd);
 
+	/* Reading the data stream files seeks from the indexed packets */
+	cfg.dstream_io = ACTF_FREADER_IO_PREAD;
+	rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
 	philo_nok_seek_test(actf_freader_to_generator(rd));
+	actf_freader_free(rd);
+
+	remove_files(path);
+}
+
+static void test_freader_full_batches(void)
+{
+	/* The decoders of the reader keep their previous events valid,
+	 * so the muxer fills its event array although the events of a
+	 * decoder run out in the middle of it. */
+	struct {
+		size_t dstream_threads;
+		bool dstream_producers;
+	} tcs[] = {
+		{ 0, false },
+		{ 2, false },
+		{ 0, true },
+	};
+	for (size_t i = 0; i < sizeof(tcs) / sizeof(*tcs); i++) {
+		struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20,
+			.dstream_threads = tcs[i].dstream_threads,
+			.dstream_producers = tcs[i].dstream_producers,
+		};
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, "testdata/ctfs/philo"), 0);
+		int rc;
+		size_t tot_evs = 0;
+		size_t last_evs_len = cfg.muxer_evs_cap;
+		size_t evs_len = 0;
+		actf_event **evs = NULL;
+		while ((rc = actf_freader_read(rd, &evs, &evs_len)) == 0 && evs_len) {
+			CU_ASSERT_EQUAL(last_evs_len, cfg.muxer_evs_cap);
+			last_evs_len = evs_len;
+			tot_evs += evs_len;
+		}
+		CU_ASSERT_EQUAL(rc, 0);
+		CU_ASSERT(tot_evs > cfg.muxer_evs_cap);
+		actf_freader_free(rd);
+	}
+}
+
+/* read_tstamps reads at most cap events of rd into tstamps and
+ * returns the number read. */
+static size_t read_tstamps(actf_freader *rd, int64_t *tstamps, size_t cap)
+{
+	int rc;
+	size_t n = 0;
+	size_t evs_len = 0;
+	actf_event **evs = NULL;
+	while ((rc = actf_freader_read(rd, &evs, &evs_len)) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len && n < cap; i++) {
+			tstamps[n++] = actf_event_tstamp_ns_from_origin(evs[i]);
+		}
+	}
+	CU_ASSERT_EQUAL(rc, 0);
+	return n;
+}
+
+static void test_freader_damaged_pkt_idx_files(void)
+{
+	/* A packet index file with a damaged entry is ignored, the
+	 * parallel and sequential decoders read as without one */
+	enum { CAP = 4096 };
+	static int64_t want[CAP];
+	static int64_t got[CAP];
+	const char *trace = "testdata/ctfs/philo";
+	const int64_t seek_tstamp = INT64_C(29816500000000);
+	char path[] = "/tmp/actf_test_freader_XXXXXX";
+	CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(path));
+	copy_files(trace, path);
+
+	struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20 };
+	actf_freader *rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) trace), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamp), 0);
+	size_t want_len = read_tstamps(rd, want, CAP);
+	CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+	actf_freader_free(rd);
+
+	cfg.pkt_idx_files = true;
+	rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_write_pkt_idx_files(rd), 0);
+	actf_freader_free(rd);
+
+	/* The last entry is that of the second of the two packets */
+	char idx_path[sizeof(path) + 64];
+	snprintf(idx_path, sizeof(idx_path), "%s/.tid125101760.actfidx", path);
+	int fd = open(idx_path, O_RDWR);
+	CU_ASSERT_FATAL(fd >= 0);
+	struct stat sb;
+	CU_ASSERT_FATAL(fstat(fd, &sb) == 0);
+	off_t entry_off = sb.st_size - sizeof(struct pkt_idx_entry);
+	struct pkt_idx_entry orig;
+	CU_ASSERT_FATAL(pread(fd, &orig, sizeof(orig), entry_off) == sizeof(orig));
+	CU_ASSERT_FATAL(orig.bit_off == 4096);
+
+	for (int damage = 0; damage < 5; damage++) {
+		struct pkt_idx_entry entry = orig;
+		switch (damage) {
+		case 0:
+			entry.bit_off = UINT64_C(1) << 40;
+			break;
+		case 1:
+			entry.bit_off += 4;	// Not byte-aligned
+			break;
+		case 2:
+			entry.tot_len *= 2;	// Past the end of the index
+			break;
+		case 3:
+			entry.content_len = entry.tot_len + 8;
+			break;
+		case 4:
+			entry.max_end_ns = INT64_MIN;
+			break;
+		}
+		CU_ASSERT_FATAL(pwrite(fd, &entry, sizeof(entry), entry_off) == sizeof(entry));
+		for (size_t dstream_threads = 0; dstream_threads < 3; dstream_threads += 2) {
+			cfg.dstream_threads = dstream_threads;
+			rd = actf_freader_init(cfg);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+			CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+			CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamp), 0);
+			size_t got_len = read_tstamps(rd, got, CAP);
+			CU_ASSERT_EQUAL(got_len, want_len);
+			CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+			actf_freader_free(rd);
+		}
+	}
+	close(fd);
+	remove_files(path);
+}
+
+static void test_freader_stale_metadata_pkt_idx_files(void)
+{
+	/* A packet index file is ignored once the metadata it was written
+	 * with has changed, here by moving the clock by 1000 s. The
+	 * metadata has no UUID. */
+	enum { CAP = 4096 };
+	static int64_t want[CAP];
+	static int64_t got[CAP];
+	static char metadata[1 << 14];
+	const char *trace = "testdata/ctfs/philo";
+	const char *freq = "\"frequency\": 1000000000";
+	char path[] = "/tmp/actf_test_freader_XXXXXX";
+	CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(path));
+	copy_files(trace, path);
+	struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20,
+		.pkt_idx_files = true
+	};
+	actf_freader *rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_write_pkt_idx_files(rd), 0);
+	actf_freader_free(rd);
+
+	char metadata_path[sizeof(path) + 64];
+	snprintf(metadata_path, sizeof(metadata_path), "%s/metadata", path);
+	FILE *f = fopen(metadata_path, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+	size_t len = fread(metadata, 1, sizeof(metadata) - 1, f);
+	CU_ASSERT_FATAL(len < sizeof(metadata) - 1);
+	fclose(f);
+	metadata[len] = '\0';
+	char *freq_at = strstr(metadata, freq);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(freq_at);
+	size_t head_len = freq_at - metadata + strlen(freq);
+	f = fopen(metadata_path, "wb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+	fwrite(metadata, 1, head_len, f);
+	fputs(",\n  \"offset-from-origin\": {\"seconds\": 1000}", f);
+	fwrite(metadata + head_len, 1, len - head_len, f);
+	CU_ASSERT_EQUAL_FATAL(fclose(f), 0);
+
+	const int64_t seek_tstamp = INT64_C(29816500000000) + INT64_C(1000000000000);
+	cfg.pkt_idx_files = false;
+	rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamp), 0);
+	size_t want_len = read_tstamps(rd, want, CAP);
+	CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+	actf_freader_free(rd);
+
+	cfg.pkt_idx_files = true;
+	for (int pread_io = 0; pread_io < 2; pread_io++) {
+		cfg.dstream_io = pread_io ? ACTF_FREADER_IO_PREAD : ACTF_FREADER_IO_MMAP;
+		rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamp), 0);
+		size_t got_len = read_tstamps(rd, got, CAP);
+		CU_ASSERT_EQUAL(got_len, want_len);
+		CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+		actf_freader_free(rd);
+	}
+	remove_files(path);
+}
+
+static void test_freader_lazy_dstreams(void)
+{
+	/* A reader mapping its data streams lazily reads the same events
+	 * as one mapping them all, however few mappings it may keep. */
+	enum { CAP = 4096 };
+	static int64_t want[CAP];
+	static int64_t got[CAP];
+	const char *trace = "testdata/ctfs/philo";
+	const int64_t seek_tstamps[] = { INT64_C(0), INT64_C(29816127914901) };
+	for (size_t s = 0; s < sizeof(seek_tstamps) / sizeof(*seek_tstamps); s++) {
+		struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20 };
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) trace), 0);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamps[s]), 0);
+		size_t want_len = read_tstamps(rd, want, CAP);
+		CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+		actf_freader_free(rd);
+
+		/* A lazy decoder has a single buffer, which the muxer must
+		 * not refill while its events are still in the output */
+		struct actf_freader_cfg lazy_cfgs[] = {
+			{.dstream_evs_cap = 20,.muxer_evs_cap = 20 },
+			{.dstream_evs_cap = 4,.muxer_evs_cap = 20,
+			 .decoder_mode = ACTF_DECODER_MODE_LAZY },
+			{.dstream_evs_cap = 20,.muxer_evs_cap = 20,
+			 .muxer_order = ACTF_MUXER_ORDER_WINDOW,.muxer_window_ns = 1 },
+		};
+		for (size_t i = 0; i < sizeof(lazy_cfgs) / sizeof(*lazy_cfgs); i++) {
+			for (size_t max_mmaps = 1; max_mmaps <= 3; max_mmaps++) {
+				cfg = lazy_cfgs[i];
+				cfg.lazy_dstreams = true;
+				cfg.max_mmaps = max_mmaps;
+				rd = actf_freader_init(cfg);
+				CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+				CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) trace), 0);
+				/* the second seek follows a read exhausting every
+				 * stream */
+				for (int round = 0; round < 2; round++) {
+					CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin
+							      (rd, seek_tstamps[s]), 0);
+					size_t got_len = read_tstamps(rd, got, CAP);
+					CU_ASSERT_EQUAL(got_len, want_len);
+					CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+				}
+				actf_freader_free(rd);
+			}
+		}
+	}
+}
+
+static void test_freader_pread_dstreams(void)
+{
+	/* A reader reading its data streams reads the same events as one
+	 * mapping them, whatever the reads. */
+	enum { CAP = 4096 };
+	static int64_t want[CAP];
+	static int64_t got[CAP];
+	const char *trace = "testdata/ctfs/philo";
+	const int64_t seek_tstamps[] = { INT64_C(0), INT64_C(29816127914901) };
+	for (size_t s = 0; s < sizeof(seek_tstamps) / sizeof(*seek_tstamps); s++) {
+		struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20 };
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) trace), 0);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamps[s]), 0);
+		size_t want_len = read_tstamps(rd, want, CAP);
+		CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+		actf_freader_free(rd);
+
+		cfg.dstream_io = ACTF_FREADER_IO_PREAD;
+		for (int direct_io = 0; direct_io < 2; direct_io++) {
+			cfg.read_size = direct_io ? 0 : 1;
+			cfg.direct_io = direct_io;
+			rd = actf_freader_init(cfg);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+			CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) trace), 0);
+			for (int round = 0; round < 2; round++) {
+				CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd,
+										       seek_tstamps[s]),
+						      0);
+				size_t got_len = read_tstamps(rd, got, CAP);
+				CU_ASSERT_EQUAL(got_len, want_len);
+				CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+			}
+			actf_freader_free(rd);
+		}
+	}
+
+	/* The last read of a data stream file of a size that is not a
+	 * multiple of the alignment works with direct I/O too */
+	const char *unaligned_traces[] = { "testdata/ctfs/pkt_ctxt", "testdata/ctfs/fxd_len_int" };
+	for (size_t t = 0; t < sizeof(unaligned_traces) / sizeof(*unaligned_traces); t++) {
+		actf_freader *rd = actf_freader_init((struct actf_freader_cfg) { 0 });
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) unaligned_traces[t]), 0);
+		size_t want_len = read_tstamps(rd, want, CAP);
+		CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+		actf_freader_free(rd);
+		for (int read_size = 0; read_size < 2; read_size++) {
+			struct actf_freader_cfg cfg = {.dstream_io = ACTF_FREADER_IO_PREAD,
+				.read_size = read_size,.direct_io = true
+			};
+			rd = actf_freader_init(cfg);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+			CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) unaligned_traces[t]),
+					      0);
+			size_t got_len = read_tstamps(rd, got, CAP);
+			CU_ASSERT_EQUAL(got_len, want_len);
+			CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+			actf_freader_free(rd);
+		}
+	}
+
+	/* A data stream file truncated after being opened is an error */
+	char path[] = "/tmp/actf_test_freader_XXXXXX";
+	CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(path));
+	copy_files(trace, path);
+	struct actf_freader_cfg cfg = {.dstream_io = ACTF_FREADER_IO_PREAD };
+	actf_freader *rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	char ds_path[sizeof(path) + 64];
+	snprintf(ds_path, sizeof(ds_path), "%s/tid125101760", path);
+	CU_ASSERT_EQUAL_FATAL(truncate(ds_path, 700), 0);
+	int rc;
+	size_t evs_len;
+	actf_event **evs;
+	while ((rc = actf_freader_read(rd, &evs, &evs_len)) == 0 && evs_len) ;
+	CU_ASSERT(rc < 0);
+	CU_ASSERT_PTR_NOT_NULL(actf_freader_last_error(rd));
+	actf_freader_free(rd);
+	remove_files(path);
+}
+
+static void test_freader_compression_of(void)
+{
+	const uint8_t gzip[] = { 0x1f, 0x8b, 0x08, 0x00 };
+	const uint8_t gzip_flags[] = { 0x1f, 0x8b, 0x08, 0x1f };
+	const uint8_t zstd[] = { 0x28, 0xb5, 0x2f, 0xfd };
+	CU_ASSERT_EQUAL(compression_of(gzip, sizeof(gzip)), COMPRESSION_GZIP);
+	CU_ASSERT_EQUAL(compression_of(gzip_flags, sizeof(gzip_flags)), COMPRESSION_GZIP);
+	CU_ASSERT_EQUAL(compression_of(zstd, sizeof(zstd)), COMPRESSION_ZSTD);
+
+	/* Packets without a magic which happen to start as a gzip
+	 * member */
+	const uint8_t not_deflate[] = { 0x1f, 0x8b, 0x09, 0x00 };
+	const uint8_t reserved_flags[] = { 0x1f, 0x8b, 0x08, 0x20 };
+	CU_ASSERT_EQUAL(compression_of(not_deflate, sizeof(not_deflate)), COMPRESSION_NONE);
+	CU_ASSERT_EQUAL(compression_of(reserved_flags, sizeof(reserved_flags)),
+			COMPRESSION_NONE);
+	CU_ASSERT_EQUAL(compression_of(gzip, 2), COMPRESSION_NONE);
+
+	const uint8_t pkt_le[] = { 0xc1, 0x1f, 0xfc, 0xc1 };
+	const uint8_t pkt_be[] = { 0xc1, 0xfc, 0x1f, 0xc1 };
+	CU_ASSERT_EQUAL(compression_of(pkt_le, sizeof(pkt_le)), COMPRESSION_NONE);
+	CU_ASSERT_EQUAL(compression_of(pkt_be, sizeof(pkt_be)), COMPRESSION_NONE);
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/* compress_file replaces the file path with len bytes of data
+ * compressed */
+typedef void (*compress_file)(const char *path, const char *data, size_t len);
+
+/* compress_dstreams compresses the data stream files of the directory
+ * path in place with compress. */
+static void compress_dstreams(const char *path, compress_file compress)
+{
+	static char data[1 << 16];
+	char buf[4096];
+	DIR *dir = opendir(path);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dir);
+	struct dirent *dp;
+	while ((dp = readdir(dir)) != NULL) {
+		if (dp->d_name[0] == '.' || strcmp(dp->d_name, "metadata") == 0) {
+			continue;
+		}
+		snprintf(buf, sizeof(buf), "%s/%s", path, dp->d_name);
+		FILE *f = fopen(buf, "rb");
+		CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+		size_t len = fread(data, 1, sizeof(data), f);
+		CU_ASSERT_FATAL(len < sizeof(data));
+		fclose(f);
+		compress(buf, data, len);
+	}
+	closedir(dir);
+}
+#endif
+
+#ifdef HAVE_ZLIB
+/* gzip_file writes data to path in two gzip members. */
+static void gzip_file(const char *path, const char *data, size_t len)
+{
+	for (int member = 0; member < 2; member++) {
+		gzFile gz = gzopen(path, member ? "ab" : "wb");
+		CU_ASSERT_PTR_NOT_NULL_FATAL(gz);
+		/* Not at a packet boundary */
+		size_t first = len / 3;
+		CU_ASSERT_FATAL(gzwrite(gz, data + (member ? first : 0),
+					member ? len - first : first) >= 0);
+		CU_ASSERT_FATAL(gzclose(gz) == Z_OK);
+	}
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* zstd_file writes data to path in two zstd frames followed by a
+ * skippable frame, which is where the seekable format keeps its seek
+ * table. */
+static void zstd_file(const char *path, const char *data, size_t len)
+{
+	static char frame[1 << 17];
+	CU_ASSERT_FATAL(ZSTD_compressBound(len) <= sizeof(frame));
+	FILE *f = fopen(path, "wb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+	/* Not at a packet boundary */
+	size_t first = len / 3;
+	for (int i = 0; i < 2; i++) {
+		size_t n = ZSTD_compress(frame, sizeof(frame), data + (i ? first : 0),
+					 i ? len - first : first, 3);
+		CU_ASSERT_FATAL(!ZSTD_isError(n));
+		CU_ASSERT_FATAL(fwrite(frame, 1, n, f) == n);
+	}
+	/* The skippable frame magic 0x184d2a5e and frame size, then a
+	 * seek table of two entries, which are not checked, and its
+	 * footer: the number of frames, a descriptor without checksums
+	 * and the seekable magic 0x8f92eab1 */
+	const uint8_t skippable[] = {
+		0x5e, 0x2a, 0x4d, 0x18, 0x19, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x02, 0x00, 0x00, 0x00, 0x00, 0xb1, 0xea, 0x92, 0x8f,
+	};
+	CU_ASSERT_FATAL(fwrite(skippable, 1, sizeof(skippable), f) == sizeof(skippable));
+	CU_ASSERT_FATAL(fclose(f) == 0);
+}
+#endif
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+static void check_compressed_dstreams(compress_file compress)
+{
+	/* Compressed data stream files are read as the uncompressed
+	 * ones, whichever way the reader is configured to read them */
+	enum { CAP = 4096 };
+	static int64_t want[CAP];
+	static int64_t got[CAP];
+	const char *trace = "testdata/ctfs/philo";
+	char path[] = "/tmp/actf_test_freader_XXXXXX";
+	CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(path));
+	copy_files(trace, path);
+	compress_dstreams(path, compress);
+
+	/* The last one is in the second packet of most files */
+	const int64_t seek_tstamps[] = { INT64_C(0), INT64_C(29816127914901),
+		INT64_C(29816500000000)
+	};
+	struct actf_freader_cfg cfgs[] = {
+		{.dstream_evs_cap = 20,.muxer_evs_cap = 20 },
+		{.dstream_evs_cap = 20,.muxer_evs_cap = 20,.lazy_dstreams = true },
+		{.dstream_evs_cap = 20,.muxer_evs_cap = 20,.dstream_producers = true },
+		{.dstream_evs_cap = 20,.muxer_evs_cap = 20,.dstream_io = ACTF_FREADER_IO_PREAD,
+		 .read_size = 1 },
+	};
+	size_t want_len = 0;
+	for (size_t s = 0; s < sizeof(seek_tstamps) / sizeof(*seek_tstamps); s++) {
+		struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20 };
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, (char *) trace), 0);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamps[s]), 0);
+		want_len = read_tstamps(rd, want, CAP);
+		CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+		actf_freader_free(rd);
+
+		for (size_t i = 0; i < sizeof(cfgs) / sizeof(*cfgs); i++) {
+			rd = actf_freader_init(cfgs[i]);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+			CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+			for (int round = 0; round < 2; round++) {
+				CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd,
+										       seek_tstamps[s]),
+						      0);
+				size_t got_len = read_tstamps(rd, got, CAP);
+				CU_ASSERT_EQUAL(got_len, want_len);
+				CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+			}
+			actf_freader_free(rd);
+		}
+	}
+
+	/* The packet index files of the decompressed data are used to
+	 * seek, want holds the events after the last sought timestamp */
+	struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20,
+		.pkt_idx_files = true
+	};
+	actf_freader *rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_write_pkt_idx_files(rd), 0);
+	actf_freader_free(rd);
+	char ds_path[sizeof(path) + 64];
+	snprintf(ds_path, sizeof(ds_path), "%s/.tid125101760.actfidx", path);
+	CU_ASSERT_EQUAL(access(ds_path, R_OK), 0);
+	rd = actf_freader_init(cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_seek_ns_from_origin(rd, seek_tstamps[2]), 0);
+	size_t got_len = read_tstamps(rd, got, CAP);
+	CU_ASSERT_EQUAL(got_len, want_len);
+	CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+	actf_freader_free(rd);
 
+	/* A compressed data stream file truncated after the data, within
+	 * the gzip trailer or the skippable zstd frame, is an error */
+	snprintf(ds_path, sizeof(ds_path), "%s/tid125101760", path);
+	struct stat sb;
+	CU_ASSERT_EQUAL_FATAL(stat(ds_path, &sb), 0);
+	CU_ASSERT_EQUAL_FATAL(truncate(ds_path, sb.st_size - 4), 0);
+	rd = actf_freader_init((struct actf_freader_cfg) { 0 });
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+	CU_ASSERT_EQUAL_FATAL(actf_freader_open_folder(rd, path), 0);
+	int rc;
+	size_t evs_len;
+	actf_event **evs;
+	while ((rc = actf_freader_read(rd, &evs, &evs_len)) == 0 && evs_len) ;
+	CU_ASSERT(rc < 0);
+	CU_ASSERT_PTR_NOT_NULL(actf_freader_last_error(rd));
 	actf_freader_free(rd);
+	remove_files(path);
+}
+#endif
+
+#ifdef HAVE_ZLIB
+static void test_freader_compressed_dstreams(void)
+{
+	check_compressed_dstreams(gzip_file);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void test_freader_zstd_dstreams(void)
+{
+	check_compressed_dstreams(zstd_file);
+}
+#endif
+
+static void test_freader_open_threads(void)
+{
+	/* Opening the directories on several threads sets up the same
+	 * data stream files as opening them one by one */
+	enum { CAP = 4096 };
+	static int64_t want[CAP];
+	static int64_t got[CAP];
+	char *paths[] = {
+		"testdata/ctfs/philo",
+		"testdata/ctfs/CTF2-PMETA-1.0-le",
+		"testdata/ctfs/philo",
+	};
+	size_t paths_len = sizeof(paths) / sizeof(*paths);
+	struct {
+		size_t dstream_threads;
+		bool dstream_producers;
+		bool lazy_dstreams;
+	} tcs[] = {
+		{ 0, false, false },
+		{ 2, false, false },
+		{ 0, true, false },
+		{ 0, false, true },
+	};
+	for (size_t i = 0; i < sizeof(tcs) / sizeof(*tcs); i++) {
+		struct actf_freader_cfg cfg = {.dstream_evs_cap = 20,.muxer_evs_cap = 20,
+			.dstream_threads = tcs[i].dstream_threads,
+			.dstream_producers = tcs[i].dstream_producers,
+			.lazy_dstreams = tcs[i].lazy_dstreams,
+		};
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folders(rd, paths, paths_len), 0);
+		size_t want_len = read_tstamps(rd, want, CAP);
+		CU_ASSERT_FATAL(want_len > 0 && want_len < CAP);
+		actf_freader_free(rd);
+
+		cfg.open_threads = 4;
+		rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folders(rd, paths, paths_len), 0);
+		size_t got_len = read_tstamps(rd, got, CAP);
+		CU_ASSERT_EQUAL(got_len, want_len);
+		CU_ASSERT(memcmp(got, want, want_len * sizeof(*want)) == 0);
+		actf_freader_free(rd);
+	}
+
+	/* The error is the one of the first directory failing to open,
+	 * whichever thread happens to fail first */
+	char *nok_paths[] = {
+		"testdata/ctfs/philo",
+		"testdata/ctfs/CTF2-PMETA-1.0_bad_major_nok",
+		"testdata/ctfs/philo",
+		"testdata/ctfs/CTF2-PMETA-1.0_bad_total_sz_nok",
+		"testdata/ctfs/nonexistent",
+	};
+	size_t nok_paths_len = sizeof(nok_paths) / sizeof(*nok_paths);
+	for (int run = 0; run < 20; run++) {
+		struct actf_freader_cfg cfg = {.open_threads = 1 + run % 5 };
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT(actf_freader_open_folders(rd, nok_paths, nok_paths_len) < 0);
+		CU_ASSERT_STRING_EQUAL(actf_freader_last_error(rd),
+				       "metadata packet header has unsupported major version 1");
+		actf_freader_free(rd);
+	}
+}
+
+static void test_freader_shared_metadata(void)
+{
+	/* Directories with identical metadata files share their
+	 * metadata */
+	char *paths[] = {
+		"testdata/ctfs/philo",
+		"testdata/ctfs/CTF2-PMETA-1.0-le",
+		"testdata/ctfs/philo",
+		"testdata/ctfs/philo",
+	};
+	size_t paths_len = sizeof(paths) / sizeof(*paths);
+	for (size_t open_threads = 0; open_threads <= 4; open_threads += 4) {
+		struct actf_freader_cfg cfg = {.open_threads = open_threads };
+		actf_freader *rd = actf_freader_init(cfg);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rd);
+		CU_ASSERT_EQUAL_FATAL(actf_freader_open_folders(rd, paths, paths_len), 0);
+		const actf_metadata *ms[4];
+		size_t ms_len = 0;
+		int rc;
+		size_t evs_len = 0;
+		actf_event **evs = NULL;
+		while ((rc = actf_freader_read(rd, &evs, &evs_len)) == 0 && evs_len) {
+			for (size_t i = 0; i < evs_len; i++) {
+				const actf_event_cls *evc = actf_event_event_cls(evs[i]);
+				const actf_metadata *m =
+				    actf_dstream_cls_metadata(actf_event_cls_dstream_cls(evc));
+				bool seen = false;
+				for (size_t j = 0; j < ms_len; j++) {
+					seen = seen || ms[j] == m;
+				}
+				if (!seen && ms_len < 4) {
+					ms[ms_len++] = m;
+				}
+			}
+		}
+		CU_ASSERT_EQUAL(rc, 0);
+		CU_ASSERT_EQUAL(ms_len, 2);
+		actf_freader_free(rd);
+	}
 }
 
 static CU_TestInfo test_freader_tests[] = {
 	{ "seek", test_freader_seek },
+	{ "pkt idx files", test_freader_pkt_idx_files },
+	{ "damaged pkt idx files", test_freader_damaged_pkt_idx_files },
+	{ "full batches", test_freader_full_batches },
+	{ "stale metadata pkt idx files", test_freader_stale_metadata_pkt_idx_files },
+	{ "lazy dstreams", test_freader_lazy_dstreams },
+	{ "pread dstreams", test_freader_pread_dstreams },
+	{ "compression of", test_freader_compression_of },
+#ifdef HAVE_ZLIB
+	{ "compressed dstreams", test_freader_compressed_dstreams },
+#endif
+#ifdef HAVE_ZSTD
+	{ "zstd dstreams", test_freader_zstd_dstreams },
+#endif
+	{ "open threads", test_freader_open_threads },
+	{ "shared metadata", test_freader_shared_metadata },
 	CU_TEST_INFO_NULL,
 };
 
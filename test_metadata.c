@@ -1135,6 +1135,44 @@ static void test_metadata_event_cls_with_extensions(void)
 	actf_metadata_free(metadata);
 }
 
+static void test_metadata_event_cls_loc_targets(void)
+{
+	struct {
+		const char *path;
+		// the marked ops of the specific context and payload plans
+		bool spec_ctx[8];
+		bool payload[8];
+	} tcs[] = {
+		// payload: struct, len, dyn arr, struct, len, dyn str
+		{"testdata/ctfs/dyn_len_arr_fld_loc/metadata", { 0 },
+		 { true, true, true, true, true, false }},
+		// specific context: struct, struct, selector
+		// payload: struct, variant, sint, uint
+		{"testdata/ctfs/variant_spec_ctxt_selector/metadata", { true, true, true },
+		 { false, false, false, false }},
+	};
+	for (size_t i = 0; i < sizeof(tcs) / sizeof(*tcs); i++) {
+		CU_ASSERT_PTR_NOT_NULL_FATAL((metadata = actf_metadata_init()));
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].path), 0);
+		struct actf_it dscit = { 0 };
+		struct actf_it evcit = { 0 };
+		const struct actf_event_cls *evc =
+		    actf_dstream_cls_event_clses_next(actf_metadata_dstream_clses_next
+						      (metadata, &dscit), &evcit);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(evc);
+		CU_ASSERT(evc->spec_ctx_plan.locs_resolved);
+		CU_ASSERT(evc->payload_plan.locs_resolved);
+		CU_ASSERT_FATAL(evc->spec_ctx_plan.len <= 8 && evc->payload_plan.len <= 8);
+		for (size_t j = 0; j < evc->spec_ctx_plan.len; j++) {
+			CU_ASSERT_EQUAL(evc->spec_ctx_plan.ops[j].loc_target, tcs[i].spec_ctx[j]);
+		}
+		for (size_t j = 0; j < evc->payload_plan.len; j++) {
+			CU_ASSERT_EQUAL(evc->payload_plan.ops[j].loc_target, tcs[i].payload[j]);
+		}
+		actf_metadata_free(metadata);
+	}
+}
+
 static void test_metadata_nparse_packetized(void)
 {
 	const char *path = "testdata/ctfs/CTF2-PMETA-1.0-be/metadata";
@@ -1226,6 +1264,7 @@ static CU_TestInfo test_metadata_tests[] = {
 	{ "ev record cls with specific context", test_metadata_event_cls_with_spec_ctx },
 	{ "ev record cls with variant", test_metadata_event_cls_with_variant },
 	{ "ev record cls with extensions", test_metadata_event_cls_with_extensions },
+	{ "ev record cls loc targets", test_metadata_event_cls_loc_targets },
 	{ "nparse with packetized metadata", test_metadata_nparse_packetized },
 	{ "clk cls eq identities", test_clk_cls_eq_identities },
 	CU_TEST_INFO_NULL,
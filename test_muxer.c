@@ -0,0 +1,619 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crust/common.h"
+#include "decoder.h"
+#include "muxer.h"
+#include "print.h"
+#include "test_muxer.h"
+
+// A data stream file appears twice to get events with equal
+// timestamps in different generators, the payloads of the second one
+// are modified to tell them apart.
+static const char *ds_paths[] = {
+	"testdata/ctfs/philo/tid125101760",
+	"testdata/ctfs/philo/tid116709056",
+	"testdata/ctfs/philo/tid125101760",
+	"testdata/ctfs/philo/tid150284608",
+};
+static const char *metadata_path = "testdata/ctfs/philo/metadata";
+
+#define N_GENS ARRLEN(ds_paths)
+#define MAX_EVS 64
+
+static char databufs[N_GENS][1024];
+static size_t data_lens[N_GENS];
+
+static int test_muxer_suite_init(void)
+{
+	for (size_t i = 0; i < N_GENS; i++) {
+		int fd = open(ds_paths[i], O_RDONLY);
+		if (fd < 0) {
+			return -1;
+		}
+		ssize_t n = read(fd, databufs[i], sizeof(databufs[i]));
+		close(fd);
+		if (n < 0) {
+			return -1;
+		}
+		data_lens[i] = n;
+	}
+	for (size_t i = 0; i + 6 <= data_lens[2]; i++) {
+		if (memcmp(databufs[2] + i, "hungry", 6) == 0) {
+			memcpy(databufs[2] + i, "HUNGRY", 6);
+		}
+	}
+	return 0;
+}
+
+static int test_muxer_suite_clean(void)
+{
+	return 0;
+}
+
+static void test_muxer_test_setup(void)
+{
+	return;
+}
+
+static void test_muxer_test_teardown(void)
+{
+	return;
+}
+
+/* print_event prints ev into a string which should be freed. */
+static char *print_event(actf_printer *p, const actf_event *ev)
+{
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	CU_ASSERT_EQUAL(actf_fprint_event(p, s, ev), 0);
+	fprintf(s, "\n");
+	fclose(s);
+	return buf;
+}
+
+/* merge_naively merges the events of all generators from the
+ * timestamp from one at a time, the earliest event first and the one
+ * of the lowest generator index first among equal timestamps. It
+ * returns the printed events as a string which should be freed. */
+static char *merge_naively(const actf_metadata *metadata, actf_printer *p, int64_t from)
+{
+	struct {
+		int64_t tstamp;
+		char *str;
+	} evs[N_GENS][MAX_EVS];
+	size_t evs_lens[N_GENS] = { 0 };
+	for (size_t i = 0; i < N_GENS; i++) {
+		actf_decoder *dec = actf_decoder_init(databufs[i], data_lens[i], MAX_EVS, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		size_t dec_evs_len;
+		actf_event **dec_evs;
+		while (actf_decoder_decode(dec, &dec_evs, &dec_evs_len) == 0 && dec_evs_len) {
+			for (size_t j = 0; j < dec_evs_len; j++) {
+				if (actf_event_tstamp_ns_from_origin(dec_evs[j]) < from) {
+					continue;
+				}
+				CU_ASSERT_FATAL(evs_lens[i] < MAX_EVS);
+				evs[i][evs_lens[i]].tstamp = actf_event_tstamp_ns_from_origin(dec_evs[j]);
+				evs[i][evs_lens[i]].str = print_event(p, dec_evs[j]);
+				evs_lens[i]++;
+			}
+		}
+		actf_decoder_free(dec);
+	}
+
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	size_t heads[N_GENS] = { 0 };
+	for (;;) {
+		size_t min_i = N_GENS;
+		for (size_t i = 0; i < N_GENS; i++) {
+			if (heads[i] < evs_lens[i] &&
+			    (min_i == N_GENS ||
+			     evs[i][heads[i]].tstamp < evs[min_i][heads[min_i]].tstamp)) {
+				min_i = i;
+			}
+		}
+		if (min_i == N_GENS) {
+			break;
+		}
+		char *str = evs[min_i][heads[min_i]++].str;
+		fputs(str, s);
+		free(str);
+	}
+	fclose(s);
+	return buf;
+}
+
+static void test_muxer_order(void)
+{
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+	char *want = merge_naively(metadata, p, INT64_MIN);
+	CU_ASSERT_FATAL(want && strlen(want) > 0);
+
+	struct {
+		size_t dec_evs_cap;
+		size_t mux_evs_cap;
+	} caps[] = {
+		{ 1, 1 },
+		{ 1, 7 },
+		{ 3, 5 },
+		{ 64, 2 },
+		{ 64, 64 },
+	};
+	for (size_t i = 0; i < ARRLEN(caps); i++) {
+		for (size_t n_bufs = 1; n_bufs <= 2; n_bufs++) {
+			struct actf_decoder_cfg cfg = {
+				.evs_cap = caps[i].dec_evs_cap,
+				.n_bufs = n_bufs,
+			};
+			actf_decoder *decs[N_GENS];
+			struct actf_event_generator gens[N_GENS];
+			for (size_t j = 0; j < N_GENS; j++) {
+				decs[j] = actf_decoder_init_cfg(databufs[j], data_lens[j], metadata, cfg);
+				CU_ASSERT_PTR_NOT_NULL_FATAL(decs[j]);
+				gens[j] = actf_decoder_to_generator(decs[j]);
+			}
+			actf_muxer *m = actf_muxer_init(gens, N_GENS, caps[i].mux_evs_cap);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(m);
+
+			char *got = NULL;
+			size_t got_len = 0;
+			FILE *s = open_memstream(&got, &got_len);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+			size_t evs_len;
+			actf_event **evs;
+			while (actf_muxer_mux(m, &evs, &evs_len) == 0 && evs_len) {
+				for (size_t j = 0; j < evs_len; j++) {
+					CU_ASSERT_EQUAL(actf_fprint_event(p, s, evs[j]), 0);
+					fprintf(s, "\n");
+				}
+			}
+			fclose(s);
+			CU_ASSERT_STRING_EQUAL(got, want);
+			free(got);
+
+			actf_muxer_free(m);
+			for (size_t j = 0; j < N_GENS; j++) {
+				actf_decoder_free(decs[j]);
+			}
+		}
+	}
+
+	free(want);
+	actf_printer_free(p);
+	actf_metadata_free(metadata);
+}
+
+/* A generator which hands out the events of a decoder while recording
+ * the last ones, to see that the muxer does not copy them. */
+struct recording_gen {
+	actf_decoder *dec;
+	actf_event **evs;
+	size_t evs_len;
+};
+
+static int recording_gen_generate(void *self, actf_event ***evs, size_t *evs_len)
+{
+	struct recording_gen *rg = self;
+	int rc = actf_decoder_decode(rg->dec, evs, evs_len);
+	rg->evs = *evs;
+	rg->evs_len = *evs_len;
+	return rc;
+}
+
+static const char *recording_gen_last_error(void *self)
+{
+	struct recording_gen *rg = self;
+	return actf_decoder_last_error(rg->dec);
+}
+
+static void test_muxer_no_copy(void)
+{
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	struct recording_gen rg = {
+		.dec = actf_decoder_init(databufs[0], data_lens[0], 4, metadata),
+	};
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rg.dec);
+	struct actf_event_generator gen = {
+		.generate = recording_gen_generate,
+		.last_error = recording_gen_last_error,
+		.self = &rg,
+	};
+	actf_muxer *m = actf_muxer_init(&gen, 1, 64);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(m);
+
+	size_t n_evs = 0;
+	size_t evs_len;
+	actf_event **evs;
+	while (actf_muxer_mux(m, &evs, &evs_len) == 0 && evs_len) {
+		CU_ASSERT_EQUAL(evs_len, rg.evs_len);
+		for (size_t i = 0; i < evs_len && i < rg.evs_len; i++) {
+			CU_ASSERT_PTR_EQUAL(evs[i], rg.evs[i]);
+		}
+		n_evs += evs_len;
+	}
+	CU_ASSERT(n_evs > 0);
+
+	actf_muxer_free(m);
+	actf_decoder_free(rg.dec);
+	actf_metadata_free(metadata);
+}
+
+/* A generator which hands out the events of a decoder while keeping
+ * copies of the batches still valid, to tell which generator an event
+ * of the muxer comes from. */
+struct tagging_gen {
+	actf_decoder *dec;
+	actf_event *evs[2][MAX_EVS];
+	size_t evs_lens[2];
+	size_t batch_i;
+	size_t n_generates;
+};
+
+static int tagging_gen_generate(void *self, actf_event ***evs, size_t *evs_len)
+{
+	struct tagging_gen *tg = self;
+	tg->n_generates++;
+	int rc = actf_decoder_decode(tg->dec, evs, evs_len);
+	tg->batch_i = (tg->batch_i + 1) % 2;
+	CU_ASSERT_FATAL(*evs_len <= MAX_EVS);
+	memcpy(tg->evs[tg->batch_i], *evs, *evs_len * sizeof(**evs));
+	tg->evs_lens[tg->batch_i] = *evs_len;
+	return rc;
+}
+
+static const char *tagging_gen_last_error(void *self)
+{
+	struct tagging_gen *tg = self;
+	return actf_decoder_last_error(tg->dec);
+}
+
+static int tagging_gen_seek_ns_from_origin(void *self, int64_t tstamp)
+{
+	struct tagging_gen *tg = self;
+	return actf_decoder_seek_ns_from_origin(tg->dec, tstamp);
+}
+
+static int tagging_gen_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	struct tagging_gen *tg = self;
+	return actf_decoder_time_range(tg->dec, begin, end);
+}
+
+static bool tagging_gen_has(struct tagging_gen *tg, size_t n_bufs, const actf_event *ev)
+{
+	for (size_t i = 0; i < n_bufs; i++) {
+		size_t batch_i = (tg->batch_i + 2 - i) % 2;
+		for (size_t j = 0; j < tg->evs_lens[batch_i]; j++) {
+			if (tg->evs[batch_i][j] == ev) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/* decode_each prints the events of each generator into a string of its
+ * own, which should be freed. */
+static void decode_each(const actf_metadata *metadata, actf_printer *p, char *strs[N_GENS])
+{
+	for (size_t i = 0; i < N_GENS; i++) {
+		size_t str_len = 0;
+		FILE *s = open_memstream(&strs[i], &str_len);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+		actf_decoder *dec = actf_decoder_init(databufs[i], data_lens[i], MAX_EVS, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		size_t evs_len;
+		actf_event **evs;
+		while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+			for (size_t j = 0; j < evs_len; j++) {
+				CU_ASSERT_EQUAL(actf_fprint_event(p, s, evs[j]), 0);
+				fprintf(s, "\n");
+			}
+		}
+		actf_decoder_free(dec);
+		fclose(s);
+	}
+}
+
+static void test_muxer_relaxed_orders(void)
+{
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+	char *want[N_GENS];
+	decode_each(metadata, p, want);
+
+	struct actf_muxer_cfg mux_cfgs[] = {
+		{ .order = ACTF_MUXER_ORDER_STREAM },
+		{ .order = ACTF_MUXER_ORDER_WINDOW, .window_ns = 1 },
+		{ .order = ACTF_MUXER_ORDER_WINDOW, .window_ns = 10000 },
+		{ .order = ACTF_MUXER_ORDER_WINDOW, .window_ns = 50000000 },
+		{ .order = ACTF_MUXER_ORDER_WINDOW, .window_ns = INT64_MAX },
+	};
+	struct {
+		size_t dec_evs_cap;
+		size_t mux_evs_cap;
+	} caps[] = {
+		{ 1, 1 },
+		{ 3, 5 },
+		{ 64, 2 },
+		{ 64, 64 },
+	};
+	for (size_t i = 0; i < ARRLEN(mux_cfgs) * 2; i++) {
+		/* The generators are deferred in the second round */
+		bool defer = i >= ARRLEN(mux_cfgs);
+		for (size_t j = 0; j < ARRLEN(caps); j++) {
+			for (size_t n_bufs = 1; n_bufs <= 2; n_bufs++) {
+				struct actf_decoder_cfg cfg = {
+					.evs_cap = caps[j].dec_evs_cap,
+					.n_bufs = n_bufs,
+				};
+				struct tagging_gen tgs[N_GENS];
+				struct actf_event_generator gens[N_GENS];
+				for (size_t k = 0; k < N_GENS; k++) {
+					tgs[k] = (struct tagging_gen) {
+						.dec = actf_decoder_init_cfg(databufs[k], data_lens[k],
+									     metadata, cfg),
+					};
+					CU_ASSERT_PTR_NOT_NULL_FATAL(tgs[k].dec);
+					gens[k] = (struct actf_event_generator) {
+						.generate = tagging_gen_generate,
+						.seek_ns_from_origin = tagging_gen_seek_ns_from_origin,
+						.last_error = tagging_gen_last_error,
+						.self = &tgs[k],
+						.n_bufs = n_bufs,
+						.time_range = tagging_gen_time_range,
+					};
+				}
+				struct actf_muxer_cfg mux_cfg = mux_cfgs[i % ARRLEN(mux_cfgs)];
+				mux_cfg.evs_cap = caps[j].mux_evs_cap;
+				mux_cfg.defer_gens = defer;
+				actf_muxer *m = actf_muxer_init_cfg(gens, N_GENS, mux_cfg);
+				CU_ASSERT_PTR_NOT_NULL_FATAL(m);
+
+				char *got[N_GENS];
+				size_t got_lens[N_GENS];
+				FILE *ss[N_GENS];
+				for (size_t k = 0; k < N_GENS; k++) {
+					ss[k] = open_memstream(&got[k], &got_lens[k]);
+					CU_ASSERT_PTR_NOT_NULL_FATAL(ss[k]);
+				}
+				int64_t max_tstamp = INT64_MIN;
+				size_t evs_len;
+				actf_event **evs;
+				bool first = true;
+				while (actf_muxer_mux(m, &evs, &evs_len) == 0 && evs_len) {
+					CU_ASSERT(evs_len <= caps[j].mux_evs_cap);
+					for (size_t k = 0; k < evs_len; k++) {
+						size_t gen_i = 0;
+						while (gen_i < N_GENS &&
+						       !tagging_gen_has(&tgs[gen_i], n_bufs, evs[k])) {
+							gen_i++;
+						}
+						CU_ASSERT_FATAL(gen_i < N_GENS);
+						CU_ASSERT_EQUAL(actf_fprint_event(p, ss[gen_i], evs[k]), 0);
+						fprintf(ss[gen_i], "\n");
+
+						int64_t tstamp = actf_event_tstamp_ns_from_origin(evs[k]);
+						if (mux_cfg.order == ACTF_MUXER_ORDER_WINDOW) {
+							CU_ASSERT(tstamp > max_tstamp ||
+								  max_tstamp - tstamp < mux_cfg.window_ns);
+						}
+						max_tstamp = MAX(max_tstamp, tstamp);
+					}
+					/* A deferred generator is first generated from
+					 * at its first turn or once a window reaches
+					 * the begin of its time range */
+					for (size_t k = 1; first && defer && k < N_GENS; k++) {
+						int64_t begin, end;
+						CU_ASSERT_EQUAL_FATAL(actf_decoder_time_range
+								      (tgs[k].dec, &begin, &end), 0);
+						if (mux_cfg.order == ACTF_MUXER_ORDER_STREAM ||
+						    begin - max_tstamp >= mux_cfg.window_ns) {
+							CU_ASSERT_EQUAL(tgs[k].n_generates, 0);
+						}
+					}
+					first = false;
+				}
+				for (size_t k = 0; k < N_GENS; k++) {
+					fclose(ss[k]);
+					CU_ASSERT_STRING_EQUAL(got[k], want[k]);
+					free(got[k]);
+				}
+
+				actf_muxer_free(m);
+				for (size_t k = 0; k < N_GENS; k++) {
+					actf_decoder_free(tgs[k].dec);
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < N_GENS; i++) {
+		free(want[i]);
+	}
+	actf_printer_free(p);
+	actf_metadata_free(metadata);
+}
+
+/* A generator which counts the calls to a decoder generator. */
+struct counting_gen {
+	struct actf_event_generator gen;
+	size_t n_generates;
+	size_t n_seeks;
+};
+
+static int counting_gen_generate(void *self, actf_event ***evs, size_t *evs_len)
+{
+	struct counting_gen *cg = self;
+	cg->n_generates++;
+	return cg->gen.generate(cg->gen.self, evs, evs_len);
+}
+
+static int counting_gen_seek_ns_from_origin(void *self, int64_t tstamp)
+{
+	struct counting_gen *cg = self;
+	cg->n_seeks++;
+	return cg->gen.seek_ns_from_origin(cg->gen.self, tstamp);
+}
+
+static int counting_gen_time_range(void *self, int64_t *begin, int64_t *end)
+{
+	struct counting_gen *cg = self;
+	return cg->gen.time_range(cg->gen.self, begin, end);
+}
+
+static const char *counting_gen_last_error(void *self)
+{
+	struct counting_gen *cg = self;
+	return cg->gen.last_error(cg->gen.self);
+}
+
+static void test_muxer_seek(void)
+{
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+
+	actf_decoder *decs[N_GENS];
+	struct counting_gen cgs[N_GENS];
+	struct actf_event_generator gens[N_GENS];
+	int64_t begins[N_GENS], ends[N_GENS];
+	int64_t first = INT64_MAX, last = INT64_MIN;
+	for (size_t i = 0; i < N_GENS; i++) {
+		decs[i] = actf_decoder_init(databufs[i], data_lens[i], 3, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(decs[i]);
+		CU_ASSERT_EQUAL_FATAL(actf_decoder_time_range(decs[i], &begins[i], &ends[i]), 0);
+		first = MIN(first, begins[i]);
+		last = MAX(last, ends[i]);
+		cgs[i] = (struct counting_gen) {
+			.gen = actf_decoder_to_generator(decs[i]),
+		};
+		gens[i] = (struct actf_event_generator) {
+			.generate = counting_gen_generate,
+			.seek_ns_from_origin = counting_gen_seek_ns_from_origin,
+			.last_error = counting_gen_last_error,
+			.self = &cgs[i],
+			.n_bufs = 1,
+			.time_range = counting_gen_time_range,
+		};
+	}
+	actf_muxer *m = actf_muxer_init(gens, N_GENS, 5);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(m);
+
+	int64_t tstamps[] = {
+		INT64_MIN, first, first + (last - first) / 4, first + (last - first) / 2,
+		ends[0], ends[0] + 1, last, last + 1, INT64_MAX,
+	};
+	for (size_t i = 0; i < ARRLEN(tstamps); i++) {
+		for (size_t j = 0; j < N_GENS; j++) {
+			cgs[j].n_generates = 0;
+			cgs[j].n_seeks = 0;
+		}
+		CU_ASSERT_EQUAL_FATAL(actf_muxer_seek_ns_from_origin(m, tstamps[i]), 0);
+		for (size_t j = 0; j < N_GENS; j++) {
+			// only the generators with events on both sides are seeked
+			bool straddles = begins[j] < tstamps[i] && ends[j] >= tstamps[i];
+			CU_ASSERT_EQUAL(cgs[j].n_seeks, straddles);
+		}
+
+		char *got = NULL;
+		size_t got_len = 0;
+		FILE *s = open_memstream(&got, &got_len);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+		int64_t max_tstamp = INT64_MIN;
+		size_t evs_len;
+		actf_event **evs;
+		while (actf_muxer_mux(m, &evs, &evs_len) == 0 && evs_len) {
+			for (size_t j = 0; j < evs_len; j++) {
+				CU_ASSERT_EQUAL(actf_fprint_event(p, s, evs[j]), 0);
+				fprintf(s, "\n");
+				max_tstamp = MAX(max_tstamp, actf_event_tstamp_ns_from_origin(evs[j]));
+			}
+			// a deferred generator is seeked once the merge reaches it
+			for (size_t j = 0; j < N_GENS; j++) {
+				if (begins[j] >= tstamps[i] && cgs[j].n_seeks) {
+					CU_ASSERT(begins[j] <= max_tstamp);
+				}
+			}
+		}
+		fclose(s);
+		char *want = merge_naively(metadata, p, tstamps[i]);
+		CU_ASSERT_STRING_EQUAL(got, want);
+		free(want);
+		free(got);
+
+		for (size_t j = 0; j < N_GENS; j++) {
+			// the generators ending before the seek are left alone
+			if (ends[j] < tstamps[i]) {
+				CU_ASSERT_EQUAL(cgs[j].n_seeks, 0);
+				CU_ASSERT_EQUAL(cgs[j].n_generates, 0);
+			} else {
+				CU_ASSERT_EQUAL(cgs[j].n_seeks, 1);
+			}
+		}
+	}
+
+	actf_muxer_free(m);
+	for (size_t i = 0; i < N_GENS; i++) {
+		actf_decoder_free(decs[i]);
+	}
+	actf_printer_free(p);
+	actf_metadata_free(metadata);
+}
+
+static CU_TestInfo test_muxer_tests[] = {
+	{ "order", test_muxer_order },
+	{ "no copy", test_muxer_no_copy },
+	{ "relaxed orders", test_muxer_relaxed_orders },
+	{ "seek", test_muxer_seek },
+	CU_TEST_INFO_NULL,
+};
+
+CU_SuiteInfo test_muxer_suite = {
+	"Muxer", test_muxer_suite_init, test_muxer_suite_clean,
+	test_muxer_test_setup, test_muxer_test_teardown, test_muxer_tests
+};
@@ -0,0 +1,257 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crust/common.h"
+#include "decoder.h"
+#include "decoder_int.h"
+#include "pdecoder.h"
+#include "pdecoder_int.h"
+#include "print.h"
+#include "test_pdecoder.h"
+
+#define DS_COPIES 8
+
+// Room for DS_COPIES copies of a data stream file of 1024 bytes
+static char databuf[DS_COPIES * 1024];
+
+static int test_pdecoder_suite_init(void)
+{
+	return 0;
+}
+
+static int test_pdecoder_suite_clean(void)
+{
+	return 0;
+}
+
+static void test_pdecoder_test_setup(void)
+{
+	return;
+}
+
+static void test_pdecoder_test_teardown(void)
+{
+	return;
+}
+
+/* Reads the data stream file path into databuf n_copies times, one
+ * after the other, and returns the total size. */
+static size_t read_file_copies(const char *path, size_t n_copies)
+{
+	int fd = open(path, O_RDONLY);
+	CU_ASSERT_FATAL(fd >= 0);
+	ssize_t n = read(fd, databuf, sizeof(databuf) / DS_COPIES);
+	CU_ASSERT_FATAL(n >= 0);
+	close(fd);
+	for (size_t i = 1; i < n_copies; i++) {
+		memcpy(databuf + i * n, databuf, n);
+	}
+	return n * n_copies;
+}
+
+/* print_gen prints all events of gen into a string which should be
+ * freed. The return code of the last generate call and the last error
+ * are printed last. */
+static char *print_gen(struct actf_event_generator gen)
+{
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+	int rc;
+	size_t evs_len;
+	actf_event **evs;
+	while ((rc = gen.generate(gen.self, &evs, &evs_len)) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len; i++) {
+			actf_fprint_event(p, s, evs[i]);
+			fprintf(s, "\n");
+		}
+	}
+	fprintf(s, "rc %d", rc);
+	if (rc < 0) {
+		fprintf(s, ": %s", gen.last_error(gen.self));
+	}
+	actf_printer_free(p);
+	fclose(s);
+	return buf;
+}
+
+static void test_pdecoder_same_as_decoder(void)
+{
+	struct {
+		const char *ds_path;
+		const char *metadata_path;
+		size_t n_copies;
+	} tcs[] = {
+		{"testdata/ctfs/philo/tid125101760", "testdata/ctfs/philo/metadata", DS_COPIES},
+		// the last packet is cut off and decoded after the indexed
+		// one, ending with an error
+		{"testdata/ctfs/philo_nok/tid125101760", "testdata/ctfs/philo_nok/metadata", 1},
+		// no packet context, nothing can be indexed
+		{"testdata/ctfs/fxd_len_bit_arr_bo_mix/ds0",
+		 "testdata/ctfs/fxd_len_bit_arr_bo_mix/metadata", 1},
+	};
+	size_t n_threads[] = { 1, 3 };
+	size_t evs_caps[] = { 1, 64 };
+	for (size_t i = 0; i < ARRLEN(tcs); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].metadata_path), 0);
+		size_t len = read_file_copies(tcs[i].ds_path, tcs[i].n_copies);
+
+		struct actf_decoder *dec = actf_decoder_init(databuf, len, 0, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *want = print_gen(actf_decoder_to_generator(dec));
+		actf_decoder_free(dec);
+
+		for (size_t j = 0; j < ARRLEN(n_threads); j++) {
+			for (size_t k = 0; k < ARRLEN(evs_caps); k++) {
+				struct actf_pdecoder_cfg cfg = {
+					.n_threads = n_threads[j],
+					.dec_cfg = {.evs_cap = evs_caps[k] },
+				};
+				actf_pdecoder *pd = actf_pdecoder_init(databuf, len, metadata, cfg);
+				CU_ASSERT_PTR_NOT_NULL_FATAL(pd);
+				char *got = print_gen(actf_pdecoder_to_generator(pd));
+				CU_ASSERT_STRING_EQUAL(got, want);
+				free(got);
+				actf_pdecoder_free(pd);
+			}
+		}
+		free(want);
+		actf_metadata_free(metadata);
+	}
+}
+
+static void test_pdecoder_seek(void)
+{
+	const char *ds_path = "testdata/ctfs/philo/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo/metadata";
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	size_t len = read_file_copies(ds_path, 1);
+
+	// collect the timestamps of all events
+	int64_t tstamps[64];
+	size_t n_tstamps = 0;
+	size_t evs_len;
+	actf_event **evs;
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 0, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len && n_tstamps < ARRLEN(tstamps); i++) {
+			tstamps[n_tstamps++] = actf_event_tstamp_ns_from_origin(evs[i]);
+		}
+	}
+	CU_ASSERT_FATAL(n_tstamps > 2);
+
+	struct actf_pdecoder_cfg cfg = {.n_threads = 2,.dec_cfg = {.evs_cap = 4 } };
+	actf_pdecoder *pd = actf_pdecoder_init(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pd);
+	// every event, both backwards and forwards in the data stream
+	for (size_t i = n_tstamps; i-- > 0;) {
+		CU_ASSERT_EQUAL(actf_decoder_seek_ns_from_origin(dec, tstamps[i]), 0);
+		char *want = print_gen(actf_decoder_to_generator(dec));
+		CU_ASSERT_EQUAL(actf_pdecoder_seek_ns_from_origin(pd, tstamps[i]), 0);
+		char *got = print_gen(actf_pdecoder_to_generator(pd));
+		CU_ASSERT_STRING_EQUAL(got, want);
+		free(want);
+		free(got);
+	}
+	// seeking in the middle of a returned packet
+	CU_ASSERT_EQUAL(actf_pdecoder_seek_ns_from_origin(pd, tstamps[0]), 0);
+	CU_ASSERT_EQUAL(actf_pdecoder_decode(pd, &evs, &evs_len), 0);
+	CU_ASSERT_EQUAL(actf_pdecoder_seek_ns_from_origin(pd, tstamps[n_tstamps - 1]), 0);
+	CU_ASSERT_EQUAL(actf_pdecoder_decode(pd, &evs, &evs_len), 0);
+	CU_ASSERT_EQUAL_FATAL(evs_len, 1);
+	CU_ASSERT_EQUAL(actf_event_tstamp_ns_from_origin(evs[0]), tstamps[n_tstamps - 1]);
+	// past the last event
+	CU_ASSERT_EQUAL(actf_pdecoder_seek_ns_from_origin(pd, tstamps[n_tstamps - 1] + 1), 0);
+	CU_ASSERT_EQUAL(actf_pdecoder_decode(pd, &evs, &evs_len), 0);
+	CU_ASSERT_EQUAL(evs_len, 0);
+
+	actf_pdecoder_free(pd);
+	actf_decoder_free(dec);
+	actf_metadata_free(metadata);
+}
+
+static void test_pdecoder_bad_idx(void)
+{
+	/* An index with packets outside of the data is refused */
+	const char *ds_path = "testdata/ctfs/philo/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo/metadata";
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	size_t len = read_file_copies(ds_path, 1);
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 0, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	struct pkt_idx idx;
+	CU_ASSERT_EQUAL_FATAL(actf_decoder_pkt_idx(dec, &idx), 0);
+	CU_ASSERT_FATAL(idx.len == 2);
+
+	struct actf_pdecoder_cfg cfg = {.n_threads = 2 };
+	actf_pdecoder *pd = actf_pdecoder_init_idx(databuf, len, metadata, cfg, idx);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pd);
+	actf_pdecoder_free(pd);
+
+	// the data ends before the last packet
+	pd = actf_pdecoder_init_idx(databuf, len - 1, metadata, cfg, idx);
+	CU_ASSERT_PTR_NULL(pd);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	actf_pdecoder_free(pd);
+
+	// an entry far past the data
+	struct pkt_idx_entry entries[2] = { idx.entries[0], idx.entries[1] };
+	entries[1].bit_off = UINT64_C(1) << 40;
+	struct pkt_idx bad_idx = {.entries = entries,.len = 2,.end_bit_off = idx.end_bit_off };
+	pd = actf_pdecoder_init_idx(databuf, len, metadata, cfg, bad_idx);
+	CU_ASSERT_PTR_NULL(pd);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	actf_pdecoder_free(pd);
+
+	actf_decoder_free(dec);
+	actf_metadata_free(metadata);
+}
+
+static CU_TestInfo test_pdecoder_tests[] = {
+	{ "same as decoder", test_pdecoder_same_as_decoder },
+	{ "seek", test_pdecoder_seek },
+	{ "bad idx", test_pdecoder_bad_idx },
+	CU_TEST_INFO_NULL,
+};
+
+CU_SuiteInfo test_pdecoder_suite = {
+	"Parallel Decoder", test_pdecoder_suite_init, test_pdecoder_suite_clean,
+	test_pdecoder_test_setup, test_pdecoder_test_teardown, test_pdecoder_tests
+};
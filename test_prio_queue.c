@@ -25,6 +25,10 @@
 
 #include "crust/common.h"
 #include "test_prio_queue.h"
+
+// counts the node comparisons of the priority queue
+static uint64_t n_cmps;
+#define PRIO_QUEUE_CMP_HOOK() (n_cmps++)
 #include "prio_queue.h"
 
 
@@ -52,7 +56,10 @@ static int cmpnode(const void *p1, const void *p2)
 {
 	const struct node *n1 = p1;
 	const struct node *n2 = p2;
-	return (n1->key < n2->key) ? -1 : (int) (n1->key - n2->key);
+	if (n1->key != n2->key) {
+		return (n1->key < n2->key) ? -1 : 1;
+	}
+	return (n1->value < n2->value) ? -1 : (n1->value > n2->value);
 }
 
 static void rand_test(void)
@@ -136,10 +143,91 @@ static void test_prio_queue_basic(void)
 	prio_queue_free(&pq);
 }
 
+static void test_prio_queue_replace_top(void)
+{
+	int rc;
+	struct prio_queue pq = { 0 };
+	struct prio_queue ref = { 0 };
+	rc = prio_queue_init(&pq, N_NODES);
+	CU_ASSERT_FATAL(rc == ACTF_OK);
+	rc = prio_queue_init(&ref, N_NODES);
+	CU_ASSERT_FATAL(rc == ACTF_OK);
+	srand(1);
+	// few distinct keys to get plenty of equal keys
+	for (size_t i = 0; i < N_NODES; i++) {
+		struct node n = {.key = rand() % 16,.value = i };
+		prio_queue_push_unchecked(&pq, n);
+		prio_queue_push_unchecked(&ref, n);
+	}
+	/* A replace top is a pop followed by a push */
+	for (size_t i = 0; i < 4 * N_NODES; i++) {
+		struct node want = prio_queue_pop_unchecked(&ref);
+		struct node n = {.key = want.key + rand() % 16,.value = want.value };
+		prio_queue_push_unchecked(&ref, n);
+		struct node got = prio_queue_replace_top_unchecked(&pq, n);
+		CU_ASSERT(memcmp(&want, &got, sizeof(want)) == 0);
+	}
+	/* Equal keys are ordered by value */
+	struct node prev = prio_queue_pop_unchecked(&pq);
+	while (pq.len) {
+		struct node n = prio_queue_pop_unchecked(&pq);
+		CU_ASSERT(prev.key < n.key || (prev.key == n.key && prev.value < n.value));
+		prev = n;
+	}
+
+	prio_queue_free(&pq);
+	prio_queue_free(&ref);
+}
+
+static int64_t elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * INT64_C(1000000000) + (end->tv_nsec - start->tv_nsec);
+}
+
+/* useful to enable when comparing implementations. It merges k inputs
+ * the way the muxer does, with a pop followed by a push and with a
+ * replace top per merged element. */
+__maybe_unused static void test_prio_queue_bench(void)
+{
+	size_t ks[] = { 4, 64, 1024 };
+	size_t n_ops = 1 << 22;
+	for (size_t i = 0; i < ARRLEN(ks); i++) {
+		for (int replace = 0; replace < 2; replace++) {
+			struct prio_queue pq = { 0 };
+			CU_ASSERT_FATAL(prio_queue_init(&pq, ks[i]) == ACTF_OK);
+			srand(1);
+			for (size_t j = 0; j < ks[i]; j++) {
+				prio_queue_push_unchecked(&pq, (struct node) {
+							  .key = rand() % 1000,.value = j});
+			}
+			n_cmps = 0;
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for (size_t j = 0; j < n_ops; j++) {
+				struct node n = prio_queue_peek_unchecked(&pq);
+				n.key += rand() % 1000;
+				if (replace) {
+					prio_queue_replace_top_unchecked(&pq, n);
+				} else {
+					prio_queue_pop_unchecked(&pq);
+					prio_queue_push_unchecked(&pq, n);
+				}
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			printf("\n  k %4zu %-11s: %5.1f cmps/event, %5.1f ns/event", ks[i],
+			       replace ? "replace top" : "pop+push", (double) n_cmps / n_ops,
+			       (double) elapsed_ns(&start, &end) / n_ops);
+			prio_queue_free(&pq);
+		}
+	}
+}
+
 static CU_TestInfo test_prio_queue_tests[] = {
 	{ "basic", test_prio_queue_basic },
 	// {"fuzz", test_prio_queue_fuzz},
 	{ "fuzz stable", test_prio_queue_fuzz_stable },
+	{ "replace top", test_prio_queue_replace_top },
+	// {"bench", test_prio_queue_bench},
 	CU_TEST_INFO_NULL,
 };
 
@@ -0,0 +1,271 @@
+/*
+ * This file is a part of ACTF.
+ *
+ * Copyright (C) 2025  Adam Wendelin <adwe live se>
+ *
+ * ACTF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ACTF is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ACTF. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crust/common.h"
+#include "decoder.h"
+#include "print.h"
+#include "producer.h"
+#include "test_producer.h"
+
+#define MAX_BUFS 2
+
+static char databuf[1024];
+
+static int test_producer_suite_init(void)
+{
+	return 0;
+}
+
+static int test_producer_suite_clean(void)
+{
+	return 0;
+}
+
+static void test_producer_test_setup(void)
+{
+	return;
+}
+
+static void test_producer_test_teardown(void)
+{
+	return;
+}
+
+static size_t read_file(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	CU_ASSERT_FATAL(fd >= 0);
+	ssize_t n = read(fd, databuf, sizeof(databuf));
+	CU_ASSERT_FATAL(n >= 0);
+	close(fd);
+	return n;
+}
+
+static char *print_evs(actf_printer *p, actf_event **evs, size_t evs_len)
+{
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	for (size_t i = 0; i < evs_len; i++) {
+		actf_fprint_event(p, s, evs[i]);
+		fprintf(s, "\n");
+	}
+	fclose(s);
+	return buf;
+}
+
+/* print_gen prints all events of gen into a string which should be
+ * freed. The return code of the last generate call and the last error
+ * are printed last. The events of the previous gen.n_bufs - 1 calls
+ * are checked to be intact after each call. */
+static char *print_gen(struct actf_event_generator gen)
+{
+	char *buf = NULL;
+	size_t buf_len = 0;
+	FILE *s = open_memstream(&buf, &buf_len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(s);
+	actf_printer *p = actf_printer_init(ACTF_PRINT_ALL | ACTF_PRINT_PROP_LABELS);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+	// prevs[0] holds the events of the most recent call
+	struct {
+		actf_event **evs;
+		size_t evs_len;
+		char *str;
+	} prevs[MAX_BUFS] = { 0 };
+	size_t n_prevs = MAX(gen.n_bufs, 1);
+	CU_ASSERT_FATAL(n_prevs <= MAX_BUFS);
+	int rc;
+	size_t evs_len;
+	actf_event **evs;
+	for (;;) {
+		rc = gen.generate(gen.self, &evs, &evs_len);
+		for (size_t i = 0; i + 1 < n_prevs; i++) {
+			if (prevs[i].str) {
+				char *after = print_evs(p, prevs[i].evs, prevs[i].evs_len);
+				CU_ASSERT_STRING_EQUAL(after, prevs[i].str);
+				free(after);
+			}
+		}
+		if (prevs[n_prevs - 1].str) {
+			fputs(prevs[n_prevs - 1].str, s);
+			free(prevs[n_prevs - 1].str);
+		}
+		memmove(prevs + 1, prevs, (n_prevs - 1) * sizeof(prevs[0]));
+		prevs[0].str = NULL;
+		if (rc < 0 || !evs_len) {
+			break;
+		}
+		prevs[0].evs = evs;
+		prevs[0].evs_len = evs_len;
+		prevs[0].str = print_evs(p, evs, evs_len);
+	}
+	for (size_t i = n_prevs; i-- > 0;) {
+		if (prevs[i].str) {
+			fputs(prevs[i].str, s);
+			free(prevs[i].str);
+		}
+	}
+	fprintf(s, "rc %d", rc);
+	if (rc < 0) {
+		fprintf(s, ": %s", gen.last_error(gen.self));
+	}
+	actf_printer_free(p);
+	fclose(s);
+	return buf;
+}
+
+static void test_producer_same_as_generator(void)
+{
+	struct {
+		const char *ds_path;
+		const char *metadata_path;
+	} tcs[] = {
+		{"testdata/ctfs/philo/tid125101760", "testdata/ctfs/philo/metadata"},
+		// the last packet is cut off, ending with an error
+		{"testdata/ctfs/philo_nok/tid125101760", "testdata/ctfs/philo_nok/metadata"},
+	};
+	size_t dec_n_bufs[] = { 2, 3, 8 };
+	size_t evs_caps[] = { 1, 64 };
+	for (size_t i = 0; i < ARRLEN(tcs); i++) {
+		struct actf_metadata *metadata = actf_metadata_init();
+		CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+		CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, tcs[i].metadata_path), 0);
+		size_t len = read_file(tcs[i].ds_path);
+
+		struct actf_decoder *dec = actf_decoder_init(databuf, len, 0, metadata);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+		char *want = print_gen(actf_decoder_to_generator(dec));
+		actf_decoder_free(dec);
+
+		for (size_t j = 0; j < ARRLEN(dec_n_bufs); j++) {
+			for (size_t k = 0; k < ARRLEN(evs_caps); k++) {
+				for (size_t n_bufs = 1; n_bufs <= MAX_BUFS; n_bufs++) {
+					struct actf_decoder_cfg cfg = {
+						.evs_cap = evs_caps[k],
+						.n_bufs = dec_n_bufs[j],
+					};
+					dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+					CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+					actf_producer *pr = actf_producer_init(actf_decoder_to_generator(dec),
+									       n_bufs);
+					CU_ASSERT_PTR_NOT_NULL_FATAL(pr);
+					struct actf_event_generator gen = actf_producer_to_generator(pr);
+					CU_ASSERT_EQUAL(gen.n_bufs, MIN(n_bufs, dec_n_bufs[j] - 1));
+					char *got = print_gen(gen);
+					CU_ASSERT_STRING_EQUAL(got, want);
+					free(got);
+					actf_producer_free(pr);
+					actf_decoder_free(dec);
+				}
+			}
+		}
+		free(want);
+		actf_metadata_free(metadata);
+	}
+}
+
+static void test_producer_seek(void)
+{
+	const char *ds_path = "testdata/ctfs/philo/tid125101760";
+	const char *metadata_path = "testdata/ctfs/philo/metadata";
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	size_t len = read_file(ds_path);
+
+	// collect the timestamps of all events
+	int64_t tstamps[64];
+	size_t n_tstamps = 0;
+	size_t evs_len;
+	actf_event **evs;
+	struct actf_decoder *dec = actf_decoder_init(databuf, len, 0, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	while (actf_decoder_decode(dec, &evs, &evs_len) == 0 && evs_len) {
+		for (size_t i = 0; i < evs_len && n_tstamps < ARRLEN(tstamps); i++) {
+			tstamps[n_tstamps++] = actf_event_tstamp_ns_from_origin(evs[i]);
+		}
+	}
+	CU_ASSERT_FATAL(n_tstamps > 2);
+
+	struct actf_decoder_cfg cfg = {.evs_cap = 2,.n_bufs = 4 };
+	struct actf_decoder *pr_dec = actf_decoder_init_cfg(databuf, len, metadata, cfg);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pr_dec);
+	actf_producer *pr = actf_producer_init(actf_decoder_to_generator(pr_dec), 2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pr);
+	// seeking before the first call as well as in the middle of the
+	// events and after the last one.
+	for (size_t i = n_tstamps; i-- > 0;) {
+		CU_ASSERT_EQUAL(actf_decoder_seek_ns_from_origin(dec, tstamps[i]), 0);
+		char *want = print_gen(actf_decoder_to_generator(dec));
+		CU_ASSERT_EQUAL(actf_producer_seek_ns_from_origin(pr, tstamps[i]), 0);
+		if (i % 2) {
+			// while the producer is still generating
+			CU_ASSERT_EQUAL(actf_producer_produce(pr, &evs, &evs_len), 0);
+			CU_ASSERT_EQUAL(actf_producer_seek_ns_from_origin(pr, tstamps[i]), 0);
+		}
+		char *got = print_gen(actf_producer_to_generator(pr));
+		CU_ASSERT_STRING_EQUAL(got, want);
+		free(want);
+		free(got);
+	}
+
+	actf_producer_free(pr);
+	actf_decoder_free(pr_dec);
+	actf_decoder_free(dec);
+	actf_metadata_free(metadata);
+}
+
+static void test_producer_single_buffer(void)
+{
+	const char *metadata_path = "testdata/ctfs/philo/metadata";
+	struct actf_metadata *metadata = actf_metadata_init();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(metadata);
+	CU_ASSERT_EQUAL_FATAL(actf_metadata_parse_file(metadata, metadata_path), 0);
+	struct actf_decoder *dec = actf_decoder_init(databuf, 0, 0, metadata);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dec);
+	// the producer could never generate ahead
+	errno = 0;
+	CU_ASSERT_PTR_NULL(actf_producer_init(actf_decoder_to_generator(dec), 1));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	actf_decoder_free(dec);
+	actf_metadata_free(metadata);
+}
+
+static CU_TestInfo test_producer_tests[] = {
+	{ "same as generator", test_producer_same_as_generator },
+	{ "seek", test_producer_seek },
+	{ "single buffer", test_producer_single_buffer },
+	CU_TEST_INFO_NULL,
+};
+
+CU_SuiteInfo test_producer_suite = {
+	"Producer", test_producer_suite_init, test_producer_suite_clean,
+	test_producer_test_setup, test_producer_test_teardown, test_producer_tests
+};
@@ -28,6 +28,9 @@
 #include "test_freader.h"
 #include "test_ctfjson.h"
 #include "test_metadata.h"
+#include "test_muxer.h"
+#include "test_pdecoder.h"
+#include "test_producer.h"
 #include "test_rng.h"
 #include "test_error.h"
 #include "test_prio_queue.h"
@@ -44,6 +47,9 @@ int main(void)
 		test_breader_suite,
 		test_filter_suite,
 		test_decoder_suite,
+		test_pdecoder_suite,
+		test_producer_suite,
+		test_muxer_suite,
 		test_fld_cls_suite,
 		test_freader_suite,
 		test_ctfjson_suite,